@@ -21,6 +21,7 @@
 #include "gdurestorediskimagedialog.h"
 #include "gduwindow.h"
 #include "gdulocaljob.h"
+#include "gduimagecatalog.h"
 
 struct _GduApplication
 {
@@ -33,6 +34,9 @@ struct _GduApplication
 
   /* Maps from UDisksObject* -> GList<GduLocalJob*> */
   GHashTable *local_jobs;
+
+  /* created on demand */
+  GduImageCatalog *image_catalog;
 };
 
 typedef struct
@@ -70,6 +74,8 @@ gdu_application_finalize (GObject *object)
   if (app->client != NULL)
     g_object_unref (app->client);
 
+  gdu_image_catalog_free (app->image_catalog);
+
   G_OBJECT_CLASS (gdu_application_parent_class)->finalize (object);
 }
 
@@ -375,6 +381,23 @@ static GActionEntry app_entries[] =
   { "quit", quit_activated, NULL, NULL, NULL }
 };
 
+/* Examine the disk images in the folder they were last used from in
+ * the background so the restore dialog can show what is in them right
+ * away
+ */
+static void
+start_indexing_images (GduApplication *app)
+{
+  gchar *image_dir_uri;
+  GFile *image_dir;
+
+  image_dir_uri = gdu_utils_get_image_dir_uri ();
+  image_dir = g_file_new_for_uri (image_dir_uri);
+  gdu_image_catalog_index_directory (gdu_application_get_image_catalog (app), image_dir);
+  g_object_unref (image_dir);
+  g_free (image_dir_uri);
+}
+
 static void
 gdu_application_startup (GApplication *_app)
 {
@@ -394,6 +417,8 @@ gdu_application_startup (GApplication *_app)
   gtk_application_set_app_menu (GTK_APPLICATION (app), app_menu);
   g_object_unref (app_menu);
   g_clear_object (&builder);
+
+  start_indexing_images (app);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -560,3 +585,13 @@ gdu_application_get_local_jobs_for_object (GduApplication *application,
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
+
+GduImageCatalog *
+gdu_application_get_image_catalog (GduApplication *application)
+{
+  g_return_val_if_fail (GDU_IS_APPLICATION (application), NULL);
+
+  if (application->image_catalog == NULL)
+    application->image_catalog = gdu_image_catalog_new ();
+  return application->image_catalog;
+}
@@ -34,6 +34,8 @@ void          gdu_application_destroy_local_job (GduApplication *application,
 GList        *gdu_application_get_local_jobs_for_object (GduApplication *application,
                                                          UDisksObject   *object);
 
+GduImageCatalog *gdu_application_get_image_catalog (GduApplication *application);
+
 
 G_END_DECLS
 
@@ -9,13 +9,18 @@
 
 #include "config.h"
 
+#define _GNU_SOURCE
+#include <fcntl.h>
+
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gio/gunixfdlist.h>
 #include <gio/gunixinputstream.h>
 #include <gio/gunixoutputstream.h>
 
 #include <glib-unix.h>
 #include <sys/ioctl.h>
+#include <sys/statvfs.h>
 #include <linux/fs.h>
 
 #include <math.h>
@@ -23,13 +28,16 @@
 #include "gduapplication.h"
 #include "gduwindow.h"
 #include "gdubenchmarkdialog.h"
-
-/* ---------------------------------------------------------------------------------------------------- */
-
-typedef struct {
-  guint64 offset;
-  gdouble value;
-} BMSample;
+#include "gdubenchmarkengine.h"
+#include "gduhistogram.h"
+#include "gdubenchmarkhistory.h"
+#include "gdubenchmarkgraph.h"
+#include "gdubenchmarkutils.h"
+#include "gdubenchmarkseekprofile.h"
+#include "gdubenchmarktransfersize.h"
+#include "gdubenchmarkstable.h"
+#include "gdudiskstats.h"
+#include "gduzones.h"
 
 /* ---------------------------------------------------------------------------------------------------- */
 
@@ -38,8 +46,153 @@ typedef enum {
   BM_STATE_OPENING_DEVICE,
   BM_STATE_TRANSFER_RATE,
   BM_STATE_ACCESS_TIME,
+  BM_STATE_QUEUE_DEPTH,
+  BM_STATE_PROFILES,
+  BM_STATE_FILESYSTEM,
+  BM_STATE_SUSTAINED_WRITE,
+  BM_STATE_RAID_MEMBERS,
+  BM_STATE_SEEK_PROFILE,
+  BM_STATE_TRANSFER_SIZE,
 } BMState;
 
+/* The queue depths measured when measuring queue depth scaling, each
+ * for QUEUE_DEPTH_STEP_USEC with both sequential and random reads
+ */
+static const guint queue_depths[] = {1, 4, 16, 32};
+
+#define QUEUE_DEPTH_STEP_USEC (2 * G_USEC_PER_SEC)
+#define QUEUE_DEPTH_SEQUENTIAL_BLOCK_SIZE (128 * 1024)
+#define QUEUE_DEPTH_RANDOM_BLOCK_SIZE (4 * 1024)
+
+typedef struct
+{
+  const gchar *name;
+  GduBenchmarkPattern pattern;
+  gsize block_size;
+  guint write_percentage;
+} BMProfile;
+
+/* Workload profiles, each run for bm_profile_duration_sec with
+ * bm_profile_num_threads requests in flight. Profiles with writes are
+ * only run if writing is allowed and then confined to the
+ * PROFILE_WRITE_REGION_SIZE bytes in the middle of the device (or of
+ * an empty zone on zoned devices), see measure_profiles().
+ */
+static const BMProfile profiles[] = {
+  {NC_("benchmark-profile", "4K Random Read"), GDU_BENCHMARK_PATTERN_RANDOM, 4 * 1024, 0},
+  {NC_("benchmark-profile", "4K Random Write"), GDU_BENCHMARK_PATTERN_RANDOM, 4 * 1024, 100},
+  {NC_("benchmark-profile", "70/30 Mixed"), GDU_BENCHMARK_PATTERN_RANDOM, 4 * 1024, 30},
+  {NC_("benchmark-profile", "64K Sequential Read"), GDU_BENCHMARK_PATTERN_SEQUENTIAL, 64 * 1024, 0},
+};
+
+#define PROFILE_WRITE_REGION_SIZE (256 * 1024 * 1024)
+
+/* Where write tests other than the sustained write test go, see
+ * prepare_write_region()
+ */
+typedef struct
+{
+  guint64 offset;
+  guint64 size;
+  guchar *data_unaligned;
+  guchar *data;                 /* what is in the region, NULL on zoned devices */
+  const GduZone *scratch_zone;  /* on zoned devices, the empty zone the region is at the start of */
+} BMWriteRegion;
+
+typedef struct
+{
+  const gchar *name;
+  GduBenchmarkPattern pattern;
+  gsize block_size;
+  guint write_percentage;
+  gboolean sync_writes;
+  gboolean metadata;
+} BMFilesystemWorkload;
+
+/* Workloads run against a test file of bm_filesystem_file_size_mib
+ * on the mounted filesystem, each for FILESYSTEM_WORKLOAD_USEC with
+ * bm_filesystem_num_threads threads. See measure_filesystem().
+ */
+static const BMFilesystemWorkload filesystem_workloads[] = {
+  {NC_("benchmark-filesystem", "Sequential Read"), GDU_BENCHMARK_PATTERN_SEQUENTIAL, 1024 * 1024, 0, FALSE, FALSE},
+  {NC_("benchmark-filesystem", "Sequential Write"), GDU_BENCHMARK_PATTERN_SEQUENTIAL, 1024 * 1024, 100, FALSE, FALSE},
+  {NC_("benchmark-filesystem", "4K Random Read"), GDU_BENCHMARK_PATTERN_RANDOM, 4 * 1024, 0, FALSE, FALSE},
+  {NC_("benchmark-filesystem", "4K Random Write"), GDU_BENCHMARK_PATTERN_RANDOM, 4 * 1024, 100, FALSE, FALSE},
+  {NC_("benchmark-filesystem", "4K Synced Write"), GDU_BENCHMARK_PATTERN_RANDOM, 4 * 1024, 100, TRUE, FALSE},
+  {NC_("benchmark-filesystem", "Create and Sync Files"), GDU_BENCHMARK_PATTERN_SEQUENTIAL, 4 * 1024, 100, TRUE, TRUE},
+};
+
+#define FILESYSTEM_WORKLOAD_USEC (10 * G_USEC_PER_SEC)
+
+/* The sustained write test writes back the region chosen by the user
+ * without pausing, SUSTAINED_WRITE_BATCH_SIZE bytes at a time (the
+ * next batch being read while the current one is written) in
+ * SUSTAINED_WRITE_BLOCK_SIZE writes, and records the write rate for
+ * every SUSTAINED_WRITE_WINDOW_USEC spent writing. See
+ * measure_sustained_write() and get_sustained_write_segments().
+ */
+#define SUSTAINED_WRITE_BATCH_SIZE (64 * 1024 * 1024)
+#define SUSTAINED_WRITE_BLOCK_SIZE (1024 * 1024)
+#define SUSTAINED_WRITE_WINDOW_USEC (G_USEC_PER_SEC / 4)
+
+/* A cliff is where the write rate drops to this fraction of what it
+ * was before or less, and stays there for at least
+ * SUSTAINED_WRITE_MIN_SEGMENT windows
+ */
+#define SUSTAINED_WRITE_CLIFF_RATIO 0.7
+#define SUSTAINED_WRITE_MIN_SEGMENT 8
+
+/* the access time percentiles shown, in addition to the maximum */
+static const gdouble access_time_percentiles[] = {50.0, 90.0, 99.0, 99.9};
+
+/* A run is flagged as a regression if its median read or write rate is
+ * this many percent below that of the run it is compared with, or
+ * below the median of all earlier comparable runs if none is chosen.
+ * See format_trend().
+ */
+#define REGRESSION_THRESHOLD_PERCENT 10.0
+
+/* A member of the RAID array being benchmarked. While the transfer
+ * rate of the array is measured, the I/O counters of each member are
+ * summed up over the timed reads. Afterwards each member is read from
+ * on its own. See measure_raid_members().
+ */
+typedef struct
+{
+  gchar *name;
+  UDisksBlock *block;          /* NULL if loaded from file */
+  dev_t device_number;
+  GduDiskStats array_stats;    /* summed over the timed reads from the array */
+  gdouble array_read_rate;     /* bytes per second read from the member while reading from the array */
+  gdouble array_access_time;   /* average seconds per read request at the same time */
+  gdouble read_rate;           /* bytes per second when read from on its own */
+} BMRaidMember;
+
+/* A RAID member is flagged as slow if it reads this many percent
+ * slower on its own than the median member
+ */
+#define RAID_MEMBER_SLOW_PERCENT 15.0
+
+/* What is painted on the cached surface of the transfer rate graph.
+ * The axes, grid and run compared with are painted once, the samples
+ * as they come in. See on_drawing_area_draw().
+ */
+typedef struct
+{
+  cairo_surface_t *surface;   /* NULL if it must be painted from scratch */
+  gint width;
+  gint height;
+  guint64 size;
+  gdouble max_visible_speed;
+  gdouble max_visible_time;
+  gdouble gx, gy, gw, gh;
+  guint read_level;
+  guint num_read_points;      /* complete points of read_level painted */
+  guint write_level;
+  guint num_write_points;     /* complete points of write_level painted */
+  guint num_access_time_samples;
+} BMGraphCache;
+
 typedef struct
 {
   volatile gint ref_count;
@@ -49,12 +202,22 @@ typedef struct
 
   GCancellable *cancellable;
 
+  /* NULL unless the device is a RAID array */
+  UDisksMDRaid *mdraid;
+
   GduWindow *window;
   GtkBuilder *builder;
 
   GtkWidget *dialog;
 
   GtkWidget *graph_drawing_area;
+  GtkWidget *queue_depth_drawing_area;
+  GtkWidget *profiles_drawing_area;
+  GtkWidget *access_time_distribution_drawing_area;
+  GtkWidget *filesystem_drawing_area;
+  GtkWidget *sustained_write_drawing_area;
+  GtkWidget *seek_profile_drawing_area;
+  GtkWidget *transfer_size_drawing_area;
 
   GtkWidget *device_label;
   GtkWidget *updated_label;
@@ -62,6 +225,20 @@ typedef struct
   GtkWidget *read_rate_label;
   GtkWidget *write_rate_label;
   GtkWidget *access_time_label;
+  GtkWidget *access_time_percentiles_label;
+  GtkWidget *queue_depth_label;
+  GtkWidget *profiles_label;
+  GtkWidget *filesystem_label;
+  GtkWidget *sustained_write_label;
+  GtkWidget *seek_profile_label;
+  GtkWidget *transfer_size_label;
+  GtkWidget *trend_label;
+  GtkWidget *raid_members_title_label;
+  GtkWidget *raid_members_label;
+  GtkWidget *run_combobox;
+  GtkWidget *compare_combobox;
+  guint num_runs_in_comboboxes;
+  gboolean updating_comboboxes;
 
   GtkWidget *start_benchmark_button;
   GtkWidget *stop_benchmark_button;
@@ -74,7 +251,29 @@ typedef struct
   gint bm_num_samples;
   gint bm_sample_size_mib;
   gboolean bm_do_write;
+  gboolean bm_do_direct_io;
   gint bm_num_access_samples;
+  gboolean bm_do_until_stable;
+  gdouble bm_stable_target_percent;
+  gint bm_stable_budget_sec;
+  gboolean bm_do_queue_depth;
+  gboolean bm_do_profiles;
+  gint bm_profile_duration_sec;
+  gint bm_profile_num_threads;
+  gboolean bm_do_filesystem;
+  gchar *bm_filesystem_mount_point;
+  gint bm_filesystem_file_size_mib;
+  gint bm_filesystem_num_threads;
+  gboolean bm_do_sustained_write;
+  gint bm_sustained_write_offset_gib;
+  gint bm_sustained_write_size_gib;
+  gboolean bm_do_raid_members;
+  gboolean bm_do_seek_profile;
+  gint bm_seek_profile_target_msec;
+  gboolean bm_do_transfer_size;
+
+  /* only used on the benchmark thread - the zones of the device, NULL if it isn't zoned */
+  GArray *bm_zones;
 
   /* must hold bm_lock when reading/writing these */
   GThread *bm_thread;
@@ -87,9 +286,59 @@ typedef struct
   gint64 bm_time_benchmarked_usec; /* 0 if never benchmarked, otherwise micro-seconds since Epoch */
   guint64 bm_size;
   guint64 bm_sample_size;
+  gboolean bm_direct_io; /* whether the page cache was bypassed */
   GArray *bm_read_samples;
   GArray *bm_write_samples;
+  guint bm_samples_reordered; /* bumped when a sample is inserted before the last one, see insert_sample() */
   GArray *bm_access_time_samples;
+  GduHistogram *bm_access_time_histogram; /* in micro-seconds */
+  /* offset is the queue depth, value is bytes per second */
+  guint64 bm_sequential_queue_depth_block_size;
+  guint64 bm_random_queue_depth_block_size;
+  GArray *bm_sequential_queue_depth_samples;
+  GArray *bm_random_queue_depth_samples;
+  /* offset is the index into profiles[], value is bytes and operations per second */
+  GArray *bm_profile_rate_samples;
+  GArray *bm_profile_iops_samples;
+  /* offset is the index into filesystem_workloads[], value is bytes and operations per second */
+  GArray *bm_filesystem_rate_samples;
+  GArray *bm_filesystem_iops_samples;
+  /* offset is micro-seconds spent writing, value is bytes per second */
+  guint64 bm_sustained_write_offset;
+  guint64 bm_sustained_write_size;
+  guint64 bm_sustained_write_num_bytes_done;
+  GArray *bm_sustained_write_samples;
+  /* the RAID level, e.g. "raid5", and the members, NULL and empty if not a RAID array */
+  gchar *bm_raid_level;
+  GPtrArray *bm_raid_members;
+  gint64 bm_raid_array_usec;      /* time spent in the timed reads from the array */
+  guint bm_raid_num_members_done; /* how many members have been read from on their own */
+  /* offset is the seek distance and the stroke in bytes, value is the median and
+   * 99th percentile access time in seconds
+   */
+  GArray *bm_seek_distance_samples;
+  GArray *bm_seek_stroke_samples;
+  gdouble bm_seek_profile_target; /* in seconds, 0 if not measured */
+  /* offset is the request size, value is bytes per second */
+  GArray *bm_transfer_size_read_samples;
+  GArray *bm_transfer_size_write_samples;
+
+  /* every run on the device, NULL if it doesn't make sense to keep one (see get_bm_filename()) */
+  GduBenchmarkHistory *bm_history;
+  /* the run the graph is compared with, if any */
+  guint64 bm_compare_size;
+  GArray *bm_compare_read_samples;
+  GArray *bm_compare_write_samples;
+
+  /* only used on the main thread, see on_drawing_area_draw() */
+  GduBenchmarkGraphSeries *graph_read_series;
+  GduBenchmarkGraphSeries *graph_write_series;
+  GduBenchmarkGraphSeries *graph_compare_read_series;
+  GduBenchmarkGraphSeries *graph_compare_write_series;
+  guint graph_samples_reordered;
+  guint graph_num_access_time_samples;
+  gdouble graph_access_time_max;
+  BMGraphCache graph_cache;
 
 } DialogData;
 
@@ -100,12 +349,31 @@ static const struct {
   const gchar *name;
 } widget_mapping[] = {
   {G_STRUCT_OFFSET (DialogData, graph_drawing_area), "graph-drawing-area"},
+  {G_STRUCT_OFFSET (DialogData, queue_depth_drawing_area), "queue-depth-drawing-area"},
+  {G_STRUCT_OFFSET (DialogData, profiles_drawing_area), "profiles-drawing-area"},
+  {G_STRUCT_OFFSET (DialogData, access_time_distribution_drawing_area), "access-time-distribution-drawing-area"},
+  {G_STRUCT_OFFSET (DialogData, filesystem_drawing_area), "filesystem-drawing-area"},
+  {G_STRUCT_OFFSET (DialogData, sustained_write_drawing_area), "sustained-write-drawing-area"},
+  {G_STRUCT_OFFSET (DialogData, seek_profile_drawing_area), "seek-profile-drawing-area"},
+  {G_STRUCT_OFFSET (DialogData, transfer_size_drawing_area), "transfer-size-drawing-area"},
   {G_STRUCT_OFFSET (DialogData, device_label), "device-label"},
   {G_STRUCT_OFFSET (DialogData, updated_label), "updated-label"},
   {G_STRUCT_OFFSET (DialogData, sample_size_label), "sample-size-label"},
   {G_STRUCT_OFFSET (DialogData, read_rate_label), "read-rate-label"},
   {G_STRUCT_OFFSET (DialogData, write_rate_label), "write-rate-label"},
   {G_STRUCT_OFFSET (DialogData, access_time_label), "access-time-label"},
+  {G_STRUCT_OFFSET (DialogData, access_time_percentiles_label), "access-time-percentiles-label"},
+  {G_STRUCT_OFFSET (DialogData, queue_depth_label), "queue-depth-label"},
+  {G_STRUCT_OFFSET (DialogData, profiles_label), "profiles-label"},
+  {G_STRUCT_OFFSET (DialogData, filesystem_label), "filesystem-label"},
+  {G_STRUCT_OFFSET (DialogData, sustained_write_label), "sustained-write-label"},
+  {G_STRUCT_OFFSET (DialogData, seek_profile_label), "seek-profile-label"},
+  {G_STRUCT_OFFSET (DialogData, transfer_size_label), "transfer-size-label"},
+  {G_STRUCT_OFFSET (DialogData, trend_label), "trend-label"},
+  {G_STRUCT_OFFSET (DialogData, raid_members_title_label), "raid-members-title-label"},
+  {G_STRUCT_OFFSET (DialogData, raid_members_label), "raid-members-label"},
+  {G_STRUCT_OFFSET (DialogData, run_combobox), "run-combobox"},
+  {G_STRUCT_OFFSET (DialogData, compare_combobox), "compare-combobox"},
   {0, NULL}
 };
 
@@ -114,6 +382,28 @@ static void update_dialog (DialogData *data);
 static gboolean maybe_load_data (DialogData  *data,
                                  GError     **error);
 
+static void update_history_comboboxes (DialogData *data);
+static gchar *format_trend (DialogData *data);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+bm_raid_member_free (BMRaidMember *member)
+{
+  g_free (member->name);
+  g_clear_object (&member->block);
+  g_free (member);
+}
+
+static gint
+bm_raid_member_compare (gconstpointer a,
+                        gconstpointer b)
+{
+  const BMRaidMember *ma = *((const BMRaidMember **) a);
+  const BMRaidMember *mb = *((const BMRaidMember **) b);
+  return g_strcmp0 (ma->name, mb->name);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static DialogData *
@@ -136,12 +426,37 @@ dialog_data_unref (DialogData *data)
         }
 
       g_clear_object (&data->object);
+      g_clear_object (&data->mdraid);
       g_clear_object (&data->window);
       g_clear_object (&data->builder);
 
       g_array_unref (data->bm_read_samples);
       g_array_unref (data->bm_write_samples);
       g_array_unref (data->bm_access_time_samples);
+      gdu_histogram_free (data->bm_access_time_histogram);
+      g_array_unref (data->bm_sequential_queue_depth_samples);
+      g_array_unref (data->bm_random_queue_depth_samples);
+      g_array_unref (data->bm_profile_rate_samples);
+      g_array_unref (data->bm_profile_iops_samples);
+      g_array_unref (data->bm_filesystem_rate_samples);
+      g_array_unref (data->bm_filesystem_iops_samples);
+      g_array_unref (data->bm_sustained_write_samples);
+      g_array_unref (data->bm_seek_distance_samples);
+      g_array_unref (data->bm_seek_stroke_samples);
+      g_array_unref (data->bm_transfer_size_read_samples);
+      g_array_unref (data->bm_transfer_size_write_samples);
+      g_free (data->bm_raid_level);
+      g_ptr_array_unref (data->bm_raid_members);
+      g_array_unref (data->bm_compare_read_samples);
+      g_array_unref (data->bm_compare_write_samples);
+      gdu_benchmark_graph_series_free (data->graph_read_series);
+      gdu_benchmark_graph_series_free (data->graph_write_series);
+      gdu_benchmark_graph_series_free (data->graph_compare_read_series);
+      gdu_benchmark_graph_series_free (data->graph_compare_write_series);
+      if (data->graph_cache.surface != NULL)
+        cairo_surface_destroy (data->graph_cache.surface);
+      gdu_benchmark_history_free (data->bm_history);
+      g_free (data->bm_filesystem_mount_point);
       g_clear_object (&data->bm_cancellable);
       g_clear_error (&data->bm_error);
 
@@ -181,7 +496,7 @@ get_max_min_avg (GArray  *array,
 
   for (n = 0; n < array->len; n++)
     {
-      BMSample *s = &g_array_index (array, BMSample, n);
+      GduBenchmarkSample *s = &g_array_index (array, GduBenchmarkSample, n);
       if (s->value > max)
         max = s->value;
       if (s->value < min)
@@ -199,37 +514,67 @@ get_max_min_avg (GArray  *array,
     *out_avg = avg;
 }
 
-static gdouble
-measure_width (cairo_t     *cr,
-               const gchar *s)
+/* Makes the transfer rate graph start over, e.g. when other samples
+ * have been loaded
+ */
+static void
+invalidate_graph (DialogData *data)
 {
-  cairo_text_extents_t te;
-  cairo_text_extents (cr, s, &te);
-  return te.width;
+  gdu_benchmark_graph_series_clear (data->graph_read_series);
+  gdu_benchmark_graph_series_clear (data->graph_write_series);
+  gdu_benchmark_graph_series_clear (data->graph_compare_read_series);
+  gdu_benchmark_graph_series_clear (data->graph_compare_write_series);
+  data->graph_num_access_time_samples = 0;
+  data->graph_access_time_max = 0.0;
+  if (data->graph_cache.surface != NULL)
+    {
+      cairo_surface_destroy (data->graph_cache.surface);
+      data->graph_cache.surface = NULL;
+    }
 }
 
-static gdouble
-measure_height (cairo_t     *cr,
-                const gchar *s)
+/* Appends the samples not yet in @series. Returns %FALSE if @series
+ * had to start over because there are fewer samples than before.
+ */
+static gboolean
+sync_graph_series (GduBenchmarkGraphSeries *series,
+                   GArray                  *samples)
 {
-  cairo_text_extents_t te;
-  cairo_text_extents (cr, s, &te);
-  return te.height;
+  gboolean ret = TRUE;
+  guint n;
+
+  if (gdu_benchmark_graph_series_get_num_samples (series) > samples->len)
+    {
+      gdu_benchmark_graph_series_clear (series);
+      ret = FALSE;
+    }
+  for (n = gdu_benchmark_graph_series_get_num_samples (series); n < samples->len; n++)
+    {
+      GduBenchmarkSample *sample = &g_array_index (samples, GduBenchmarkSample, n);
+      gdu_benchmark_graph_series_append (series, sample->offset, sample->value);
+    }
+  return ret;
 }
 
+/* The transfer rate graph is painted on a cached surface: the axes,
+ * grid and run compared with when the scale or size changes, and then
+ * only the samples appended since the last time. Lines are drawn from
+ * the min/max decimation pyramids in the graph series, at no more than
+ * a point per pixel, so each update touches only the new samples no
+ * matter how many there are.
+ */
 static gboolean
 on_drawing_area_draw (GtkWidget      *widget,
                       cairo_t        *cr,
                       gpointer        user_data)
 {
   DialogData *data = user_data;
+  BMGraphCache *cache = &data->graph_cache;
   GtkAllocation allocation;
-  gdouble width, height;
-  gdouble gx, gy, gw, gh;
+  cairo_t *surface_cr;
+  gboolean repaint = FALSE;
   guint n;
-  gdouble w, h;
   gdouble x, y;
-  gdouble x_marker_height;
   gchar *s;
   gdouble max_speed;
   gdouble max_visible_speed;
@@ -237,39 +582,51 @@ on_drawing_area_draw (GtkWidget      *widget,
   gdouble max_time;
   gdouble time_res;
   gdouble max_visible_time;
-  gchar **y_left_markers;
-  gchar **y_right_markers;
   guint num_y_markers;
-  GPtrArray *p;
-  GPtrArray *p2;
-  gdouble read_transfer_rate_max = 0.0;
-  gdouble write_transfer_rate_max = 0.0;
-  gdouble access_time_max = 0.0;
-  gdouble prev_x;
-  gdouble prev_y;
+  guint read_level;
+  guint write_level;
+  guint num_read_points;
+  guint num_write_points;
 
-  G_LOCK (bm_lock);
+  gtk_widget_get_allocation (widget, &allocation);
 
-  //g_print ("drawing: %d %d %d\n",
-  //         data->bm_read_samples->len,
-  //         data->bm_write_samples->len,
-  //         data->bm_access_time_samples->len);
+  G_LOCK (bm_lock);
 
-  get_max_min_avg (data->bm_read_samples,
-                   &read_transfer_rate_max,
-                   NULL,
-                   NULL);
-  get_max_min_avg (data->bm_write_samples,
-                   &write_transfer_rate_max,
-                   NULL,
-                   NULL);
-  get_max_min_avg (data->bm_access_time_samples,
-                   &access_time_max,
-                   NULL,
-                   NULL);
+  /* start over if a sample was inserted in the middle ... */
+  if (data->graph_samples_reordered != data->bm_samples_reordered)
+    {
+      invalidate_graph (data);
+      data->graph_samples_reordered = data->bm_samples_reordered;
+      repaint = TRUE;
+    }
+  /* ... otherwise only look at the samples appended since the last time */
+  if (!sync_graph_series (data->graph_read_series, data->bm_read_samples))
+    repaint = TRUE;
+  if (!sync_graph_series (data->graph_write_series, data->bm_write_samples))
+    repaint = TRUE;
+  if (!sync_graph_series (data->graph_compare_read_series, data->bm_compare_read_samples))
+    repaint = TRUE;
+  if (!sync_graph_series (data->graph_compare_write_series, data->bm_compare_write_samples))
+    repaint = TRUE;
+  if (data->graph_num_access_time_samples > data->bm_access_time_samples->len)
+    {
+      data->graph_num_access_time_samples = 0;
+      data->graph_access_time_max = 0.0;
+      repaint = TRUE;
+    }
+  for (n = data->graph_num_access_time_samples; n < data->bm_access_time_samples->len; n++)
+    {
+      GduBenchmarkSample *sample = &g_array_index (data->bm_access_time_samples, GduBenchmarkSample, n);
+      data->graph_access_time_max = MAX (data->graph_access_time_max, sample->value);
+    }
+  data->graph_num_access_time_samples = data->bm_access_time_samples->len;
 
-  max_speed = MAX (read_transfer_rate_max, write_transfer_rate_max);
-  max_time = access_time_max;
+  max_speed = MAX (gdu_benchmark_graph_series_get_max (data->graph_read_series),
+                   gdu_benchmark_graph_series_get_max (data->graph_write_series));
+  max_speed = MAX (max_speed,
+                   MAX (gdu_benchmark_graph_series_get_max (data->graph_compare_read_series),
+                        gdu_benchmark_graph_series_get_max (data->graph_compare_write_series)));
+  max_time = data->graph_access_time_max;
 
   if (max_speed == 0)
     max_speed = 100 * 1000 * 1000;
@@ -313,241 +670,201 @@ on_drawing_area_draw (GtkWidget      *widget,
     }
   max_visible_time = time_res * num_y_markers;
 
-  //g_print ("max_visible_speed=%f, max_speed=%f, speed_res=%f\n", max_visible_speed, max_speed, speed_res);
-  //g_print ("max_visible_time=%f, max_time=%f, time_res=%f\n", max_visible_time, max_time, time_res);
-
-  p = g_ptr_array_new ();
-  p2 = g_ptr_array_new ();
-  for (n = 0; n <= num_y_markers; n++)
+  /* no more points than pixels */
+  read_level = gdu_benchmark_graph_series_get_level (data->graph_read_series, MAX (allocation.width, 1));
+  write_level = gdu_benchmark_graph_series_get_level (data->graph_write_series, MAX (allocation.width, 1));
+
+  if (cache->surface == NULL ||
+      cache->width != allocation.width ||
+      cache->height != allocation.height ||
+      cache->size != data->bm_size ||
+      cache->max_visible_speed != max_visible_speed ||
+      cache->max_visible_time != max_visible_time ||
+      cache->read_level != read_level ||
+      cache->write_level != write_level)
+    repaint = TRUE;
+
+  if (repaint)
     {
-      gdouble val;
-
-      val = n * speed_res;
-      /* Translators: This is used in the benchmark graph - %d is megabytes per second */
-      s = g_strdup_printf (C_("benchmark-graph", "%d MB/s"), (gint) (val / (1000 * 1000)));
-      g_ptr_array_add (p, s);
-
-      val = n * time_res;
-      /* Translators: This is used in the benchmark graph - %g is number of milliseconds */
-      s = g_strdup_printf (C_("benchmark-graph", "%3g ms"), val * 1000.0);
-      g_ptr_array_add (p2, s);
-    }
-  g_ptr_array_add (p, NULL);
-  g_ptr_array_add (p2, NULL);
-  y_left_markers = (gchar **) g_ptr_array_free (p, FALSE);
-  y_right_markers = (gchar **) g_ptr_array_free (p2, FALSE);
-
-  gtk_widget_get_allocation (widget, &allocation);
-  width = allocation.width;
-  height = allocation.height;
-
-  cairo_select_font_face (cr, "sans",
-                          CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-  cairo_set_font_size (cr, 8.0);
-  cairo_set_line_width (cr, 1.0);
+      gchar **x_markers;
+      gchar **y_left_markers;
+      gchar **y_right_markers;
+      GPtrArray *p;
+      GPtrArray *p2;
+
+      p = g_ptr_array_new ();
+      p2 = g_ptr_array_new ();
+      for (n = 0; n <= num_y_markers; n++)
+        {
+          gdouble val;
 
-#if 0
-  cairo_set_source_rgb (cr, 0.25, 0.25, 0.25);
-  cairo_rectangle (cr, 0, 0, width, height);
-  cairo_set_line_width (cr, 0.0);
-  cairo_fill (cr);
-#endif
+          val = n * speed_res;
+          /* Translators: This is used in the benchmark graph - %d is megabytes per second */
+          s = g_strdup_printf (C_("benchmark-graph", "%d MB/s"), (gint) (val / (1000 * 1000)));
+          g_ptr_array_add (p, s);
 
-  gx = 0;
-  gy = 0;
-  gw = width;
-  gh = height;
-
-  /* make horizontal and vertical room for x markers ("%d%%") */
-  w = ceil (measure_width (cr, "0%") / 2.0);
-  gx +=  w;
-  gw -=  w;
-  w = ceil (measure_width (cr, "100%") / 2.0);
-  x_marker_height = ceil (measure_height (cr, "100%")) + 10;
-  gw -= w;
-  gh -= x_marker_height;
-
-  /* make horizontal room for left y markers ("%d MB/s") */
-  for (n = 0; n <= num_y_markers; n++)
-    {
-      w = ceil (measure_width (cr, y_left_markers[n])) + 2 * 3;
-      if (w > gx)
+          val = n * time_res;
+          /* Translators: This is used in the benchmark graph - %g is number of milliseconds */
+          s = g_strdup_printf (C_("benchmark-graph", "%3g ms"), val * 1000.0);
+          g_ptr_array_add (p2, s);
+        }
+      g_ptr_array_add (p, NULL);
+      g_ptr_array_add (p2, NULL);
+      y_left_markers = (gchar **) g_ptr_array_free (p, FALSE);
+      y_right_markers = (gchar **) g_ptr_array_free (p2, FALSE);
+
+      p = g_ptr_array_new ();
+      for (n = 0; n <= 10; n++)
+        g_ptr_array_add (p, g_strdup_printf ("%d%%", n * 10));
+      g_ptr_array_add (p, NULL);
+      x_markers = (gchar **) g_ptr_array_free (p, FALSE);
+
+      if (cache->surface != NULL)
+        cairo_surface_destroy (cache->surface);
+      cache->surface = gdk_window_create_similar_surface (gtk_widget_get_window (widget),
+                                                          CAIRO_CONTENT_COLOR_ALPHA,
+                                                          allocation.width,
+                                                          allocation.height);
+      cache->width = allocation.width;
+      cache->height = allocation.height;
+      cache->size = data->bm_size;
+      cache->max_visible_speed = max_visible_speed;
+      cache->max_visible_time = max_visible_time;
+      cache->read_level = read_level;
+      cache->num_read_points = 0;
+      cache->write_level = write_level;
+      cache->num_write_points = 0;
+      cache->num_access_time_samples = 0;
+
+      surface_cr = cairo_create (cache->surface);
+      gdu_benchmark_graph_draw_frame (surface_cr,
+                                      allocation.width,
+                                      allocation.height,
+                                      x_markers,
+                                      y_left_markers,
+                                      y_right_markers,
+                                      &cache->gx, &cache->gy, &cache->gw, &cache->gh);
+
+      /* draw the run compared with as dashed lines */
+      if (data->bm_compare_size > 0)
         {
-          gdouble needed = w - gx;
-          gx += needed;
-          gw -= needed;
+          gdouble dashes[] = {3.0, 3.0};
+          guint level;
+
+          cairo_set_line_width (surface_cr, 1.0);
+          cairo_set_dash (surface_cr, dashes, G_N_ELEMENTS (dashes), 0.0);
+
+          cairo_set_source_rgb (surface_cr, 0.3, 0.3, 0.8);
+          level = gdu_benchmark_graph_series_get_level (data->graph_compare_read_series, MAX (allocation.width, 1));
+          gdu_benchmark_graph_series_stroke (data->graph_compare_read_series, surface_cr, level,
+                                             0, G_MAXUINT,
+                                             cache->gx, cache->gy, cache->gw, cache->gh,
+                                             data->bm_compare_size, max_visible_speed);
+
+          cairo_set_source_rgb (surface_cr, 0.8, 0.3, 0.3);
+          level = gdu_benchmark_graph_series_get_level (data->graph_compare_write_series, MAX (allocation.width, 1));
+          gdu_benchmark_graph_series_stroke (data->graph_compare_write_series, surface_cr, level,
+                                             0, G_MAXUINT,
+                                             cache->gx, cache->gy, cache->gw, cache->gh,
+                                             data->bm_compare_size, max_visible_speed);
+
+          cairo_set_dash (surface_cr, NULL, 0, 0.0);
         }
-    }
 
-  /* make vertical room for top-left y marker */
-  h = ceil (measure_height (cr, y_left_markers[num_y_markers]) / 2.0);
-  if (h > gy)
-    {
-      gdouble needed = h - gy;
-      gy += needed;
-      gh -= needed;
+      g_strfreev (x_markers);
+      g_strfreev (y_left_markers);
+      g_strfreev (y_right_markers);
     }
-
-  /* make horizontal room for right y markers ("%d ms") */
-  for (n = 0; n <= num_y_markers; n++)
+  else
     {
-      w = ceil (measure_width (cr, y_right_markers[n])) + 2 * 3;
-      if (w > width - (gx + gw))
-        {
-          gdouble needed = w - (width - (gx + gw));
-          gw -= needed;
-        }
+      surface_cr = cairo_create (cache->surface);
+      cairo_rectangle (surface_cr, cache->gx + 0.5, cache->gy + 0.5, cache->gw, cache->gh);
+      cairo_clip (surface_cr);
     }
 
-  /* make vertical room for top-right y marker */
-  h = ceil (measure_height (cr, y_right_markers[num_y_markers]) / 2.0);
-  if (h > gy)
+  /* paint the read and write points completed since the last time,
+   * from the last one painted so the lines are continuous
+   */
+  cairo_set_line_width (surface_cr, 1.5);
+  num_read_points = gdu_benchmark_graph_series_get_num_complete_points (data->graph_read_series, read_level);
+  if (num_read_points > cache->num_read_points)
     {
-      gdouble needed = h - gy;
-      gy += needed;
-      gh -= needed;
+      cairo_set_source_rgb (surface_cr, 0.5, 0.5, 1.0);
+      gdu_benchmark_graph_series_stroke (data->graph_read_series, surface_cr, read_level,
+                                         cache->num_read_points > 0 ? cache->num_read_points - 1 : 0,
+                                         num_read_points,
+                                         cache->gx, cache->gy, cache->gw, cache->gh,
+                                         data->bm_size, max_visible_speed);
+      cache->num_read_points = num_read_points;
     }
-
-  /* draw x markers ("%d%%") + vertical grid */
-  for (n = 0; n <= 10; n++)
+  num_write_points = gdu_benchmark_graph_series_get_num_complete_points (data->graph_write_series, write_level);
+  if (num_write_points > cache->num_write_points)
     {
-      cairo_text_extents_t te;
-
-      x = gx + ceil (n * gw / 10.0);
-      y = gy + gh + x_marker_height/2.0;
-
-      s = g_strdup_printf ("%d%%", n * 10);
-
-      cairo_text_extents (cr, s, &te);
-
-      cairo_move_to (cr,
-                     x - te.x_bearing - te.width/2,
-                     y - te.y_bearing - te.height/2);
-      cairo_set_source_rgb (cr, 0, 0, 0);
-      cairo_show_text (cr, s);
-
-      g_free (s);
+      cairo_set_source_rgb (surface_cr, 1.0, 0.5, 0.5);
+      gdu_benchmark_graph_series_stroke (data->graph_write_series, surface_cr, write_level,
+                                         cache->num_write_points > 0 ? cache->num_write_points - 1 : 0,
+                                         num_write_points,
+                                         cache->gx, cache->gy, cache->gw, cache->gh,
+                                         data->bm_size, max_visible_speed);
+      cache->num_write_points = num_write_points;
     }
 
-  /* draw left y markers ("%d MB/s") */
-  for (n = 0; n <= num_y_markers; n++)
+  /* and the access time dots + lines measured since the last time */
+  cairo_set_line_width (surface_cr, 0.5);
+  for (n = cache->num_access_time_samples; n < data->bm_access_time_samples->len; n++)
     {
-      cairo_text_extents_t te;
-
-      x = gx/2.0;
-      y = gy + gh - gh * n / num_y_markers;
-
-      s = y_left_markers[n];
-      cairo_text_extents (cr, s, &te);
-      cairo_move_to (cr,
-                     x - te.x_bearing - te.width/2,
-                     y - te.y_bearing - te.height/2);
-      cairo_set_source_rgb (cr, 0, 0, 0);
-      cairo_show_text (cr, s);
-    }
+      GduBenchmarkSample *sample = &g_array_index (data->bm_access_time_samples, GduBenchmarkSample, n);
 
-  /* draw right y markers ("%d ms") */
-  for (n = 0; n <= num_y_markers; n++)
-    {
-      cairo_text_extents_t te;
+      x = cache->gx + cache->gw * sample->offset / data->bm_size;
+      y = cache->gy + cache->gh - cache->gh * sample->value / max_visible_time;
 
-      x = gx + gw + (width - (gx + gw))/2.0;
-      y = gy + gh - gh * n / num_y_markers;
+      /*g_debug ("time = %f @ %f", point->value, x);*/
 
-      s = y_right_markers[n];
-      cairo_text_extents (cr, s, &te);
-      cairo_move_to (cr,
-                     x - te.x_bearing - te.width/2,
-                     y - te.y_bearing - te.height/2);
-      cairo_set_source_rgb (cr, 0, 0, 0);
-      cairo_show_text (cr, s);
-    }
+      cairo_set_source_rgba (surface_cr, 0.4, 1.0, 0.4, 0.5);
+      cairo_arc (surface_cr, x, y, 1.5, 0, 2 * M_PI);
+      cairo_fill (surface_cr);
 
-  /* fill graph area */
-  cairo_set_source_rgb (cr, 1, 1, 1);
-  cairo_rectangle (cr, gx + 0.5, gy + 0.5, gw, gh);
-  cairo_fill_preserve (cr);
-  /* grid - first a rect */
-  cairo_set_source_rgba (cr, 0, 0, 0, 0.25);
-  cairo_set_line_width (cr, 1.0);
-  /* rect - also clip to rect for all future drawing operations */
-  cairo_stroke_preserve (cr);
-  cairo_clip (cr);
-  /* vertical lines */
-  for (n = 1; n < 10; n++)
-    {
-      x = gx + ceil (n * gw / 10.0);
-      cairo_move_to (cr, x + 0.5, gy + 0.5);
-      cairo_line_to (cr, x + 0.5, gy + gh + 0.5);
-      cairo_stroke (cr);
-    }
-  /* horizontal lines */
-  for (n = 1; n < num_y_markers; n++)
-    {
-      y = gy + ceil (n * gh / num_y_markers);
-      cairo_move_to (cr, gx + 0.5, y + 0.5);
-      cairo_line_to (cr, gx + gw + 0.5, y + 0.5);
-      cairo_stroke (cr);
+      if (n > 0)
+        {
+          GduBenchmarkSample *prev_sample = &g_array_index (data->bm_access_time_samples, GduBenchmarkSample, n - 1);
+          cairo_set_source_rgba (surface_cr, 0.2, 0.5, 0.2, 0.10);
+          cairo_move_to (surface_cr,
+                         cache->gx + cache->gw * prev_sample->offset / data->bm_size,
+                         cache->gy + cache->gh - cache->gh * prev_sample->value / max_visible_time);
+          cairo_line_to (surface_cr, x, y);
+          cairo_stroke (surface_cr);
+        }
     }
+  cache->num_access_time_samples = data->bm_access_time_samples->len;
 
-  /* draw read graph */
-  cairo_set_source_rgb (cr, 0.5, 0.5, 1.0);
-  cairo_set_line_width (cr, 1.5);
-  for (n = 0; n < data->bm_read_samples->len; n++)
-    {
-      BMSample *sample = &g_array_index (data->bm_read_samples, BMSample, n);
-
-      x = gx + gw * sample->offset / data->bm_size;
-      y = gy + gh - gh * sample->value / max_visible_speed;
+  cairo_destroy (surface_cr);
 
-      if (n == 0)
-        cairo_move_to (cr, x, y);
-      else
-        cairo_line_to (cr, x, y);
-    }
-  cairo_stroke (cr);
+  cairo_set_source_surface (cr, cache->surface, 0, 0);
+  cairo_paint (cr);
 
-  /* draw write graph */
-  cairo_set_source_rgb (cr, 1.0, 0.5, 0.5);
+  /* the last read and write points still change as samples come in so
+   * they are drawn on top instead of being painted on the surface
+   */
+  cairo_rectangle (cr, cache->gx + 0.5, cache->gy + 0.5, cache->gw, cache->gh);
+  cairo_clip (cr);
   cairo_set_line_width (cr, 1.5);
-  for (n = 0; n < data->bm_write_samples->len; n++)
+  if (num_read_points < gdu_benchmark_graph_series_get_num_points (data->graph_read_series, read_level))
     {
-      BMSample *sample = &g_array_index (data->bm_write_samples, BMSample, n);
-      x = gx + gw * sample->offset / data->bm_size;
-      y = gy + gh - gh * sample->value / max_visible_speed;
-
-      if (n == 0)
-        cairo_move_to (cr, x, y);
-      else
-        cairo_line_to (cr, x, y);
+      cairo_set_source_rgb (cr, 0.5, 0.5, 1.0);
+      gdu_benchmark_graph_series_stroke (data->graph_read_series, cr, read_level,
+                                         num_read_points > 0 ? num_read_points - 1 : 0,
+                                         G_MAXUINT,
+                                         cache->gx, cache->gy, cache->gw, cache->gh,
+                                         data->bm_size, max_visible_speed);
     }
-  cairo_stroke (cr);
-
-  /* draw access time dots + lines */
-  cairo_set_line_width (cr, 0.5);
-  for (n = 0; n < data->bm_access_time_samples->len; n++)
+  if (num_write_points < gdu_benchmark_graph_series_get_num_points (data->graph_write_series, write_level))
     {
-      BMSample *sample = &g_array_index (data->bm_access_time_samples, BMSample, n);
-
-      x = gx + gw * sample->offset / data->bm_size;
-      y = gy + gh - gh * sample->value / max_visible_time;
-
-      /*g_debug ("time = %f @ %f", point->value, x);*/
-
-      cairo_set_source_rgba (cr, 0.4, 1.0, 0.4, 0.5);
-      cairo_arc (cr, x, y, 1.5, 0, 2 * M_PI);
-      cairo_fill (cr);
-
-      if (n > 0)
-        {
-          cairo_set_source_rgba (cr, 0.2, 0.5, 0.2, 0.10);
-          cairo_move_to (cr, prev_x, prev_y);
-          cairo_line_to (cr, x, y);
-          cairo_stroke (cr);
-        }
-
-      prev_x = x;
-      prev_y = y;
+      cairo_set_source_rgb (cr, 1.0, 0.5, 0.5);
+      gdu_benchmark_graph_series_stroke (data->graph_write_series, cr, write_level,
+                                         num_write_points > 0 ? num_write_points - 1 : 0,
+                                         G_MAXUINT,
+                                         cache->gx, cache->gy, cache->gw, cache->gh,
+                                         data->bm_size, max_visible_speed);
     }
 
 #if 0
@@ -618,517 +935,4175 @@ on_drawing_area_draw (GtkWidget      *widget,
         }
 #endif
 
-        g_strfreev (y_left_markers);
-        g_strfreev (y_right_markers);
-
   G_UNLOCK (bm_lock);
 
   /* propagate event further */
   return FALSE;
 }
 
-/* ---------------------------------------------------------------------------------------------------- */
-
 static gchar *
-format_transfer_rate (gdouble bytes_per_sec)
+format_iops_marker (gdouble iops)
 {
-  gchar *ret = NULL;
-  gchar *s;
+  gchar *ret;
 
-  s = g_format_size ((guint64) bytes_per_sec);
-  /* Translators: %s is the formatted size, e.g. "42 MB" and the trailing "/s" means per second */
-  ret = g_strdup_printf (C_("benchmark-transfer-rate", "%s/s"), s);
-  g_free (s);
+  if (iops >= 10000.0)
+    {
+      /* Translators: This is used in the benchmark graph - %g is thousands of I/O operations per second */
+      ret = g_strdup_printf (C_("benchmark-graph", "%gk IOPS"), iops / 1000.0);
+    }
+  else
+    {
+      /* Translators: This is used in the benchmark graph - %g is I/O operations per second */
+      ret = g_strdup_printf (C_("benchmark-graph", "%g IOPS"), iops);
+    }
   return ret;
 }
 
-static gchar *
-format_transfer_rate_and_num_samples (gdouble bytes_per_sec,
-                                      guint   num_samples)
+typedef struct
 {
-  gchar *ret = NULL;
-  gchar *s;
-  gchar *s2;
+  GArray *rates;        /* value is bytes per second */
+  GArray *iops;         /* value is operations per second, NULL to derive it from block_size */
+  guint64 block_size;
+  gchar *label;
+  gdouble red, green, blue;
+} BarGraphSeries;
 
-  s = format_transfer_rate (bytes_per_sec);
-  s2 = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
-                                     "%d sample",
-                                     "%d samples",
-                                     num_samples),
-                        num_samples);
-  ret = g_strdup_printf ("%s <small>(%s)</small>", s, s2);
-  g_free (s2);
-  g_free (s);
-  return ret;
+static gdouble
+bar_graph_series_get_iops (BarGraphSeries *series,
+                           guint           n)
+{
+  if (series->iops != NULL)
+    return n < series->iops->len ? g_array_index (series->iops, GduBenchmarkSample, n).value : 0.0;
+  if (series->block_size == 0)
+    return 0.0;
+  return g_array_index (series->rates, GduBenchmarkSample, n).value / series->block_size;
 }
 
-
+/* Draws a graph with a column for each of the @category_ids, a sample
+ * goes in the column whose id is the offset of the sample. Transfer
+ * rates are drawn as bars against the left axis and IOPS as dots
+ * against the right axis, connected by lines if @connect_iops is
+ * %TRUE.
+ *
+ * Must be called with bm_lock held.
+ */
 static void
-update_updated_label (DialogData *data)
+draw_bar_graph (GtkWidget       *widget,
+                cairo_t         *cr,
+                gchar          **category_labels,
+                const guint64   *category_ids,
+                BarGraphSeries  *series,
+                guint            num_series,
+                gboolean         connect_iops)
 {
-  gchar *s = NULL;
+  GtkAllocation allocation;
+  gdouble gx, gy, gw, gh;
+  gdouble x, y;
+  gdouble prev_x = 0.0;
+  gdouble prev_y = 0.0;
+  gdouble bar_width;
+  gdouble max_speed = 0.0;
+  gdouble max_iops = 0.0;
+  gdouble max_visible_speed;
+  gdouble max_visible_iops;
+  gchar **x_markers;
+  gchar **y_left_markers;
+  gchar **y_right_markers;
+  guint num_categories;
+  guint num_x_markers;
+  guint num_y_markers;
+  GPtrArray *p;
+  GPtrArray *p2;
+  guint n, m, c;
 
-  G_LOCK (bm_lock);
-  switch (data->bm_state)
+  num_categories = g_strv_length (category_labels);
+
+  for (m = 0; m < num_series; m++)
     {
-    case BM_STATE_NONE:
-      if (data->bm_time_benchmarked_usec > 0)
-        {
-          gint64 now_usec;
-          gchar *s2;
-          GDateTime *time_benchmarked_dt;
-          GDateTime *time_benchmarked_dt_local;
-          gchar *time_benchmarked_str;
+      gdouble speed = 0.0;
+      get_max_min_avg (series[m].rates, &speed, NULL, NULL);
+      max_speed = MAX (max_speed, speed);
+      for (n = 0; n < series[m].rates->len; n++)
+        max_iops = MAX (max_iops, bar_graph_series_get_iops (&series[m], n));
+    }
 
-          now_usec = g_get_real_time ();
+  if (max_speed == 0)
+    max_speed = 100 * 1000 * 1000;
+  if (max_iops == 0)
+    max_iops = 1000;
 
-          time_benchmarked_dt = g_date_time_new_from_unix_utc (data->bm_time_benchmarked_usec / G_USEC_PER_SEC);
-          time_benchmarked_dt_local = g_date_time_to_local (time_benchmarked_dt);
-          time_benchmarked_str = g_date_time_format (time_benchmarked_dt_local, "%c");
+  num_y_markers = 10;
+  max_visible_speed = gdu_benchmark_graph_round_up_for_markers (max_speed, num_y_markers);
+  max_visible_iops = gdu_benchmark_graph_round_up_for_markers (max_iops, num_y_markers);
 
-          s = gdu_utils_format_duration_usec ((now_usec - data->bm_time_benchmarked_usec),
-                                              GDU_FORMAT_DURATION_FLAGS_NO_SECONDS);
-          /* Translators: The first %s is the date and time the benchmark took place in the preferred
-           * format for the locale (e.g. "%c" for strftime()/g_date_time_format()), for example
-           * "Tue 12 Jun 2012 03:57:08 PM EDT". The second %s is how long ago that is from right
-           * now, for example "3 days" or "2 hours" or "12 minutes".
-           */
-          s2 = g_strdup_printf (C_("benchmark-updated", "%s (%s ago)"),
-                                time_benchmarked_str,
-                                s);
-          gtk_label_set_text (GTK_LABEL (data->updated_label), s2);
-          g_free (s2);
-          g_free (s);
-          g_free (time_benchmarked_str);
-          g_date_time_unref (time_benchmarked_dt_local);
-          g_date_time_unref (time_benchmarked_dt);
+  p = g_ptr_array_new ();
+  p2 = g_ptr_array_new ();
+  for (n = 0; n <= num_y_markers; n++)
+    {
+      /* Translators: This is used in the benchmark graph - %d is megabytes per second */
+      g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "%d MB/s"),
+                                           (gint) (n * max_visible_speed / num_y_markers / (1000 * 1000))));
+      g_ptr_array_add (p2, format_iops_marker (n * max_visible_iops / num_y_markers));
+    }
+  g_ptr_array_add (p, NULL);
+  g_ptr_array_add (p2, NULL);
+  y_left_markers = (gchar **) g_ptr_array_free (p, FALSE);
+  y_right_markers = (gchar **) g_ptr_array_free (p2, FALSE);
+
+  /* leave an empty column on each side so the bars fit */
+  p = g_ptr_array_new ();
+  g_ptr_array_add (p, g_strdup (""));
+  for (c = 0; c < num_categories; c++)
+    g_ptr_array_add (p, g_strdup (category_labels[c]));
+  g_ptr_array_add (p, g_strdup (""));
+  g_ptr_array_add (p, NULL);
+  x_markers = (gchar **) g_ptr_array_free (p, FALSE);
+  num_x_markers = num_categories + 1;
+
+  gtk_widget_get_allocation (widget, &allocation);
+  gdu_benchmark_graph_draw_frame (cr,
+                                  allocation.width,
+                                  allocation.height,
+                                  x_markers,
+                                  y_left_markers,
+                                  y_right_markers,
+                                  &gx, &gy, &gw, &gh);
+
+  /* transfer rate as bars, side by side ... */
+  bar_width = gw / num_x_markers / (2 * num_series);
+  for (m = 0; m < num_series; m++)
+    {
+      cairo_set_source_rgb (cr, series[m].red, series[m].green, series[m].blue);
+      for (n = 0; n < series[m].rates->len; n++)
+        {
+          GduBenchmarkSample *sample = &g_array_index (series[m].rates, GduBenchmarkSample, n);
+
+          for (c = 0; c < num_categories; c++)
+            if (category_ids[c] == sample->offset)
+              break;
+          if (c == num_categories)
+            continue;
+
+          x = gx + ceil ((c + 1) * gw / num_x_markers) - bar_width * num_series / 2.0 + m * bar_width;
+          y = gy + gh - gh * sample->value / max_visible_speed;
+          cairo_rectangle (cr, x, y, bar_width, gy + gh - y);
+          cairo_fill (cr);
         }
-      else
+    }
+
+  /* ... and IOPS as dots on top */
+  cairo_set_line_width (cr, 1.5);
+  for (m = 0; m < num_series; m++)
+    {
+      for (n = 0; n < series[m].rates->len; n++)
         {
-          gtk_label_set_markup (GTK_LABEL (data->updated_label), C_("benchmark-updated", "No benchmark data available"));
+          GduBenchmarkSample *sample = &g_array_index (series[m].rates, GduBenchmarkSample, n);
+
+          for (c = 0; c < num_categories; c++)
+            if (category_ids[c] == sample->offset)
+              break;
+          if (c == num_categories)
+            continue;
+
+          x = gx + ceil ((c + 1) * gw / num_x_markers);
+          if (!connect_iops)
+            x += - bar_width * num_series / 2.0 + (m + 0.5) * bar_width;
+          y = gy + gh - gh * bar_graph_series_get_iops (&series[m], n) / max_visible_iops;
+
+          cairo_set_source_rgb (cr, series[m].red * 0.5, series[m].green * 0.5, series[m].blue * 0.5);
+          cairo_arc (cr, x, y, 2.0, 0, 2 * M_PI);
+          cairo_fill (cr);
+          if (connect_iops && n > 0)
+            {
+              cairo_move_to (cr, prev_x, prev_y);
+              cairo_line_to (cr, x, y);
+              cairo_stroke (cr);
+            }
+          prev_x = x;
+          prev_y = y;
         }
-      break;
+    }
 
-    case BM_STATE_OPENING_DEVICE:
-      gtk_label_set_markup (GTK_LABEL (data->updated_label), C_("benchmark-updated", "Opening Device…"));
-      break;
+  /* legend */
+  for (m = 0; m < num_series; m++)
+    {
+      if (series[m].label == NULL || series[m].rates->len == 0)
+        continue;
 
-    case BM_STATE_TRANSFER_RATE:
-      s = g_strdup_printf (C_("benchmark-updated", "Measuring transfer rate (%2.1f%% complete)…"),
-                           data->bm_read_samples->len * 100.0 / data->bm_num_samples);
-      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
-      g_free (s);
-      break;
+      y = gy + 8 + m * 12;
+      cairo_set_source_rgb (cr, series[m].red, series[m].green, series[m].blue);
+      cairo_rectangle (cr, gx + 8, y, 8, 8);
+      cairo_fill (cr);
+      cairo_set_source_rgb (cr, 0, 0, 0);
+      cairo_move_to (cr, gx + 20, y + 8);
+      cairo_show_text (cr, series[m].label);
+    }
 
-    case BM_STATE_ACCESS_TIME:
-      s = g_strdup_printf (C_("benchmark-updated", "Measuring access time (%2.1f%% complete)…"),
-                           data->bm_access_time_samples->len * 100.0 / data->bm_num_access_samples);
-      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
-      g_free (s);
-      break;
+  g_strfreev (x_markers);
+  g_strfreev (y_left_markers);
+  g_strfreev (y_right_markers);
+}
+
+static gboolean
+on_queue_depth_drawing_area_draw (GtkWidget      *widget,
+                                  cairo_t        *cr,
+                                  gpointer        user_data)
+{
+  DialogData *data = user_data;
+  BarGraphSeries series[2] = {{0}};
+  guint64 category_ids[G_N_ELEMENTS (queue_depths)];
+  GPtrArray *p;
+  gchar **category_labels;
+  gchar *s;
+  guint n;
+
+  p = g_ptr_array_new ();
+  for (n = 0; n < G_N_ELEMENTS (queue_depths); n++)
+    {
+      /* Translators: This is used in the benchmark graph - %u is the queue depth, e.g. the
+       * number of requests the device is given at once
+       */
+      g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "QD %u"), queue_depths[n]));
+      category_ids[n] = queue_depths[n];
     }
+  g_ptr_array_add (p, NULL);
+  category_labels = (gchar **) g_ptr_array_free (p, FALSE);
+
+  G_LOCK (bm_lock);
+
+  series[0].rates = data->bm_sequential_queue_depth_samples;
+  series[0].block_size = data->bm_sequential_queue_depth_block_size;
+  s = g_format_size_full (series[0].block_size, G_FORMAT_SIZE_IEC_UNITS);
+  /* Translators: This is used in the benchmark graph legend - %s is the request size, e.g. "128 KiB" */
+  series[0].label = g_strdup_printf (C_("benchmark-graph", "Sequential reads of %s"), s);
+  g_free (s);
+  series[0].red = 0.5;
+  series[0].green = 0.5;
+  series[0].blue = 1.0;
+  series[1].rates = data->bm_random_queue_depth_samples;
+  series[1].block_size = data->bm_random_queue_depth_block_size;
+  s = g_format_size_full (series[1].block_size, G_FORMAT_SIZE_IEC_UNITS);
+  /* Translators: This is used in the benchmark graph legend - %s is the request size, e.g. "4 KiB" */
+  series[1].label = g_strdup_printf (C_("benchmark-graph", "Random reads of %s"), s);
+  g_free (s);
+  series[1].red = 0.4;
+  series[1].green = 0.8;
+  series[1].blue = 0.4;
+
+  draw_bar_graph (widget, cr,
+                  category_labels, category_ids,
+                  series, G_N_ELEMENTS (series),
+                  TRUE); /* connect_iops */
+
   G_UNLOCK (bm_lock);
+
+  g_free (series[0].label);
+  g_free (series[1].label);
+  g_strfreev (category_labels);
+
+  /* propagate event further */
+  return FALSE;
 }
 
-/* returns NULL if it doesn't make sense to load/save benchmark data (removable media,
- * non-drive devices etc.)
- */
-static gchar *
-get_bm_filename (DialogData *data)
+static gboolean
+on_profiles_drawing_area_draw (GtkWidget      *widget,
+                               cairo_t        *cr,
+                               gpointer        user_data)
 {
-  gchar *ret = NULL;
-  gchar *bench_dir = NULL;
-  const gchar *id = NULL;
-
-  id = udisks_block_get_id (data->block);
-  if (id == NULL || strlen (id) == 0)
-    goto out;
+  DialogData *data = user_data;
+  BarGraphSeries series[1] = {{0}};
+  guint64 category_ids[G_N_ELEMENTS (profiles)];
+  GPtrArray *p;
+  gchar **category_labels;
+  guint n;
 
-  bench_dir = g_strdup_printf ("%s/gnome-disks/benchmarks", g_get_user_cache_dir ());
-  if (g_mkdir_with_parents (bench_dir, 0777) != 0)
+  p = g_ptr_array_new ();
+  for (n = 0; n < G_N_ELEMENTS (profiles); n++)
     {
-      g_warning ("Error creating directory %s: %m", bench_dir);
-      goto out;
+      g_ptr_array_add (p, g_strdup (g_dpgettext2 (NULL, "benchmark-profile", profiles[n].name)));
+      category_ids[n] = n;
     }
+  g_ptr_array_add (p, NULL);
+  category_labels = (gchar **) g_ptr_array_free (p, FALSE);
 
-  ret = g_strdup_printf ("%s/%s.gnome-disks-benchmark", bench_dir, id);
+  G_LOCK (bm_lock);
+  series[0].rates = data->bm_profile_rate_samples;
+  series[0].iops = data->bm_profile_iops_samples;
+  series[0].red = 0.5;
+  series[0].green = 0.5;
+  series[0].blue = 1.0;
+  draw_bar_graph (widget, cr,
+                  category_labels, category_ids,
+                  series, G_N_ELEMENTS (series),
+                  FALSE); /* connect_iops */
+  G_UNLOCK (bm_lock);
 
- out:
-  g_free (bench_dir);
-  return ret;
+  g_strfreev (category_labels);
+
+  /* propagate event further */
+  return FALSE;
 }
 
-static void
-update_dialog (DialogData *data)
+static gboolean
+on_filesystem_drawing_area_draw (GtkWidget      *widget,
+                                 cairo_t        *cr,
+                                 gpointer        user_data)
 {
-  GError *error = NULL;
-  GdkWindow *window = NULL;
-  gdouble read_avg = 0.0;
-  gdouble write_avg = 0.0;
-  gdouble access_time_avg = 0.0;
-  gchar *s = NULL;
-  UDisksDrive *drive = NULL;
-  UDisksObjectInfo *info = NULL;
+  DialogData *data = user_data;
+  BarGraphSeries series[1] = {{0}};
+  guint64 category_ids[G_N_ELEMENTS (filesystem_workloads)];
+  GPtrArray *p;
+  gchar **category_labels;
+  guint n;
 
-  G_LOCK (bm_lock);
-  if (data->bm_error != NULL)
+  p = g_ptr_array_new ();
+  for (n = 0; n < G_N_ELEMENTS (filesystem_workloads); n++)
     {
-      error = data->bm_error;
-      data->bm_error = NULL;
+      g_ptr_array_add (p, g_strdup (g_dpgettext2 (NULL, "benchmark-filesystem", filesystem_workloads[n].name)));
+      category_ids[n] = n;
     }
+  g_ptr_array_add (p, NULL);
+  category_labels = (gchar **) g_ptr_array_free (p, FALSE);
+
+  G_LOCK (bm_lock);
+  series[0].rates = data->bm_filesystem_rate_samples;
+  series[0].iops = data->bm_filesystem_iops_samples;
+  series[0].red = 0.5;
+  series[0].green = 0.5;
+  series[0].blue = 1.0;
+  draw_bar_graph (widget, cr,
+                  category_labels, category_ids,
+                  series, G_N_ELEMENTS (series),
+                  FALSE); /* connect_iops */
   G_UNLOCK (bm_lock);
 
-  /* first of all, present an error if something went wrong */
-  if (error != NULL)
-    {
-      if (!data->closed)
-        {
-          if (!(error->domain == G_IO_ERROR && error->code == G_IO_ERROR_CANCELLED))
-            gdu_utils_show_error (GTK_WINDOW (data->window), C_("benchmarking", "An error occurred"), error);
-        }
-      g_clear_error (&error);
+  g_strfreev (category_labels);
 
-      /* and reload old data */
-      if (!maybe_load_data (data, &error))
-        {
-          /* not worth complaining in dialog about */
-          g_warning ("Error loading cached data: %s (%s, %d)",
-                     error->message, g_quark_to_string (error->domain), error->code);
-          g_clear_error (&error);
-        }
-    }
+  /* propagate event further */
+  return FALSE;
+}
 
-  update_updated_label (data);
+/* x position of @usec on the logarithmic axis of the access time distribution graph */
+static gdouble
+get_access_time_x (gdouble usec,
+                   gdouble min_decade,
+                   gdouble max_decade,
+                   gdouble gx,
+                   gdouble gw)
+{
+  return gx + gw * (log10 (MAX (usec, 1.0)) - min_decade) / (max_decade - min_decade);
+}
 
-  /* disk / device label */
-  drive = udisks_client_get_drive_for_block (gdu_window_get_client (data->window), data->block);
-  info = udisks_client_get_object_info (gdu_window_get_client (data->window), data->object);
-  gtk_label_set_text (GTK_LABEL (data->device_label), udisks_object_info_get_one_liner (info));
-  g_free (s);
+static gboolean
+on_access_time_distribution_drawing_area_draw (GtkWidget      *widget,
+                                               cairo_t        *cr,
+                                               gpointer        user_data)
+{
+  DialogData *data = user_data;
+  GduHistogram *histogram = data->bm_access_time_histogram;
+  GtkAllocation allocation;
+  gdouble gx, gy, gw, gh;
+  gdouble x, y;
+  gdouble min_decade = 1.0;
+  gdouble max_decade = 5.0;
+  gdouble max_fraction = 0.0;
+  gdouble max_visible_fraction;
+  gchar **x_markers;
+  gchar **y_left_markers;
+  gchar **y_right_markers;
+  guint num_y_markers;
+  GPtrArray *p;
+  GPtrArray *p2;
+  guint64 count;
+  guint64 cumulative;
+  guint n;
 
   G_LOCK (bm_lock);
 
-  if (data->bm_in_progress)
+  count = gdu_histogram_get_count (histogram);
+  if (count > 0)
     {
-
-      gtk_widget_hide (data->start_benchmark_button);
-      gtk_widget_show (data->stop_benchmark_button);
+      min_decade = floor (log10 (MAX (gdu_histogram_get_min (histogram), 1)));
+      max_decade = ceil (log10 (gdu_histogram_get_max (histogram) + 1));
+      if (max_decade <= min_decade)
+        max_decade = min_decade + 1;
+      for (n = 0; n < gdu_histogram_get_num_buckets (histogram); n++)
+        max_fraction = MAX (max_fraction,
+                            ((gdouble) gdu_histogram_get_bucket (histogram, n, NULL, NULL)) / count);
     }
-  else
+  if (max_fraction == 0.0)
+    max_fraction = 0.1;
+
+  num_y_markers = 10;
+  max_visible_fraction = gdu_benchmark_graph_round_up_for_markers (max_fraction * 100.0, num_y_markers) / 100.0;
+
+  p = g_ptr_array_new ();
+  p2 = g_ptr_array_new ();
+  for (n = 0; n <= num_y_markers; n++)
     {
-      gtk_widget_show (data->start_benchmark_button);
-      gtk_widget_hide (data->stop_benchmark_button);
+      g_ptr_array_add (p, g_strdup_printf ("%g%%", n * max_visible_fraction * 100.0 / num_y_markers));
+      g_ptr_array_add (p2, g_strdup_printf ("%d%%", n * 100 / num_y_markers));
     }
+  g_ptr_array_add (p, NULL);
+  g_ptr_array_add (p2, NULL);
+  y_left_markers = (gchar **) g_ptr_array_free (p, FALSE);
+  y_right_markers = (gchar **) g_ptr_array_free (p2, FALSE);
 
-  get_max_min_avg (data->bm_read_samples,
-                   NULL, NULL, &read_avg);
-  get_max_min_avg (data->bm_write_samples,
-                   NULL, NULL, &write_avg);
-  get_max_min_avg (data->bm_access_time_samples,
-                   NULL, NULL, &access_time_avg);
+  p = g_ptr_array_new ();
+  for (n = (guint) min_decade; n <= (guint) max_decade; n++)
+    {
+      /* Translators: This is used in the benchmark graph - %g is number of milliseconds */
+      g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "%3g ms"), pow (10.0, n) / 1000.0));
+    }
+  g_ptr_array_add (p, NULL);
+  x_markers = (gchar **) g_ptr_array_free (p, FALSE);
 
-  G_UNLOCK (bm_lock);
+  gtk_widget_get_allocation (widget, &allocation);
+  gdu_benchmark_graph_draw_frame (cr,
+                                  allocation.width,
+                                  allocation.height,
+                                  x_markers,
+                                  y_left_markers,
+                                  y_right_markers,
+                                  &gx, &gy, &gw, &gh);
+
+  if (count == 0)
+    goto out;
 
-  if (data->bm_sample_size == 0)
-    s = g_strdup ("–");
-  else
-    s = g_format_size_full (data->bm_sample_size, G_FORMAT_SIZE_IEC_UNITS | G_FORMAT_SIZE_LONG_FORMAT);
-  gtk_label_set_markup (GTK_LABEL (data->sample_size_label), s);
-  g_free (s);
+  /* how many of the samples are in each bucket ... */
+  cairo_set_source_rgb (cr, 0.4, 1.0, 0.4);
+  for (n = 0; n < gdu_histogram_get_num_buckets (histogram); n++)
+    {
+      guint64 bucket_count;
+      guint64 lowest_value;
+      guint64 highest_value;
+      gdouble x2;
+
+      bucket_count = gdu_histogram_get_bucket (histogram, n, &lowest_value, &highest_value);
+      if (bucket_count == 0)
+        continue;
+
+      x = get_access_time_x (lowest_value, min_decade, max_decade, gx, gw);
+      x2 = get_access_time_x (highest_value + 1, min_decade, max_decade, gx, gw);
+      y = gy + gh - gh * (((gdouble) bucket_count) / count) / max_visible_fraction;
+      cairo_rectangle (cr, x, y, MAX (x2 - x, 1.0), gy + gh - y);
+      cairo_fill (cr);
+    }
 
-  if (read_avg == 0.0)
-    s = g_strdup ("–");
-  else
-    s = format_transfer_rate_and_num_samples (read_avg, data->bm_read_samples->len);
-  gtk_label_set_markup (GTK_LABEL (data->read_rate_label), s);
-  g_free (s);
+  /* ... how many are at most that long ... */
+  cairo_set_source_rgb (cr, 0.2, 0.5, 0.2);
+  cairo_set_line_width (cr, 1.5);
+  cairo_move_to (cr, gx, gy + gh);
+  cumulative = 0;
+  for (n = 0; n < gdu_histogram_get_num_buckets (histogram); n++)
+    {
+      guint64 bucket_count;
+      guint64 highest_value;
 
-  if (write_avg == 0.0)
-    s = g_strdup ("–");
-  else
-    s = format_transfer_rate_and_num_samples (write_avg, data->bm_write_samples->len);
-  gtk_label_set_markup (GTK_LABEL (data->write_rate_label), s);
-  g_free (s);
+      bucket_count = gdu_histogram_get_bucket (histogram, n, NULL, &highest_value);
+      if (bucket_count == 0)
+        continue;
 
-  if (access_time_avg == 0.0)
-    {
-      s = g_strdup ("–");
+      cumulative += bucket_count;
+      x = get_access_time_x (highest_value + 1, min_decade, max_decade, gx, gw);
+      y = gy + gh - gh * ((gdouble) cumulative) / count;
+      cairo_line_to (cr, x, y);
     }
-  else
+  cairo_stroke (cr);
+
+  /* ... and where the percentiles are */
+  cairo_set_line_width (cr, 1.0);
+  for (n = 0; n < G_N_ELEMENTS (access_time_percentiles); n++)
     {
-      gchar *s2;
-      gchar *s3;
-      /* Translators: %d is number of milliseconds and msec means "milli-second" */
-      s2 = g_strdup_printf (C_("benchmark-access-time", "%.2f msec"), access_time_avg * 1000.0);
-      s3 = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
-                                         "%d sample",
-                                         "%d samples",
-                                         data->bm_access_time_samples->len),
-                            data->bm_access_time_samples->len);
-      s = g_strdup_printf ("%s <small>(%s)</small>", s2, s3);
-      g_free (s3);
-      g_free (s2);
+      gchar *s;
+      gdouble dashes[] = {3.0, 3.0};
+
+      x = get_access_time_x (gdu_histogram_get_value_at_percentile (histogram, access_time_percentiles[n]),
+                             min_decade, max_decade, gx, gw);
+      x = ceil (x) + 0.5;
+      cairo_set_source_rgba (cr, 0, 0, 0, 0.5);
+      cairo_set_dash (cr, dashes, G_N_ELEMENTS (dashes), 0.0);
+      cairo_move_to (cr, x, gy);
+      cairo_line_to (cr, x, gy + gh);
+      cairo_stroke (cr);
+      cairo_set_dash (cr, NULL, 0, 0.0);
+
+      s = g_strdup_printf ("p%g", access_time_percentiles[n]);
+      cairo_set_source_rgb (cr, 0, 0, 0);
+      cairo_move_to (cr, x + 2, gy + 10 + n * 10);
+      cairo_show_text (cr, s);
+      g_free (s);
     }
-  gtk_label_set_markup (GTK_LABEL (data->access_time_label), s);
-  g_free (s);
 
+ out:
+  g_strfreev (x_markers);
+  g_strfreev (y_left_markers);
+  g_strfreev (y_right_markers);
 
-  window = gtk_widget_get_window (data->graph_drawing_area);
-  if (window != NULL)
-    gdk_window_invalidate_rect (window, NULL, TRUE);
+  G_UNLOCK (bm_lock);
 
-  g_clear_object (&drive);
-  g_clear_object (&info);
+  /* propagate event further */
+  return FALSE;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* A part of the sustained write test where the write rate is about the same */
+typedef struct
+{
+  guint begin;   /* index of the first sample */
+  guint end;     /* index of the sample after the last sample */
+  gdouble mean;  /* average write rate, in bytes per second */
+} BMSegment;
 
-/* called every second (on the second) */
-static gboolean
-on_timeout (gpointer user_data)
+static gdouble
+get_segment_mean (const gdouble *sums,
+                  guint          begin,
+                  guint          end)
 {
-  DialogData *data = user_data;
-  update_updated_label (data);
-  return TRUE; /* keep timeout around */
+  return (sums[end] - sums[begin]) / (end - begin);
 }
 
-/* ---------------------------------------------------------------------------------------------------- */
+/* the sum of squared differences from the mean */
+static gdouble
+get_segment_cost (const gdouble *sums,
+                  const gdouble *sums_sq,
+                  guint          begin,
+                  guint          end)
+{
+  gdouble sum = sums[end] - sums[begin];
+  return (sums_sq[end] - sums_sq[begin]) - sum * sum / (end - begin);
+}
+
+/* Splits samples [begin, end) in two where a single step fits them
+ * best and, if that step is a cliff, does the same for each half.
+ * Otherwise the samples are one segment.
+ */
+static void
+find_segments (const gdouble *sums,
+               const gdouble *sums_sq,
+               guint          begin,
+               guint          end,
+               GArray        *segments)
+{
+  BMSegment segment;
+  gdouble best_cost = G_MAXDOUBLE;
+  guint best_split = 0;
+  guint n;
+
+  for (n = begin + SUSTAINED_WRITE_MIN_SEGMENT; n + SUSTAINED_WRITE_MIN_SEGMENT <= end; n++)
+    {
+      gdouble cost;
+      cost = get_segment_cost (sums, sums_sq, begin, n) + get_segment_cost (sums, sums_sq, n, end);
+      if (cost < best_cost)
+        {
+          best_cost = cost;
+          best_split = n;
+        }
+    }
+
+  if (best_split > 0 &&
+      get_segment_mean (sums, best_split, end) <= SUSTAINED_WRITE_CLIFF_RATIO * get_segment_mean (sums, begin, best_split))
+    {
+      find_segments (sums, sums_sq, begin, best_split, segments);
+      find_segments (sums, sums_sq, best_split, end, segments);
+    }
+  else
+    {
+      segment.begin = begin;
+      segment.end = end;
+      segment.mean = get_segment_mean (sums, begin, end);
+      g_array_append_val (segments, segment);
+    }
+}
+
+/* Divides the sustained write test at the cliffs in the write rate,
+ * e.g. when an SSD's SLC cache is full or the drive starts to throttle
+ * because it is too hot, and returns the segments in order - the last
+ * one is the sustained write rate.
+ *
+ * Must hold bm_lock. Free with g_array_unref().
+ */
+static GArray *
+get_sustained_write_segments (DialogData *data)
+{
+  GArray *ret;
+  GArray *samples = data->bm_sustained_write_samples;
+  gdouble *sums;
+  gdouble *sums_sq;
+  guint n;
+
+  ret = g_array_new (FALSE, FALSE, sizeof (BMSegment));
+  if (samples->len == 0)
+    goto out;
+
+  /* so the cost of any segment can be computed in constant time */
+  sums = g_new0 (gdouble, samples->len + 1);
+  sums_sq = g_new0 (gdouble, samples->len + 1);
+  for (n = 0; n < samples->len; n++)
+    {
+      gdouble value = g_array_index (samples, GduBenchmarkSample, n).value;
+      sums[n + 1] = sums[n] + value;
+      sums_sq[n + 1] = sums_sq[n] + value * value;
+    }
+  find_segments (sums, sums_sq, 0, samples->len, ret);
+  g_free (sums_sq);
+  g_free (sums);
+
+ out:
+  return ret;
+}
+
+/* micro-seconds spent writing before the @n'th window of the sustained write test */
+static guint64
+get_sustained_write_window_start (DialogData *data,
+                                  guint       n)
+{
+  if (n == 0)
+    return 0;
+  return g_array_index (data->bm_sustained_write_samples, GduBenchmarkSample, n - 1).offset;
+}
+
+static gboolean
+on_sustained_write_drawing_area_draw (GtkWidget      *widget,
+                                      cairo_t        *cr,
+                                      gpointer        user_data)
+{
+  DialogData *data = user_data;
+  GArray *samples = data->bm_sustained_write_samples;
+  GArray *segments = NULL;
+  GtkAllocation allocation;
+  gdouble gx, gy, gw, gh;
+  gdouble x, y;
+  gdouble max_speed = 0.0;
+  gdouble max_visible_speed;
+  gdouble max_sec;
+  gdouble max_visible_sec;
+  gchar **x_markers;
+  gchar **y_left_markers;
+  guint num_x_markers;
+  guint num_y_markers;
+  GPtrArray *p;
+  guint n;
+
+  G_LOCK (bm_lock);
+
+  get_max_min_avg (samples, &max_speed, NULL, NULL);
+  if (max_speed == 0)
+    max_speed = 100 * 1000 * 1000;
+  if (samples->len > 0)
+    max_sec = ((gdouble) g_array_index (samples, GduBenchmarkSample, samples->len - 1).offset) / G_USEC_PER_SEC;
+  else
+    max_sec = 60.0;
+
+  num_x_markers = 10;
+  num_y_markers = 10;
+  max_visible_speed = gdu_benchmark_graph_round_up_for_markers (max_speed, num_y_markers);
+  max_visible_sec = gdu_benchmark_graph_round_up_for_markers (max_sec, num_x_markers);
+
+  p = g_ptr_array_new ();
+  for (n = 0; n <= num_y_markers; n++)
+    {
+      /* Translators: This is used in the benchmark graph - %d is megabytes per second */
+      g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "%d MB/s"),
+                                           (gint) (n * max_visible_speed / num_y_markers / (1000 * 1000))));
+    }
+  g_ptr_array_add (p, NULL);
+  y_left_markers = (gchar **) g_ptr_array_free (p, FALSE);
+
+  p = g_ptr_array_new ();
+  for (n = 0; n <= num_x_markers; n++)
+    {
+      /* Translators: This is used in the benchmark graph - %g is number of seconds */
+      g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "%g s"), n * max_visible_sec / num_x_markers));
+    }
+  g_ptr_array_add (p, NULL);
+  x_markers = (gchar **) g_ptr_array_free (p, FALSE);
+
+  gtk_widget_get_allocation (widget, &allocation);
+  gdu_benchmark_graph_draw_frame (cr,
+                                  allocation.width,
+                                  allocation.height,
+                                  x_markers,
+                                  y_left_markers,
+                                  NULL,
+                                  &gx, &gy, &gw, &gh);
+
+  /* draw write rate over time ... */
+  cairo_set_source_rgb (cr, 1.0, 0.5, 0.5);
+  cairo_set_line_width (cr, 1.5);
+  for (n = 0; n < samples->len; n++)
+    {
+      GduBenchmarkSample *sample = &g_array_index (samples, GduBenchmarkSample, n);
+
+      x = gx + gw * sample->offset / (max_visible_sec * G_USEC_PER_SEC);
+      y = gy + gh - gh * sample->value / max_visible_speed;
+
+      if (n == 0)
+        cairo_move_to (cr, x, y);
+      else
+        cairo_line_to (cr, x, y);
+    }
+  cairo_stroke (cr);
+
+  /* ... the average between cliffs ... */
+  segments = get_sustained_write_segments (data);
+  cairo_set_source_rgb (cr, 0.6, 0.2, 0.2);
+  cairo_set_line_width (cr, 1.0);
+  for (n = 0; n < segments->len; n++)
+    {
+      BMSegment *segment = &g_array_index (segments, BMSegment, n);
+      gdouble x2;
+
+      x = gx + gw * get_sustained_write_window_start (data, segment->begin) / (max_visible_sec * G_USEC_PER_SEC);
+      x2 = gx + gw * get_sustained_write_window_start (data, segment->end) / (max_visible_sec * G_USEC_PER_SEC);
+      y = ceil (gy + gh - gh * segment->mean / max_visible_speed) + 0.5;
+      cairo_move_to (cr, x, y);
+      cairo_line_to (cr, x2, y);
+      cairo_stroke (cr);
+    }
+
+  /* ... and the cliffs */
+  for (n = 1; n < segments->len; n++)
+    {
+      BMSegment *segment = &g_array_index (segments, BMSegment, n);
+      gdouble dashes[] = {3.0, 3.0};
+
+      x = gx + gw * get_sustained_write_window_start (data, segment->begin) / (max_visible_sec * G_USEC_PER_SEC);
+      x = ceil (x) + 0.5;
+      cairo_set_source_rgba (cr, 0, 0, 0, 0.5);
+      cairo_set_dash (cr, dashes, G_N_ELEMENTS (dashes), 0.0);
+      cairo_move_to (cr, x, gy);
+      cairo_line_to (cr, x, gy + gh);
+      cairo_stroke (cr);
+      cairo_set_dash (cr, NULL, 0, 0.0);
+    }
+
+  g_array_unref (segments);
+  g_strfreev (x_markers);
+  g_strfreev (y_left_markers);
+
+  G_UNLOCK (bm_lock);
+
+  /* propagate event further */
+  return FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Returns how big a partition at the start of the device can be while
+ * keeping the 99th percentile access time under the
+ * target, interpolating between the strokes measured and rounded down
+ * to a MiB. That's the whole device if no stroke is over the target
+ * and 0 if even the shortest one is. Must hold bm_lock.
+ */
+static guint64
+get_recommended_stroke (DialogData *data)
+{
+  GArray *samples = data->bm_seek_stroke_samples;
+  GduBenchmarkSample *prev;
+  GduBenchmarkSample *sample = NULL;
+  gdouble stroke;
+  guint n;
+
+  for (n = 0; n < samples->len; n++)
+    {
+      sample = &g_array_index (samples, GduBenchmarkSample, n);
+      if (sample->value > data->bm_seek_profile_target)
+        break;
+    }
+  if (n == samples->len)
+    return data->bm_size;
+  if (n == 0)
+    return 0;
+
+  prev = &g_array_index (samples, GduBenchmarkSample, n - 1);
+  stroke = prev->offset + (sample->offset - prev->offset) *
+    (data->bm_seek_profile_target - prev->value) / (sample->value - prev->value);
+  return ((guint64) stroke) & ~((guint64) 1024 * 1024 - 1);
+}
+
+static gboolean
+on_seek_profile_drawing_area_draw (GtkWidget      *widget,
+                                   cairo_t        *cr,
+                                   gpointer        user_data)
+{
+  DialogData *data = user_data;
+  struct {
+    GArray *samples;
+    const gchar *label;
+    gdouble red, green, blue;
+  } series[2];
+  GtkAllocation allocation;
+  gdouble gx, gy, gw, gh;
+  gdouble x, y;
+  gdouble max_msec = 0.0;
+  gdouble max_visible_msec;
+  gchar **x_markers;
+  gchar **y_left_markers;
+  guint num_x_markers;
+  guint num_y_markers;
+  gdouble dashes[] = {3.0, 3.0};
+  GPtrArray *p;
+  guint m;
+  guint n;
+
+  G_LOCK (bm_lock);
+
+  series[0].samples = data->bm_seek_distance_samples;
+  /* Translators: Used in the legend of the seek profile graph, for the median access time
+   * plotted over the distance between two reads
+   */
+  series[0].label = C_("benchmark-seek-profile", "Median by seek distance");
+  series[0].red = 0.4;
+  series[0].green = 0.8;
+  series[0].blue = 0.4;
+  series[1].samples = data->bm_seek_stroke_samples;
+  /* Translators: Used in the legend of the seek profile graph, for the 99th percentile
+   * access time of random reads plotted over how much of the disk they are spread over
+   */
+  series[1].label = C_("benchmark-seek-profile", "99th percentile by stroke");
+  series[1].red = 0.5;
+  series[1].green = 0.5;
+  series[1].blue = 1.0;
+
+  for (m = 0; m < G_N_ELEMENTS (series); m++)
+    {
+      gdouble max = 0.0;
+      get_max_min_avg (series[m].samples, &max, NULL, NULL);
+      max_msec = MAX (max_msec, max * 1000.0);
+    }
+  max_msec = MAX (max_msec, data->bm_seek_profile_target * 1000.0);
+  if (max_msec == 0.0)
+    max_msec = 20.0;
+
+  num_x_markers = 10;
+  num_y_markers = 10;
+  max_visible_msec = gdu_benchmark_graph_round_up_for_markers (max_msec, num_y_markers);
+
+  p = g_ptr_array_new ();
+  for (n = 0; n <= num_y_markers; n++)
+    {
+      /* Translators: This is used in the benchmark graph - %g is number of milliseconds */
+      g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "%3g ms"), n * max_visible_msec / num_y_markers));
+    }
+  g_ptr_array_add (p, NULL);
+  y_left_markers = (gchar **) g_ptr_array_free (p, FALSE);
+
+  p = g_ptr_array_new ();
+  for (n = 0; n <= num_x_markers; n++)
+    g_ptr_array_add (p, g_strdup_printf ("%u%%", n * 100 / num_x_markers));
+  g_ptr_array_add (p, NULL);
+  x_markers = (gchar **) g_ptr_array_free (p, FALSE);
+
+  gtk_widget_get_allocation (widget, &allocation);
+  gdu_benchmark_graph_draw_frame (cr,
+                                  allocation.width,
+                                  allocation.height,
+                                  x_markers,
+                                  y_left_markers,
+                                  NULL,
+                                  &gx, &gy, &gw, &gh);
+
+  if (data->bm_size == 0 || data->bm_seek_distance_samples->len == 0)
+    goto out;
+
+  /* the access time over how far apart the reads are or how far they are spread ... */
+  cairo_set_line_width (cr, 1.5);
+  for (m = 0; m < G_N_ELEMENTS (series); m++)
+    {
+      cairo_set_source_rgb (cr, series[m].red, series[m].green, series[m].blue);
+      for (n = 0; n < series[m].samples->len; n++)
+        {
+          GduBenchmarkSample *sample = &g_array_index (series[m].samples, GduBenchmarkSample, n);
+
+          x = gx + gw * sample->offset / data->bm_size;
+          y = gy + gh - gh * sample->value * 1000.0 / max_visible_msec;
+          if (n == 0)
+            cairo_move_to (cr, x, y);
+          else
+            cairo_line_to (cr, x, y);
+        }
+      cairo_stroke (cr);
+    }
+
+  /* ... the target ... */
+  cairo_set_line_width (cr, 1.0);
+  cairo_set_source_rgba (cr, 0, 0, 0, 0.5);
+  cairo_set_dash (cr, dashes, G_N_ELEMENTS (dashes), 0.0);
+  y = ceil (gy + gh - gh * data->bm_seek_profile_target * 1000.0 / max_visible_msec) + 0.5;
+  cairo_move_to (cr, gx, y);
+  cairo_line_to (cr, gx + gw, y);
+  cairo_stroke (cr);
+
+  /* ... and the recommended partition size */
+  if (data->bm_seek_stroke_samples->len > 0)
+    {
+      x = ceil (gx + gw * get_recommended_stroke (data) / data->bm_size) + 0.5;
+      cairo_move_to (cr, x, gy);
+      cairo_line_to (cr, x, gy + gh);
+      cairo_stroke (cr);
+    }
+  cairo_set_dash (cr, NULL, 0, 0.0);
+
+  /* legend */
+  for (m = 0; m < G_N_ELEMENTS (series); m++)
+    {
+      y = gy + 8 + m * 12;
+      cairo_set_source_rgb (cr, series[m].red, series[m].green, series[m].blue);
+      cairo_rectangle (cr, gx + 8, y, 8, 8);
+      cairo_fill (cr);
+      cairo_set_source_rgb (cr, 0, 0, 0);
+      cairo_move_to (cr, gx + 20, y + 8);
+      cairo_show_text (cr, series[m].label);
+    }
+
+ out:
+  g_strfreev (x_markers);
+  g_strfreev (y_left_markers);
+
+  G_UNLOCK (bm_lock);
+
+  /* propagate event further */
+  return FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+on_transfer_size_drawing_area_draw (GtkWidget      *widget,
+                                    cairo_t        *cr,
+                                    gpointer        user_data)
+{
+  DialogData *data = user_data;
+  struct {
+    GArray *samples;
+    const gchar *label;
+    gdouble red, green, blue;
+  } series[2];
+  GtkAllocation allocation;
+  gdouble gx, gy, gw, gh;
+  gdouble x, y;
+  gdouble max_speed = 0.0;
+  gdouble max_visible_speed;
+  gchar **x_markers;
+  gchar **y_left_markers;
+  guint num_y_markers;
+  gdouble dashes[] = {3.0, 3.0};
+  GPtrArray *p;
+  guint m;
+  guint n;
+
+  G_LOCK (bm_lock);
+
+  series[0].samples = data->bm_transfer_size_read_samples;
+  /* Translators: Used in the legend of the transfer size graph */
+  series[0].label = C_("benchmark-transfer-size", "Read");
+  series[0].red = 0.5;
+  series[0].green = 0.5;
+  series[0].blue = 1.0;
+  series[1].samples = data->bm_transfer_size_write_samples;
+  /* Translators: Used in the legend of the transfer size graph */
+  series[1].label = C_("benchmark-transfer-size", "Write");
+  series[1].red = 1.0;
+  series[1].green = 0.5;
+  series[1].blue = 0.5;
+
+  for (m = 0; m < G_N_ELEMENTS (series); m++)
+    {
+      gdouble max = 0.0;
+      get_max_min_avg (series[m].samples, &max, NULL, NULL);
+      max_speed = MAX (max_speed, max);
+    }
+  if (max_speed == 0)
+    max_speed = 100 * 1000 * 1000;
+
+  num_y_markers = 10;
+  max_visible_speed = gdu_benchmark_graph_round_up_for_markers (max_speed, num_y_markers);
+
+  p = g_ptr_array_new ();
+  for (n = 0; n <= num_y_markers; n++)
+    {
+      /* Translators: This is used in the benchmark graph - %d is megabytes per second */
+      g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "%d MB/s"),
+                                           (gint) (n * max_visible_speed / num_y_markers / (1000 * 1000))));
+    }
+  g_ptr_array_add (p, NULL);
+  y_left_markers = (gchar **) g_ptr_array_free (p, FALSE);
+
+  /* one marker per request size, which doubles every step */
+  p = g_ptr_array_new ();
+  for (n = 0; n < GDU_BENCHMARK_TRANSFER_SIZE_NUM_STEPS; n++)
+    {
+      guint64 size = ((guint64) GDU_BENCHMARK_TRANSFER_SIZE_MIN) << n;
+      if (size < 1024 * 1024)
+        {
+          /* Translators: This is used in the benchmark graph - %u is the request size in KiB */
+          g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "%u KiB"), (guint) (size / 1024)));
+        }
+      else
+        {
+          /* Translators: This is used in the benchmark graph - %u is the request size in MiB */
+          g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "%u MiB"), (guint) (size / (1024 * 1024))));
+        }
+    }
+  g_ptr_array_add (p, NULL);
+  x_markers = (gchar **) g_ptr_array_free (p, FALSE);
+
+  gtk_widget_get_allocation (widget, &allocation);
+  gdu_benchmark_graph_draw_frame (cr,
+                                  allocation.width,
+                                  allocation.height,
+                                  x_markers,
+                                  y_left_markers,
+                                  NULL,
+                                  &gx, &gy, &gw, &gh);
+
+  if (data->bm_transfer_size_read_samples->len == 0)
+    goto out;
+
+  /* the transfer rate over the request size ... */
+  for (m = 0; m < G_N_ELEMENTS (series); m++)
+    {
+      cairo_set_source_rgb (cr, series[m].red, series[m].green, series[m].blue);
+      cairo_set_line_width (cr, 1.5);
+      for (n = 0; n < series[m].samples->len; n++)
+        {
+          GduBenchmarkSample *sample = &g_array_index (series[m].samples, GduBenchmarkSample, n);
+
+          x = gx + gw * log2 (((gdouble) sample->offset) / GDU_BENCHMARK_TRANSFER_SIZE_MIN)
+            / (GDU_BENCHMARK_TRANSFER_SIZE_NUM_STEPS - 1);
+          y = gy + gh - gh * sample->value / max_visible_speed;
+          if (n == 0)
+            cairo_move_to (cr, x, y);
+          else
+            cairo_line_to (cr, x, y);
+        }
+      cairo_stroke (cr);
+
+      /* ... and its knee */
+      if (series[m].samples->len > 0)
+        {
+          guint64 knee = gdu_benchmark_get_transfer_size_knee (series[m].samples);
+
+          x = gx + gw * log2 (((gdouble) knee) / GDU_BENCHMARK_TRANSFER_SIZE_MIN)
+            / (GDU_BENCHMARK_TRANSFER_SIZE_NUM_STEPS - 1);
+          x = ceil (x) + 0.5;
+          cairo_set_line_width (cr, 1.0);
+          cairo_set_dash (cr, dashes, G_N_ELEMENTS (dashes), 0.0);
+          cairo_move_to (cr, x, gy);
+          cairo_line_to (cr, x, gy + gh);
+          cairo_stroke (cr);
+          cairo_set_dash (cr, NULL, 0, 0.0);
+        }
+    }
+
+  /* legend */
+  for (m = 0; m < G_N_ELEMENTS (series); m++)
+    {
+      if (series[m].samples->len == 0)
+        continue;
+      y = gy + 8 + m * 12;
+      cairo_set_source_rgb (cr, series[m].red, series[m].green, series[m].blue);
+      cairo_rectangle (cr, gx + 8, y, 8, 8);
+      cairo_fill (cr);
+      cairo_set_source_rgb (cr, 0, 0, 0);
+      cairo_move_to (cr, gx + 20, y + 8);
+      cairo_show_text (cr, series[m].label);
+    }
+
+ out:
+  g_strfreev (x_markers);
+  g_strfreev (y_left_markers);
+
+  G_UNLOCK (bm_lock);
+
+  /* propagate event further */
+  return FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Formats the number of samples, together with the confidence
+ * interval from gdu_benchmark_get_confidence_interval() if there is one
+ */
+static gchar *
+format_num_samples (guint   num_samples,
+                    gdouble confidence_interval)
+{
+  gchar *ret = NULL;
+  gchar *s;
+
+  s = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                    "%d sample",
+                                    "%d samples",
+                                    num_samples),
+                       num_samples);
+  if (confidence_interval > 0.0)
+    {
+      /* Translators: Used for the 95% confidence interval of a result in the benchmark dialog.
+       * The %.1f is how far the real average may be from the measured one, in percent, and
+       * the %s is the number of samples (e.g. "100 samples").
+       */
+      ret = g_strdup_printf (C_("benchmark-confidence-interval", "±%.1f%%, %s"),
+                             confidence_interval * 100.0, s);
+      g_free (s);
+    }
+  else
+    {
+      ret = s;
+    }
+  return ret;
+}
+
+static gchar *
+format_transfer_rate_and_num_samples (gdouble bytes_per_sec,
+                                      guint   num_samples,
+                                      gdouble confidence_interval)
+{
+  gchar *ret = NULL;
+  gchar *s;
+  gchar *s2;
+
+  s = gdu_benchmark_format_transfer_rate (bytes_per_sec);
+  s2 = format_num_samples (num_samples, confidence_interval);
+  ret = g_strdup_printf ("%s <small>(%s)</small>", s, s2);
+  g_free (s2);
+  g_free (s);
+  return ret;
+}
+
+/* Sums up the queue depth samples as the best sequential transfer rate
+ * and the best random IOPS together with the queue depths they were
+ * achieved at.
+ */
+static gchar *
+format_queue_depth_scaling (DialogData *data)
+{
+  gchar *ret = NULL;
+  GduBenchmarkSample *best_sequential = NULL;
+  GduBenchmarkSample *best_random = NULL;
+  gchar *s;
+  gchar *s2;
+  guint n;
+
+  G_LOCK (bm_lock);
+  for (n = 0; n < data->bm_sequential_queue_depth_samples->len; n++)
+    {
+      GduBenchmarkSample *sample = &g_array_index (data->bm_sequential_queue_depth_samples, GduBenchmarkSample, n);
+      if (best_sequential == NULL || sample->value > best_sequential->value)
+        best_sequential = sample;
+    }
+  for (n = 0; n < data->bm_random_queue_depth_samples->len; n++)
+    {
+      GduBenchmarkSample *sample = &g_array_index (data->bm_random_queue_depth_samples, GduBenchmarkSample, n);
+      if (best_random == NULL || sample->value > best_random->value)
+        best_random = sample;
+    }
+
+  if (best_sequential == NULL || best_random == NULL || data->bm_random_queue_depth_block_size == 0)
+    {
+      ret = g_strdup ("–");
+      goto out;
+    }
+
+  s = gdu_benchmark_format_transfer_rate (best_sequential->value);
+  s2 = g_strdup_printf ("%.0f", best_random->value / data->bm_random_queue_depth_block_size);
+  /* Translators: Used to sum up how the device scales with queue depth.
+   * The first %s is the best sequential transfer rate (e.g. "1.2 GB/s") and the first %u the
+   * queue depth it was measured at. The second %s is the best number of random I/O
+   * operations per second (e.g. "95000") and the second %u the queue depth it was measured at.
+   */
+  ret = g_strdup_printf (C_("benchmark-queue-depth", "%s sequential at QD %u, %s IOPS random at QD %u"),
+                         s, (guint) best_sequential->offset,
+                         s2, (guint) best_random->offset);
+  g_free (s2);
+  g_free (s);
+
+ out:
+  G_UNLOCK (bm_lock);
+  return ret;
+}
+
+static gboolean
+profile_should_run (DialogData *data,
+                    guint       n)
+{
+  return profiles[n].write_percentage == 0 || data->bm_do_write;
+}
+
+static guint
+get_num_profiles_to_run (DialogData *data)
+{
+  guint ret = 0;
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (profiles); n++)
+    {
+      if (profile_should_run (data, n))
+        ret++;
+    }
+  return ret;
+}
+
+static gchar *
+format_access_time (guint64 usec)
+{
+  /* Translators: %d is number of milliseconds and msec means "milli-second" */
+  return g_strdup_printf (C_("benchmark-access-time", "%.2f msec"), usec / 1000.0);
+}
+
+static gchar *
+format_access_time_percentiles (DialogData *data)
+{
+  GString *str;
+  gchar *s;
+  guint n;
+
+  str = g_string_new (NULL);
+  G_LOCK (bm_lock);
+  if (gdu_histogram_get_count (data->bm_access_time_histogram) == 0)
+    {
+      g_string_append (str, "–");
+      goto out;
+    }
+
+  for (n = 0; n < G_N_ELEMENTS (access_time_percentiles); n++)
+    {
+      s = format_access_time (gdu_histogram_get_value_at_percentile (data->bm_access_time_histogram,
+                                                                     access_time_percentiles[n]));
+      /* Translators: Used for the access time percentiles in the benchmark dialog.
+       * %g is the percentile (e.g. 99.9) and %s the access time (e.g. "0.25 msec")
+       */
+      g_string_append_printf (str, C_("benchmark-access-time", "p%g: %s"), access_time_percentiles[n], s);
+      g_string_append (str, ", ");
+      g_free (s);
+    }
+  s = format_access_time (gdu_histogram_get_max (data->bm_access_time_histogram));
+  /* Translators: Used for the access time percentiles in the benchmark dialog.
+   * %s is the longest access time measured (e.g. "12.50 msec")
+   */
+  g_string_append_printf (str, C_("benchmark-access-time", "max: %s"), s);
+  g_free (s);
+
+ out:
+  G_UNLOCK (bm_lock);
+  return g_string_free (str, FALSE);
+}
+
+/* The write rate until the first cliff, if any, and after the last one */
+static gchar *
+format_sustained_write (DialogData *data)
+{
+  GArray *segments = NULL;
+  BMSegment *first;
+  BMSegment *last;
+  gchar *ret = NULL;
+  gchar *s;
+
+  G_LOCK (bm_lock);
+  if (data->bm_sustained_write_samples->len == 0)
+    {
+      ret = g_strdup ("–");
+      goto out;
+    }
+
+  segments = get_sustained_write_segments (data);
+  first = &g_array_index (segments, BMSegment, 0);
+  last = &g_array_index (segments, BMSegment, segments->len - 1);
+
+  s = gdu_benchmark_format_transfer_rate (last->mean);
+  if (segments->len == 1)
+    {
+      /* Translators: Used for the sustained write test in the benchmark dialog when
+       * the write rate never dropped. The %s is the write rate, e.g. "450 MB/s"
+       */
+      ret = g_strdup_printf (C_("benchmark-sustained-write", "%s sustained, no drop detected"), s);
+    }
+  else
+    {
+      gdouble num_bytes = 0.0;
+      gchar *s2;
+      gchar *s3;
+      gchar *s4;
+      guint n;
+
+      for (n = first->begin; n < first->end; n++)
+        {
+          GduBenchmarkSample *sample = &g_array_index (data->bm_sustained_write_samples, GduBenchmarkSample, n);
+          num_bytes += sample->value * (sample->offset - get_sustained_write_window_start (data, n)) / G_USEC_PER_SEC;
+        }
+
+      s2 = gdu_benchmark_format_transfer_rate (first->mean);
+      s3 = gdu_utils_format_duration_usec (get_sustained_write_window_start (data, first->end),
+                                           GDU_FORMAT_DURATION_FLAGS_NONE);
+      s4 = g_format_size ((guint64) num_bytes);
+      /* Translators: Used for the sustained write test in the benchmark dialog when
+       * the write rate dropped. The first %s is the write rate before that (e.g. "1.2 GB/s"),
+       * the second %s is for how long (e.g. "42 seconds"), the third %s is how much was
+       * written before it dropped (e.g. "50.4 GB") and the fourth %s is the write rate at
+       * the end of the test (e.g. "450 MB/s").
+       */
+      ret = g_strdup_printf (C_("benchmark-sustained-write", "%s for %s (%s written), then %s sustained"),
+                             s2, s3, s4, s);
+      g_free (s4);
+      g_free (s3);
+      g_free (s2);
+
+      if (segments->len > 2)
+        {
+          gchar *s5;
+          s2 = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                             "%d drop",
+                                             "%d drops",
+                                             segments->len - 1),
+                                segments->len - 1);
+          s5 = g_strdup_printf ("%s <small>(%s)</small>", ret, s2);
+          g_free (s2);
+          g_free (ret);
+          ret = s5;
+        }
+    }
+  g_free (s);
+
+ out:
+  G_UNLOCK (bm_lock);
+  if (segments != NULL)
+    g_array_unref (segments);
+  return ret;
+}
+
+/* The access time for short and full-stroke seeks and how big a
+ * partition at the start of the device can be for the target
+ */
+static gchar *
+format_seek_profile (DialogData *data)
+{
+  GString *str;
+  guint64 stroke;
+  gchar *s;
+  gchar *s2;
+  gchar *s3;
+
+  str = g_string_new (NULL);
+  G_LOCK (bm_lock);
+  if (data->bm_seek_distance_samples->len == 0 || data->bm_seek_stroke_samples->len == 0)
+    {
+      g_string_append (str, "–");
+      goto out;
+    }
+
+  s = format_access_time (g_array_index (data->bm_seek_distance_samples, GduBenchmarkSample, 0).value * G_USEC_PER_SEC);
+  s2 = format_access_time (g_array_index (data->bm_seek_distance_samples, GduBenchmarkSample,
+                                          data->bm_seek_distance_samples->len - 1).value * G_USEC_PER_SEC);
+  /* Translators: Used for the seek profile in the benchmark dialog. The first %s is the
+   * median access time for the shortest seeks measured (e.g. "1.20 msec") and the second
+   * %s the one for seeks across the whole disk (e.g. "18.50 msec").
+   */
+  g_string_append_printf (str, C_("benchmark-seek-profile", "%s for short seeks, %s for full-stroke seeks"), s, s2);
+  g_string_append_c (str, '\n');
+  g_free (s2);
+  g_free (s);
+
+  s = format_access_time (data->bm_seek_profile_target * G_USEC_PER_SEC);
+  stroke = get_recommended_stroke (data);
+  if (stroke >= data->bm_size)
+    {
+      /* Translators: Used for the seek profile in the benchmark dialog when the target
+       * is met everywhere. The %s is the target access time (e.g. "20.00 msec").
+       */
+      g_string_append_printf (str, C_("benchmark-seek-profile",
+                                      "The whole disk keeps the 99th percentile under %s"), s);
+    }
+  else if (stroke == 0)
+    {
+      /* Translators: Used for the seek profile in the benchmark dialog when the target
+       * can't be met. The %s is the target access time (e.g. "5.00 msec").
+       */
+      g_string_append_printf (str, C_("benchmark-seek-profile",
+                                      "Even the shortest stroke measured is over %s at the 99th percentile"), s);
+    }
+  else
+    {
+      s2 = g_format_size (stroke);
+      s3 = g_strdup_printf ("%.0f", 100.0 * stroke / data->bm_size);
+      /* Translators: Used for the seek profile in the benchmark dialog to recommend a
+       * partition size. The first %s is the size (e.g. "1.2 TB"), the second %s how much
+       * of the disk that is in percent (e.g. "30") and the third %s the target access
+       * time (e.g. "20.00 msec").
+       */
+      g_string_append_printf (str, C_("benchmark-seek-profile",
+                                      "Partitions within the first %s (%s%% of the disk) keep the 99th percentile under %s"),
+                              s2, s3, s);
+      g_free (s3);
+      g_free (s2);
+    }
+  g_free (s);
+
+ out:
+  G_UNLOCK (bm_lock);
+  return g_string_free (str, FALSE);
+}
+
+/* The knees of the transfer size sweep with the transfer rate at them */
+static gchar *
+format_transfer_size (DialogData *data)
+{
+  GString *str;
+  GArray *samples[2];
+  guint n;
+
+  str = g_string_new (NULL);
+  G_LOCK (bm_lock);
+  if (data->bm_transfer_size_read_samples->len == 0)
+    {
+      g_string_append (str, "–");
+      goto out;
+    }
+
+  samples[0] = data->bm_transfer_size_read_samples;
+  samples[1] = data->bm_transfer_size_write_samples;
+  for (n = 0; n < G_N_ELEMENTS (samples); n++)
+    {
+      guint64 knee;
+      gdouble rate = 0.0;
+      gchar *s;
+      gchar *s2;
+      guint m;
+
+      if (samples[n]->len == 0)
+        continue;
+
+      knee = gdu_benchmark_get_transfer_size_knee (samples[n]);
+      for (m = 0; m < samples[n]->len; m++)
+        {
+          GduBenchmarkSample *sample = &g_array_index (samples[n], GduBenchmarkSample, m);
+          if (sample->offset == knee)
+            rate = sample->value;
+        }
+
+      s = g_format_size_full (knee, G_FORMAT_SIZE_IEC_UNITS);
+      s2 = gdu_benchmark_format_transfer_rate (rate);
+      if (n > 0)
+        g_string_append_c (str, '\n');
+      if (n == 0)
+        {
+          /* Translators: Used for the transfer size sweep in the benchmark dialog. The first %s
+           * is the smallest request size reaching 90% of the best read rate (e.g. "512.0 KiB")
+           * and the second %s the read rate at that size (e.g. "1.2 GB/s").
+           */
+          g_string_append_printf (str, C_("benchmark-transfer-size", "Reads reach full speed at %s (%s)"), s, s2);
+        }
+      else
+        {
+          /* Translators: Used for the transfer size sweep in the benchmark dialog. The first %s
+           * is the smallest request size reaching 90% of the best write rate (e.g. "1.0 MiB")
+           * and the second %s the write rate at that size (e.g. "900.0 MB/s").
+           */
+          g_string_append_printf (str, C_("benchmark-transfer-size", "Writes reach full speed at %s (%s)"), s, s2);
+        }
+      g_free (s2);
+      g_free (s);
+    }
+
+ out:
+  G_UNLOCK (bm_lock);
+  return g_string_free (str, FALSE);
+}
+
+/* One line per measured workload profile with its IOPS and transfer rate */
+static gchar *
+format_profiles (DialogData *data)
+{
+  GString *str;
+  guint n;
+
+  str = g_string_new (NULL);
+  G_LOCK (bm_lock);
+  for (n = 0; n < data->bm_profile_rate_samples->len && n < data->bm_profile_iops_samples->len; n++)
+    {
+      GduBenchmarkSample *rate_sample = &g_array_index (data->bm_profile_rate_samples, GduBenchmarkSample, n);
+      GduBenchmarkSample *iops_sample = &g_array_index (data->bm_profile_iops_samples, GduBenchmarkSample, n);
+      gchar *s;
+
+      if (rate_sample->offset >= G_N_ELEMENTS (profiles))
+        continue;
+
+      if (str->len > 0)
+        g_string_append_c (str, '\n');
+      s = gdu_benchmark_format_transfer_rate (rate_sample->value);
+      /* Translators: Used for the result of a workload profile in the benchmark dialog.
+       * The first %s is the name of the profile (e.g. "4K Random Read"), %.0f is the number
+       * of I/O operations per second and the last %s is the transfer rate (e.g. "371 MB/s").
+       */
+      g_string_append_printf (str, C_("benchmark-profile", "%s: %.0f IOPS, %s"),
+                              g_dpgettext2 (NULL, "benchmark-profile", profiles[rate_sample->offset].name),
+                              iops_sample->value,
+                              s);
+      g_free (s);
+    }
+  G_UNLOCK (bm_lock);
+
+  if (str->len == 0)
+    g_string_append (str, "–");
+  return g_string_free (str, FALSE);
+}
+
+/* One line per filesystem workload with its IOPS and transfer rate */
+static gchar *
+format_filesystem (DialogData *data)
+{
+  GString *str;
+  guint n;
+
+  str = g_string_new (NULL);
+  G_LOCK (bm_lock);
+  for (n = 0; n < data->bm_filesystem_rate_samples->len && n < data->bm_filesystem_iops_samples->len; n++)
+    {
+      GduBenchmarkSample *rate_sample = &g_array_index (data->bm_filesystem_rate_samples, GduBenchmarkSample, n);
+      GduBenchmarkSample *iops_sample = &g_array_index (data->bm_filesystem_iops_samples, GduBenchmarkSample, n);
+      gchar *s;
+
+      if (rate_sample->offset >= G_N_ELEMENTS (filesystem_workloads))
+        continue;
+
+      if (str->len > 0)
+        g_string_append_c (str, '\n');
+      s = gdu_benchmark_format_transfer_rate (rate_sample->value);
+      /* Translators: Used for the result of a filesystem workload in the benchmark dialog.
+       * The first %s is the name of the workload (e.g. "4K Synced Write"), %.0f is the number
+       * of I/O operations per second and the last %s is the transfer rate (e.g. "371 MB/s").
+       */
+      g_string_append_printf (str, C_("benchmark-filesystem", "%s: %.0f IOPS, %s"),
+                              g_dpgettext2 (NULL, "benchmark-filesystem", filesystem_workloads[rate_sample->offset].name),
+                              iops_sample->value,
+                              s);
+      g_free (s);
+    }
+  G_UNLOCK (bm_lock);
+
+  if (str->len == 0)
+    g_string_append (str, "–");
+  return g_string_free (str, FALSE);
+}
+
+/* Returns the rate a RAID array of @level with @num_members members
+ * reads at, at best, if each member reads at @member_rate. Only the
+ * members holding data for a stripe count, e.g. not the parity of
+ * RAID 5, and a single reader of RAID 1 only gets data from one
+ * mirror. Returns 0 if not known for @level.
+ */
+static gdouble
+get_raid_stripe_rate (const gchar *level,
+                      guint        num_members,
+                      gdouble      member_rate)
+{
+  guint num_data_members = 0;
+
+  if (g_strcmp0 (level, "raid0") == 0)
+    num_data_members = num_members;
+  else if (g_strcmp0 (level, "raid1") == 0)
+    num_data_members = MIN (num_members, 1);
+  else if (g_strcmp0 (level, "raid4") == 0 || g_strcmp0 (level, "raid5") == 0)
+    num_data_members = num_members > 1 ? num_members - 1 : 0;
+  else if (g_strcmp0 (level, "raid6") == 0)
+    num_data_members = num_members > 2 ? num_members - 2 : 0;
+  else if (g_strcmp0 (level, "raid10") == 0)
+    num_data_members = num_members / 2; /* assumes two copies of each chunk, the default */
+
+  return num_data_members * member_rate;
+}
+
+/* The measured read rate of the RAID array next to the theoretical
+ * stripe rate given by its slowest member, followed by one line per
+ * member
+ */
+static gchar *
+format_raid_members (DialogData *data)
+{
+  GString *str;
+  GArray *rates;
+  gdouble slowest_rate = 0.0;
+  gdouble median_rate;
+  gdouble read_avg = 0.0;
+  gdouble stripe_rate;
+  gchar *s;
+  gchar *s2;
+  guint n;
+
+  str = g_string_new (NULL);
+  rates = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  G_LOCK (bm_lock);
+  for (n = 0; n < data->bm_raid_members->len; n++)
+    {
+      BMRaidMember *member = data->bm_raid_members->pdata[n];
+      if (member->read_rate > 0.0)
+        {
+          g_array_append_val (rates, member->read_rate);
+          if (slowest_rate == 0.0 || member->read_rate < slowest_rate)
+            slowest_rate = member->read_rate;
+        }
+    }
+  median_rate = gdu_benchmark_get_median_of_doubles (rates);
+  get_max_min_avg (data->bm_read_samples, NULL, NULL, &read_avg);
+
+  stripe_rate = get_raid_stripe_rate (data->bm_raid_level, rates->len, slowest_rate);
+  if (stripe_rate > 0.0 && read_avg > 0.0)
+    {
+      s = gdu_benchmark_format_transfer_rate (read_avg);
+      s2 = gdu_benchmark_format_transfer_rate (stripe_rate);
+      /* Translators: Used for a RAID array in the benchmark dialog. The first %s is the
+       * measured read rate of the array (e.g. "412 MB/s"), the second %s is the rate it
+       * could read at given its slowest member (e.g. "480 MB/s") and %.0f is the first in
+       * percent of the second.
+       */
+      g_string_append_printf (str, C_("benchmark-raid", "Array: %s of a theoretical %s (%.0f%%)"),
+                              s, s2, read_avg * 100.0 / stripe_rate);
+      g_free (s2);
+      g_free (s);
+    }
+
+  for (n = 0; n < data->bm_raid_members->len; n++)
+    {
+      BMRaidMember *member = data->bm_raid_members->pdata[n];
+      gchar *name;
+      gchar *line;
+
+      if (str->len > 0)
+        g_string_append_c (str, '\n');
+
+      name = g_markup_escape_text (member->name, -1);
+      s = member->read_rate > 0.0 ? gdu_benchmark_format_transfer_rate (member->read_rate) : g_strdup ("–");
+      s2 = member->array_read_rate > 0.0 ? gdu_benchmark_format_transfer_rate (member->array_read_rate) : g_strdup ("–");
+      /* Translators: Used for a RAID member in the benchmark dialog. The first %s is the
+       * name of the member (e.g. "/dev/sda1"), the second %s is its read rate when read
+       * from on its own (e.g. "160 MB/s"), the third %s is its read rate while the array
+       * was read from and %.2f is its average latency at the same time in milliseconds.
+       */
+      line = g_strdup_printf (C_("benchmark-raid", "%s: %s on its own, %s at %.2f msec in the array"),
+                              name, s, s2, member->array_access_time * 1000.0);
+      if (median_rate > 0.0 && member->read_rate > 0.0 &&
+          (median_rate - member->read_rate) * 100.0 / median_rate > RAID_MEMBER_SLOW_PERCENT)
+        {
+          /* Translators: Used for a RAID member that is a lot slower than the others.
+           * The %s is the line for the member and %.0f is how many percent slower it is
+           * than the median member, e.g. "23"
+           */
+          g_string_append_printf (str, C_("benchmark-raid", "<b>%s (%.0f%% slower than the median member)</b>"),
+                                  line, (median_rate - member->read_rate) * 100.0 / median_rate);
+        }
+      else
+        {
+          g_string_append (str, line);
+        }
+      g_free (line);
+      g_free (s2);
+      g_free (s);
+      g_free (name);
+    }
+  G_UNLOCK (bm_lock);
+
+  g_array_unref (rates);
+
+  if (str->len == 0)
+    g_string_append (str, "–");
+  return g_string_free (str, FALSE);
+}
+
+static void
+update_updated_label (DialogData *data)
+{
+  gchar *s = NULL;
+
+  G_LOCK (bm_lock);
+  switch (data->bm_state)
+    {
+    case BM_STATE_NONE:
+      if (data->bm_time_benchmarked_usec > 0)
+        {
+          gint64 now_usec;
+          gchar *s2;
+          GDateTime *time_benchmarked_dt;
+          GDateTime *time_benchmarked_dt_local;
+          gchar *time_benchmarked_str;
+
+          now_usec = g_get_real_time ();
+
+          time_benchmarked_dt = g_date_time_new_from_unix_utc (data->bm_time_benchmarked_usec / G_USEC_PER_SEC);
+          time_benchmarked_dt_local = g_date_time_to_local (time_benchmarked_dt);
+          time_benchmarked_str = g_date_time_format (time_benchmarked_dt_local, "%c");
+
+          s = gdu_utils_format_duration_usec ((now_usec - data->bm_time_benchmarked_usec),
+                                              GDU_FORMAT_DURATION_FLAGS_NO_SECONDS);
+          /* Translators: The first %s is the date and time the benchmark took place in the preferred
+           * format for the locale (e.g. "%c" for strftime()/g_date_time_format()), for example
+           * "Tue 12 Jun 2012 03:57:08 PM EDT". The second %s is how long ago that is from right
+           * now, for example "3 days" or "2 hours" or "12 minutes".
+           */
+          s2 = g_strdup_printf (C_("benchmark-updated", "%s (%s ago)"),
+                                time_benchmarked_str,
+                                s);
+          gtk_label_set_text (GTK_LABEL (data->updated_label), s2);
+          g_free (s2);
+          g_free (s);
+          g_free (time_benchmarked_str);
+          g_date_time_unref (time_benchmarked_dt_local);
+          g_date_time_unref (time_benchmarked_dt);
+        }
+      else
+        {
+          gtk_label_set_markup (GTK_LABEL (data->updated_label), C_("benchmark-updated", "No benchmark data available"));
+        }
+      break;
+
+    case BM_STATE_OPENING_DEVICE:
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), C_("benchmark-updated", "Opening Device…"));
+      break;
+
+    case BM_STATE_TRANSFER_RATE:
+      if (data->bm_do_until_stable)
+        s = g_strdup_printf (C_("benchmark-updated", "Measuring transfer rate until stable (pass %u)…"),
+                             data->bm_read_samples->len / data->bm_num_samples + 1);
+      else
+        s = g_strdup_printf (C_("benchmark-updated", "Measuring transfer rate (%2.1f%% complete)…"),
+                             data->bm_read_samples->len * 100.0 / data->bm_num_samples);
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+
+    case BM_STATE_ACCESS_TIME:
+      if (data->bm_do_until_stable)
+        s = g_strdup_printf (C_("benchmark-updated", "Measuring access time until stable (pass %u)…"),
+                             data->bm_access_time_samples->len / data->bm_num_access_samples + 1);
+      else
+        s = g_strdup_printf (C_("benchmark-updated", "Measuring access time (%2.1f%% complete)…"),
+                             data->bm_access_time_samples->len * 100.0 / data->bm_num_access_samples);
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+
+    case BM_STATE_QUEUE_DEPTH:
+      s = g_strdup_printf (C_("benchmark-updated", "Measuring queue depth scaling (%2.1f%% complete)…"),
+                           (data->bm_sequential_queue_depth_samples->len + data->bm_random_queue_depth_samples->len)
+                           * 100.0 / (2 * G_N_ELEMENTS (queue_depths)));
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+
+    case BM_STATE_PROFILES:
+      s = g_strdup_printf (C_("benchmark-updated", "Measuring workload profiles (%2.1f%% complete)…"),
+                           data->bm_profile_rate_samples->len * 100.0 / get_num_profiles_to_run (data));
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+
+    case BM_STATE_FILESYSTEM:
+      s = g_strdup_printf (C_("benchmark-updated", "Measuring filesystem performance (%2.1f%% complete)…"),
+                           data->bm_filesystem_rate_samples->len * 100.0 / G_N_ELEMENTS (filesystem_workloads));
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+
+    case BM_STATE_SUSTAINED_WRITE:
+      s = g_strdup_printf (C_("benchmark-updated", "Measuring sustained write rate (%2.1f%% complete)…"),
+                           data->bm_sustained_write_size > 0 ?
+                           data->bm_sustained_write_num_bytes_done * 100.0 / data->bm_sustained_write_size : 0.0);
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+
+    case BM_STATE_RAID_MEMBERS:
+      s = g_strdup_printf (C_("benchmark-updated", "Measuring RAID members (%2.1f%% complete)…"),
+                           data->bm_raid_members->len > 0 ?
+                           data->bm_raid_num_members_done * 100.0 / data->bm_raid_members->len : 0.0);
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+
+    case BM_STATE_SEEK_PROFILE:
+      s = g_strdup_printf (C_("benchmark-updated", "Measuring seek profile (%2.1f%% complete)…"),
+                           (data->bm_seek_distance_samples->len + data->bm_seek_stroke_samples->len)
+                           * 100.0 / (2 * gdu_benchmark_seek_profile_get_num_steps ()));
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+
+    case BM_STATE_TRANSFER_SIZE:
+      s = g_strdup_printf (C_("benchmark-updated", "Measuring transfer sizes (%2.1f%% complete)…"),
+                           (data->bm_transfer_size_read_samples->len + data->bm_transfer_size_write_samples->len)
+                           * 100.0 / (GDU_BENCHMARK_TRANSFER_SIZE_NUM_STEPS * (data->bm_do_write ? 2 : 1)));
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+    }
+  G_UNLOCK (bm_lock);
+}
+
+/* returns NULL if it doesn't make sense to load/save benchmark data for @block (removable
+ * media, non-drive devices etc.), otherwise the file for it with @extension
+ */
+static gchar *
+get_bm_filename_for_block (UDisksBlock *block,
+                           const gchar *extension)
+{
+  gchar *ret = NULL;
+  gchar *bench_dir = NULL;
+  const gchar *id = NULL;
+
+  id = udisks_block_get_id (block);
+  if (id == NULL || strlen (id) == 0)
+    goto out;
+
+  bench_dir = g_strdup_printf ("%s/gnome-disks/benchmarks", g_get_user_cache_dir ());
+  if (g_mkdir_with_parents (bench_dir, 0777) != 0)
+    {
+      g_warning ("Error creating directory %s: %m", bench_dir);
+      goto out;
+    }
+
+  ret = g_strdup_printf ("%s/%s.%s", bench_dir, id, extension);
+
+ out:
+  g_free (bench_dir);
+  return ret;
+}
+
+static gchar *
+get_bm_filename (DialogData *data)
+{
+  return get_bm_filename_for_block (data->block, "gnome-disks-benchmark");
+}
+
+static void
+update_dialog (DialogData *data)
+{
+  GError *error = NULL;
+  GdkWindow *window = NULL;
+  gdouble read_avg = 0.0;
+  gdouble write_avg = 0.0;
+  gdouble access_time_avg = 0.0;
+  gdouble read_ci;
+  gdouble write_ci;
+  gdouble access_time_ci;
+  gchar *s = NULL;
+  UDisksDrive *drive = NULL;
+  UDisksObjectInfo *info = NULL;
+
+  G_LOCK (bm_lock);
+  if (data->bm_error != NULL)
+    {
+      error = data->bm_error;
+      data->bm_error = NULL;
+    }
+  G_UNLOCK (bm_lock);
+
+  /* first of all, present an error if something went wrong */
+  if (error != NULL)
+    {
+      if (!data->closed)
+        {
+          if (!(error->domain == G_IO_ERROR && error->code == G_IO_ERROR_CANCELLED))
+            gdu_utils_show_error (GTK_WINDOW (data->window), C_("benchmarking", "An error occurred"), error);
+        }
+      g_clear_error (&error);
+
+      /* and reload old data */
+      if (!maybe_load_data (data, &error))
+        {
+          /* not worth complaining in dialog about */
+          g_warning ("Error loading cached data: %s (%s, %d)",
+                     error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+      /* which is the newest run */
+      data->num_runs_in_comboboxes = G_MAXUINT;
+    }
+
+  update_updated_label (data);
+  update_history_comboboxes (data);
+
+  /* disk / device label */
+  drive = udisks_client_get_drive_for_block (gdu_window_get_client (data->window), data->block);
+  info = udisks_client_get_object_info (gdu_window_get_client (data->window), data->object);
+  gtk_label_set_text (GTK_LABEL (data->device_label), udisks_object_info_get_one_liner (info));
+  g_free (s);
+
+  G_LOCK (bm_lock);
+
+  if (data->bm_in_progress)
+    {
+
+      gtk_widget_hide (data->start_benchmark_button);
+      gtk_widget_show (data->stop_benchmark_button);
+    }
+  else
+    {
+      gtk_widget_show (data->start_benchmark_button);
+      gtk_widget_hide (data->stop_benchmark_button);
+    }
+
+  get_max_min_avg (data->bm_read_samples,
+                   NULL, NULL, &read_avg);
+  get_max_min_avg (data->bm_write_samples,
+                   NULL, NULL, &write_avg);
+  get_max_min_avg (data->bm_access_time_samples,
+                   NULL, NULL, &access_time_avg);
+  read_ci = gdu_benchmark_get_confidence_interval (data->bm_read_samples);
+  write_ci = gdu_benchmark_get_confidence_interval (data->bm_write_samples);
+  access_time_ci = gdu_benchmark_get_confidence_interval (data->bm_access_time_samples);
+
+  G_UNLOCK (bm_lock);
+
+  if (data->bm_sample_size == 0)
+    s = g_strdup ("–");
+  else if (data->bm_direct_io)
+    {
+      gchar *s2;
+      s2 = g_format_size_full (data->bm_sample_size, G_FORMAT_SIZE_IEC_UNITS | G_FORMAT_SIZE_LONG_FORMAT);
+      /* Translators: Used for the sample size in the benchmark dialog when the page cache
+       * was bypassed. The %s is the sample size, e.g. "10.0 MiB (10485760 bytes)"
+       */
+      s = g_strdup_printf (C_("benchmark-sample-size", "%s <small>(direct I/O)</small>"), s2);
+      g_free (s2);
+    }
+  else
+    s = g_format_size_full (data->bm_sample_size, G_FORMAT_SIZE_IEC_UNITS | G_FORMAT_SIZE_LONG_FORMAT);
+  gtk_label_set_markup (GTK_LABEL (data->sample_size_label), s);
+  g_free (s);
+
+  if (read_avg == 0.0)
+    s = g_strdup ("–");
+  else
+    s = format_transfer_rate_and_num_samples (read_avg, data->bm_read_samples->len, read_ci);
+  gtk_label_set_markup (GTK_LABEL (data->read_rate_label), s);
+  g_free (s);
+
+  if (write_avg == 0.0)
+    s = g_strdup ("–");
+  else
+    s = format_transfer_rate_and_num_samples (write_avg, data->bm_write_samples->len, write_ci);
+  gtk_label_set_markup (GTK_LABEL (data->write_rate_label), s);
+  g_free (s);
+
+  if (access_time_avg == 0.0)
+    {
+      s = g_strdup ("–");
+    }
+  else
+    {
+      gchar *s2;
+      gchar *s3;
+      /* Translators: %d is number of milliseconds and msec means "milli-second" */
+      s2 = g_strdup_printf (C_("benchmark-access-time", "%.2f msec"), access_time_avg * 1000.0);
+      s3 = format_num_samples (data->bm_access_time_samples->len, access_time_ci);
+      s = g_strdup_printf ("%s <small>(%s)</small>", s2, s3);
+      g_free (s3);
+      g_free (s2);
+    }
+  gtk_label_set_markup (GTK_LABEL (data->access_time_label), s);
+  g_free (s);
+
+  s = format_access_time_percentiles (data);
+  gtk_label_set_markup (GTK_LABEL (data->access_time_percentiles_label), s);
+  g_free (s);
+
+  s = format_queue_depth_scaling (data);
+  gtk_label_set_markup (GTK_LABEL (data->queue_depth_label), s);
+  g_free (s);
+
+  s = format_profiles (data);
+  gtk_label_set_text (GTK_LABEL (data->profiles_label), s);
+  g_free (s);
+
+  s = format_filesystem (data);
+  gtk_label_set_text (GTK_LABEL (data->filesystem_label), s);
+  g_free (s);
+
+  s = format_sustained_write (data);
+  gtk_label_set_markup (GTK_LABEL (data->sustained_write_label), s);
+  g_free (s);
+
+  s = format_seek_profile (data);
+  gtk_label_set_text (GTK_LABEL (data->seek_profile_label), s);
+  g_free (s);
+
+  s = format_transfer_size (data);
+  gtk_label_set_text (GTK_LABEL (data->transfer_size_label), s);
+  g_free (s);
+
+  s = format_raid_members (data);
+  gtk_label_set_markup (GTK_LABEL (data->raid_members_label), s);
+  g_free (s);
+  /* only RAID arrays have members */
+  gtk_widget_set_visible (data->raid_members_title_label,
+                          data->mdraid != NULL || data->bm_raid_members->len > 0);
+  gtk_widget_set_visible (data->raid_members_label,
+                          data->mdraid != NULL || data->bm_raid_members->len > 0);
+
+  s = format_trend (data);
+  gtk_label_set_markup (GTK_LABEL (data->trend_label), s);
+  g_free (s);
+
+  window = gtk_widget_get_window (data->graph_drawing_area);
+  if (window != NULL)
+    gdk_window_invalidate_rect (window, NULL, TRUE);
+  window = gtk_widget_get_window (data->queue_depth_drawing_area);
+  if (window != NULL)
+    gdk_window_invalidate_rect (window, NULL, TRUE);
+  window = gtk_widget_get_window (data->profiles_drawing_area);
+  if (window != NULL)
+    gdk_window_invalidate_rect (window, NULL, TRUE);
+  window = gtk_widget_get_window (data->access_time_distribution_drawing_area);
+  if (window != NULL)
+    gdk_window_invalidate_rect (window, NULL, TRUE);
+  window = gtk_widget_get_window (data->filesystem_drawing_area);
+  if (window != NULL)
+    gdk_window_invalidate_rect (window, NULL, TRUE);
+  window = gtk_widget_get_window (data->sustained_write_drawing_area);
+  if (window != NULL)
+    gdk_window_invalidate_rect (window, NULL, TRUE);
+  window = gtk_widget_get_window (data->seek_profile_drawing_area);
+  if (window != NULL)
+    gdk_window_invalidate_rect (window, NULL, TRUE);
+  window = gtk_widget_get_window (data->transfer_size_drawing_area);
+  if (window != NULL)
+    gdk_window_invalidate_rect (window, NULL, TRUE);
+
+  g_clear_object (&drive);
+  g_clear_object (&info);
+}
+
+
+/* called every second (on the second) */
+static gboolean
+on_timeout (gpointer user_data)
+{
+  DialogData *data = user_data;
+  update_updated_label (data);
+  return TRUE; /* keep timeout around */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+samples_from_gvariant (GArray   *array,
+                       GVariant *variant)
+{
+  GVariantIter iter;
+  GduBenchmarkSample sample;
+
+  g_array_set_size (array, 0);
+
+  g_variant_iter_init (&iter, variant);
+  while (g_variant_iter_next (&iter, "(td)", &sample.offset, &sample.value))
+    {
+      g_array_append_val (array, sample);
+    }
+}
+
+static gboolean
+load_data_from_gvariant (DialogData  *data,
+                         GVariant    *value,
+                         GError     **error)
+{
+  gboolean ret = FALSE;
+  GError *local_error = NULL;
+  GVariant *read_samples_variant = NULL;
+  GVariant *write_samples_variant = NULL;
+  GVariant *access_time_samples_variant = NULL;
+  GVariant *sequential_queue_depth_samples_variant = NULL;
+  GVariant *random_queue_depth_samples_variant = NULL;
+  GVariant *profile_rate_samples_variant = NULL;
+  GVariant *profile_iops_samples_variant = NULL;
+  GVariant *access_time_histogram_variant = NULL;
+  GVariant *filesystem_rate_samples_variant = NULL;
+  GVariant *filesystem_iops_samples_variant = NULL;
+  GVariant *sustained_write_samples_variant = NULL;
+  GVariant *raid_members_variant = NULL;
+  GVariant *seek_distance_samples_variant = NULL;
+  GVariant *seek_stroke_samples_variant = NULL;
+  GVariant *transfer_size_read_samples_variant = NULL;
+  GVariant *transfer_size_write_samples_variant = NULL;
+  gint32 version;
+  gint64 timestamp_usec;
+  guint64 device_size;
+  guint64 sample_size;
+
+  if (!g_variant_lookup (value, "version", "i", &version))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "No version key");
+      goto out;
+    }
+  if (version != 1)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Cannot decode version %d data", version);
+      goto out;
+    }
+
+  if (!g_variant_lookup (value, "timestamp-usec", "x", &timestamp_usec))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "No timestamp-usec");
+      goto out;
+    }
+
+  if (!g_variant_lookup (value, "device-size", "t", &device_size))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "No device-size");
+      goto out;
+    }
+
+  if (!g_variant_lookup (value, "read-samples", "@a(td)", &read_samples_variant))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "No read-samples");
+      goto out;
+    }
+
+  if (!g_variant_lookup (value, "write-samples", "@a(td)", &write_samples_variant))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "No write-samples");
+      goto out;
+    }
+
+  if (!g_variant_lookup (value, "access-time-samples", "@a(td)", &access_time_samples_variant))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "No access-time-samples");
+      goto out;
+    }
+
+  if (!g_variant_lookup (value, "sample-size", "t", &sample_size))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "No sample-size");
+      goto out;
+    }
+
+  data->bm_time_benchmarked_usec = timestamp_usec;
+  data->bm_size = device_size;
+  data->bm_sample_size = sample_size;
+  /* optional, older files don't say if the page cache was bypassed */
+  if (!g_variant_lookup (value, "direct-io", "b", &data->bm_direct_io))
+    data->bm_direct_io = FALSE;
+  samples_from_gvariant (data->bm_read_samples, read_samples_variant);
+  samples_from_gvariant (data->bm_write_samples, write_samples_variant);
+  samples_from_gvariant (data->bm_access_time_samples, access_time_samples_variant);
+
+  /* the histogram is optional, files without it have every access time sample */
+  gdu_histogram_clear (data->bm_access_time_histogram);
+  if (g_variant_lookup (value, "access-time-histogram", "@a{sv}", &access_time_histogram_variant))
+    {
+      GduHistogram *histogram;
+      histogram = gdu_histogram_new_from_gvariant (access_time_histogram_variant, &local_error);
+      if (histogram == NULL)
+        {
+          g_propagate_error (error, local_error);
+          goto out;
+        }
+      gdu_histogram_free (data->bm_access_time_histogram);
+      data->bm_access_time_histogram = histogram;
+    }
+  else
+    {
+      guint n;
+      for (n = 0; n < data->bm_access_time_samples->len; n++)
+        {
+          GduBenchmarkSample *sample = &g_array_index (data->bm_access_time_samples, GduBenchmarkSample, n);
+          gdu_histogram_record (data->bm_access_time_histogram, sample->value * G_USEC_PER_SEC);
+        }
+    }
+
+  /* queue depth scaling is optional */
+  g_array_set_size (data->bm_sequential_queue_depth_samples, 0);
+  g_array_set_size (data->bm_random_queue_depth_samples, 0);
+  data->bm_sequential_queue_depth_block_size = 0;
+  data->bm_random_queue_depth_block_size = 0;
+  if (g_variant_lookup (value, "sequential-queue-depth-samples", "@a(td)", &sequential_queue_depth_samples_variant) &&
+      g_variant_lookup (value, "random-queue-depth-samples", "@a(td)", &random_queue_depth_samples_variant) &&
+      g_variant_lookup (value, "sequential-queue-depth-block-size", "t", &data->bm_sequential_queue_depth_block_size) &&
+      g_variant_lookup (value, "random-queue-depth-block-size", "t", &data->bm_random_queue_depth_block_size))
+    {
+      samples_from_gvariant (data->bm_sequential_queue_depth_samples, sequential_queue_depth_samples_variant);
+      samples_from_gvariant (data->bm_random_queue_depth_samples, random_queue_depth_samples_variant);
+    }
+
+  /* so are workload profiles */
+  g_array_set_size (data->bm_profile_rate_samples, 0);
+  g_array_set_size (data->bm_profile_iops_samples, 0);
+  if (g_variant_lookup (value, "profile-rate-samples", "@a(td)", &profile_rate_samples_variant) &&
+      g_variant_lookup (value, "profile-iops-samples", "@a(td)", &profile_iops_samples_variant))
+    {
+      samples_from_gvariant (data->bm_profile_rate_samples, profile_rate_samples_variant);
+      samples_from_gvariant (data->bm_profile_iops_samples, profile_iops_samples_variant);
+    }
+
+  /* and filesystem workloads */
+  g_array_set_size (data->bm_filesystem_rate_samples, 0);
+  g_array_set_size (data->bm_filesystem_iops_samples, 0);
+  if (g_variant_lookup (value, "filesystem-rate-samples", "@a(td)", &filesystem_rate_samples_variant) &&
+      g_variant_lookup (value, "filesystem-iops-samples", "@a(td)", &filesystem_iops_samples_variant))
+    {
+      samples_from_gvariant (data->bm_filesystem_rate_samples, filesystem_rate_samples_variant);
+      samples_from_gvariant (data->bm_filesystem_iops_samples, filesystem_iops_samples_variant);
+    }
+
+  /* and the sustained write test */
+  g_array_set_size (data->bm_sustained_write_samples, 0);
+  data->bm_sustained_write_offset = 0;
+  data->bm_sustained_write_size = 0;
+  if (g_variant_lookup (value, "sustained-write-samples", "@a(td)", &sustained_write_samples_variant) &&
+      g_variant_lookup (value, "sustained-write-offset", "t", &data->bm_sustained_write_offset) &&
+      g_variant_lookup (value, "sustained-write-size", "t", &data->bm_sustained_write_size))
+    {
+      samples_from_gvariant (data->bm_sustained_write_samples, sustained_write_samples_variant);
+    }
+
+  /* and the seek profile */
+  g_array_set_size (data->bm_seek_distance_samples, 0);
+  g_array_set_size (data->bm_seek_stroke_samples, 0);
+  data->bm_seek_profile_target = 0.0;
+  if (g_variant_lookup (value, "seek-distance-samples", "@a(td)", &seek_distance_samples_variant) &&
+      g_variant_lookup (value, "seek-stroke-samples", "@a(td)", &seek_stroke_samples_variant) &&
+      g_variant_lookup (value, "seek-profile-target", "d", &data->bm_seek_profile_target))
+    {
+      samples_from_gvariant (data->bm_seek_distance_samples, seek_distance_samples_variant);
+      samples_from_gvariant (data->bm_seek_stroke_samples, seek_stroke_samples_variant);
+    }
+
+  /* and the transfer size sweep, which may not have written */
+  g_array_set_size (data->bm_transfer_size_read_samples, 0);
+  g_array_set_size (data->bm_transfer_size_write_samples, 0);
+  if (g_variant_lookup (value, "transfer-size-read-samples", "@a(td)", &transfer_size_read_samples_variant))
+    samples_from_gvariant (data->bm_transfer_size_read_samples, transfer_size_read_samples_variant);
+  if (g_variant_lookup (value, "transfer-size-write-samples", "@a(td)", &transfer_size_write_samples_variant))
+    samples_from_gvariant (data->bm_transfer_size_write_samples, transfer_size_write_samples_variant);
+
+  /* and the RAID members */
+  g_ptr_array_set_size (data->bm_raid_members, 0);
+  g_free (data->bm_raid_level);
+  data->bm_raid_level = NULL;
+  if (g_variant_lookup (value, "raid-level", "s", &data->bm_raid_level) &&
+      g_variant_lookup (value, "raid-members", "@a(sddd)", &raid_members_variant))
+    {
+      GVariantIter iter;
+      const gchar *name;
+      gdouble read_rate;
+      gdouble array_read_rate;
+      gdouble array_access_time;
+
+      g_variant_iter_init (&iter, raid_members_variant);
+      while (g_variant_iter_next (&iter, "(&sddd)", &name, &read_rate, &array_read_rate, &array_access_time))
+        {
+          BMRaidMember *member = g_new0 (BMRaidMember, 1);
+          member->name = g_strdup (name);
+          member->read_rate = read_rate;
+          member->array_read_rate = array_read_rate;
+          member->array_access_time = array_access_time;
+          g_ptr_array_add (data->bm_raid_members, member);
+        }
+    }
+
+  ret = TRUE;
+
+ out:
+  /* the samples are not the ones drawn any more */
+  invalidate_graph (data);
+  if (read_samples_variant != NULL)
+    g_variant_unref (read_samples_variant);
+  if (write_samples_variant != NULL)
+    g_variant_unref (write_samples_variant);
+  if (access_time_samples_variant != NULL)
+    g_variant_unref (access_time_samples_variant);
+  if (sequential_queue_depth_samples_variant != NULL)
+    g_variant_unref (sequential_queue_depth_samples_variant);
+  if (random_queue_depth_samples_variant != NULL)
+    g_variant_unref (random_queue_depth_samples_variant);
+  if (profile_rate_samples_variant != NULL)
+    g_variant_unref (profile_rate_samples_variant);
+  if (profile_iops_samples_variant != NULL)
+    g_variant_unref (profile_iops_samples_variant);
+  if (access_time_histogram_variant != NULL)
+    g_variant_unref (access_time_histogram_variant);
+  if (filesystem_rate_samples_variant != NULL)
+    g_variant_unref (filesystem_rate_samples_variant);
+  if (filesystem_iops_samples_variant != NULL)
+    g_variant_unref (filesystem_iops_samples_variant);
+  if (sustained_write_samples_variant != NULL)
+    g_variant_unref (sustained_write_samples_variant);
+  if (raid_members_variant != NULL)
+    g_variant_unref (raid_members_variant);
+  if (seek_distance_samples_variant != NULL)
+    g_variant_unref (seek_distance_samples_variant);
+  if (seek_stroke_samples_variant != NULL)
+    g_variant_unref (seek_stroke_samples_variant);
+  if (transfer_size_read_samples_variant != NULL)
+    g_variant_unref (transfer_size_read_samples_variant);
+  if (transfer_size_write_samples_variant != NULL)
+    g_variant_unref (transfer_size_write_samples_variant);
+  return ret;
+}
+
+static gboolean
+maybe_load_data (DialogData  *data,
+                 GError     **error)
+{
+  gboolean ret = FALSE;
+  gchar *filename = NULL;
+  GVariant *value = NULL;
+  gchar *variant_data = NULL;
+  gsize variant_size;
+  GError *local_error = NULL;
+
+  filename = get_bm_filename (data);
+  if (filename == NULL)
+    {
+      /* all good since we don't want to load data for this device */
+      ret = TRUE;
+      goto out;
+    }
+
+  if (!g_file_get_contents (filename,
+                            &variant_data,
+                            &variant_size,
+                            &local_error))
+    {
+      if (local_error->domain == G_FILE_ERROR && local_error->code == G_FILE_ERROR_NOENT)
+        {
+          /* don't complain about a missing file */
+          g_clear_error (&local_error);
+          ret = TRUE;
+          goto out;
+        }
+      g_propagate_error (error, local_error);
+      goto out;
+    }
+
+  value = g_variant_new_from_data (G_VARIANT_TYPE_VARDICT,
+                                   variant_data,
+                                   variant_size,
+                                   FALSE,
+                                   NULL, NULL);
+  g_variant_ref_sink (value);
+
+  if (!load_data_from_gvariant (data, value, error))
+    goto out;
+
+  ret = TRUE;
+
+ out:
+  if (value != NULL)
+    g_variant_unref (value);
+  g_free (variant_data);
+  g_free (filename);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GVariant *
+samples_to_gvariant (GArray *array)
+{
+  guint n;
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(td)"));
+  for (n = 0; n < array->len; n++)
+    {
+      GduBenchmarkSample *s = &g_array_index (array, GduBenchmarkSample, n);
+      g_variant_builder_add (&builder, "(td)", s->offset, s->value);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Loads the request sizes saved by save_transfer_sizes() from
+ * @filename, leaving them at 0 if there are none
+ */
+static void
+load_transfer_sizes (const gchar *filename,
+                     guint64     *out_read_size,
+                     guint64     *out_write_size)
+{
+  gchar *variant_data = NULL;
+  gsize variant_size;
+  GVariant *value;
+
+  *out_read_size = 0;
+  *out_write_size = 0;
+
+  if (!g_file_get_contents (filename, &variant_data, &variant_size, NULL))
+    goto out;
+
+  value = g_variant_new_from_data (G_VARIANT_TYPE_VARDICT,
+                                   variant_data,
+                                   variant_size,
+                                   FALSE,
+                                   NULL, NULL);
+  g_variant_ref_sink (value);
+  g_variant_lookup (value, "read-transfer-size", "t", out_read_size);
+  g_variant_lookup (value, "write-transfer-size", "t", out_write_size);
+  g_variant_unref (value);
+
+ out:
+  g_free (variant_data);
+}
+
+/* The knees of the transfer size sweep are kept in a file of their
+ * own so later runs without the sweep don't throw them away. A write
+ * knee from before is kept if this run didn't write.
+ */
+static gboolean
+save_transfer_sizes (DialogData  *data,
+                     GError     **error)
+{
+  gboolean ret = FALSE;
+  gchar *filename = NULL;
+  GVariantBuilder builder;
+  GVariant *value = NULL;
+  guint64 read_size;
+  guint64 write_size;
+
+  filename = get_bm_filename_for_block (data->block, "gnome-disks-transfer-size");
+  if (filename == NULL)
+    {
+      ret = TRUE;
+      goto out;
+    }
+
+  load_transfer_sizes (filename, &read_size, &write_size);
+  G_LOCK (bm_lock);
+  read_size = gdu_benchmark_get_transfer_size_knee (data->bm_transfer_size_read_samples);
+  if (data->bm_transfer_size_write_samples->len > 0)
+    write_size = gdu_benchmark_get_transfer_size_knee (data->bm_transfer_size_write_samples);
+  G_UNLOCK (bm_lock);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "version", g_variant_new_int32 (1));
+  g_variant_builder_add (&builder, "{sv}", "read-transfer-size", g_variant_new_uint64 (read_size));
+  g_variant_builder_add (&builder, "{sv}", "write-transfer-size", g_variant_new_uint64 (write_size));
+  value = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  if (!g_file_set_contents (filename,
+                            g_variant_get_data (value),
+                            g_variant_get_size (value),
+                            error))
+    goto out;
+
+  ret = TRUE;
+
+ out:
+  if (value != NULL)
+    g_variant_unref (value);
+  g_free (filename);
+  return ret;
+}
+
+/**
+ * gdu_benchmark_dialog_get_transfer_size:
+ * @client: A #UDisksClient.
+ * @block: A #UDisksBlock.
+ * @for_writing: Whether the data is to be written to @block.
+ *
+ * Gets the request size to copy data to or from @block with, as found
+ * by the transfer size sweep of the last benchmark that did one on
+ * @block or, failing that, on the whole drive it's on. If the sweep
+ * didn't write, the read size is used for writing as well.
+ *
+ * Returns: The request size in bytes or 0 if it isn't known.
+ */
+gsize
+gdu_benchmark_dialog_get_transfer_size (UDisksClient *client,
+                                        UDisksBlock  *block,
+                                        gboolean      for_writing)
+{
+  gchar *filename;
+  UDisksDrive *drive = NULL;
+  UDisksBlock *drive_block = NULL;
+  guint64 read_size = 0;
+  guint64 write_size = 0;
+
+  g_return_val_if_fail (UDISKS_IS_CLIENT (client), 0);
+  g_return_val_if_fail (UDISKS_IS_BLOCK (block), 0);
+
+  filename = get_bm_filename_for_block (block, "gnome-disks-transfer-size");
+  if (filename != NULL)
+    load_transfer_sizes (filename, &read_size, &write_size);
+  g_free (filename);
+
+  /* e.g. a partition, benchmarks are usually run on the whole drive */
+  if (read_size == 0)
+    {
+      drive = udisks_client_get_drive_for_block (client, block);
+      if (drive != NULL)
+        drive_block = udisks_client_get_block_for_drive (client, drive, FALSE);
+      if (drive_block != NULL && drive_block != block)
+        {
+          filename = get_bm_filename_for_block (drive_block, "gnome-disks-transfer-size");
+          if (filename != NULL)
+            load_transfer_sizes (filename, &read_size, &write_size);
+          g_free (filename);
+        }
+    }
+
+  g_clear_object (&drive_block);
+  g_clear_object (&drive);
+  return (for_writing && write_size > 0) ? write_size : read_size;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GVariant *
+data_to_gvariant (DialogData *data)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "version", g_variant_new_int32 (1));
+  g_variant_builder_add (&builder, "{sv}", "timestamp-usec", g_variant_new_int64 (data->bm_time_benchmarked_usec));
+  g_variant_builder_add (&builder, "{sv}", "device-size", g_variant_new_uint64 (data->bm_size));
+  g_variant_builder_add (&builder, "{sv}", "sample-size", g_variant_new_uint64 (data->bm_sample_size));
+  g_variant_builder_add (&builder, "{sv}", "direct-io", g_variant_new_boolean (data->bm_direct_io));
+  g_variant_builder_add (&builder, "{sv}", "read-samples", samples_to_gvariant (data->bm_read_samples));
+  g_variant_builder_add (&builder, "{sv}", "write-samples", samples_to_gvariant (data->bm_write_samples));
+  g_variant_builder_add (&builder, "{sv}", "access-time-samples", samples_to_gvariant (data->bm_access_time_samples));
+  g_variant_builder_add (&builder, "{sv}", "access-time-histogram", gdu_histogram_to_gvariant (data->bm_access_time_histogram));
+  g_variant_builder_add (&builder, "{sv}", "read-rate-median", g_variant_new_double (gdu_benchmark_get_median (data->bm_read_samples)));
+  g_variant_builder_add (&builder, "{sv}", "write-rate-median", g_variant_new_double (gdu_benchmark_get_median (data->bm_write_samples)));
+  g_variant_builder_add (&builder, "{sv}", "access-time-median", g_variant_new_double (gdu_benchmark_get_median (data->bm_access_time_samples)));
+  if (data->bm_sequential_queue_depth_samples->len > 0 || data->bm_random_queue_depth_samples->len > 0)
+    {
+      g_variant_builder_add (&builder, "{sv}", "sequential-queue-depth-block-size",
+                             g_variant_new_uint64 (data->bm_sequential_queue_depth_block_size));
+      g_variant_builder_add (&builder, "{sv}", "sequential-queue-depth-samples",
+                             samples_to_gvariant (data->bm_sequential_queue_depth_samples));
+      g_variant_builder_add (&builder, "{sv}", "random-queue-depth-block-size",
+                             g_variant_new_uint64 (data->bm_random_queue_depth_block_size));
+      g_variant_builder_add (&builder, "{sv}", "random-queue-depth-samples",
+                             samples_to_gvariant (data->bm_random_queue_depth_samples));
+    }
+  if (data->bm_profile_rate_samples->len > 0)
+    {
+      g_variant_builder_add (&builder, "{sv}", "profile-duration-usec",
+                             g_variant_new_int64 (((gint64) data->bm_profile_duration_sec) * G_USEC_PER_SEC));
+      g_variant_builder_add (&builder, "{sv}", "profile-threads",
+                             g_variant_new_int32 (data->bm_profile_num_threads));
+      g_variant_builder_add (&builder, "{sv}", "profile-rate-samples",
+                             samples_to_gvariant (data->bm_profile_rate_samples));
+      g_variant_builder_add (&builder, "{sv}", "profile-iops-samples",
+                             samples_to_gvariant (data->bm_profile_iops_samples));
+    }
+  if (data->bm_filesystem_rate_samples->len > 0)
+    {
+      g_variant_builder_add (&builder, "{sv}", "filesystem-file-size",
+                             g_variant_new_uint64 (((guint64) data->bm_filesystem_file_size_mib) * 1024 * 1024));
+      g_variant_builder_add (&builder, "{sv}", "filesystem-threads",
+                             g_variant_new_int32 (data->bm_filesystem_num_threads));
+      g_variant_builder_add (&builder, "{sv}", "filesystem-rate-samples",
+                             samples_to_gvariant (data->bm_filesystem_rate_samples));
+      g_variant_builder_add (&builder, "{sv}", "filesystem-iops-samples",
+                             samples_to_gvariant (data->bm_filesystem_iops_samples));
+    }
+  if (data->bm_sustained_write_samples->len > 0)
+    {
+      g_variant_builder_add (&builder, "{sv}", "sustained-write-offset",
+                             g_variant_new_uint64 (data->bm_sustained_write_offset));
+      g_variant_builder_add (&builder, "{sv}", "sustained-write-size",
+                             g_variant_new_uint64 (data->bm_sustained_write_size));
+      g_variant_builder_add (&builder, "{sv}", "sustained-write-samples",
+                             samples_to_gvariant (data->bm_sustained_write_samples));
+    }
+  if (data->bm_seek_distance_samples->len > 0)
+    {
+      g_variant_builder_add (&builder, "{sv}", "seek-distance-samples",
+                             samples_to_gvariant (data->bm_seek_distance_samples));
+      g_variant_builder_add (&builder, "{sv}", "seek-stroke-samples",
+                             samples_to_gvariant (data->bm_seek_stroke_samples));
+      g_variant_builder_add (&builder, "{sv}", "seek-profile-target",
+                             g_variant_new_double (data->bm_seek_profile_target));
+    }
+  if (data->bm_transfer_size_read_samples->len > 0)
+    {
+      g_variant_builder_add (&builder, "{sv}", "transfer-size-read-samples",
+                             samples_to_gvariant (data->bm_transfer_size_read_samples));
+      if (data->bm_transfer_size_write_samples->len > 0)
+        g_variant_builder_add (&builder, "{sv}", "transfer-size-write-samples",
+                               samples_to_gvariant (data->bm_transfer_size_write_samples));
+    }
+  if (data->bm_raid_members->len > 0)
+    {
+      GVariantBuilder members_builder;
+      guint n;
+
+      g_variant_builder_init (&members_builder, G_VARIANT_TYPE ("a(sddd)"));
+      for (n = 0; n < data->bm_raid_members->len; n++)
+        {
+          BMRaidMember *member = data->bm_raid_members->pdata[n];
+          g_variant_builder_add (&members_builder, "(sddd)",
+                                 member->name,
+                                 member->read_rate,
+                                 member->array_read_rate,
+                                 member->array_access_time);
+        }
+      g_variant_builder_add (&builder, "{sv}", "raid-level",
+                             g_variant_new_string (data->bm_raid_level != NULL ? data->bm_raid_level : ""));
+      g_variant_builder_add (&builder, "{sv}", "raid-members",
+                             g_variant_builder_end (&members_builder));
+    }
+  return g_variant_builder_end (&builder);
+}
+
+static gboolean
+maybe_save_data (DialogData  *data,
+                 GError     **error)
+{
+  gboolean ret = FALSE;
+  gchar *filename = NULL;
+  GVariant *value = NULL;
+  gconstpointer variant_data;
+  gsize variant_size;
+  GError *local_error = NULL;
+
+  filename = get_bm_filename (data);
+  if (filename == NULL)
+    {
+      /* all good since we don't want to save data for this device */
+      ret = TRUE;
+      goto out;
+    }
+
+  value = g_variant_ref_sink (data_to_gvariant (data));
+
+  variant_data = g_variant_get_data (value);
+  variant_size = g_variant_get_size (value);
+
+  if (!g_file_set_contents (filename,
+                            variant_data,
+                            variant_size,
+                            error))
+    goto out;
+
+  if (data->bm_transfer_size_read_samples->len > 0 && !save_transfer_sizes (data, error))
+    goto out;
+
+  /* also keep the run in the history, failing that is not worth discarding the run for */
+  G_LOCK (bm_lock);
+  if (data->bm_history != NULL && !gdu_benchmark_history_append (data->bm_history, value, &local_error))
+    {
+      g_warning ("Error appending to benchmark history: %s (%s, %d)",
+                 local_error->message, g_quark_to_string (local_error->domain), local_error->code);
+      g_clear_error (&local_error);
+    }
+  G_UNLOCK (bm_lock);
+
+  ret = TRUE;
+
+ out:
+  if (value != NULL)
+    g_variant_unref (value);
+  g_free (filename);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* returns NULL if it doesn't make sense to keep a history of runs, see get_bm_filename() */
+static gchar *
+get_bm_history_filename (DialogData *data)
+{
+  gchar *ret = NULL;
+  gchar *filename;
+
+  filename = get_bm_filename (data);
+  if (filename != NULL)
+    ret = g_strdup_printf ("%s-history", filename);
+  g_free (filename);
+  return ret;
+}
+
+static gchar *
+format_timestamp (gint64 timestamp_usec)
+{
+  GDateTime *dt;
+  GDateTime *dt_local;
+  gchar *ret;
+
+  dt = g_date_time_new_from_unix_utc (timestamp_usec / G_USEC_PER_SEC);
+  dt_local = g_date_time_to_local (dt);
+  ret = g_date_time_format (dt_local, "%c");
+  g_date_time_unref (dt_local);
+  g_date_time_unref (dt);
+  return ret;
+}
+
+/* Gets the median of the samples in @run, using the summary in @median_key if present */
+static gdouble
+get_run_median (GVariant    *run,
+                const gchar *median_key,
+                const gchar *samples_key)
+{
+  gdouble ret = 0.0;
+  GVariant *samples_variant;
+
+  if (g_variant_lookup (run, median_key, "d", &ret))
+    goto out;
+
+  /* runs from before the summary was kept */
+  if (g_variant_lookup (run, samples_key, "@a(td)", &samples_variant))
+    {
+      GArray *samples;
+      samples = g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSample));
+      samples_from_gvariant (samples, samples_variant);
+      ret = gdu_benchmark_get_median (samples);
+      g_array_unref (samples);
+      g_variant_unref (samples_variant);
+    }
+
+ out:
+  return ret;
+}
+
+/* Gets the run at @combobox_index in the run or compare combo box, newest first */
+static GVariant *
+get_run_for_combobox_index (DialogData *data,
+                            gint        combobox_index)
+{
+  guint num_runs;
+
+  num_runs = gdu_benchmark_history_get_num_runs (data->bm_history);
+  g_return_val_if_fail (combobox_index >= 0 && (guint) combobox_index < num_runs, NULL);
+  return gdu_benchmark_history_get_run (data->bm_history, num_runs - 1 - combobox_index);
+}
+
+/* Sets the run that is drawn dashed in the transfer rate graph, %NULL to not draw any */
+static void
+set_compare_run (DialogData *data,
+                 GVariant   *run)
+{
+  GVariant *read_samples_variant = NULL;
+  GVariant *write_samples_variant = NULL;
+
+  G_LOCK (bm_lock);
+  data->bm_compare_size = 0;
+  g_array_set_size (data->bm_compare_read_samples, 0);
+  g_array_set_size (data->bm_compare_write_samples, 0);
+  if (run != NULL &&
+      g_variant_lookup (run, "device-size", "t", &data->bm_compare_size) &&
+      g_variant_lookup (run, "read-samples", "@a(td)", &read_samples_variant) &&
+      g_variant_lookup (run, "write-samples", "@a(td)", &write_samples_variant))
+    {
+      samples_from_gvariant (data->bm_compare_read_samples, read_samples_variant);
+      samples_from_gvariant (data->bm_compare_write_samples, write_samples_variant);
+    }
+  else
+    {
+      data->bm_compare_size = 0;
+    }
+  G_UNLOCK (bm_lock);
+  invalidate_graph (data);
+
+  if (read_samples_variant != NULL)
+    g_variant_unref (read_samples_variant);
+  if (write_samples_variant != NULL)
+    g_variant_unref (write_samples_variant);
+}
+
+/* Updates the run and compare combo boxes if the number of runs has changed */
+static void
+update_history_comboboxes (DialogData *data)
+{
+  gboolean in_progress;
+  gboolean rebuilt = FALSE;
+  guint num_runs = 0;
+  guint n;
+
+  G_LOCK (bm_lock);
+  in_progress = data->bm_in_progress;
+  if (data->bm_history != NULL)
+    num_runs = gdu_benchmark_history_get_num_runs (data->bm_history);
+
+  if (num_runs != data->num_runs_in_comboboxes)
+    {
+      data->updating_comboboxes = TRUE;
+      gtk_combo_box_text_remove_all (GTK_COMBO_BOX_TEXT (data->run_combobox));
+      gtk_combo_box_text_remove_all (GTK_COMBO_BOX_TEXT (data->compare_combobox));
+      /* Translators: Used in the benchmark dialog for not comparing with another run */
+      gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (data->compare_combobox),
+                                      C_("benchmark-compare", "None"));
+      for (n = 0; n < num_runs; n++)
+        {
+          GVariant *run;
+          gint64 timestamp_usec = 0;
+          gchar *s;
+
+          run = get_run_for_combobox_index (data, n);
+          g_variant_lookup (run, "timestamp-usec", "x", &timestamp_usec);
+          s = format_timestamp (timestamp_usec);
+          gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (data->run_combobox), s);
+          gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (data->compare_combobox), s);
+          g_free (s);
+        }
+      /* the newest run is the one loaded or just measured */
+      gtk_combo_box_set_active (GTK_COMBO_BOX (data->run_combobox), num_runs > 0 ? 0 : -1);
+      gtk_combo_box_set_active (GTK_COMBO_BOX (data->compare_combobox), 0);
+      data->num_runs_in_comboboxes = num_runs;
+      data->updating_comboboxes = FALSE;
+      rebuilt = TRUE;
+    }
+  G_UNLOCK (bm_lock);
+
+  if (rebuilt)
+    set_compare_run (data, NULL);
+
+  gtk_widget_set_sensitive (data->run_combobox, num_runs > 1 && !in_progress);
+  gtk_widget_set_sensitive (data->compare_combobox, num_runs > 0 && !in_progress);
+}
+
+static void
+on_run_combobox_changed (GtkComboBox *combobox,
+                         gpointer     user_data)
+{
+  DialogData *data = user_data;
+  GVariant *run;
+  GError *error = NULL;
+  gint index;
+
+  index = gtk_combo_box_get_active (combobox);
+  if (data->updating_comboboxes || index < 0)
+    return;
+
+  G_LOCK (bm_lock);
+  run = g_variant_ref (get_run_for_combobox_index (data, index));
+  G_UNLOCK (bm_lock);
+
+  if (!load_data_from_gvariant (data, run, &error))
+    {
+      gdu_utils_show_error (GTK_WINDOW (data->dialog), C_("benchmarking", "Error loading benchmark run"), error);
+      g_clear_error (&error);
+    }
+  g_variant_unref (run);
+
+  update_dialog (data);
+}
+
+static void
+on_compare_combobox_changed (GtkComboBox *combobox,
+                             gpointer     user_data)
+{
+  DialogData *data = user_data;
+  GVariant *run = NULL;
+  gint index;
+
+  index = gtk_combo_box_get_active (combobox);
+  if (data->updating_comboboxes || index < 0)
+    return;
+
+  /* the first item is "None" */
+  G_LOCK (bm_lock);
+  if (index > 0)
+    run = g_variant_ref (get_run_for_combobox_index (data, index - 1));
+  G_UNLOCK (bm_lock);
+
+  set_compare_run (data, run);
+  if (run != NULL)
+    g_variant_unref (run);
+
+  update_dialog (data);
+}
+
+/* Compares the median read and write rates with those of the run
+ * chosen to compare with or, if none is, with the median of all
+ * earlier runs with the same settings
+ */
+static gchar *
+format_trend (DialogData *data)
+{
+  gchar *ret = NULL;
+  gchar *baseline_str = NULL;
+  GString *str = NULL;
+  gdouble read_median;
+  gdouble write_median;
+  gdouble baseline_read = 0.0;
+  gdouble baseline_write = 0.0;
+  gboolean regression = FALSE;
+  gint compare_index;
+  gchar *s;
+
+  G_LOCK (bm_lock);
+  if (data->bm_history == NULL || data->bm_in_progress || data->bm_time_benchmarked_usec == 0)
+    {
+      ret = g_strdup ("–");
+      goto out;
+    }
+
+  read_median = gdu_benchmark_get_median (data->bm_read_samples);
+  write_median = gdu_benchmark_get_median (data->bm_write_samples);
+
+  compare_index = gtk_combo_box_get_active (GTK_COMBO_BOX (data->compare_combobox));
+  if (compare_index > 0)
+    {
+      GVariant *run;
+      gint64 timestamp_usec = 0;
+      gchar *s2;
+
+      run = get_run_for_combobox_index (data, compare_index - 1);
+      baseline_read = get_run_median (run, "read-rate-median", "read-samples");
+      baseline_write = get_run_median (run, "write-rate-median", "write-samples");
+      g_variant_lookup (run, "timestamp-usec", "x", &timestamp_usec);
+      s = format_timestamp (timestamp_usec);
+      s2 = g_markup_escape_text (s, -1);
+      /* Translators: Used for the trend in the benchmark dialog when comparing with a
+       * specific run. The %s is when that run took place, e.g. "Tue 12 Jun 2012 03:57:08 PM EDT"
+       */
+      baseline_str = g_strdup_printf (C_("benchmark-trend", "the run of %s"), s2);
+      g_free (s2);
+      g_free (s);
+    }
+  else
+    {
+      GArray *reads;
+      GArray *writes;
+      guint num_earlier = 0;
+      guint n;
+
+      reads = g_array_new (FALSE, FALSE, sizeof (gdouble));
+      writes = g_array_new (FALSE, FALSE, sizeof (gdouble));
+      for (n = 0; n < gdu_benchmark_history_get_num_runs (data->bm_history); n++)
+        {
+          GVariant *run = gdu_benchmark_history_get_run (data->bm_history, n);
+          gint64 timestamp_usec = 0;
+          guint64 sample_size = 0;
+          gboolean direct_io = FALSE;
+          gdouble value;
+
+          g_variant_lookup (run, "timestamp-usec", "x", &timestamp_usec);
+          g_variant_lookup (run, "sample-size", "t", &sample_size);
+          g_variant_lookup (run, "direct-io", "b", &direct_io);
+          if (timestamp_usec >= data->bm_time_benchmarked_usec ||
+              sample_size != data->bm_sample_size ||
+              direct_io != data->bm_direct_io)
+            continue;
+
+          value = get_run_median (run, "read-rate-median", "read-samples");
+          if (value > 0.0)
+            g_array_append_val (reads, value);
+          value = get_run_median (run, "write-rate-median", "write-samples");
+          if (value > 0.0)
+            g_array_append_val (writes, value);
+          num_earlier++;
+        }
+      baseline_read = gdu_benchmark_get_median_of_doubles (reads);
+      baseline_write = gdu_benchmark_get_median_of_doubles (writes);
+      g_array_unref (writes);
+      g_array_unref (reads);
+
+      if (num_earlier > 0)
+        {
+          /* Translators: Used for the trend in the benchmark dialog when comparing with
+           * earlier runs with the same settings. The %d is the number of runs.
+           */
+          baseline_str = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                                       "the median of %d earlier run",
+                                                       "the median of %d earlier runs",
+                                                       num_earlier),
+                                          num_earlier);
+        }
+    }
+
+  str = g_string_new (NULL);
+  if (read_median > 0.0 && baseline_read > 0.0)
+    {
+      gdouble change = (read_median - baseline_read) * 100.0 / baseline_read;
+      /* Translators: Used for the trend in the benchmark dialog. The %+.1f is how much the
+       * median read rate changed in percent, e.g. "-12.3"
+       */
+      g_string_append_printf (str, C_("benchmark-trend", "Read %+.1f%%"), change);
+      if (change < -REGRESSION_THRESHOLD_PERCENT)
+        regression = TRUE;
+    }
+  if (write_median > 0.0 && baseline_write > 0.0)
+    {
+      gdouble change = (write_median - baseline_write) * 100.0 / baseline_write;
+      if (str->len > 0)
+        g_string_append (str, ", ");
+      /* Translators: Used for the trend in the benchmark dialog. The %+.1f is how much the
+       * median write rate changed in percent, e.g. "-12.3"
+       */
+      g_string_append_printf (str, C_("benchmark-trend", "Write %+.1f%%"), change);
+      if (change < -REGRESSION_THRESHOLD_PERCENT)
+        regression = TRUE;
+    }
+
+  if (baseline_str == NULL || str->len == 0)
+    {
+      ret = g_strdup (C_("benchmark-trend", "No earlier runs to compare with"));
+      goto out;
+    }
+
+  /* Translators: Used for the trend in the benchmark dialog. The first %s is how the
+   * median rates changed, e.g. "Read -12.3%, Write +0.4%", and the second %s is what
+   * they are compared with, e.g. "the median of 4 earlier runs"
+   */
+  ret = g_strdup_printf (C_("benchmark-trend", "%s <small>(compared to %s)</small>"), str->str, baseline_str);
+  if (regression)
+    {
+      s = ret;
+      /* Translators: Used for the trend in the benchmark dialog when the median read or
+       * write rate dropped considerably. The %s is the trend, e.g. "Read -12.3%, Write +0.4%
+       * (compared to the median of 4 earlier runs)"
+       */
+      ret = g_strdup_printf (C_("benchmark-trend", "<b>Regression:</b> %s"), s);
+      g_free (s);
+    }
+
+ out:
+  G_UNLOCK (bm_lock);
+  if (str != NULL)
+    g_string_free (str, TRUE);
+  g_free (baseline_str);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called on main / UI thread */
+static gboolean
+bmt_on_timeout (gpointer user_data)
+{
+  DialogData *data = user_data;
+  update_dialog (data);
+  G_LOCK (bm_lock);
+  data->bm_update_timeout_pending = FALSE;
+  G_UNLOCK (bm_lock);
+  dialog_data_unref (data);
+  return FALSE; /* don't run again */
+}
+
+static void
+bmt_schedule_update (DialogData *data)
+{
+  /* rate-limit updates */
+  G_LOCK (bm_lock);
+  if (!data->bm_update_timeout_pending)
+    {
+      g_timeout_add (200, /* ms */
+                     bmt_on_timeout,
+                     dialog_data_ref (data));
+      data->bm_update_timeout_pending = TRUE;
+    }
+  G_UNLOCK (bm_lock);
+}
+
+/* In the "until stable" mode, the transfer rate and the access time
+ * are measured in passes of bm_num_samples and bm_num_access_samples
+ * samples. Returns %TRUE if another pass should be made, see
+ * gdu_benchmark_take_another_pass().
+ */
+static gboolean
+take_another_pass (DialogData *data,
+                   GArray     *samples,
+                   GArray     *more_samples,
+                   guint       num_passes,
+                   gint64      begin_usec)
+{
+  gboolean ret;
+
+  if (!data->bm_do_until_stable)
+    return FALSE;
+
+  G_LOCK (bm_lock);
+  ret = gdu_benchmark_take_another_pass (samples, more_samples, num_passes, begin_usec,
+                                         data->bm_stable_target_percent, data->bm_stable_budget_sec);
+  G_UNLOCK (bm_lock);
+  return ret;
+}
+
+/* Inserts @sample into @samples, which are ordered by offset, after
+ * any with the same offset. The transfer rate graph has to start over
+ * if it isn't the last one. Must hold bm_lock.
+ */
+static void
+insert_sample (DialogData     *data,
+               GArray         *samples,
+               const GduBenchmarkSample *sample)
+{
+  guint n;
+
+  for (n = samples->len; n > 0; n--)
+    {
+      if (g_array_index (samples, GduBenchmarkSample, n - 1).offset <= sample->offset)
+        break;
+    }
+  g_array_insert_val (samples, n, *sample);
+  if (n < samples->len - 1)
+    data->bm_samples_reordered++;
+}
+
+/* Checks if @size bytes at @offset can be written back to where they
+ * were read from, i.e. the device isn't zoned or they are in a
+ * conventional zone
+ */
+static gboolean
+can_write_in_place (DialogData *data,
+                    guint64     offset,
+                    guint64     size)
+{
+  const GduZone *zone;
+
+  if (data->bm_zones == NULL)
+    return TRUE;
+  zone = gdu_zones_lookup (data->bm_zones, offset);
+  return zone != NULL && !zone->sequential && offset + size <= zone->offset + zone->size;
+}
+
+/* On zoned devices, write tests go to the start of an empty zone
+ * instead, which is reset afterwards so nothing is lost. Returns an
+ * empty zone near @offset with room for @size bytes.
+ */
+static const GduZone *
+get_scratch_zone (DialogData  *data,
+                  guint64      offset,
+                  guint64      size,
+                  GError     **error)
+{
+  const GduZone *zone;
+
+  zone = gdu_zones_find_empty (data->bm_zones, offset, size);
+  if (zone == NULL)
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                 C_("benchmarking", "The device is zoned and has no empty zone to run the write test in"));
+  return zone;
+}
+
+/* Picks the PROFILE_WRITE_REGION_SIZE bytes in the middle of the
+ * device for write tests and reads what is in there, for the writes
+ * to write back (see gdu_benchmark_engine_run()). On zoned devices,
+ * it's the start of an empty zone instead and there's nothing to
+ * read. Free with clear_write_region(), also on failure.
+ */
+static gboolean
+prepare_write_region (DialogData     *data,
+                      gint            fd,
+                      guint64         disk_size,
+                      long            page_size,
+                      BMWriteRegion  *region,
+                      GError        **error)
+{
+  guint64 done;
+
+  if (data->bm_zones != NULL)
+    {
+      /* nothing to read, writes go to the zone in order from its start */
+      region->scratch_zone = get_scratch_zone (data, disk_size / 2, page_size, error);
+      if (region->scratch_zone == NULL)
+        return FALSE;
+      region->offset = region->scratch_zone->offset;
+      region->size = MIN (PROFILE_WRITE_REGION_SIZE, region->scratch_zone->capacity) & ~((guint64) page_size - 1);
+      return TRUE;
+    }
+
+  region->size = MIN (PROFILE_WRITE_REGION_SIZE, disk_size) & ~((guint64) page_size - 1);
+  region->offset = ((disk_size - region->size) / 2) & ~((guint64) page_size - 1);
+  region->data_unaligned = g_try_malloc (region->size + page_size);
+  if (region->data_unaligned == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                   C_("benchmarking", "Error allocating memory for the write test"));
+      return FALSE;
+    }
+  region->data = (guchar*) (((gintptr) (region->data_unaligned + page_size)) & (~(page_size - 1)));
+  for (done = 0; done < region->size; )
+    {
+      gsize chunk_size = MIN (region->size - done, 1024 * 1024);
+      ssize_t num_read;
+
+      if (g_cancellable_set_error_if_cancelled (data->bm_cancellable, error))
+        return FALSE;
+
+      num_read = pread (fd, region->data + done, chunk_size, region->offset + done);
+      if (num_read <= 0)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       num_read < 0 ? g_io_error_from_errno (errno) : G_IO_ERROR_FAILED,
+                       C_("benchmarking", "Error reading %lld bytes from offset %lld"),
+                       (long long int) chunk_size,
+                       (long long int) (region->offset + done));
+          return FALSE;
+        }
+      done += num_read;
+    }
+
+  return TRUE;
+}
+
+static void
+clear_write_region (BMWriteRegion *region)
+{
+  g_free (region->data_unaligned);
+  memset (region, 0, sizeof (BMWriteRegion));
+}
+
+/* Measures reading with each of the queue depths in queue_depths[] */
+static gboolean
+measure_queue_depth_scaling (DialogData           *data,
+                             gint                  fd,
+                             guint64               disk_size,
+                             GduBenchmarkPattern   pattern,
+                             gsize                 block_size,
+                             GArray               *samples,
+                             GError              **error)
+{
+  gboolean ret = FALSE;
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (queue_depths); n++)
+    {
+      GduBenchmarkWorkload workload = {0};
+      GduBenchmarkResult result = {0};
+      GduBenchmarkSample sample = {0};
+
+      workload.pattern = pattern;
+      workload.offset = 0;
+      workload.size = disk_size;
+      workload.block_size = block_size;
+      workload.queue_depth = queue_depths[n];
+      workload.max_usec = QUEUE_DEPTH_STEP_USEC;
+
+      if (!gdu_benchmark_engine_run (fd, &workload, &result, data->bm_cancellable, error))
+        goto out;
+
+      sample.offset = queue_depths[n];
+      sample.value = gdu_benchmark_result_get_bytes_per_sec (&result);
+      G_LOCK (bm_lock);
+      g_array_append_val (samples, sample);
+      G_UNLOCK (bm_lock);
+
+      bmt_schedule_update (data);
+    }
+
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+/* Runs each of the workload profiles that should run */
+static gboolean
+measure_profiles (DialogData  *data,
+                  gint         fd,
+                  guint64      disk_size,
+                  long         page_size,
+                  GError     **error)
+{
+  gboolean ret = FALSE;
+  BMWriteRegion region = {0};
+  gboolean scratch_zone_dirty = FALSE;
+  guint n;
+
+  if (data->bm_do_write && !prepare_write_region (data, fd, disk_size, page_size, &region, error))
+    goto out;
+
+  for (n = 0; n < G_N_ELEMENTS (profiles); n++)
+    {
+      GduBenchmarkWorkload workload = {0};
+      GduBenchmarkResult result = {0};
+      GduBenchmarkSample sample = {0};
+
+      if (!profile_should_run (data, n))
+        continue;
+
+      workload.pattern = profiles[n].pattern;
+      workload.block_size = profiles[n].block_size;
+      workload.queue_depth = data->bm_profile_num_threads;
+      workload.write_percentage = profiles[n].write_percentage;
+      workload.max_usec = ((gint64) data->bm_profile_duration_sec) * G_USEC_PER_SEC;
+      if (workload.write_percentage > 0)
+        {
+          workload.offset = region.offset;
+          workload.size = region.size;
+          workload.write_data = region.data;
+          workload.sequential_writes = (region.scratch_zone != NULL);
+          scratch_zone_dirty = (region.scratch_zone != NULL);
+        }
+      else
+        {
+          workload.offset = 0;
+          workload.size = disk_size;
+        }
+
+      if (!gdu_benchmark_engine_run (fd, &workload, &result, data->bm_cancellable, error))
+        goto out;
+
+      /* empty the zone again for the next profile */
+      if (scratch_zone_dirty)
+        {
+          if (!gdu_zones_reset (fd, region.scratch_zone, error))
+            goto out;
+          scratch_zone_dirty = FALSE;
+        }
+
+      sample.offset = n;
+      G_LOCK (bm_lock);
+      sample.value = gdu_benchmark_result_get_bytes_per_sec (&result);
+      g_array_append_val (data->bm_profile_rate_samples, sample);
+      sample.value = gdu_benchmark_result_get_iops (&result);
+      g_array_append_val (data->bm_profile_iops_samples, sample);
+      G_UNLOCK (bm_lock);
+
+      bmt_schedule_update (data);
+    }
+
+  ret = TRUE;
+
+ out:
+  /* don't leave anything behind in the zone, not even on failure */
+  if (scratch_zone_dirty)
+    gdu_zones_reset (fd, region.scratch_zone, NULL);
+  clear_write_region (&region);
+  return ret;
+}
+
+/* A batch of the sustained write test, see measure_sustained_write() */
+typedef struct
+{
+  gint fd;
+  GCancellable *cancellable;
+  guchar *buffer;
+  guint64 offset;
+  gsize size;
+  /* FALSE if zeroes are to be written instead of what is there */
+  gboolean write_back;
+  GError *error;
+} SustainedWriteBatch;
+
+/* Finds the next batch to write, starting at @done bytes into the
+ * region. Returns FALSE if there is nothing more to write.
+ */
+static gboolean
+get_sustained_write_batch (DialogData           *data,
+                           guint64               region_offset,
+                           guint64               region_size,
+                           guint64               done,
+                           GPtrArray            *written_zones,
+                           SustainedWriteBatch  *batch)
+{
+  while (done < region_size)
+    {
+      batch->offset = region_offset + done;
+      batch->size = MIN (region_size - done, SUSTAINED_WRITE_BATCH_SIZE);
+      batch->write_back = TRUE;
+
+      if (data->bm_zones != NULL)
+        {
+          const GduZone *zone;
+
+          zone = gdu_zones_lookup (data->bm_zones, region_offset + done);
+          if (zone != NULL && zone->sequential)
+            {
+              guint64 zone_done = region_offset + done - zone->offset;
+              gboolean started;
+
+              started = (written_zones->len > 0 && written_zones->pdata[written_zones->len - 1] == zone);
+              if (!zone->empty || zone_done >= zone->capacity || (zone_done > 0 && !started))
+                {
+                  done = MIN (zone->offset + zone->size - region_offset, region_size);
+                  continue;
+                }
+              if (!started)
+                g_ptr_array_add (written_zones, (gpointer) zone);
+              batch->size = MIN (batch->size, zone->capacity - zone_done);
+              batch->write_back = FALSE;
+            }
+          else if (zone != NULL)
+            {
+              /* don't run into the next zone, it may be sequential */
+              batch->size = MIN (batch->size, zone->offset + zone->size - (region_offset + done));
+            }
+        }
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Reads what is to be written back, runs in its own thread */
+static gpointer
+sustained_write_read_func (gpointer user_data)
+{
+  SustainedWriteBatch *batch = user_data;
+  gsize pos;
+
+  if (!batch->write_back)
+    {
+      memset (batch->buffer, 0, batch->size);
+      return NULL;
+    }
+
+  for (pos = 0; pos < batch->size; )
+    {
+      gsize chunk_size = MIN (batch->size - pos, SUSTAINED_WRITE_BLOCK_SIZE);
+      ssize_t num_read;
+
+      if (g_cancellable_set_error_if_cancelled (batch->cancellable, &batch->error))
+        break;
+
+      num_read = pread (batch->fd, batch->buffer + pos, chunk_size, batch->offset + pos);
+      if (num_read < 0 && errno == EINTR)
+        continue;
+      if (num_read <= 0)
+        {
+          g_set_error (&batch->error,
+                       G_IO_ERROR,
+                       num_read < 0 ? g_io_error_from_errno (errno) : G_IO_ERROR_FAILED,
+                       C_("benchmarking", "Error reading %lld bytes from offset %lld"),
+                       (long long int) chunk_size,
+                       (long long int) (batch->offset + pos));
+          break;
+        }
+      pos += num_read;
+    }
+
+  return NULL;
+}
+
+/* Writes back the region chosen by the user without pausing and
+ * records the write rate for every SUSTAINED_WRITE_WINDOW_USEC spent
+ * writing. The next SUSTAINED_WRITE_BATCH_SIZE bytes are read in
+ * another thread while the current ones are written - if the writes
+ * had to wait for them, the drive could use the pause to empty its
+ * fast cache, hiding the drop in the write rate this test is about.
+ *
+ * This always bypasses the page cache - otherwise the rate would drop
+ * when the kernel starts throttling dirty pages rather than when the
+ * drive runs out of fast cache or throttles.
+ *
+ * On zoned devices, what is in sequential zones can't be written back
+ * so only the empty ones are written, from their start, and reset
+ * afterwards. The others are skipped.
+ */
+static gboolean
+measure_sustained_write (DialogData  *data,
+                         gint         fd,
+                         guint64      disk_size,
+                         long         page_size,
+                         GError     **error)
+{
+  gboolean ret = FALSE;
+  guchar *buffers_unaligned[2] = {NULL, NULL};
+  SustainedWriteBatch batches[2];
+  SustainedWriteBatch *batch;
+  SustainedWriteBatch *next_batch;
+  GThread *read_thread = NULL;
+  gboolean have_batch;
+  guint64 region_offset;
+  guint64 region_size;
+  gint64 write_usec = 0;
+  gint64 window_usec = 0;
+  guint64 window_bytes = 0;
+  gint64 begin_usec;
+  gint64 end_usec;
+  guint64 num_bytes_written = 0;
+  GPtrArray *written_zones = NULL;
+  GduBenchmarkSample sample = {0};
+  guint n;
+
+  memset (batches, 0, sizeof batches);
+
+  region_offset = MIN (((guint64) data->bm_sustained_write_offset_gib) * 1024 * 1024 * 1024, disk_size);
+  region_offset &= ~((guint64) page_size - 1);
+  region_size = MIN (((guint64) data->bm_sustained_write_size_gib) * 1024 * 1024 * 1024, disk_size - region_offset);
+  region_size &= ~((guint64) page_size - 1);
+  if (region_size == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   C_("benchmarking", "The region for the sustained write test is past the end of the device"));
+      goto out;
+    }
+
+  G_LOCK (bm_lock);
+  data->bm_sustained_write_offset = region_offset;
+  data->bm_sustained_write_size = region_size;
+  data->bm_sustained_write_num_bytes_done = 0;
+  G_UNLOCK (bm_lock);
+
+  for (n = 0; n < 2; n++)
+    {
+      buffers_unaligned[n] = g_try_malloc (SUSTAINED_WRITE_BATCH_SIZE + page_size);
+      if (buffers_unaligned[n] == NULL)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                       C_("benchmarking", "Error allocating memory for the write test"));
+          goto out;
+        }
+      batches[n].fd = fd;
+      batches[n].cancellable = data->bm_cancellable;
+      batches[n].buffer = (guchar*) (((gintptr) (buffers_unaligned[n] + page_size)) & (~(page_size - 1)));
+    }
+
+  if (data->bm_zones != NULL)
+    written_zones = g_ptr_array_new ();
+
+  if (!set_direct_io (fd, TRUE, error))
+    goto out;
+
+  batch = &batches[0];
+  next_batch = &batches[1];
+  have_batch = get_sustained_write_batch (data, region_offset, region_size, 0, written_zones, batch);
+  if (have_batch)
+    read_thread = g_thread_new ("sustained-write-read", sustained_write_read_func, batch);
+
+  while (have_batch)
+    {
+      SustainedWriteBatch *tmp;
+      gboolean have_next_batch;
+      gsize pos;
+
+      g_thread_join (read_thread);
+      read_thread = NULL;
+      if (batch->error != NULL)
+        {
+          g_propagate_error (error, batch->error);
+          batch->error = NULL;
+          goto out;
+        }
+
+      have_next_batch = get_sustained_write_batch (data, region_offset, region_size,
+                                                   batch->offset + batch->size - region_offset,
+                                                   written_zones, next_batch);
+      if (have_next_batch)
+        read_thread = g_thread_new ("sustained-write-read", sustained_write_read_func, next_batch);
+
+      for (pos = 0; pos < batch->size; )
+        {
+          gsize chunk_size = MIN (batch->size - pos, SUSTAINED_WRITE_BLOCK_SIZE);
+          ssize_t num_written;
+
+          if (g_cancellable_set_error_if_cancelled (data->bm_cancellable, error))
+            goto out;
+
+          begin_usec = g_get_monotonic_time ();
+          num_written = pwrite (fd, batch->buffer + pos, chunk_size, batch->offset + pos);
+          end_usec = g_get_monotonic_time ();
+          if (num_written < 0)
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errno),
+                           C_("benchmarking", "Error writing %lld bytes at offset %lld: %m"),
+                           (long long int) chunk_size,
+                           (long long int) (batch->offset + pos));
+              goto out;
+            }
+          else if (num_written == 0)
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_FAILED,
+                           C_("benchmarking", "Error writing %lld bytes at offset %lld: Nothing was written"),
+                           (long long int) chunk_size,
+                           (long long int) (batch->offset + pos));
+              goto out;
+            }
+          pos += num_written;
+          num_bytes_written += num_written;
+
+          write_usec += end_usec - begin_usec;
+          window_usec += end_usec - begin_usec;
+          window_bytes += num_written;
+          if (window_usec >= SUSTAINED_WRITE_WINDOW_USEC)
+            {
+              sample.offset = write_usec;
+              sample.value = ((gdouble) G_USEC_PER_SEC) * window_bytes / window_usec;
+              G_LOCK (bm_lock);
+              g_array_append_val (data->bm_sustained_write_samples, sample);
+              G_UNLOCK (bm_lock);
+              window_usec = 0;
+              window_bytes = 0;
+              bmt_schedule_update (data);
+            }
+
+          G_LOCK (bm_lock);
+          data->bm_sustained_write_num_bytes_done = batch->offset + pos - region_offset;
+          G_UNLOCK (bm_lock);
+        }
+
+      tmp = batch;
+      batch = next_batch;
+      next_batch = tmp;
+      have_batch = have_next_batch;
+    }
+
+  G_LOCK (bm_lock);
+  data->bm_sustained_write_num_bytes_done = region_size;
+  G_UNLOCK (bm_lock);
+
+  if (num_bytes_written == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                   C_("benchmarking", "The device is zoned and has no empty zone in the region for the sustained write test"));
+      goto out;
+    }
+
+  /* what's still in the drive's write cache counts towards the last window */
+  begin_usec = g_get_monotonic_time ();
+  if (fsync (fd) != 0)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error syncing (at offset %lld): %m"),
+                   (long long int) (region_offset + region_size));
+      goto out;
+    }
+  end_usec = g_get_monotonic_time ();
+  write_usec += end_usec - begin_usec;
+  window_usec += end_usec - begin_usec;
+  if (window_bytes > 0 && window_usec > 0)
+    {
+      sample.offset = write_usec;
+      sample.value = ((gdouble) G_USEC_PER_SEC) * window_bytes / window_usec;
+      G_LOCK (bm_lock);
+      g_array_append_val (data->bm_sustained_write_samples, sample);
+      G_UNLOCK (bm_lock);
+      bmt_schedule_update (data);
+    }
 
-static void
-samples_from_gvariant (GArray   *array,
-                       GVariant *variant)
-{
-  GVariantIter iter;
-  BMSample sample;
+  if (!set_direct_io (fd, data->bm_do_direct_io, error))
+    goto out;
 
-  g_array_set_size (array, 0);
+  ret = TRUE;
 
-  g_variant_iter_init (&iter, variant);
-  while (g_variant_iter_next (&iter, "(td)", &sample.offset, &sample.value))
+ out:
+  /* the reads must be done before the buffers can be freed */
+  if (read_thread != NULL)
+    g_thread_join (read_thread);
+  for (n = 0; n < 2; n++)
+    g_clear_error (&batches[n].error);
+
+  /* the zones written to were empty so make them empty again */
+  if (written_zones != NULL)
     {
-      g_array_append_val (array, sample);
+      for (n = 0; n < written_zones->len; n++)
+        {
+          GError *local_error = NULL;
+
+          if (gdu_zones_reset (fd, written_zones->pdata[n], &local_error))
+            continue;
+          if (ret)
+            {
+              g_propagate_error (error, local_error);
+              ret = FALSE;
+            }
+          else
+            {
+              g_error_free (local_error);
+            }
+        }
+      g_ptr_array_unref (written_zones);
     }
+  g_free (buffers_unaligned[0]);
+  g_free (buffers_unaligned[1]);
+  return ret;
 }
 
+/* Runs filesystem_workloads[] against a test file in a temporary
+ * directory on the filesystem mounted at bm_filesystem_mount_point.
+ * Nothing is left behind, not even on failure or if cancelled.
+ */
 static gboolean
-maybe_load_data (DialogData  *data,
-                 GError     **error)
+measure_filesystem (DialogData  *data,
+                    long         page_size,
+                    GError     **error)
 {
   gboolean ret = FALSE;
+  struct statvfs vfs;
+  gchar *directory = NULL;
   gchar *filename = NULL;
-  GVariant *value = NULL;
-  gchar *variant_data = NULL;
-  gsize variant_size;
-  GError *local_error = NULL;
-  GVariant *read_samples_variant = NULL;
-  GVariant *write_samples_variant = NULL;
-  GVariant *access_time_samples_variant = NULL;
-  gint32 version;
-  gint64 timestamp_usec;
-  guint64 device_size;
-  guint64 sample_size;
+  guchar *buffer_unaligned = NULL;
+  guchar *buffer;
+  GRand *rand = NULL;
+  guint64 file_size;
+  guint64 done;
+  gint fd = -1;
+  gint flags;
+  guint n;
 
-  filename = get_bm_filename (data);
-  if (filename == NULL)
+  file_size = ((guint64) data->bm_filesystem_file_size_mib) * 1024 * 1024;
+
+  if (statvfs (data->bm_filesystem_mount_point, &vfs) != 0)
     {
-      /* all good since we don't want to load data for this device */
-      ret = TRUE;
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error getting free space of %s: %m"),
+                   data->bm_filesystem_mount_point);
       goto out;
     }
-
-  if (!g_file_get_contents (filename,
-                            &variant_data,
-                            &variant_size,
-                            &local_error))
+  /* leave some room for the filesystem's own metadata */
+  if (((guint64) vfs.f_bavail) * vfs.f_frsize < file_size + file_size / 10)
     {
-      if (local_error->domain == G_FILE_ERROR && local_error->code == G_FILE_ERROR_NOENT)
-        {
-          /* don't complain about a missing file */
-          g_clear_error (&local_error);
-          ret = TRUE;
-          goto out;
-        }
-      g_propagate_error (error, local_error);
+      gchar *s;
+      s = g_format_size (file_size);
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                   C_("benchmarking", "Not enough free space on %s for a %s test file"),
+                   data->bm_filesystem_mount_point, s);
+      g_free (s);
       goto out;
     }
 
-  value = g_variant_new_from_data (G_VARIANT_TYPE_VARDICT,
-                                   variant_data,
-                                   variant_size,
-                                   FALSE,
-                                   NULL, NULL);
-
-  if (!g_variant_lookup (value, "version", "i", &version))
+  directory = g_build_filename (data->bm_filesystem_mount_point, ".gnome-disks-benchmark-XXXXXX", NULL);
+  if (g_mkdtemp (directory) == NULL)
     {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                   "No version key");
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error creating a directory on %s: %m"),
+                   data->bm_filesystem_mount_point);
+      g_free (directory);
+      directory = NULL;
       goto out;
     }
-  if (version != 1)
+
+  /* not all filesystems support O_DIRECT, e.g. tmpfs */
+  filename = g_build_filename (directory, "test-file", NULL);
+  flags = O_RDWR | O_CREAT | O_CLOEXEC;
+  if (data->bm_do_direct_io)
+    fd = open (filename, flags | O_DIRECT, 0600);
+  if (fd == -1)
+    fd = open (filename, flags, 0600);
+  if (fd == -1)
     {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                   "Cannot decode version %d data", version);
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error creating %s: %m"),
+                   filename);
+      g_free (filename);
+      filename = NULL;
       goto out;
     }
 
-  if (!g_variant_lookup (value, "timestamp-usec", "x", &timestamp_usec))
+  /* Fill the file with real data (not just allocated blocks) so reads
+   * go to the disk. Not all zeroes in case the filesystem compresses.
+   */
+  buffer_unaligned = g_new0 (guchar, 1024 * 1024 + page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+  rand = g_rand_new_with_seed (42);
+  for (n = 0; n < 1024 * 1024; n += sizeof (guint32))
+    *((guint32 *) (buffer + n)) = g_rand_int (rand);
+  for (done = 0; done < file_size; )
     {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                   "No timestamp-usec");
-      goto out;
-    }
+      ssize_t num_written;
 
-  if (!g_variant_lookup (value, "device-size", "t", &device_size))
+      if (g_cancellable_set_error_if_cancelled (data->bm_cancellable, error))
+        goto out;
+
+      num_written = pwrite (fd, buffer, MIN (file_size - done, 1024 * 1024), done);
+      if (num_written <= 0)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       num_written < 0 ? g_io_error_from_errno (errno) : G_IO_ERROR_FAILED,
+                       C_("benchmarking", "Error writing to %s: %m"),
+                       filename);
+          goto out;
+        }
+      done += num_written;
+    }
+  if (fsync (fd) != 0)
     {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                   "No device-size");
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error syncing %s: %m"),
+                   filename);
       goto out;
     }
 
-  if (!g_variant_lookup (value, "read-samples", "@a(td)", &read_samples_variant))
+  for (n = 0; n < G_N_ELEMENTS (filesystem_workloads); n++)
     {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                   "No read-samples");
-      goto out;
+      const BMFilesystemWorkload *fs_workload = &filesystem_workloads[n];
+      GduBenchmarkResult result = {0};
+      GduBenchmarkSample sample = {0};
+
+      if (fs_workload->metadata)
+        {
+          if (!gdu_benchmark_engine_run_metadata (directory,
+                                                  data->bm_filesystem_num_threads,
+                                                  FILESYSTEM_WORKLOAD_USEC,
+                                                  &result,
+                                                  data->bm_cancellable,
+                                                  error))
+            goto out;
+        }
+      else
+        {
+          GduBenchmarkWorkload workload = {0};
+
+          workload.pattern = fs_workload->pattern;
+          workload.offset = 0;
+          workload.size = file_size;
+          workload.block_size = fs_workload->block_size;
+          workload.queue_depth = data->bm_filesystem_num_threads;
+          workload.write_percentage = fs_workload->write_percentage;
+          workload.write_data = NULL; /* it's our file */
+          workload.sync_writes = fs_workload->sync_writes;
+          workload.max_usec = FILESYSTEM_WORKLOAD_USEC;
+          if (!gdu_benchmark_engine_run (fd, &workload, &result, data->bm_cancellable, error))
+            goto out;
+        }
+
+      sample.offset = n;
+      G_LOCK (bm_lock);
+      sample.value = gdu_benchmark_result_get_bytes_per_sec (&result);
+      g_array_append_val (data->bm_filesystem_rate_samples, sample);
+      sample.value = gdu_benchmark_result_get_iops (&result);
+      g_array_append_val (data->bm_filesystem_iops_samples, sample);
+      G_UNLOCK (bm_lock);
+
+      bmt_schedule_update (data);
     }
 
-  if (!g_variant_lookup (value, "write-samples", "@a(td)", &write_samples_variant))
+  ret = TRUE;
+
+ out:
+  if (fd != -1)
+    close (fd);
+  if (filename != NULL)
+    g_unlink (filename);
+  if (directory != NULL)
+    g_rmdir (directory);
+  if (rand != NULL)
+    g_rand_free (rand);
+  g_free (buffer_unaligned);
+  g_free (filename);
+  g_free (directory);
+  return ret;
+}
+
+/* The fd from OpenForBenchmark() normally has O_DIRECT set already
+ * but don't rely on it, and clear it if the page cache is to be used
+ */
+static gboolean
+set_direct_io (gint       fd,
+               gboolean   direct_io,
+               GError   **error)
+{
+  gint flags;
+
+  flags = fcntl (fd, F_GETFL);
+  if (flags == -1)
     {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                   "No write-samples");
-      goto out;
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error getting file status flags: %m"));
+      return FALSE;
     }
 
-  if (!g_variant_lookup (value, "access-time-samples", "@a(td)", &access_time_samples_variant))
+  if (((flags & O_DIRECT) != 0) == (direct_io != FALSE))
+    return TRUE;
+
+  if (direct_io)
+    flags |= O_DIRECT;
+  else
+    flags &= ~O_DIRECT;
+  if (fcntl (fd, F_SETFL, flags) != 0)
     {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                   "No access-time-samples");
-      goto out;
+      if (direct_io)
+        g_set_error (error,
+                     G_IO_ERROR,
+                     g_io_error_from_errno (errno),
+                     C_("benchmarking", "Error enabling direct I/O: %m"));
+      else
+        g_set_error (error,
+                     G_IO_ERROR,
+                     g_io_error_from_errno (errno),
+                     C_("benchmarking", "Error disabling direct I/O: %m"));
+      return FALSE;
     }
 
-  if (!g_variant_lookup (value, "sample-size", "t", &sample_size))
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Where a measurement pass puts its samples, see append_sample() */
+typedef struct
+{
+  DialogData *data;
+  GArray *samples;
+} BMSampleSink;
+
+static void
+append_sample (const GduBenchmarkSample *sample,
+               gpointer                  user_data)
+{
+  BMSampleSink *sink = user_data;
+
+  G_LOCK (bm_lock);
+  g_array_append_vals (sink->samples, sample, 1);
+  G_UNLOCK (bm_lock);
+
+  bmt_schedule_update (sink->data);
+}
+
+/* Measures the access time by seek distance and by stroke, see
+ * gdubenchmarkseekprofile.c. The page cache is always bypassed since
+ * it would hide the seeks.
+ */
+static gboolean
+measure_seek_profile (DialogData  *data,
+                      gint         fd,
+                      guint64      disk_size,
+                      long         page_size,
+                      GError     **error)
+{
+  BMSampleSink distances = {data, data->bm_seek_distance_samples};
+  BMSampleSink strokes = {data, data->bm_seek_stroke_samples};
+
+  if (!set_direct_io (fd, TRUE, error))
+    return FALSE;
+
+  if (!gdu_benchmark_measure_seek_distances (fd, disk_size, page_size, append_sample, &distances,
+                                             data->bm_cancellable, error))
+    return FALSE;
+  if (!gdu_benchmark_measure_seek_strokes (fd, disk_size, page_size, append_sample, &strokes,
+                                           data->bm_cancellable, error))
+    return FALSE;
+
+  return set_direct_io (fd, data->bm_do_direct_io, error);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Reads, and writes if allowed, with each of the request sizes of the
+ * transfer size sweep, see gdubenchmarktransfersize.c. Writes go to
+ * the same region as the workload profiles. The page cache is always
+ * bypassed since it would split and merge requests.
+ */
+static gboolean
+measure_transfer_sizes (DialogData  *data,
+                        gint         fd,
+                        guint64      disk_size,
+                        long         page_size,
+                        GError     **error)
+{
+  gboolean ret = FALSE;
+  BMWriteRegion region = {0};
+  BMSampleSink reads = {data, data->bm_transfer_size_read_samples};
+  BMSampleSink writes = {data, data->bm_transfer_size_write_samples};
+
+  if (!set_direct_io (fd, TRUE, error))
+    goto out;
+
+  if (!gdu_benchmark_measure_transfer_size_reads (fd, disk_size, page_size, append_sample, &reads,
+                                                  data->bm_cancellable, error))
+    goto out;
+
+  if (data->bm_do_write)
     {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                   "No sample-size");
-      goto out;
+      if (!prepare_write_region (data, fd, disk_size, page_size, &region, error))
+        goto out;
+      if (!gdu_benchmark_measure_transfer_size_writes (fd, region.offset, region.size,
+                                                       region.data, region.scratch_zone,
+                                                       append_sample, &writes,
+                                                       data->bm_cancellable, error))
+        goto out;
     }
 
-  data->bm_time_benchmarked_usec = timestamp_usec;
-  data->bm_size = device_size;
-  data->bm_sample_size = sample_size;
-  samples_from_gvariant (data->bm_read_samples, read_samples_variant);
-  samples_from_gvariant (data->bm_write_samples, write_samples_variant);
-  samples_from_gvariant (data->bm_access_time_samples, access_time_samples_variant);
+  if (!set_direct_io (fd, data->bm_do_direct_io, error))
+    goto out;
 
   ret = TRUE;
 
  out:
-  if (read_samples_variant != NULL)
-    g_variant_unref (read_samples_variant);
-  if (write_samples_variant != NULL)
-    g_variant_unref (write_samples_variant);
-  if (access_time_samples_variant != NULL)
-    g_variant_unref (access_time_samples_variant);
-  if (value != NULL)
-    g_variant_unref (value);
-  g_free (variant_data);
-  g_free (filename);
+  clear_write_region (&region);
   return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static GVariant *
-samples_to_gvariant (GArray *array)
+/* Reads the I/O counters of each RAID member into @stats */
+static gboolean
+read_raid_members_stats (DialogData    *data,
+                         GduDiskStats  *stats,
+                         GError       **error)
 {
   guint n;
-  GVariantBuilder builder;
 
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(td)"));
-  for (n = 0; n < array->len; n++)
+  for (n = 0; n < data->bm_raid_members->len; n++)
     {
-      BMSample *s = &g_array_index (array, BMSample, n);
-      g_variant_builder_add (&builder, "(td)", s->offset, s->value);
+      BMRaidMember *member = data->bm_raid_members->pdata[n];
+      if (!gdu_disk_stats_read (member->device_number, &stats[n], error))
+        return FALSE;
     }
-
-  return g_variant_builder_end (&builder);
+  return TRUE;
 }
 
+/* Adds what happened to each RAID member since @before was read, in a
+ * timed read from the array taking @usec, to what it did so far
+ */
+static gboolean
+add_raid_members_stats (DialogData          *data,
+                        const GduDiskStats  *before,
+                        gint64               usec,
+                        GError             **error)
+{
+  guint n;
+
+  for (n = 0; n < data->bm_raid_members->len; n++)
+    {
+      BMRaidMember *member = data->bm_raid_members->pdata[n];
+      GduDiskStats after;
+      GduDiskStats delta;
+
+      if (!gdu_disk_stats_read (member->device_number, &after, error))
+        return FALSE;
+      gdu_disk_stats_subtract (&after, &before[n], &delta);
+
+      G_LOCK (bm_lock);
+      member->array_stats.read_ios += delta.read_ios;
+      member->array_stats.read_sectors += delta.read_sectors;
+      member->array_stats.read_ticks_msec += delta.read_ticks_msec;
+      G_UNLOCK (bm_lock);
+    }
+
+  G_LOCK (bm_lock);
+  data->bm_raid_array_usec += usec;
+  G_UNLOCK (bm_lock);
+  return TRUE;
+}
 
+/* Reads from @member on its own, read-only, at the start of as many
+ * evenly spread slices as there were samples of the array
+ */
 static gboolean
-maybe_save_data (DialogData  *data,
-                 GError     **error)
+measure_raid_member (DialogData    *data,
+                     BMRaidMember  *member,
+                     long           page_size,
+                     GError       **error)
 {
   gboolean ret = FALSE;
-  gchar *filename = NULL;
-  GVariantBuilder builder;
-  GVariant *value = NULL;
-  gconstpointer variant_data;
-  gsize variant_size;
+  GVariant *fd_index = NULL;
+  GUnixFDList *fd_list = NULL;
+  GVariantBuilder options_builder;
+  GduBenchmarkWorkload workload = {0};
+  GduBenchmarkResult result = {0};
+  guint64 member_size;
+  gdouble sum = 0.0;
+  gint fd = -1;
+  gint n;
 
-  filename = get_bm_filename (data);
-  if (filename == NULL)
+  g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&options_builder, "{sv}", "writable", g_variant_new_boolean (FALSE));
+  if (!udisks_block_call_open_for_benchmark_sync (member->block,
+                                                  g_variant_builder_end (&options_builder),
+                                                  NULL, /* fd_list */
+                                                  &fd_index,
+                                                  &fd_list,
+                                                  data->bm_cancellable,
+                                                  error))
+    goto out;
+
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+  if (fd == -1)
+    goto out;
+
+  if (ioctl (fd, BLKGETSIZE64, &member_size) != 0)
     {
-      /* all good since we don't want to save data for this device */
-      ret = TRUE;
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error getting size of device: %m"));
+      goto out;
+    }
+
+  if (member_size < data->bm_sample_size)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   C_("benchmarking", "The device is too small for the benchmark"));
       goto out;
     }
 
-  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
-  g_variant_builder_add (&builder, "{sv}", "version", g_variant_new_int32 (1));
-  g_variant_builder_add (&builder, "{sv}", "timestamp-usec", g_variant_new_int64 (data->bm_time_benchmarked_usec));
-  g_variant_builder_add (&builder, "{sv}", "device-size", g_variant_new_uint64 (data->bm_size));
-  g_variant_builder_add (&builder, "{sv}", "sample-size", g_variant_new_uint64 (data->bm_sample_size));
-  g_variant_builder_add (&builder, "{sv}", "read-samples", samples_to_gvariant (data->bm_read_samples));
-  g_variant_builder_add (&builder, "{sv}", "write-samples", samples_to_gvariant (data->bm_write_samples));
-  g_variant_builder_add (&builder, "{sv}", "access-time-samples", samples_to_gvariant (data->bm_access_time_samples));
-  value = g_variant_builder_end (&builder);
+  if (!set_direct_io (fd, data->bm_do_direct_io, error))
+    goto out;
 
-  variant_data = g_variant_get_data (value);
-  variant_size = g_variant_get_size (value);
+  workload.pattern = GDU_BENCHMARK_PATTERN_SEQUENTIAL;
+  workload.size = data->bm_sample_size;
+  workload.block_size = data->bm_sample_size;
+  workload.queue_depth = 1;
+  workload.max_ops = 1;
+  for (n = 0; n < data->bm_num_samples; n++)
+    {
+      workload.offset = MIN (n * (member_size / data->bm_num_samples), member_size - data->bm_sample_size);
+      workload.offset &= ~((guint64) page_size - 1);
+      if (!gdu_benchmark_engine_run (fd, &workload, &result, data->bm_cancellable, error))
+        goto out;
+      sum += gdu_benchmark_result_get_bytes_per_sec (&result);
+    }
 
-  if (!g_file_set_contents (filename,
-                            variant_data,
-                            variant_size,
-                            error))
-    goto out;
+  G_LOCK (bm_lock);
+  member->read_rate = sum / data->bm_num_samples;
+  G_UNLOCK (bm_lock);
+
+  ret = TRUE;
 
  out:
-  if (value != NULL)
-    g_variant_unref (value);
-  g_free (filename);
+  if (fd != -1)
+    close (fd);
+  g_clear_object (&fd_list);
+  if (fd_index != NULL)
+    g_variant_unref (fd_index);
   return ret;
 }
 
-/* ---------------------------------------------------------------------------------------------------- */
-
-/* called on main / UI thread */
+/* Sums up how each RAID member fared while the transfer rate of the
+ * array was measured and then reads from each member on its own
+ */
 static gboolean
-bmt_on_timeout (gpointer user_data)
+measure_raid_members (DialogData  *data,
+                      long         page_size,
+                      GError     **error)
 {
-  DialogData *data = user_data;
-  update_dialog (data);
-  G_LOCK (bm_lock);
-  data->bm_update_timeout_pending = FALSE;
-  G_UNLOCK (bm_lock);
-  dialog_data_unref (data);
-  return FALSE; /* don't run again */
-}
+  guint n;
 
-static void
-bmt_schedule_update (DialogData *data)
-{
-  /* rate-limit updates */
   G_LOCK (bm_lock);
-  if (!data->bm_update_timeout_pending)
+  for (n = 0; n < data->bm_raid_members->len; n++)
     {
-      g_timeout_add (200, /* ms */
-                     bmt_on_timeout,
-                     dialog_data_ref (data));
-      data->bm_update_timeout_pending = TRUE;
+      BMRaidMember *member = data->bm_raid_members->pdata[n];
+      if (data->bm_raid_array_usec > 0)
+        member->array_read_rate = member->array_stats.read_sectors * 512.0 * G_USEC_PER_SEC / data->bm_raid_array_usec;
+      if (member->array_stats.read_ios > 0)
+        member->array_access_time = member->array_stats.read_ticks_msec / 1000.0 / member->array_stats.read_ios;
     }
   G_UNLOCK (bm_lock);
+
+  for (n = 0; n < data->bm_raid_members->len; n++)
+    {
+      if (!measure_raid_member (data, data->bm_raid_members->pdata[n], page_size, error))
+        return FALSE;
+
+      G_LOCK (bm_lock);
+      data->bm_raid_num_members_done++;
+      G_UNLOCK (bm_lock);
+      bmt_schedule_update (data);
+    }
+
+  return TRUE;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
 static gpointer
 benchmark_thread (gpointer user_data)
 {
@@ -1139,14 +5114,15 @@ benchmark_thread (gpointer user_data)
   guchar *buffer_unaligned = NULL;
   guchar *buffer = NULL;
   GRand *rand = NULL;
+  GduDiskStats *raid_stats_before = NULL;
+  const GduZone *dirty_zone = NULL;
   int fd = -1;
   gint n;
+  gint64 pass_begin_usec;
   long page_size;
   guint64 disk_size;
   GVariantBuilder options_builder;
 
-  //g_print ("bm thread start\n");
-
   g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
   g_variant_builder_add (&options_builder, "{sv}", "writable", g_variant_new_boolean (data->bm_do_write));
 
@@ -1185,52 +5161,103 @@ benchmark_thread (gpointer user_data)
       goto out;
     }
 
+  /* zoned devices only allow writing sequential zones at their write pointer */
+  if (data->bm_do_write &&
+      gdu_zones_get_model (udisks_block_get_device_number (data->block)) != GDU_ZONED_MODEL_NONE)
+    {
+      data->bm_zones = gdu_zones_report (fd, &error);
+      if (data->bm_zones == NULL)
+        goto out;
+    }
+
+  if (!set_direct_io (fd, data->bm_do_direct_io, &error))
+    goto out;
+
+  /* page-aligned so it can be used with O_DIRECT */
   buffer_unaligned = g_new0 (guchar, data->bm_sample_size_mib*1024*1024 + page_size);
   buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
 
+  /* With the page cache bypassed, offsets are random (but still
+   * page-aligned) so a run doesn't read what the drive itself cached
+   * during the last one. Otherwise, they are deterministic (per size)
+   * so runs are repeatable.
+   */
+  if (data->bm_do_direct_io)
+    rand = g_rand_new ();
+  else
+    rand = g_rand_new_with_seed (42);
+
   /* transfer rate... */
   G_LOCK (bm_lock);
   data->bm_size = disk_size;
   data->bm_sample_size = data->bm_sample_size_mib*1024*1024;
+  data->bm_direct_io = data->bm_do_direct_io;
   data->bm_state = BM_STATE_TRANSFER_RATE;
   G_UNLOCK (bm_lock);
-  for (n = 0; n < data->bm_num_samples; n++)
+  /* for RAID arrays, also keep track of what each member does in the timed reads */
+  if (data->bm_do_raid_members)
+    raid_stats_before = g_new0 (GduDiskStats, data->bm_raid_members->len);
+  pass_begin_usec = g_get_monotonic_time ();
+  for (n = 0; ; n++)
     {
       gchar *s, *s2;
       gint64 begin_usec;
       gint64 end_usec;
       gint64 offset;
       ssize_t num_read;
-      BMSample sample = {0};
+      guint slice;
+      guint pass;
+      GduBenchmarkSample sample = {0};
 
       if (g_cancellable_set_error_if_cancelled (data->bm_cancellable, &error))
         goto out;
 
-      /* figure out offset and align to page-size */
-      offset = n * disk_size / data->bm_num_samples;
-      offset &= ~(page_size - 1);
+      slice = n % data->bm_num_samples;
+      pass = n / data->bm_num_samples;
+      if (slice == 0 && pass > 0 &&
+          !take_another_pass (data, data->bm_read_samples, data->bm_write_samples, pass, pass_begin_usec))
+        break;
 
-      if (lseek (fd, offset, SEEK_SET) != offset)
+      /* figure out offset, anywhere in the slice of the device with
+       * direct I/O or where this pass reads in it otherwise, and align
+       * to page-size
+       */
+      offset = slice * disk_size / data->bm_num_samples;
+      if (disk_size / data->bm_num_samples > data->bm_sample_size)
         {
-          g_set_error (&error,
-                       G_IO_ERROR,
-                       g_io_error_from_errno (errno),
-                       C_("benchmarking", "Error seeking to offset %lld"),
-                       (long long int) offset);
-          goto out;
+          if (data->bm_do_direct_io)
+            offset += (gint64) g_rand_double_range (rand, 0,
+                                                    (gdouble) (disk_size / data->bm_num_samples - data->bm_sample_size));
+          else
+            offset += (gint64) (gdu_benchmark_get_pass_fraction (pass) * (disk_size / data->bm_num_samples - data->bm_sample_size));
         }
-      if (read (fd, buffer, page_size) != page_size)
+      offset &= ~(page_size - 1);
+
+      /* without direct I/O, make sure the drive is spun up and the head is in position */
+      if (!data->bm_do_direct_io)
         {
-          s = g_format_size_full (page_size, G_FORMAT_SIZE_LONG_FORMAT);
-          s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
-          g_set_error (&error,
-                       G_IO_ERROR,
-                       g_io_error_from_errno (errno),
-                       C_("benchmarking", "Error pre-reading %s from offset %s"),
-                       s, s2);
-          g_free (s2);
-          g_free (s);
-          goto out;
+          if (lseek (fd, offset, SEEK_SET) != offset)
+            {
+              g_set_error (&error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errno),
+                           C_("benchmarking", "Error seeking to offset %lld"),
+                           (long long int) offset);
+              goto out;
+            }
+          if (read (fd, buffer, page_size) != page_size)
+            {
+              s = g_format_size_full (page_size, G_FORMAT_SIZE_LONG_FORMAT);
+              s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
+              g_set_error (&error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errno),
+                           C_("benchmarking", "Error pre-reading %s from offset %s"),
+                           s, s2);
+              g_free (s2);
+              g_free (s);
+              goto out;
+            }
         }
       if (lseek (fd, offset, SEEK_SET) != offset)
         {
@@ -1243,6 +5270,8 @@ benchmark_thread (gpointer user_data)
           g_free (s);
           goto out;
         }
+      if (raid_stats_before != NULL && !read_raid_members_stats (data, raid_stats_before, &error))
+        goto out;
       begin_usec = g_get_monotonic_time ();
       num_read = read (fd, buffer, data->bm_sample_size_mib*1024*1024);
       if (G_UNLIKELY (num_read < 0))
@@ -1259,48 +5288,65 @@ benchmark_thread (gpointer user_data)
           goto out;
         }
       end_usec = g_get_monotonic_time ();
+      if (raid_stats_before != NULL && !add_raid_members_stats (data, raid_stats_before, end_usec - begin_usec, &error))
+        goto out;
 
       sample.offset = offset;
       sample.value = ((gdouble) G_USEC_PER_SEC) * num_read / (end_usec - begin_usec);
       G_LOCK (bm_lock);
-      g_array_append_val (data->bm_read_samples, sample);
+      insert_sample (data, data->bm_read_samples, &sample);
       G_UNLOCK (bm_lock);
 
       bmt_schedule_update (data);
 
       if (data->bm_do_write)
         {
+          const GduZone *scratch_zone = NULL;
+          gint64 write_offset = offset;
           ssize_t num_written;
 
-          /* and now write the same block again... */
-          if (lseek (fd, offset, SEEK_SET) != offset)
+          /* and now write the same block again... or, if it's in a
+           * sequential zone, to an empty zone (see get_scratch_zone())
+           */
+          if (!can_write_in_place (data, offset, num_read))
             {
-              g_set_error (&error,
-                           G_IO_ERROR,
-                           g_io_error_from_errno (errno),
-                           C_("benchmarking", "Error seeking to offset %lld"),
-                           (long long int) offset);
-              goto out;
+              scratch_zone = get_scratch_zone (data, offset, num_read, &error);
+              if (scratch_zone == NULL)
+                goto out;
+              write_offset = scratch_zone->offset;
             }
-          if (read (fd, buffer, page_size) != page_size)
+          if (!data->bm_do_direct_io && scratch_zone == NULL)
             {
-              g_set_error (&error,
-                           G_IO_ERROR,
-                           g_io_error_from_errno (errno),
-                           C_("benchmarking", "Error pre-reading %lld bytes from offset %lld"),
-                           (long long int) page_size,
-                           (long long int) offset);
-              goto out;
+              if (lseek (fd, write_offset, SEEK_SET) != write_offset)
+                {
+                  g_set_error (&error,
+                               G_IO_ERROR,
+                               g_io_error_from_errno (errno),
+                               C_("benchmarking", "Error seeking to offset %lld"),
+                               (long long int) write_offset);
+                  goto out;
+                }
+              if (read (fd, buffer, page_size) != page_size)
+                {
+                  g_set_error (&error,
+                               G_IO_ERROR,
+                               g_io_error_from_errno (errno),
+                               C_("benchmarking", "Error pre-reading %lld bytes from offset %lld"),
+                               (long long int) page_size,
+                               (long long int) write_offset);
+                  goto out;
+                }
             }
-          if (lseek (fd, offset, SEEK_SET) != offset)
+          if (lseek (fd, write_offset, SEEK_SET) != write_offset)
             {
               g_set_error (&error,
                            G_IO_ERROR,
                            g_io_error_from_errno (errno),
                            C_("benchmarking", "Error seeking to offset %lld"),
-                           (long long int) offset);
+                           (long long int) write_offset);
               goto out;
             }
+          dirty_zone = scratch_zone;
           begin_usec = g_get_monotonic_time ();
           num_written = write (fd, buffer, num_read);
           if (G_UNLIKELY (num_written < 0))
@@ -1310,7 +5356,7 @@ benchmark_thread (gpointer user_data)
                            g_io_error_from_errno (errno),
                            C_("benchmarking", "Error writing %lld bytes at offset %lld: %m"),
                            (long long int) num_read,
-                           (long long int) offset);
+                           (long long int) write_offset);
               goto out;
             }
           if (num_written != num_read)
@@ -1329,15 +5375,23 @@ benchmark_thread (gpointer user_data)
                            G_IO_ERROR,
                            g_io_error_from_errno (errno),
                            C_("benchmarking", "Error syncing (at offset %lld): %m"),
-                           (long long int) offset);
+                           (long long int) write_offset);
               goto out;
             }
           end_usec = g_get_monotonic_time ();
 
+          if (dirty_zone != NULL)
+            {
+              if (!gdu_zones_reset (fd, dirty_zone, &error))
+                goto out;
+              dirty_zone = NULL;
+            }
+
+          /* plotted where it was read from, even if written to a zone elsewhere */
           sample.offset = offset;
           sample.value = ((gdouble) G_USEC_PER_SEC) * num_written / (end_usec - begin_usec);
           G_LOCK (bm_lock);
-          g_array_append_val (data->bm_write_samples, sample);
+          insert_sample (data, data->bm_write_samples, &sample);
           G_UNLOCK (bm_lock);
 
           bmt_schedule_update (data);
@@ -1348,18 +5402,23 @@ benchmark_thread (gpointer user_data)
   G_LOCK (bm_lock);
   data->bm_state = BM_STATE_ACCESS_TIME;
   G_UNLOCK (bm_lock);
-  rand = g_rand_new_with_seed (42); /* want this to be deterministic (per size) so it's repeatable */
-  for (n = 0; n < data->bm_num_access_samples; n++)
+  pass_begin_usec = g_get_monotonic_time ();
+  for (n = 0; ; n++)
     {
       gint64 begin_usec;
       gint64 end_usec;
       gint64 offset;
       ssize_t num_read;
-      BMSample sample = {0};
+      GduBenchmarkSample sample = {0};
 
       if (g_cancellable_set_error_if_cancelled (data->bm_cancellable, &error))
         goto out;
 
+      if (n % data->bm_num_access_samples == 0 && n > 0 &&
+          !take_another_pass (data, data->bm_access_time_samples, NULL,
+                              n / data->bm_num_access_samples, pass_begin_usec))
+        break;
+
       offset = (guint64) g_rand_double_range (rand, 0, (gdouble) disk_size);
       offset &= ~(page_size - 1);
 
@@ -1391,11 +5450,95 @@ benchmark_thread (gpointer user_data)
       sample.value = (end_usec - begin_usec) / ((gdouble) G_USEC_PER_SEC);
       G_LOCK (bm_lock);
       g_array_append_val (data->bm_access_time_samples, sample);
+      gdu_histogram_record (data->bm_access_time_histogram, end_usec - begin_usec);
       G_UNLOCK (bm_lock);
 
       bmt_schedule_update (data);
     }
 
+  /* seek profile... */
+  if (data->bm_do_seek_profile)
+    {
+      G_LOCK (bm_lock);
+      data->bm_state = BM_STATE_SEEK_PROFILE;
+      data->bm_seek_profile_target = data->bm_seek_profile_target_msec / 1000.0;
+      G_UNLOCK (bm_lock);
+      if (!measure_seek_profile (data, fd, disk_size, page_size, &error))
+        goto out;
+    }
+
+  /* RAID members... */
+  if (data->bm_do_raid_members)
+    {
+      G_LOCK (bm_lock);
+      data->bm_state = BM_STATE_RAID_MEMBERS;
+      G_UNLOCK (bm_lock);
+      if (!measure_raid_members (data, page_size, &error))
+        goto out;
+    }
+
+  /* queue depth scaling... */
+  if (data->bm_do_queue_depth)
+    {
+      G_LOCK (bm_lock);
+      data->bm_state = BM_STATE_QUEUE_DEPTH;
+      data->bm_sequential_queue_depth_block_size = QUEUE_DEPTH_SEQUENTIAL_BLOCK_SIZE;
+      data->bm_random_queue_depth_block_size = QUEUE_DEPTH_RANDOM_BLOCK_SIZE;
+      G_UNLOCK (bm_lock);
+      if (!measure_queue_depth_scaling (data, fd, disk_size,
+                                        GDU_BENCHMARK_PATTERN_SEQUENTIAL,
+                                        QUEUE_DEPTH_SEQUENTIAL_BLOCK_SIZE,
+                                        data->bm_sequential_queue_depth_samples,
+                                        &error))
+        goto out;
+      if (!measure_queue_depth_scaling (data, fd, disk_size,
+                                        GDU_BENCHMARK_PATTERN_RANDOM,
+                                        QUEUE_DEPTH_RANDOM_BLOCK_SIZE,
+                                        data->bm_random_queue_depth_samples,
+                                        &error))
+        goto out;
+    }
+
+  /* transfer size sweep... */
+  if (data->bm_do_transfer_size)
+    {
+      G_LOCK (bm_lock);
+      data->bm_state = BM_STATE_TRANSFER_SIZE;
+      G_UNLOCK (bm_lock);
+      if (!measure_transfer_sizes (data, fd, disk_size, page_size, &error))
+        goto out;
+    }
+
+  /* workload profiles... */
+  if (data->bm_do_profiles)
+    {
+      G_LOCK (bm_lock);
+      data->bm_state = BM_STATE_PROFILES;
+      G_UNLOCK (bm_lock);
+      if (!measure_profiles (data, fd, disk_size, page_size, &error))
+        goto out;
+    }
+
+  /* filesystem... */
+  if (data->bm_do_filesystem)
+    {
+      G_LOCK (bm_lock);
+      data->bm_state = BM_STATE_FILESYSTEM;
+      G_UNLOCK (bm_lock);
+      if (!measure_filesystem (data, page_size, &error))
+        goto out;
+    }
+
+  /* sustained write... */
+  if (data->bm_do_sustained_write)
+    {
+      G_LOCK (bm_lock);
+      data->bm_state = BM_STATE_SUSTAINED_WRITE;
+      G_UNLOCK (bm_lock);
+      if (!measure_sustained_write (data, fd, disk_size, page_size, &error))
+        goto out;
+    }
+
   G_LOCK (bm_lock);
   data->bm_time_benchmarked_usec = g_get_real_time ();
   G_UNLOCK (bm_lock);
@@ -1409,9 +5552,18 @@ benchmark_thread (gpointer user_data)
 
   if (fd_index != NULL)
     g_variant_unref (fd_index);
+  /* don't leave anything behind in an empty zone written to */
+  if (dirty_zone != NULL)
+    gdu_zones_reset (fd, dirty_zone, NULL);
+  if (data->bm_zones != NULL)
+    {
+      g_array_unref (data->bm_zones);
+      data->bm_zones = NULL;
+    }
   if (fd != -1)
     close (fd);
   g_free (buffer_unaligned);
+  g_free (raid_stats_before);
   data->bm_in_progress = FALSE;
   data->bm_thread = NULL;
   data->bm_state = BM_STATE_NONE;
@@ -1423,6 +5575,22 @@ benchmark_thread (gpointer user_data)
       g_array_set_size (data->bm_read_samples, 0);
       g_array_set_size (data->bm_write_samples, 0);
       g_array_set_size (data->bm_access_time_samples, 0);
+      gdu_histogram_clear (data->bm_access_time_histogram);
+      g_array_set_size (data->bm_sequential_queue_depth_samples, 0);
+      g_array_set_size (data->bm_random_queue_depth_samples, 0);
+      g_array_set_size (data->bm_profile_rate_samples, 0);
+      g_array_set_size (data->bm_profile_iops_samples, 0);
+      g_array_set_size (data->bm_filesystem_rate_samples, 0);
+      g_array_set_size (data->bm_filesystem_iops_samples, 0);
+      g_array_set_size (data->bm_sustained_write_samples, 0);
+      g_array_set_size (data->bm_seek_distance_samples, 0);
+      g_array_set_size (data->bm_seek_stroke_samples, 0);
+      data->bm_seek_profile_target = 0.0;
+      g_array_set_size (data->bm_transfer_size_read_samples, 0);
+      g_array_set_size (data->bm_transfer_size_write_samples, 0);
+      g_ptr_array_set_size (data->bm_raid_members, 0);
+      g_free (data->bm_raid_level);
+      data->bm_raid_level = NULL;
       data->bm_time_benchmarked_usec = 0;
       data->bm_sample_size = 0;
       data->bm_size = 0;
@@ -1433,7 +5601,6 @@ benchmark_thread (gpointer user_data)
 
   dialog_data_unref (data);
 
-  //g_print ("bm thread end\n");
   return NULL;
 }
 
@@ -1446,13 +5613,59 @@ abort_benchmark (DialogData *data)
 static void
 start_benchmark2 (DialogData *data)
 {
+  invalidate_graph (data);
   data->bm_in_progress = TRUE;
   data->bm_state = BM_STATE_OPENING_DEVICE;
   g_clear_error (&data->bm_error);
   g_array_set_size (data->bm_read_samples, 0);
   g_array_set_size (data->bm_write_samples, 0);
   g_array_set_size (data->bm_access_time_samples, 0);
+  gdu_histogram_clear (data->bm_access_time_histogram);
+  g_array_set_size (data->bm_sequential_queue_depth_samples, 0);
+  g_array_set_size (data->bm_random_queue_depth_samples, 0);
+  data->bm_sequential_queue_depth_block_size = 0;
+  data->bm_random_queue_depth_block_size = 0;
+  g_array_set_size (data->bm_profile_rate_samples, 0);
+  g_array_set_size (data->bm_profile_iops_samples, 0);
+  g_array_set_size (data->bm_filesystem_rate_samples, 0);
+  g_array_set_size (data->bm_filesystem_iops_samples, 0);
+  g_array_set_size (data->bm_sustained_write_samples, 0);
+  data->bm_sustained_write_offset = 0;
+  data->bm_sustained_write_size = 0;
+  data->bm_sustained_write_num_bytes_done = 0;
+  g_array_set_size (data->bm_seek_distance_samples, 0);
+  g_array_set_size (data->bm_seek_stroke_samples, 0);
+  data->bm_seek_profile_target = 0.0;
+  g_array_set_size (data->bm_transfer_size_read_samples, 0);
+  g_array_set_size (data->bm_transfer_size_write_samples, 0);
+  g_ptr_array_set_size (data->bm_raid_members, 0);
+  g_free (data->bm_raid_level);
+  data->bm_raid_level = NULL;
+  data->bm_raid_array_usec = 0;
+  data->bm_raid_num_members_done = 0;
+  if (data->bm_do_raid_members)
+    {
+      GList *members;
+      GList *l;
+
+      data->bm_raid_level = udisks_mdraid_dup_level (data->mdraid);
+      members = udisks_client_get_members_for_mdraid (gdu_window_get_client (data->window), data->mdraid);
+      for (l = members; l != NULL; l = l->next)
+        {
+          UDisksBlock *block = UDISKS_BLOCK (l->data);
+          BMRaidMember *member;
+
+          member = g_new0 (BMRaidMember, 1);
+          member->name = udisks_block_dup_preferred_device (block);
+          member->block = g_object_ref (block);
+          member->device_number = udisks_block_get_device_number (block);
+          g_ptr_array_add (data->bm_raid_members, member);
+        }
+      g_ptr_array_sort (data->bm_raid_members, bm_raid_member_compare);
+      g_list_free_full (members, g_object_unref);
+    }
   data->bm_time_benchmarked_usec = 0;
+  data->bm_direct_io = FALSE;
   g_cancellable_reset (data->bm_cancellable);
 
   data->bm_thread = g_thread_new ("benchmark-thread",
@@ -1473,6 +5686,64 @@ ensure_unused_cb (GduWindow     *window,
   dialog_data_unref (data);
 }
 
+/* Returns the first mount point of the filesystem on the device, or
+ * of the unlocked device if it's encrypted, or %NULL if not mounted
+ */
+static gchar *
+get_filesystem_mount_point (DialogData *data)
+{
+  UDisksClient *client = gdu_window_get_client (data->window);
+  UDisksFilesystem *filesystem;
+  UDisksBlock *cleartext_block = NULL;
+  UDisksObject *cleartext_object = NULL;
+  const gchar *const *mount_points;
+  gchar *ret = NULL;
+
+  filesystem = udisks_object_peek_filesystem (data->object);
+  if (filesystem == NULL)
+    {
+      cleartext_block = udisks_client_get_cleartext_block (client, data->block);
+      if (cleartext_block == NULL)
+        goto out;
+      cleartext_object = (UDisksObject *) g_dbus_interface_dup_object (G_DBUS_INTERFACE (cleartext_block));
+      if (cleartext_object == NULL)
+        goto out;
+      filesystem = udisks_object_peek_filesystem (cleartext_object);
+      if (filesystem == NULL)
+        goto out;
+    }
+
+  mount_points = udisks_filesystem_get_mount_points (filesystem);
+  if (mount_points != NULL && mount_points[0] != NULL)
+    ret = g_strdup (mount_points[0]);
+
+ out:
+  g_clear_object (&cleartext_object);
+  g_clear_object (&cleartext_block);
+  return ret;
+}
+
+/* Writing to the device requires it to be unused (e.g. unmounted) and
+ * the filesystem benchmark requires it to be mounted
+ */
+static void
+on_write_checkbutton_toggled (GtkToggleButton *write_checkbutton,
+                              gpointer         user_data)
+{
+  GtkToggleButton *filesystem_checkbutton = GTK_TOGGLE_BUTTON (user_data);
+  if (gtk_toggle_button_get_active (write_checkbutton))
+    gtk_toggle_button_set_active (filesystem_checkbutton, FALSE);
+}
+
+static void
+on_filesystem_checkbutton_toggled (GtkToggleButton *filesystem_checkbutton,
+                                   gpointer         user_data)
+{
+  GtkToggleButton *write_checkbutton = GTK_TOGGLE_BUTTON (user_data);
+  if (gtk_toggle_button_get_active (filesystem_checkbutton))
+    gtk_toggle_button_set_active (write_checkbutton, FALSE);
+}
+
 static void
 start_benchmark (DialogData *data)
 {
@@ -1481,7 +5752,27 @@ start_benchmark (DialogData *data)
   GtkWidget *num_samples_spinbutton;
   GtkWidget *sample_size_spinbutton;
   GtkWidget *write_checkbutton;
+  GtkWidget *direct_io_checkbutton;
   GtkWidget *num_access_samples_spinbutton;
+  GtkWidget *queue_depth_checkbutton;
+  GtkWidget *transfer_size_checkbutton;
+  GtkWidget *profiles_checkbutton;
+  GtkWidget *profile_duration_spinbutton;
+  GtkWidget *profile_threads_spinbutton;
+  GtkWidget *sustained_write_checkbutton;
+  GtkWidget *sustained_write_offset_spinbutton;
+  GtkWidget *sustained_write_size_spinbutton;
+  GtkWidget *filesystem_checkbutton;
+  GtkWidget *filesystem_file_size_spinbutton;
+  GtkWidget *filesystem_threads_spinbutton;
+  GtkWidget *raid_members_checkbutton;
+  GtkWidget *seek_profile_checkbutton;
+  GtkWidget *seek_profile_target_spinbutton;
+  GtkWidget *stable_checkbutton;
+  GtkWidget *stable_target_spinbutton;
+  GtkWidget *stable_budget_spinbutton;
+  gchar *mount_point = NULL;
+  gdouble size_gib;
   gint response;
 
   g_assert (!data->bm_in_progress);
@@ -1498,7 +5789,119 @@ start_benchmark (DialogData *data)
   num_samples_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "num-samples-spinbutton"));
   sample_size_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "sample-size-spinbutton"));
   write_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "write-checkbutton"));
+  direct_io_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "direct-io-checkbutton"));
   num_access_samples_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "num-access-samples-spinbutton"));
+  queue_depth_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "queue-depth-checkbutton"));
+  transfer_size_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "transfer-size-checkbutton"));
+  profiles_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "profiles-checkbutton"));
+  profile_duration_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "profile-duration-spinbutton"));
+  profile_threads_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "profile-threads-spinbutton"));
+  sustained_write_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "sustained-write-checkbutton"));
+  sustained_write_offset_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "sustained-write-offset-spinbutton"));
+  sustained_write_size_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "sustained-write-size-spinbutton"));
+  filesystem_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "filesystem-checkbutton"));
+  filesystem_file_size_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "filesystem-file-size-spinbutton"));
+  filesystem_threads_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "filesystem-threads-spinbutton"));
+  raid_members_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "raid-members-checkbutton"));
+  seek_profile_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "seek-profile-checkbutton"));
+  seek_profile_target_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "seek-profile-target-spinbutton"));
+  stable_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "stable-checkbutton"));
+  stable_target_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "stable-target-spinbutton"));
+  stable_budget_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "stable-budget-spinbutton"));
+
+  g_object_bind_property (profiles_checkbutton,
+                          "active",
+                          profile_duration_spinbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+  g_object_bind_property (profiles_checkbutton,
+                          "active",
+                          profile_threads_spinbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+  g_object_bind_property (seek_profile_checkbutton,
+                          "active",
+                          seek_profile_target_spinbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+  g_object_bind_property (stable_checkbutton,
+                          "active",
+                          stable_target_spinbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+  g_object_bind_property (stable_checkbutton,
+                          "active",
+                          stable_budget_spinbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+  g_object_bind_property (write_checkbutton,
+                          "active",
+                          sustained_write_checkbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+  g_object_bind_property (sustained_write_checkbutton,
+                          "active",
+                          sustained_write_offset_spinbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+  g_object_bind_property (sustained_write_checkbutton,
+                          "active",
+                          sustained_write_size_spinbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+
+  g_object_bind_property (filesystem_checkbutton,
+                          "active",
+                          filesystem_file_size_spinbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+  g_object_bind_property (filesystem_checkbutton,
+                          "active",
+                          filesystem_threads_spinbutton,
+                          "sensitive",
+                          G_BINDING_SYNC_CREATE);
+  g_signal_connect (write_checkbutton,
+                    "toggled",
+                    G_CALLBACK (on_write_checkbutton_toggled),
+                    filesystem_checkbutton);
+  g_signal_connect (filesystem_checkbutton,
+                    "toggled",
+                    G_CALLBACK (on_filesystem_checkbutton_toggled),
+                    write_checkbutton);
+
+  /* the filesystem can only be benchmarked if it's mounted */
+  mount_point = get_filesystem_mount_point (data);
+  if (mount_point != NULL)
+    {
+      gchar *s;
+      /* Translators: Used for the check button in the benchmark settings dialog.
+       * The %s is the mount point, e.g. "/home"
+       */
+      s = g_strdup_printf (C_("benchmark", "Benchmark the _filesystem mounted at %s"), mount_point);
+      gtk_button_set_label (GTK_BUTTON (filesystem_checkbutton), s);
+      g_free (s);
+    }
+  else
+    {
+      gtk_widget_set_sensitive (filesystem_checkbutton, FALSE);
+    }
+
+  /* only RAID arrays have members */
+  if (data->mdraid == NULL)
+    {
+      gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (raid_members_checkbutton), FALSE);
+      gtk_widget_set_sensitive (raid_members_checkbutton, FALSE);
+    }
+
+  /* the sustained write region must be on the device */
+  size_gib = floor (((gdouble) udisks_block_get_size (data->block)) / (1024.0 * 1024.0 * 1024.0));
+  if (size_gib >= 1.0)
+    {
+      gtk_adjustment_set_upper (gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON (sustained_write_offset_spinbutton)),
+                                size_gib - 1.0);
+      gtk_adjustment_set_upper (gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON (sustained_write_size_spinbutton)),
+                                size_gib);
+    }
 
   /* if device is read-only, uncheck the "perform write-test"
    * check-button and also make it insensitive
@@ -1526,12 +5929,31 @@ start_benchmark (DialogData *data)
   data->bm_num_samples = gtk_spin_button_get_value (GTK_SPIN_BUTTON (num_samples_spinbutton));
   data->bm_sample_size_mib = gtk_spin_button_get_value (GTK_SPIN_BUTTON (sample_size_spinbutton));
   data->bm_do_write = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (write_checkbutton));
+  data->bm_do_direct_io = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (direct_io_checkbutton));
   data->bm_num_access_samples = gtk_spin_button_get_value (GTK_SPIN_BUTTON (num_access_samples_spinbutton));
+  data->bm_do_until_stable = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (stable_checkbutton));
+  data->bm_stable_target_percent = gtk_spin_button_get_value (GTK_SPIN_BUTTON (stable_target_spinbutton));
+  data->bm_stable_budget_sec = gtk_spin_button_get_value (GTK_SPIN_BUTTON (stable_budget_spinbutton));
+  data->bm_do_seek_profile = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (seek_profile_checkbutton));
+  data->bm_seek_profile_target_msec = gtk_spin_button_get_value (GTK_SPIN_BUTTON (seek_profile_target_spinbutton));
+  data->bm_do_queue_depth = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (queue_depth_checkbutton));
+  data->bm_do_transfer_size = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (transfer_size_checkbutton));
+  data->bm_do_profiles = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (profiles_checkbutton));
+  data->bm_profile_duration_sec = gtk_spin_button_get_value (GTK_SPIN_BUTTON (profile_duration_spinbutton));
+  data->bm_profile_num_threads = gtk_spin_button_get_value (GTK_SPIN_BUTTON (profile_threads_spinbutton));
+  data->bm_do_filesystem = mount_point != NULL &&
+    gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (filesystem_checkbutton));
+  g_free (data->bm_filesystem_mount_point);
+  data->bm_filesystem_mount_point = g_strdup (mount_point);
+  data->bm_filesystem_file_size_mib = gtk_spin_button_get_value (GTK_SPIN_BUTTON (filesystem_file_size_spinbutton));
+  data->bm_filesystem_num_threads = gtk_spin_button_get_value (GTK_SPIN_BUTTON (filesystem_threads_spinbutton));
+  data->bm_do_sustained_write = data->bm_do_write &&
+    gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (sustained_write_checkbutton));
+  data->bm_sustained_write_offset_gib = gtk_spin_button_get_value (GTK_SPIN_BUTTON (sustained_write_offset_spinbutton));
+  data->bm_sustained_write_size_gib = gtk_spin_button_get_value (GTK_SPIN_BUTTON (sustained_write_size_spinbutton));
+  data->bm_do_raid_members = data->mdraid != NULL &&
+    gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (raid_members_checkbutton));
 
-  //g_print ("num_samples=%d\n", data->bm_num_samples);
-  //g_print ("sample_size=%d MB\n", data->bm_sample_size_mib);
-  //g_print ("do_write=%d\n", data->bm_do_write);
-  //g_print ("num_access_samples=%d\n", data->bm_num_access_samples);
 
   if (data->bm_do_write)
     {
@@ -1548,6 +5970,7 @@ start_benchmark (DialogData *data)
     }
 
  out:
+  g_free (mount_point);
   gtk_widget_destroy (dialog);
   g_clear_object (&builder);
   update_dialog (data);
@@ -1560,8 +5983,10 @@ gdu_benchmark_dialog_show (GduWindow    *window,
                            UDisksObject *object)
 {
   DialogData *data;
+  UDisksObject *mdraid_object;
   guint n;
   guint timeout_id;
+  gchar *history_filename;
   GError *error = NULL;
 
   data = g_new0 (DialogData, 1);
@@ -1571,15 +5996,64 @@ gdu_benchmark_dialog_show (GduWindow    *window,
   data->window = g_object_ref (window);
   data->bm_cancellable = g_cancellable_new ();
 
+  mdraid_object = udisks_client_peek_object (gdu_window_get_client (window), udisks_block_get_mdraid (data->block));
+  if (mdraid_object != NULL && udisks_object_peek_mdraid (mdraid_object) != NULL)
+    data->mdraid = g_object_ref (udisks_object_peek_mdraid (mdraid_object));
+
   data->bm_read_samples = g_array_new (FALSE, /* zero-terminated */
                                        FALSE, /* clear */
-                                       sizeof (BMSample));
+                                       sizeof (GduBenchmarkSample));
   data->bm_write_samples = g_array_new (FALSE, /* zero-terminated */
                                         FALSE, /* clear */
-                                        sizeof (BMSample));
+                                        sizeof (GduBenchmarkSample));
   data->bm_access_time_samples = g_array_new (FALSE, /* zero-terminated */
                                               FALSE, /* clear */
-                                              sizeof (BMSample));
+                                              sizeof (GduBenchmarkSample));
+  data->bm_access_time_histogram = gdu_histogram_new ();
+  data->bm_sequential_queue_depth_samples = g_array_new (FALSE, /* zero-terminated */
+                                                         FALSE, /* clear */
+                                                         sizeof (GduBenchmarkSample));
+  data->bm_random_queue_depth_samples = g_array_new (FALSE, /* zero-terminated */
+                                                     FALSE, /* clear */
+                                                     sizeof (GduBenchmarkSample));
+  data->bm_profile_rate_samples = g_array_new (FALSE, /* zero-terminated */
+                                               FALSE, /* clear */
+                                               sizeof (GduBenchmarkSample));
+  data->bm_profile_iops_samples = g_array_new (FALSE, /* zero-terminated */
+                                               FALSE, /* clear */
+                                               sizeof (GduBenchmarkSample));
+  data->bm_filesystem_rate_samples = g_array_new (FALSE, /* zero-terminated */
+                                                  FALSE, /* clear */
+                                                  sizeof (GduBenchmarkSample));
+  data->bm_filesystem_iops_samples = g_array_new (FALSE, /* zero-terminated */
+                                                  FALSE, /* clear */
+                                                  sizeof (GduBenchmarkSample));
+  data->bm_sustained_write_samples = g_array_new (FALSE, /* zero-terminated */
+                                                  FALSE, /* clear */
+                                                  sizeof (GduBenchmarkSample));
+  data->bm_seek_distance_samples = g_array_new (FALSE, /* zero-terminated */
+                                                FALSE, /* clear */
+                                                sizeof (GduBenchmarkSample));
+  data->bm_seek_stroke_samples = g_array_new (FALSE, /* zero-terminated */
+                                              FALSE, /* clear */
+                                              sizeof (GduBenchmarkSample));
+  data->bm_transfer_size_read_samples = g_array_new (FALSE, /* zero-terminated */
+                                                     FALSE, /* clear */
+                                                     sizeof (GduBenchmarkSample));
+  data->bm_transfer_size_write_samples = g_array_new (FALSE, /* zero-terminated */
+                                                      FALSE, /* clear */
+                                                      sizeof (GduBenchmarkSample));
+  data->bm_raid_members = g_ptr_array_new_with_free_func ((GDestroyNotify) bm_raid_member_free);
+  data->bm_compare_read_samples = g_array_new (FALSE, /* zero-terminated */
+                                               FALSE, /* clear */
+                                               sizeof (GduBenchmarkSample));
+  data->bm_compare_write_samples = g_array_new (FALSE, /* zero-terminated */
+                                                FALSE, /* clear */
+                                                sizeof (GduBenchmarkSample));
+  data->graph_read_series = gdu_benchmark_graph_series_new ();
+  data->graph_write_series = gdu_benchmark_graph_series_new ();
+  data->graph_compare_read_series = gdu_benchmark_graph_series_new ();
+  data->graph_compare_write_series = gdu_benchmark_graph_series_new ();
 
   data->dialog = GTK_WIDGET (gdu_application_new_widget (gdu_window_get_application (window),
                                                          "benchmark-dialog.ui",
@@ -1601,6 +6075,42 @@ gdu_benchmark_dialog_show (GduWindow    *window,
                     "draw",
                     G_CALLBACK (on_drawing_area_draw),
                     data);
+  g_signal_connect (data->queue_depth_drawing_area,
+                    "draw",
+                    G_CALLBACK (on_queue_depth_drawing_area_draw),
+                    data);
+  g_signal_connect (data->profiles_drawing_area,
+                    "draw",
+                    G_CALLBACK (on_profiles_drawing_area_draw),
+                    data);
+  g_signal_connect (data->access_time_distribution_drawing_area,
+                    "draw",
+                    G_CALLBACK (on_access_time_distribution_drawing_area_draw),
+                    data);
+  g_signal_connect (data->filesystem_drawing_area,
+                    "draw",
+                    G_CALLBACK (on_filesystem_drawing_area_draw),
+                    data);
+  g_signal_connect (data->sustained_write_drawing_area,
+                    "draw",
+                    G_CALLBACK (on_sustained_write_drawing_area_draw),
+                    data);
+  g_signal_connect (data->seek_profile_drawing_area,
+                    "draw",
+                    G_CALLBACK (on_seek_profile_drawing_area_draw),
+                    data);
+  g_signal_connect (data->transfer_size_drawing_area,
+                    "draw",
+                    G_CALLBACK (on_transfer_size_drawing_area_draw),
+                    data);
+  g_signal_connect (data->run_combobox,
+                    "changed",
+                    G_CALLBACK (on_run_combobox_changed),
+                    data);
+  g_signal_connect (data->compare_combobox,
+                    "changed",
+                    G_CALLBACK (on_compare_combobox_changed),
+                    data);
 
   /* set minimum size for the graph */
   gtk_widget_set_size_request (data->graph_drawing_area,
@@ -1619,6 +6129,33 @@ gdu_benchmark_dialog_show (GduWindow    *window,
       g_clear_error (&error);
     }
 
+  history_filename = get_bm_history_filename (data);
+  if (history_filename != NULL)
+    {
+      data->bm_history = gdu_benchmark_history_load (history_filename, &error);
+      if (data->bm_history == NULL)
+        {
+          g_warning ("Error loading benchmark history: %s (%s, %d)",
+                     error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+      g_free (history_filename);
+    }
+
+  /* start the history with the run from before there was one */
+  if (data->bm_history != NULL &&
+      gdu_benchmark_history_get_num_runs (data->bm_history) == 0 &&
+      data->bm_time_benchmarked_usec > 0)
+    {
+      if (!gdu_benchmark_history_append (data->bm_history, data_to_gvariant (data), &error))
+        {
+          g_warning ("Error appending to benchmark history: %s (%s, %d)",
+                     error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+    }
+
+  data->num_runs_in_comboboxes = G_MAXUINT;
   update_dialog (data);
 
   while (TRUE)
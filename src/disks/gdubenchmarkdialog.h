@@ -15,8 +15,12 @@
 
 G_BEGIN_DECLS
 
-void   gdu_benchmark_dialog_show (GduWindow    *window,
-                                  UDisksObject *object);
+void   gdu_benchmark_dialog_show              (GduWindow    *window,
+                                               UDisksObject *object);
+
+gsize  gdu_benchmark_dialog_get_transfer_size (UDisksClient *client,
+                                               UDisksBlock  *block,
+                                               gboolean      for_writing);
 
 G_END_DECLS
 
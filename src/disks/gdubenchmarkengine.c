@@ -0,0 +1,823 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "gdubenchmarkengine.h"
+
+/* The benchmark engine keeps a number of requests in flight against a
+ * file descriptor until a time or request budget is used up and
+ * counts how many of them completed.
+ *
+ * If built with liburing, requests are submitted through an io_uring
+ * with one slot per outstanding request. If that isn't available at
+ * run-time (old kernel, io_uring disabled by policy etc.) each
+ * outstanding request is instead served by its own thread doing
+ * blocking I/O. Either way the device sees the requested queue depth.
+ *
+ * Workloads for the sequential zones of zoned block devices can ask
+ * for writes to be sequential: they then go to the next block of the
+ * region, one at a time so they reach the device in order, and reads
+ * only go to what has been written.
+ *
+ * For filesystems there is also a metadata workload where a number of
+ * threads each create, write, sync and delete small files as fast as
+ * they can.
+ */
+
+/* the size of the files created by the metadata workload */
+#define METADATA_FILE_SIZE 4096
+
+typedef struct
+{
+  gint fd;
+  const GduBenchmarkWorkload *workload;
+  GCancellable *cancellable;
+  guint64 num_blocks;
+  gint64 deadline_usec;
+
+  /* must hold write_lock from picking the offset of a sequential write until it completes */
+  GMutex write_lock;
+
+  /* must hold lock when reading/writing these */
+  GMutex lock;
+  guint64 next_block;
+  guint64 next_write_block;
+  guint64 num_issued;
+  gboolean stop;
+  GError *error;
+} Run;
+
+typedef struct
+{
+  Run *run;
+  GRand *rand;
+  guchar *buffer_unaligned;
+  guchar *buffer;
+  guint64 offset;
+  gboolean is_write;
+  guint64 num_ops;
+  guint64 num_bytes;
+} Worker;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+run_set_error (Run          *run,
+               GError       *error)
+{
+  g_mutex_lock (&run->lock);
+  if (run->error == NULL)
+    run->error = error;
+  else
+    g_error_free (error);
+  run->stop = TRUE;
+  g_mutex_unlock (&run->lock);
+}
+
+/* Picks the offset and direction of the next request for @worker.
+ * Returns FALSE if no more requests should be issued.
+ */
+static gboolean
+run_next_request (Run    *run,
+                  Worker *worker)
+{
+  const GduBenchmarkWorkload *workload = run->workload;
+  GError *error = NULL;
+  gboolean ret = FALSE;
+  guint64 block = 0;
+
+  if (g_cancellable_set_error_if_cancelled (run->cancellable, &error))
+    {
+      run_set_error (run, error);
+      goto out;
+    }
+
+  if (run->deadline_usec > 0 && g_get_monotonic_time () >= run->deadline_usec)
+    goto out;
+
+  if (workload->pattern == GDU_BENCHMARK_PATTERN_RANDOM)
+    block = (((guint64) g_rand_int (worker->rand)) << 32) | g_rand_int (worker->rand);
+  worker->is_write = (workload->write_percentage > 0 &&
+                      (guint) g_rand_int_range (worker->rand, 0, 100) < workload->write_percentage);
+
+  g_mutex_lock (&run->lock);
+  if (run->stop || (workload->max_ops > 0 && run->num_issued >= workload->max_ops))
+    {
+      g_mutex_unlock (&run->lock);
+      goto out;
+    }
+  run->num_issued++;
+  if (workload->sequential_writes && workload->write_percentage > 0)
+    {
+      /* Reads only go to what has been written so write first. The
+       * offset of writes is picked by run_next_write_offset().
+       */
+      if (run->next_write_block == 0)
+        worker->is_write = TRUE;
+      if (!worker->is_write && workload->pattern == GDU_BENCHMARK_PATTERN_SEQUENTIAL)
+        {
+          block = run->next_block % run->next_write_block;
+          run->next_block = block + 1;
+        }
+      else if (!worker->is_write)
+        {
+          block %= run->next_write_block;
+        }
+    }
+  else if (workload->pattern == GDU_BENCHMARK_PATTERN_SEQUENTIAL)
+    {
+      block = run->next_block;
+      run->next_block = (run->next_block + 1) % run->num_blocks;
+    }
+  else
+    {
+      block %= run->num_blocks;
+    }
+  g_mutex_unlock (&run->lock);
+
+  worker->offset = workload->offset + block * workload->block_size;
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+/* Picks the offset of a sequential write for @worker, see
+ * gdu_benchmark_engine_run(). Must hold run->write_lock. Returns FALSE
+ * if the region is full, which ends the run.
+ */
+static gboolean
+run_next_write_offset (Run    *run,
+                       Worker *worker)
+{
+  gboolean ret = FALSE;
+
+  g_mutex_lock (&run->lock);
+  if (run->next_write_block == run->num_blocks)
+    {
+      run->stop = TRUE;
+      goto out;
+    }
+  worker->offset = run->workload->offset + run->next_write_block * run->workload->block_size;
+  run->next_write_block++;
+  ret = TRUE;
+
+ out:
+  g_mutex_unlock (&run->lock);
+  return ret;
+}
+
+/* Checks the outcome of a request, @res is the return value of
+ * pread(2) / pwrite(2) or the negated errno. Returns FALSE if the run
+ * should stop.
+ */
+static gboolean
+run_complete_request (Run    *run,
+                      Worker *worker,
+                      gssize  res)
+{
+  const GduBenchmarkWorkload *workload = run->workload;
+  GError *error = NULL;
+
+  if (G_UNLIKELY (res < 0 && worker->is_write))
+    {
+      error = g_error_new (G_IO_ERROR,
+                           g_io_error_from_errno (-res),
+                           C_("benchmarking", "Error writing %lld bytes at offset %lld: %s"),
+                           (long long int) workload->block_size,
+                           (long long int) worker->offset,
+                           g_strerror (-res));
+      run_set_error (run, error);
+      return FALSE;
+    }
+  if (G_UNLIKELY (res < 0))
+    {
+      error = g_error_new (G_IO_ERROR,
+                           g_io_error_from_errno (-res),
+                           C_("benchmarking", "Error reading %lld bytes from offset %lld: %s"),
+                           (long long int) workload->block_size,
+                           (long long int) worker->offset,
+                           g_strerror (-res));
+      run_set_error (run, error);
+      return FALSE;
+    }
+  if (G_UNLIKELY ((gsize) res != workload->block_size && worker->is_write))
+    {
+      error = g_error_new (G_IO_ERROR,
+                           G_IO_ERROR_FAILED,
+                           C_("benchmarking", "Expected to write %lld bytes, only wrote %lld"),
+                           (long long int) workload->block_size,
+                           (long long int) res);
+      run_set_error (run, error);
+      return FALSE;
+    }
+  if (G_UNLIKELY ((gsize) res != workload->block_size))
+    {
+      error = g_error_new (G_IO_ERROR,
+                           G_IO_ERROR_FAILED,
+                           C_("benchmarking", "Expected to read %lld bytes, only read %lld"),
+                           (long long int) workload->block_size,
+                           (long long int) res);
+      run_set_error (run, error);
+      return FALSE;
+    }
+
+  worker->num_ops++;
+  worker->num_bytes += res;
+  return TRUE;
+}
+
+/* Writes put back what is already there so the contents of the region
+ * don't change - unless they don't matter, e.g. for a scratch file
+ */
+static const guchar *
+run_get_write_data (Run    *run,
+                    Worker *worker)
+{
+  if (run->workload->write_data == NULL)
+    return worker->buffer;
+  return run->workload->write_data + (worker->offset - run->workload->offset);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Does a sequential write for @worker. Returns FALSE if the region is
+ * full, otherwise sets @res and errno like pwrite(2) does.
+ */
+static gboolean
+worker_write_sequential (Worker *worker,
+                         gssize *res)
+{
+  Run *run = worker->run;
+  gboolean ret = FALSE;
+  gint errsv = 0;
+
+  g_mutex_lock (&run->write_lock);
+  if (!run_next_write_offset (run, worker))
+    goto out;
+  do
+    *res = pwrite (run->fd, run_get_write_data (run, worker), run->workload->block_size, worker->offset);
+  while (*res < 0 && errno == EINTR);
+  errsv = errno;
+  ret = TRUE;
+
+ out:
+  g_mutex_unlock (&run->write_lock);
+  errno = errsv;
+  return ret;
+}
+
+static gpointer
+worker_thread_func (gpointer user_data)
+{
+  Worker *worker = user_data;
+  Run *run = worker->run;
+
+  while (run_next_request (run, worker))
+    {
+      gssize res;
+
+      if (worker->is_write && run->workload->sequential_writes)
+        {
+          if (!worker_write_sequential (worker, &res))
+            break;
+        }
+      else if (worker->is_write)
+        {
+          do
+            res = pwrite (run->fd, run_get_write_data (run, worker), run->workload->block_size, worker->offset);
+          while (res < 0 && errno == EINTR);
+        }
+      else
+        {
+          do
+            res = pread (run->fd, worker->buffer, run->workload->block_size, worker->offset);
+          while (res < 0 && errno == EINTR);
+        }
+      if (res < 0)
+        res = -errno;
+      if (!run_complete_request (run, worker, res))
+        break;
+      if (worker->is_write && run->workload->sync_writes && fdatasync (run->fd) != 0)
+        {
+          gint errsv = errno;
+          run_set_error (run, g_error_new (G_IO_ERROR,
+                                           g_io_error_from_errno (errsv),
+                                           C_("benchmarking", "Error syncing (at offset %lld): %s"),
+                                           (long long int) worker->offset,
+                                           g_strerror (errsv)));
+          break;
+        }
+    }
+  return NULL;
+}
+
+static void
+run_with_threads (Run    *run,
+                  Worker *workers)
+{
+  GThread **threads;
+  guint n;
+
+  threads = g_new0 (GThread *, run->workload->queue_depth);
+  for (n = 0; n < run->workload->queue_depth; n++)
+    threads[n] = g_thread_new ("benchmark-worker", worker_thread_func, &workers[n]);
+  for (n = 0; n < run->workload->queue_depth; n++)
+    g_thread_join (threads[n]);
+  g_free (threads);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+#ifdef HAVE_LIBURING
+
+static void
+uring_prep (struct io_uring *ring,
+            Run             *run,
+            Worker          *worker)
+{
+  struct io_uring_sqe *sqe;
+
+  /* the ring has as many entries as there are workers so this can't fail */
+  sqe = io_uring_get_sqe (ring);
+  if (worker->is_write)
+    io_uring_prep_write (sqe, run->fd, run_get_write_data (run, worker), run->workload->block_size, worker->offset);
+  else
+    io_uring_prep_read (sqe, run->fd, worker->buffer, run->workload->block_size, worker->offset);
+  io_uring_sqe_set_data (sqe, worker);
+}
+
+/* Returns FALSE if io_uring can't be used, in which case nothing was submitted */
+static gboolean
+run_with_uring (Run    *run,
+                Worker *workers)
+{
+  struct io_uring ring;
+  struct io_uring_probe *probe;
+  gboolean ret = FALSE;
+  guint in_flight = 0;
+  guint n;
+  gint rc;
+
+  /* A write and the fdatasync(2) after it would have to be linked and
+   * sequential writes would have to be kept in order, just use threads
+   */
+  if (run->workload->sync_writes || run->workload->sequential_writes)
+    goto out;
+
+  if (io_uring_queue_init (run->workload->queue_depth, &ring, 0) < 0)
+    goto out;
+
+  probe = io_uring_get_probe_ring (&ring);
+  if (probe == NULL ||
+      !io_uring_opcode_supported (probe, IORING_OP_READ) ||
+      !io_uring_opcode_supported (probe, IORING_OP_WRITE))
+    {
+      if (probe != NULL)
+        io_uring_free_probe (probe);
+      io_uring_queue_exit (&ring);
+      goto out;
+    }
+  io_uring_free_probe (probe);
+
+  ret = TRUE;
+
+  for (n = 0; n < run->workload->queue_depth; n++)
+    {
+      if (!run_next_request (run, &workers[n]))
+        break;
+      uring_prep (&ring, run, &workers[n]);
+      in_flight++;
+    }
+  io_uring_submit (&ring);
+
+  while (in_flight > 0)
+    {
+      struct io_uring_cqe *cqe;
+      Worker *worker;
+      gssize res;
+
+      rc = io_uring_wait_cqe (&ring, &cqe);
+      if (rc == -EINTR || rc == -EAGAIN)
+        continue;
+      if (rc < 0)
+        {
+          run_set_error (run, g_error_new (G_IO_ERROR,
+                                           g_io_error_from_errno (-rc),
+                                           C_("benchmarking", "Error waiting for I/O to complete: %s"),
+                                           g_strerror (-rc)));
+          /* Requests may still be in flight so the ring and the
+           * buffers can't be released - just leak them
+           */
+          for (n = 0; n < run->workload->queue_depth; n++)
+            workers[n].buffer_unaligned = NULL;
+          goto out;
+        }
+
+      worker = io_uring_cqe_get_data (cqe);
+      res = cqe->res;
+      io_uring_cqe_seen (&ring, cqe);
+      in_flight--;
+
+      /* an interrupted request is submitted again, it still counts */
+      if (res == -EINTR)
+        {
+          uring_prep (&ring, run, worker);
+          io_uring_submit (&ring);
+          in_flight++;
+          continue;
+        }
+
+      if (!run_complete_request (run, worker, res))
+        continue;
+      if (!run_next_request (run, worker))
+        continue;
+      uring_prep (&ring, run, worker);
+      io_uring_submit (&ring);
+      in_flight++;
+    }
+
+  io_uring_queue_exit (&ring);
+
+ out:
+  return ret;
+}
+
+#endif /* HAVE_LIBURING */
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * gdu_benchmark_engine_run:
+ * @fd: A file descriptor opened for reading.
+ * @workload: What to do.
+ * @result: Return location for the result.
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Runs @workload against @fd, blocking the calling thread until the
+ * budget in @workload is used up.
+ *
+ * If the workload has writes, @fd must be opened for writing and the
+ * write_data member of @workload must point to the current contents
+ * of the region, aligned to the page size. Writes copy from there so
+ * the contents of the device never change, not even if the benchmark
+ * is interrupted. If the contents don't matter (e.g. for a scratch
+ * file), write_data may be %NULL.
+ *
+ * If the sequential_writes member of @workload is set, writes go to
+ * the blocks of the region in order, one at a time, as required for
+ * sequential zones of zoned block devices, and reads only go to the
+ * blocks written so far. The run ends early if the region fills up.
+ * Since the region is overwritten from its start, write_data should
+ * be %NULL.
+ *
+ * Returns: %TRUE if @result was set, %FALSE if @error is set.
+ */
+gboolean
+gdu_benchmark_engine_run (gint                         fd,
+                          const GduBenchmarkWorkload  *workload,
+                          GduBenchmarkResult          *result,
+                          GCancellable                *cancellable,
+                          GError                     **error)
+{
+  gboolean ret = FALSE;
+  Worker *workers = NULL;
+  Run run = {0};
+  gint64 begin_usec;
+  long page_size;
+  guint n;
+
+  g_return_val_if_fail (fd != -1, FALSE);
+  g_return_val_if_fail (workload != NULL, FALSE);
+  g_return_val_if_fail (workload->block_size > 0, FALSE);
+  g_return_val_if_fail (workload->queue_depth > 0, FALSE);
+  g_return_val_if_fail (workload->max_ops > 0 || workload->max_usec > 0, FALSE);
+  g_return_val_if_fail (workload->write_percentage <= 100, FALSE);
+  g_return_val_if_fail (result != NULL, FALSE);
+
+  run.fd = fd;
+  run.workload = workload;
+  run.cancellable = cancellable;
+  run.num_blocks = workload->size / workload->block_size;
+  g_mutex_init (&run.lock);
+  g_mutex_init (&run.write_lock);
+
+  if (run.num_blocks == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   C_("benchmarking", "The device is too small for the benchmark"));
+      goto out;
+    }
+
+  page_size = sysconf (_SC_PAGESIZE);
+  if (page_size < 1)
+    page_size = 4096;
+
+  workers = g_new0 (Worker, workload->queue_depth);
+  for (n = 0; n < workload->queue_depth; n++)
+    {
+      Worker *worker = &workers[n];
+      worker->run = &run;
+      /* want this to be deterministic so it's repeatable */
+      worker->rand = g_rand_new_with_seed (42 + n);
+      /* aligned to the page size so the file descriptor may use O_DIRECT */
+      worker->buffer_unaligned = g_new0 (guchar, workload->block_size + page_size);
+      worker->buffer = (guchar*) (((gintptr) (worker->buffer_unaligned + page_size)) & (~(page_size - 1)));
+    }
+
+  begin_usec = g_get_monotonic_time ();
+  if (workload->max_usec > 0)
+    run.deadline_usec = begin_usec + workload->max_usec;
+
+#ifdef HAVE_LIBURING
+  if (!run_with_uring (&run, workers))
+    run_with_threads (&run, workers);
+#else
+  run_with_threads (&run, workers);
+#endif
+
+  result->elapsed_usec = g_get_monotonic_time () - begin_usec;
+  result->num_ops = 0;
+  result->num_bytes = 0;
+  for (n = 0; n < workload->queue_depth; n++)
+    {
+      result->num_ops += workers[n].num_ops;
+      result->num_bytes += workers[n].num_bytes;
+    }
+
+  if (run.error != NULL)
+    {
+      g_propagate_error (error, run.error);
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  if (workers != NULL)
+    {
+      for (n = 0; n < workload->queue_depth; n++)
+        {
+          g_rand_free (workers[n].rand);
+          g_free (workers[n].buffer_unaligned);
+        }
+      g_free (workers);
+    }
+  g_mutex_clear (&run.lock);
+  g_mutex_clear (&run.write_lock);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  Run *run;
+  const gchar *directory;
+  guint index;
+  guint64 num_ops;
+  guint64 num_bytes;
+} MetadataWorker;
+
+static gpointer
+metadata_worker_thread_func (gpointer user_data)
+{
+  MetadataWorker *worker = user_data;
+  Run *run = worker->run;
+  guchar buffer[METADATA_FILE_SIZE];
+  GRand *rand;
+  guint64 n;
+  guint m;
+
+  /* not all zeroes in case the filesystem compresses */
+  rand = g_rand_new_with_seed (42 + worker->index);
+  for (m = 0; m < sizeof (buffer); m++)
+    buffer[m] = g_rand_int (rand);
+  g_rand_free (rand);
+
+  for (n = 0; ; n++)
+    {
+      GError *error = NULL;
+      gchar *path;
+      gboolean stop;
+      gint fd;
+      gint errsv;
+
+      if (g_cancellable_set_error_if_cancelled (run->cancellable, &error))
+        {
+          run_set_error (run, error);
+          break;
+        }
+      if (g_get_monotonic_time () >= run->deadline_usec)
+        break;
+      g_mutex_lock (&run->lock);
+      stop = run->stop;
+      g_mutex_unlock (&run->lock);
+      if (stop)
+        break;
+
+      path = g_strdup_printf ("%s/%u-%" G_GUINT64_FORMAT, worker->directory, worker->index, n);
+      fd = open (path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+      if (fd == -1)
+        {
+          errsv = errno;
+          error = g_error_new (G_IO_ERROR,
+                               g_io_error_from_errno (errsv),
+                               C_("benchmarking", "Error creating %s: %s"),
+                               path,
+                               g_strerror (errsv));
+          goto fail;
+        }
+      if (write (fd, buffer, sizeof (buffer)) != (gssize) sizeof (buffer))
+        {
+          errsv = errno;
+          error = g_error_new (G_IO_ERROR,
+                               g_io_error_from_errno (errsv),
+                               C_("benchmarking", "Error writing to %s: %s"),
+                               path,
+                               g_strerror (errsv));
+          goto fail;
+        }
+      if (fsync (fd) != 0)
+        {
+          errsv = errno;
+          error = g_error_new (G_IO_ERROR,
+                               g_io_error_from_errno (errsv),
+                               C_("benchmarking", "Error syncing %s: %s"),
+                               path,
+                               g_strerror (errsv));
+          goto fail;
+        }
+      close (fd);
+      fd = -1;
+      if (unlink (path) != 0)
+        {
+          errsv = errno;
+          error = g_error_new (G_IO_ERROR,
+                               g_io_error_from_errno (errsv),
+                               C_("benchmarking", "Error deleting %s: %s"),
+                               path,
+                               g_strerror (errsv));
+          goto fail;
+        }
+      /* so the directory entry is gone too */
+      if (fsync (run->fd) != 0)
+        {
+          errsv = errno;
+          error = g_error_new (G_IO_ERROR,
+                               g_io_error_from_errno (errsv),
+                               C_("benchmarking", "Error syncing %s: %s"),
+                               worker->directory,
+                               g_strerror (errsv));
+          goto fail;
+        }
+      g_free (path);
+
+      worker->num_ops++;
+      worker->num_bytes += sizeof (buffer);
+      continue;
+
+    fail:
+      if (fd != -1)
+        {
+          close (fd);
+          unlink (path);
+        }
+      g_free (path);
+      run_set_error (run, error);
+      break;
+    }
+
+  return NULL;
+}
+
+/**
+ * gdu_benchmark_engine_run_metadata:
+ * @directory: An existing directory.
+ * @num_threads: Number of threads.
+ * @max_usec: How long to run.
+ * @result: Return location for the result.
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Measures how many files can be created in @directory, written,
+ * synced and deleted again per second, with @num_threads threads
+ * doing it at the same time. Blocks the calling thread for @max_usec.
+ *
+ * The files are named after the thread and a counter so other files
+ * in @directory are left alone. None of the files created are left
+ * behind, not even if the benchmark fails.
+ *
+ * Returns: %TRUE if @result was set, %FALSE if @error is set.
+ */
+gboolean
+gdu_benchmark_engine_run_metadata (const gchar         *directory,
+                                   guint                num_threads,
+                                   gint64               max_usec,
+                                   GduBenchmarkResult  *result,
+                                   GCancellable        *cancellable,
+                                   GError             **error)
+{
+  gboolean ret = FALSE;
+  MetadataWorker *workers = NULL;
+  GThread **threads = NULL;
+  Run run = {0};
+  gint64 begin_usec;
+  guint n;
+
+  g_return_val_if_fail (directory != NULL, FALSE);
+  g_return_val_if_fail (num_threads > 0, FALSE);
+  g_return_val_if_fail (max_usec > 0, FALSE);
+  g_return_val_if_fail (result != NULL, FALSE);
+
+  run.cancellable = cancellable;
+  g_mutex_init (&run.lock);
+
+  run.fd = open (directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (run.fd == -1)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error opening %s: %m"),
+                   directory);
+      goto out;
+    }
+
+  workers = g_new0 (MetadataWorker, num_threads);
+  threads = g_new0 (GThread *, num_threads);
+
+  begin_usec = g_get_monotonic_time ();
+  run.deadline_usec = begin_usec + max_usec;
+  for (n = 0; n < num_threads; n++)
+    {
+      workers[n].run = &run;
+      workers[n].directory = directory;
+      workers[n].index = n;
+      threads[n] = g_thread_new ("benchmark-worker", metadata_worker_thread_func, &workers[n]);
+    }
+  for (n = 0; n < num_threads; n++)
+    g_thread_join (threads[n]);
+
+  result->elapsed_usec = g_get_monotonic_time () - begin_usec;
+  result->num_ops = 0;
+  result->num_bytes = 0;
+  for (n = 0; n < num_threads; n++)
+    {
+      result->num_ops += workers[n].num_ops;
+      result->num_bytes += workers[n].num_bytes;
+    }
+
+  if (run.error != NULL)
+    {
+      g_propagate_error (error, run.error);
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  if (run.fd != -1)
+    close (run.fd);
+  g_free (threads);
+  g_free (workers);
+  g_mutex_clear (&run.lock);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+gdouble
+gdu_benchmark_result_get_bytes_per_sec (const GduBenchmarkResult *result)
+{
+  if (result->elapsed_usec <= 0)
+    return 0.0;
+  return ((gdouble) G_USEC_PER_SEC) * result->num_bytes / result->elapsed_usec;
+}
+
+gdouble
+gdu_benchmark_result_get_iops (const GduBenchmarkResult *result)
+{
+  if (result->elapsed_usec <= 0)
+    return 0.0;
+  return ((gdouble) G_USEC_PER_SEC) * result->num_ops / result->elapsed_usec;
+}
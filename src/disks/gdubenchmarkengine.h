@@ -0,0 +1,58 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BENCHMARK_ENGINE_H__
+#define __GDU_BENCHMARK_ENGINE_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+struct GduBenchmarkWorkload
+{
+  GduBenchmarkPattern  pattern;
+  guint64              offset;       /* start of the region to use */
+  guint64              size;         /* size of the region to use */
+  gsize                block_size;   /* size of each request, a multiple of the logical block size */
+  guint                queue_depth;  /* number of requests to keep in flight */
+  guint                write_percentage;  /* how many of the requests are writes, 0 to 100 */
+  const guchar        *write_data;   /* what is in the region, see gdu_benchmark_engine_run() */
+  gboolean             sync_writes;  /* whether to fdatasync(2) after each write */
+  gboolean             sequential_writes;  /* whether writes go one at a time from the start of the region */
+  guint64              max_ops;      /* stop after this many requests, 0 for no limit */
+  gint64               max_usec;     /* stop after this long, 0 for no limit */
+};
+
+struct GduBenchmarkResult
+{
+  guint64  num_ops;
+  guint64  num_bytes;
+  gint64   elapsed_usec;
+};
+
+gboolean  gdu_benchmark_engine_run                (gint                         fd,
+                                                   const GduBenchmarkWorkload  *workload,
+                                                   GduBenchmarkResult          *result,
+                                                   GCancellable                *cancellable,
+                                                   GError                     **error);
+
+gboolean  gdu_benchmark_engine_run_metadata       (const gchar                 *directory,
+                                                   guint                        num_threads,
+                                                   gint64                       max_usec,
+                                                   GduBenchmarkResult          *result,
+                                                   GCancellable                *cancellable,
+                                                   GError                     **error);
+
+gdouble   gdu_benchmark_result_get_bytes_per_sec  (const GduBenchmarkResult    *result);
+gdouble   gdu_benchmark_result_get_iops           (const GduBenchmarkResult    *result);
+
+G_END_DECLS
+
+#endif /* __GDU_BENCHMARK_ENGINE_H__ */
@@ -0,0 +1,486 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <math.h>
+
+#include "gdubenchmarkgraph.h"
+
+/* Drawing helpers shared by the graphs of the benchmark dialogs.
+ *
+ * A GduBenchmarkGraphSeries keeps the samples of a line in the graph
+ * together with a min/max decimation pyramid of them: level 0 has a
+ * point per sample, and each point of level k covers two points of
+ * level k - 1 and is the lowest and highest sample among them. A line
+ * is drawn from the coarsest level with no more points than there are
+ * pixels, so drawing it takes the same time no matter how many
+ * samples there are while spikes and dips are still visible. Samples
+ * are appended in O(log n) so the pyramid can grow while a benchmark
+ * is running.
+ */
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gdouble
+measure_width (cairo_t     *cr,
+               const gchar *s)
+{
+  cairo_text_extents_t te;
+  cairo_text_extents (cr, s, &te);
+  return te.width;
+}
+
+static gdouble
+measure_height (cairo_t     *cr,
+                const gchar *s)
+{
+  cairo_text_extents_t te;
+  cairo_text_extents (cr, s, &te);
+  return te.height;
+}
+
+/* Lays out and draws the markers, background and grid of a graph and
+ * clips @cr to the area the graph itself goes in, which is returned
+ * in @out_gx, @out_gy, @out_gw and @out_gh.
+ *
+ * The @x_markers are spread evenly from the left to the right edge of
+ * the graph and the y markers from the bottom to the top. There is a
+ * grid line for each marker. @y_right_markers may be %NULL.
+ */
+void
+gdu_benchmark_graph_draw_frame (cairo_t  *cr,
+                                gdouble   width,
+                                gdouble   height,
+                                gchar   **x_markers,
+                                gchar   **y_left_markers,
+                                gchar   **y_right_markers,
+                                gdouble  *out_gx,
+                                gdouble  *out_gy,
+                                gdouble  *out_gw,
+                                gdouble  *out_gh)
+{
+  gdouble gx, gy, gw, gh;
+  guint num_x_markers;
+  guint num_y_markers;
+  gdouble x_marker_height;
+  gdouble w, h;
+  gdouble x, y;
+  guint n;
+
+  num_x_markers = g_strv_length (x_markers) - 1;
+  num_y_markers = g_strv_length (y_left_markers) - 1;
+  g_warn_if_fail (y_right_markers == NULL || g_strv_length (y_right_markers) == num_y_markers + 1);
+
+  cairo_select_font_face (cr, "sans",
+                          CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size (cr, 8.0);
+  cairo_set_line_width (cr, 1.0);
+
+  gx = 0;
+  gy = 0;
+  gw = width;
+  gh = height;
+
+  /* make horizontal and vertical room for x markers */
+  w = ceil (measure_width (cr, x_markers[0]) / 2.0);
+  gx +=  w;
+  gw -=  w;
+  w = ceil (measure_width (cr, x_markers[num_x_markers]) / 2.0);
+  gw -= w;
+  x_marker_height = 0;
+  for (n = 0; n <= num_x_markers; n++)
+    x_marker_height = MAX (x_marker_height, ceil (measure_height (cr, x_markers[n])));
+  x_marker_height += 10;
+  gh -= x_marker_height;
+
+  /* make horizontal room for left y markers */
+  for (n = 0; n <= num_y_markers; n++)
+    {
+      w = ceil (measure_width (cr, y_left_markers[n])) + 2 * 3;
+      if (w > gx)
+        {
+          gdouble needed = w - gx;
+          gx += needed;
+          gw -= needed;
+        }
+    }
+
+  /* make vertical room for top-left y marker */
+  h = ceil (measure_height (cr, y_left_markers[num_y_markers]) / 2.0);
+  if (h > gy)
+    {
+      gdouble needed = h - gy;
+      gy += needed;
+      gh -= needed;
+    }
+
+  if (y_right_markers != NULL)
+    {
+      /* make horizontal room for right y markers */
+      for (n = 0; n <= num_y_markers; n++)
+        {
+          w = ceil (measure_width (cr, y_right_markers[n])) + 2 * 3;
+          if (w > width - (gx + gw))
+            {
+              gdouble needed = w - (width - (gx + gw));
+              gw -= needed;
+            }
+        }
+
+      /* make vertical room for top-right y marker */
+      h = ceil (measure_height (cr, y_right_markers[num_y_markers]) / 2.0);
+      if (h > gy)
+        {
+          gdouble needed = h - gy;
+          gy += needed;
+          gh -= needed;
+        }
+    }
+
+  /* draw x markers */
+  for (n = 0; n <= num_x_markers; n++)
+    {
+      cairo_text_extents_t te;
+
+      x = gx + ceil (n * gw / num_x_markers);
+      y = gy + gh + x_marker_height/2.0;
+
+      cairo_text_extents (cr, x_markers[n], &te);
+      cairo_move_to (cr,
+                     x - te.x_bearing - te.width/2,
+                     y - te.y_bearing - te.height/2);
+      cairo_set_source_rgb (cr, 0, 0, 0);
+      cairo_show_text (cr, x_markers[n]);
+    }
+
+  /* draw left y markers */
+  for (n = 0; n <= num_y_markers; n++)
+    {
+      cairo_text_extents_t te;
+
+      x = gx/2.0;
+      y = gy + gh - gh * n / num_y_markers;
+
+      cairo_text_extents (cr, y_left_markers[n], &te);
+      cairo_move_to (cr,
+                     x - te.x_bearing - te.width/2,
+                     y - te.y_bearing - te.height/2);
+      cairo_set_source_rgb (cr, 0, 0, 0);
+      cairo_show_text (cr, y_left_markers[n]);
+    }
+
+  /* draw right y markers */
+  for (n = 0; y_right_markers != NULL && n <= num_y_markers; n++)
+    {
+      cairo_text_extents_t te;
+
+      x = gx + gw + (width - (gx + gw))/2.0;
+      y = gy + gh - gh * n / num_y_markers;
+
+      cairo_text_extents (cr, y_right_markers[n], &te);
+      cairo_move_to (cr,
+                     x - te.x_bearing - te.width/2,
+                     y - te.y_bearing - te.height/2);
+      cairo_set_source_rgb (cr, 0, 0, 0);
+      cairo_show_text (cr, y_right_markers[n]);
+    }
+
+  /* fill graph area */
+  cairo_set_source_rgb (cr, 1, 1, 1);
+  cairo_rectangle (cr, gx + 0.5, gy + 0.5, gw, gh);
+  cairo_fill_preserve (cr);
+  /* grid - first a rect */
+  cairo_set_source_rgba (cr, 0, 0, 0, 0.25);
+  cairo_set_line_width (cr, 1.0);
+  /* rect - also clip to rect for all future drawing operations */
+  cairo_stroke_preserve (cr);
+  cairo_clip (cr);
+  /* vertical lines */
+  for (n = 1; n < num_x_markers; n++)
+    {
+      x = gx + ceil (n * gw / num_x_markers);
+      cairo_move_to (cr, x + 0.5, gy + 0.5);
+      cairo_line_to (cr, x + 0.5, gy + gh + 0.5);
+      cairo_stroke (cr);
+    }
+  /* horizontal lines */
+  for (n = 1; n < num_y_markers; n++)
+    {
+      y = gy + ceil (n * gh / num_y_markers);
+      cairo_move_to (cr, gx + 0.5, y + 0.5);
+      cairo_line_to (cr, gx + gw + 0.5, y + 0.5);
+      cairo_stroke (cr);
+    }
+
+  *out_gx = gx;
+  *out_gy = gy;
+  *out_gw = gw;
+  *out_gh = gh;
+}
+
+/* Rounds @value up so the graph can have @num_markers nicely spaced markers */
+gdouble
+gdu_benchmark_graph_round_up_for_markers (gdouble value,
+                                          guint   num_markers)
+{
+  gdouble step;
+  gdouble magnitude;
+  gdouble normalized;
+
+  if (value <= 0.0)
+    return num_markers;
+
+  step = value / num_markers;
+  magnitude = pow (10.0, floor (log10 (step)));
+  normalized = step / magnitude;
+  if (normalized <= 1.0)
+    step = magnitude;
+  else if (normalized <= 2.0)
+    step = 2.0 * magnitude;
+  else if (normalized <= 2.5)
+    step = 2.5 * magnitude;
+  else if (normalized <= 5.0)
+    step = 5.0 * magnitude;
+  else
+    step = 10.0 * magnitude;
+
+  return step * num_markers;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  gdouble min_x;
+  gdouble min_y;
+  gdouble max_x;
+  gdouble max_y;
+} Point;
+
+struct GduBenchmarkGraphSeries
+{
+  guint num_samples;
+  GPtrArray *levels;  /* of GArray of Point, level 0 first */
+};
+
+GduBenchmarkGraphSeries *
+gdu_benchmark_graph_series_new (void)
+{
+  GduBenchmarkGraphSeries *series;
+
+  series = g_new0 (GduBenchmarkGraphSeries, 1);
+  series->levels = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+  return series;
+}
+
+void
+gdu_benchmark_graph_series_free (GduBenchmarkGraphSeries *series)
+{
+  if (series == NULL)
+    return;
+  g_ptr_array_unref (series->levels);
+  g_free (series);
+}
+
+void
+gdu_benchmark_graph_series_clear (GduBenchmarkGraphSeries *series)
+{
+  g_ptr_array_set_size (series->levels, 0);
+  series->num_samples = 0;
+}
+
+static void
+point_merge (Point       *point,
+             const Point *other)
+{
+  if (other->min_y < point->min_y)
+    {
+      point->min_x = other->min_x;
+      point->min_y = other->min_y;
+    }
+  if (other->max_y > point->max_y)
+    {
+      point->max_x = other->max_x;
+      point->max_y = other->max_y;
+    }
+}
+
+/**
+ * gdu_benchmark_graph_series_append:
+ * @series: A #GduBenchmarkGraphSeries.
+ * @x: Where the sample is on the x axis.
+ * @y: The value of the sample.
+ *
+ * Appends a sample to @series. Samples must be appended in increasing
+ * order of @x.
+ */
+void
+gdu_benchmark_graph_series_append (GduBenchmarkGraphSeries *series,
+                                   gdouble                  x,
+                                   gdouble                  y)
+{
+  Point point = {x, y, x, y};
+  guint index;
+  guint k;
+
+  if (series->levels->len == 0)
+    g_ptr_array_add (series->levels, g_array_new (FALSE, FALSE, sizeof (Point)));
+  g_array_append_val ((GArray *) series->levels->pdata[0], point);
+  index = series->num_samples++;
+
+  /* add the sample to the point covering it in each level above, up
+   * to and including a level with a single point
+   */
+  for (k = 1; k < series->levels->len || ((GArray *) series->levels->pdata[k - 1])->len > 1; k++)
+    {
+      GArray *below = series->levels->pdata[k - 1];
+      GArray *level;
+
+      if (k == series->levels->len)
+        {
+          /* the level below just got its second point */
+          Point merged = g_array_index (below, Point, 0);
+          point_merge (&merged, &g_array_index (below, Point, 1));
+          level = g_array_new (FALSE, FALSE, sizeof (Point));
+          g_array_append_val (level, merged);
+          g_ptr_array_add (series->levels, level);
+        }
+      else
+        {
+          level = series->levels->pdata[k];
+          if ((index >> k) < level->len)
+            point_merge (&g_array_index (level, Point, index >> k), &point);
+          else
+            g_array_append_val (level, point);
+        }
+    }
+}
+
+guint
+gdu_benchmark_graph_series_get_num_samples (GduBenchmarkGraphSeries *series)
+{
+  return series->num_samples;
+}
+
+/* Returns the highest sample, 0 if there are none */
+gdouble
+gdu_benchmark_graph_series_get_max (GduBenchmarkGraphSeries *series)
+{
+  GArray *top;
+
+  if (series->levels->len == 0)
+    return 0.0;
+  top = series->levels->pdata[series->levels->len - 1];
+  return g_array_index (top, Point, 0).max_y;
+}
+
+/* Returns the finest level with at most @max_points points */
+guint
+gdu_benchmark_graph_series_get_level (GduBenchmarkGraphSeries *series,
+                                      guint                    max_points)
+{
+  guint k;
+
+  for (k = 0; k + 1 < series->levels->len; k++)
+    {
+      if (((GArray *) series->levels->pdata[k])->len <= max_points)
+        break;
+    }
+  return k;
+}
+
+guint
+gdu_benchmark_graph_series_get_num_points (GduBenchmarkGraphSeries *series,
+                                           guint                    level)
+{
+  if (level >= series->levels->len)
+    return 0;
+  return ((GArray *) series->levels->pdata[level])->len;
+}
+
+/* Returns the number of points of @level that won't change when more
+ * samples are appended, i.e. all but a last point covering fewer
+ * samples than it will eventually
+ */
+guint
+gdu_benchmark_graph_series_get_num_complete_points (GduBenchmarkGraphSeries *series,
+                                                    guint                    level)
+{
+  if (level >= series->levels->len)
+    return 0;
+  return series->num_samples >> level;
+}
+
+/**
+ * gdu_benchmark_graph_series_stroke:
+ * @series: A #GduBenchmarkGraphSeries.
+ * @cr: The context to draw on.
+ * @level: The level to draw, see gdu_benchmark_graph_series_get_level().
+ * @first_point: The first point of @level to draw.
+ * @end_point: The point after the last point to draw.
+ * @gx: The left edge of the graph.
+ * @gy: The top edge of the graph.
+ * @gw: The width of the graph.
+ * @gh: The height of the graph.
+ * @max_x: The value at the right edge of the graph.
+ * @max_y: The value at the top edge of the graph.
+ *
+ * Strokes a line through the given points with the current source and
+ * line width of @cr. Each point is drawn as its lowest and highest
+ * sample in the order they were appended.
+ */
+void
+gdu_benchmark_graph_series_stroke (GduBenchmarkGraphSeries *series,
+                                   cairo_t                 *cr,
+                                   guint                    level,
+                                   guint                    first_point,
+                                   guint                    end_point,
+                                   gdouble                  gx,
+                                   gdouble                  gy,
+                                   gdouble                  gw,
+                                   gdouble                  gh,
+                                   gdouble                  max_x,
+                                   gdouble                  max_y)
+{
+  GArray *points;
+  guint n;
+
+  if (level >= series->levels->len || max_x <= 0.0 || max_y <= 0.0)
+    return;
+  points = series->levels->pdata[level];
+  end_point = MIN (end_point, points->len);
+
+  cairo_new_path (cr);
+  for (n = first_point; n < end_point; n++)
+    {
+      Point *point = &g_array_index (points, Point, n);
+      gdouble x1, y1, x2, y2;
+
+      if (point->min_x <= point->max_x)
+        {
+          x1 = point->min_x;
+          y1 = point->min_y;
+          x2 = point->max_x;
+          y2 = point->max_y;
+        }
+      else
+        {
+          x1 = point->max_x;
+          y1 = point->max_y;
+          x2 = point->min_x;
+          y2 = point->min_y;
+        }
+
+      cairo_line_to (cr, gx + gw * x1 / max_x, gy + gh - gh * y1 / max_y);
+      if (x2 != x1 || y2 != y1)
+        cairo_line_to (cr, gx + gw * x2 / max_x, gy + gh - gh * y2 / max_y);
+    }
+  cairo_stroke (cr);
+}
@@ -0,0 +1,59 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BENCHMARK_GRAPH_H__
+#define __GDU_BENCHMARK_GRAPH_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+void     gdu_benchmark_graph_draw_frame            (cairo_t  *cr,
+                                                    gdouble   width,
+                                                    gdouble   height,
+                                                    gchar   **x_markers,
+                                                    gchar   **y_left_markers,
+                                                    gchar   **y_right_markers,
+                                                    gdouble  *out_gx,
+                                                    gdouble  *out_gy,
+                                                    gdouble  *out_gw,
+                                                    gdouble  *out_gh);
+gdouble  gdu_benchmark_graph_round_up_for_markers  (gdouble   value,
+                                                    guint     num_markers);
+
+GduBenchmarkGraphSeries *gdu_benchmark_graph_series_new                     (void);
+void                     gdu_benchmark_graph_series_free                    (GduBenchmarkGraphSeries *series);
+void                     gdu_benchmark_graph_series_clear                   (GduBenchmarkGraphSeries *series);
+void                     gdu_benchmark_graph_series_append                  (GduBenchmarkGraphSeries *series,
+                                                                             gdouble                  x,
+                                                                             gdouble                  y);
+guint                    gdu_benchmark_graph_series_get_num_samples         (GduBenchmarkGraphSeries *series);
+gdouble                  gdu_benchmark_graph_series_get_max                 (GduBenchmarkGraphSeries *series);
+guint                    gdu_benchmark_graph_series_get_level               (GduBenchmarkGraphSeries *series,
+                                                                             guint                    max_points);
+guint                    gdu_benchmark_graph_series_get_num_points          (GduBenchmarkGraphSeries *series,
+                                                                             guint                    level);
+guint                    gdu_benchmark_graph_series_get_num_complete_points (GduBenchmarkGraphSeries *series,
+                                                                             guint                    level);
+void                     gdu_benchmark_graph_series_stroke                  (GduBenchmarkGraphSeries *series,
+                                                                             cairo_t                 *cr,
+                                                                             guint                    level,
+                                                                             guint                    first_point,
+                                                                             guint                    end_point,
+                                                                             gdouble                  gx,
+                                                                             gdouble                  gy,
+                                                                             gdouble                  gw,
+                                                                             gdouble                  gh,
+                                                                             gdouble                  max_x,
+                                                                             gdouble                  max_y);
+
+G_END_DECLS
+
+#endif /* __GDU_BENCHMARK_GRAPH_H__ */
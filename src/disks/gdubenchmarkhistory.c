@@ -0,0 +1,273 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "gdubenchmarkhistory.h"
+
+/* The benchmark history of a device is every benchmark run ever made
+ * on it, oldest first, so a device that is slowly getting slower can
+ * be spotted.
+ *
+ * It is stored as a sequence of records that are only ever appended
+ * to - each record is the size of a serialized GVariant as a 32-bit
+ * little-endian number followed by the serialized GVariant itself (in
+ * normal form and host byte order). The GVariant is of type a{sv} and
+ * has the same keys as the file used for the last benchmark of the
+ * device, see gdubenchmarkdialog.c.
+ *
+ * Since each record is written with a single write(2) call, the worst
+ * that can happen when e.g. running out of disk space is that the last
+ * record is incomplete. Such a record is ignored when loading and
+ * overwritten by the next record appended.
+ */
+
+#define RECORD_HEADER_SIZE sizeof (guint32)
+
+struct GduBenchmarkHistory
+{
+  gchar *filename;
+  GPtrArray *runs;
+
+  /* the size of the complete records in the file */
+  goffset valid_size;
+  /* whether there is an incomplete record after that */
+  gboolean truncate_pending;
+};
+
+static GduBenchmarkHistory *
+gdu_benchmark_history_new (const gchar *filename)
+{
+  GduBenchmarkHistory *history;
+
+  history = g_new0 (GduBenchmarkHistory, 1);
+  history->filename = g_strdup (filename);
+  history->runs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+  return history;
+}
+
+void
+gdu_benchmark_history_free (GduBenchmarkHistory *history)
+{
+  if (history == NULL)
+    return;
+  g_free (history->filename);
+  g_ptr_array_unref (history->runs);
+  g_free (history);
+}
+
+/**
+ * gdu_benchmark_history_load:
+ * @filename: The file the history is stored in.
+ * @error: Return location for error or %NULL.
+ *
+ * Loads the benchmark history stored in @filename. It is not an error
+ * if @filename does not exist, the history is just empty.
+ *
+ * Returns: A #GduBenchmarkHistory to free with
+ * gdu_benchmark_history_free() or %NULL if @error is set.
+ */
+GduBenchmarkHistory *
+gdu_benchmark_history_load (const gchar  *filename,
+                            GError      **error)
+{
+  GduBenchmarkHistory *ret = NULL;
+  GduBenchmarkHistory *history = NULL;
+  gchar *contents = NULL;
+  gsize length = 0;
+  gsize pos;
+  GError *local_error = NULL;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  history = gdu_benchmark_history_new (filename);
+
+  if (!g_file_get_contents (filename,
+                            &contents,
+                            &length,
+                            &local_error))
+    {
+      if (local_error->domain == G_FILE_ERROR && local_error->code == G_FILE_ERROR_NOENT)
+        {
+          /* no runs yet */
+          g_clear_error (&local_error);
+          ret = history;
+          history = NULL;
+          goto out;
+        }
+      g_propagate_error (error, local_error);
+      goto out;
+    }
+
+  pos = 0;
+  while (length - pos >= RECORD_HEADER_SIZE)
+    {
+      guint32 size;
+      gpointer variant_data;
+      GVariant *run;
+
+      memcpy (&size, contents + pos, RECORD_HEADER_SIZE);
+      size = GUINT32_FROM_LE (size);
+      if (size > length - pos - RECORD_HEADER_SIZE)
+        break;
+
+      /* copy the data so it is suitably aligned */
+      variant_data = g_malloc (size);
+      memcpy (variant_data, contents + pos + RECORD_HEADER_SIZE, size);
+      run = g_variant_new_from_data (G_VARIANT_TYPE_VARDICT,
+                                     variant_data,
+                                     size,
+                                     FALSE,
+                                     g_free, variant_data);
+      g_ptr_array_add (history->runs, g_variant_ref_sink (run));
+
+      pos += RECORD_HEADER_SIZE + size;
+    }
+
+  history->valid_size = pos;
+  if (pos < length)
+    {
+      g_warning ("Ignoring incomplete record of %" G_GSIZE_FORMAT " bytes at the end of %s",
+                 length - pos, filename);
+      history->truncate_pending = TRUE;
+    }
+
+  ret = history;
+  history = NULL;
+
+ out:
+  gdu_benchmark_history_free (history);
+  g_free (contents);
+  return ret;
+}
+
+/**
+ * gdu_benchmark_history_append:
+ * @history: A #GduBenchmarkHistory.
+ * @run: A #GVariant of type a{sv}. If floating, it is consumed.
+ * @error: Return location for error or %NULL.
+ *
+ * Appends @run to @history and to the file it is stored in.
+ *
+ * Returns: %TRUE if @run was appended, %FALSE if @error is set.
+ */
+gboolean
+gdu_benchmark_history_append (GduBenchmarkHistory  *history,
+                              GVariant             *run,
+                              GError              **error)
+{
+  gboolean ret = FALSE;
+  GVariant *normal_run = NULL;
+  guchar *record = NULL;
+  gsize record_size;
+  guint32 size;
+  gssize num_written;
+  gint fd = -1;
+
+  g_return_val_if_fail (history != NULL, FALSE);
+  g_return_val_if_fail (g_variant_is_of_type (run, G_VARIANT_TYPE_VARDICT), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  g_variant_ref_sink (run);
+  normal_run = g_variant_get_normal_form (run);
+
+  if (g_variant_get_size (normal_run) > G_MAXUINT32)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Benchmark run is too big");
+      goto out;
+    }
+
+  size = GUINT32_TO_LE ((guint32) g_variant_get_size (normal_run));
+  record_size = RECORD_HEADER_SIZE + g_variant_get_size (normal_run);
+  record = g_malloc (record_size);
+  memcpy (record, &size, RECORD_HEADER_SIZE);
+  g_variant_store (normal_run, record + RECORD_HEADER_SIZE);
+
+  fd = g_open (history->filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+  if (fd == -1)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error opening %s: %m", history->filename);
+      goto out;
+    }
+
+  if (history->truncate_pending)
+    {
+      if (ftruncate (fd, history->valid_size) != 0)
+        {
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                       "Error truncating %s: %m", history->filename);
+          goto out;
+        }
+      history->truncate_pending = FALSE;
+    }
+
+  num_written = write (fd, record, record_size);
+  if (num_written != (gssize) record_size)
+    {
+      if (num_written < 0)
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                     "Error writing to %s: %m", history->filename);
+      else
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                     "Short write to %s", history->filename);
+      if (num_written > 0)
+        history->truncate_pending = TRUE;
+      goto out;
+    }
+  history->valid_size += record_size;
+
+  if (close (fd) != 0)
+    {
+      fd = -1;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error closing %s: %m", history->filename);
+      goto out;
+    }
+  fd = -1;
+
+  g_ptr_array_add (history->runs, normal_run);
+  normal_run = NULL;
+
+  ret = TRUE;
+
+ out:
+  if (fd != -1)
+    close (fd);
+  g_free (record);
+  if (normal_run != NULL)
+    g_variant_unref (normal_run);
+  g_variant_unref (run);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+guint
+gdu_benchmark_history_get_num_runs (GduBenchmarkHistory *history)
+{
+  return history->runs->len;
+}
+
+/* Returns the @index'th run, oldest first. The returned value is owned by @history. */
+GVariant *
+gdu_benchmark_history_get_run (GduBenchmarkHistory *history,
+                               guint                index)
+{
+  g_return_val_if_fail (index < history->runs->len, NULL);
+  return history->runs->pdata[index];
+}
@@ -0,0 +1,31 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BENCHMARK_HISTORY_H__
+#define __GDU_BENCHMARK_HISTORY_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+GduBenchmarkHistory *gdu_benchmark_history_load          (const gchar          *filename,
+                                                          GError              **error);
+void                 gdu_benchmark_history_free          (GduBenchmarkHistory  *history);
+gboolean             gdu_benchmark_history_append        (GduBenchmarkHistory  *history,
+                                                          GVariant             *run,
+                                                          GError              **error);
+
+guint                gdu_benchmark_history_get_num_runs  (GduBenchmarkHistory  *history);
+GVariant            *gdu_benchmark_history_get_run       (GduBenchmarkHistory  *history,
+                                                          guint                 index);
+
+G_END_DECLS
+
+#endif /* __GDU_BENCHMARK_HISTORY_H__ */
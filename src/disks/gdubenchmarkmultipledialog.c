@@ -0,0 +1,1057 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+#include <gio/gunixfdlist.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include <math.h>
+
+#include "gduapplication.h"
+#include "gduwindow.h"
+#include "gdubenchmarkmultipledialog.h"
+#include "gdubenchmarkengine.h"
+#include "gdubenchmarkgraph.h"
+#include "gdubenchmarkutils.h"
+
+/* Benchmarks several devices and compares them, e.g. to find the odd
+ * one out among a batch of new disks before putting them in a RAID
+ * array.
+ *
+ * Each device is benchmarked read-only: first the read rate of a
+ * number of samples spread evenly over the device, then the average
+ * access time of a number of random reads. The devices are either
+ * benchmarked all at the same time, one thread per device, or one
+ * after another. If the devices are slower all at the same time than
+ * one at a time, whatever they are attached to is the bottleneck.
+ */
+
+/* A device is an outlier if its average read rate is off by more than
+ * this many percent from the median of all devices benchmarked the
+ * same way
+ */
+#define OUTLIER_THRESHOLD_PERCENT 15.0
+
+/* The controller or bus is considered the bottleneck if the devices
+ * are this much slower, or more, all at the same time than one at a
+ * time
+ */
+#define BOTTLENECK_RATIO 0.8
+
+typedef enum {
+  BM_DEVICE_STATE_NONE,
+  BM_DEVICE_STATE_WAITING,
+  BM_DEVICE_STATE_OPENING_DEVICE,
+  BM_DEVICE_STATE_TRANSFER_RATE,
+  BM_DEVICE_STATE_ACCESS_TIME,
+  BM_DEVICE_STATE_DONE,
+  BM_DEVICE_STATE_FAILED,
+} BMDeviceState;
+
+/* the colors of the devices in the graph, used in turn */
+static const struct {
+  gdouble red, green, blue;
+} device_colors[] = {
+  {0.20, 0.40, 0.90},
+  {0.90, 0.30, 0.30},
+  {0.20, 0.70, 0.20},
+  {0.90, 0.60, 0.10},
+  {0.60, 0.30, 0.80},
+  {0.10, 0.70, 0.70},
+  {0.80, 0.30, 0.60},
+  {0.50, 0.50, 0.50},
+};
+
+typedef struct
+{
+  UDisksObject *object;
+  UDisksBlock *block;
+  gchar *name;
+
+  /* must hold bm_lock when reading/writing these */
+  BMDeviceState state;
+  guint64 size;
+  GArray *read_samples;       /* offset is where on the device, value is bytes per second */
+  gdouble access_time;        /* average, in seconds, 0 if not measured */
+  gdouble read_rate_alone;    /* average when benchmarked one at a time, 0 if not measured */
+  gdouble read_rate_together; /* average when benchmarked all at the same time, 0 if not measured */
+  gchar *error_message;
+} BMDevice;
+
+typedef struct
+{
+  volatile gint ref_count;
+
+  GduWindow *window;
+  GtkBuilder *builder;
+
+  GtkWidget *dialog;
+  GtkWidget *graph_drawing_area;
+  GtkWidget *treeview;
+  GtkWidget *summary_label;
+  GtkWidget *num_samples_spinbutton;
+  GtkWidget *sample_size_spinbutton;
+  GtkWidget *num_access_samples_spinbutton;
+  GtkWidget *one_at_a_time_checkbutton;
+
+  GtkWidget *start_benchmark_button;
+  GtkWidget *stop_benchmark_button;
+
+  GtkListStore *store;
+
+  BMDevice *devices;
+  guint num_devices;
+
+  /* set before starting the benchmark threads */
+  gint bm_num_samples;
+  guint64 bm_sample_size;
+  gint bm_num_access_samples;
+  gboolean bm_one_at_a_time;
+
+  /* must hold bm_lock when reading/writing these */
+  GCancellable *bm_cancellable;
+  gboolean bm_in_progress;
+  guint bm_num_threads;
+  gboolean bm_update_timeout_pending;
+} DialogData;
+
+G_LOCK_DEFINE_STATIC (bm_lock);
+
+static const struct {
+  goffset offset;
+  const gchar *name;
+} widget_mapping[] = {
+  {G_STRUCT_OFFSET (DialogData, graph_drawing_area), "graph-drawing-area"},
+  {G_STRUCT_OFFSET (DialogData, treeview), "treeview"},
+  {G_STRUCT_OFFSET (DialogData, summary_label), "summary-label"},
+  {G_STRUCT_OFFSET (DialogData, num_samples_spinbutton), "num-samples-spinbutton"},
+  {G_STRUCT_OFFSET (DialogData, sample_size_spinbutton), "sample-size-spinbutton"},
+  {G_STRUCT_OFFSET (DialogData, num_access_samples_spinbutton), "num-access-samples-spinbutton"},
+  {G_STRUCT_OFFSET (DialogData, one_at_a_time_checkbutton), "one-at-a-time-checkbutton"},
+  {0, NULL}
+};
+
+enum
+{
+  COLUMN_INDEX,
+  N_COLUMNS
+};
+
+static void update_dialog (DialogData *data);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static DialogData *
+dialog_data_ref (DialogData *data)
+{
+  g_atomic_int_inc (&data->ref_count);
+  return data;
+}
+
+static void
+dialog_data_unref (DialogData *data)
+{
+  if (g_atomic_int_dec_and_test (&data->ref_count))
+    {
+      guint n;
+
+      if (data->dialog != NULL)
+        {
+          gtk_widget_hide (data->dialog);
+          gtk_widget_destroy (data->dialog);
+          data->dialog = NULL;
+        }
+
+      for (n = 0; n < data->num_devices; n++)
+        {
+          BMDevice *device = &data->devices[n];
+          g_object_unref (device->object);
+          g_free (device->name);
+          g_array_unref (device->read_samples);
+          g_free (device->error_message);
+        }
+      g_free (data->devices);
+
+      g_clear_object (&data->store);
+      g_clear_object (&data->window);
+      g_clear_object (&data->builder);
+      g_clear_object (&data->bm_cancellable);
+
+      g_free (data);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Returns the median of the non-zero read rates at @rate_offset in the
+ * devices, 0 if there are none. Must hold bm_lock.
+ */
+static gdouble
+get_median_read_rate (DialogData *data,
+                      goffset     rate_offset)
+{
+  GArray *rates;
+  gdouble ret = 0.0;
+  guint n;
+
+  rates = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  for (n = 0; n < data->num_devices; n++)
+    {
+      gdouble rate = G_STRUCT_MEMBER (gdouble, &data->devices[n], rate_offset);
+      if (rate > 0.0)
+        g_array_append_val (rates, rate);
+    }
+  ret = gdu_benchmark_get_median_of_doubles (rates);
+  g_array_unref (rates);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+on_drawing_area_draw (GtkWidget      *widget,
+                      cairo_t        *cr,
+                      gpointer        user_data)
+{
+  DialogData *data = user_data;
+  GtkAllocation allocation;
+  gdouble gx, gy, gw, gh;
+  gdouble x, y;
+  gdouble max_speed = 0.0;
+  gdouble max_visible_speed;
+  gchar **x_markers;
+  gchar **y_left_markers;
+  guint num_y_markers = 10;
+  GPtrArray *p;
+  guint n, m;
+
+  G_LOCK (bm_lock);
+
+  for (n = 0; n < data->num_devices; n++)
+    {
+      BMDevice *device = &data->devices[n];
+      for (m = 0; m < device->read_samples->len; m++)
+        max_speed = MAX (max_speed, g_array_index (device->read_samples, GduBenchmarkSample, m).value);
+    }
+  if (max_speed == 0.0)
+    max_speed = 100 * 1000 * 1000;
+  max_visible_speed = gdu_benchmark_graph_round_up_for_markers (max_speed / (1000 * 1000), num_y_markers) * 1000 * 1000;
+
+  p = g_ptr_array_new ();
+  for (n = 0; n <= num_y_markers; n++)
+    {
+      gdouble val = n * max_visible_speed / num_y_markers;
+      /* Translators: This is used in the benchmark graph - %d is megabytes per second */
+      g_ptr_array_add (p, g_strdup_printf (C_("benchmark-graph", "%d MB/s"), (gint) (val / (1000 * 1000))));
+    }
+  g_ptr_array_add (p, NULL);
+  y_left_markers = (gchar **) g_ptr_array_free (p, FALSE);
+
+  p = g_ptr_array_new ();
+  for (n = 0; n <= 10; n++)
+    g_ptr_array_add (p, g_strdup_printf ("%d%%", n * 10));
+  g_ptr_array_add (p, NULL);
+  x_markers = (gchar **) g_ptr_array_free (p, FALSE);
+
+  gtk_widget_get_allocation (widget, &allocation);
+  gdu_benchmark_graph_draw_frame (cr,
+                                  allocation.width,
+                                  allocation.height,
+                                  x_markers,
+                                  y_left_markers,
+                                  NULL,
+                                  &gx, &gy, &gw, &gh);
+
+  /* the read rate of each device, over where on the device it was measured */
+  cairo_set_line_width (cr, 1.5);
+  for (n = 0; n < data->num_devices; n++)
+    {
+      BMDevice *device = &data->devices[n];
+      guint color = n % G_N_ELEMENTS (device_colors);
+
+      if (device->size == 0)
+        continue;
+
+      cairo_set_source_rgb (cr,
+                            device_colors[color].red,
+                            device_colors[color].green,
+                            device_colors[color].blue);
+      for (m = 0; m < device->read_samples->len; m++)
+        {
+          GduBenchmarkSample *sample = &g_array_index (device->read_samples, GduBenchmarkSample, m);
+
+          x = gx + gw * sample->offset / device->size;
+          y = gy + gh - gh * sample->value / max_visible_speed;
+
+          if (m == 0)
+            cairo_move_to (cr, x, y);
+          else
+            cairo_line_to (cr, x, y);
+        }
+      cairo_stroke (cr);
+    }
+
+  G_UNLOCK (bm_lock);
+
+  g_strfreev (x_markers);
+  g_strfreev (y_left_markers);
+
+  /* propagate event further */
+  return FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static BMDevice *
+get_device_for_iter (DialogData   *data,
+                     GtkTreeModel *model,
+                     GtkTreeIter  *iter)
+{
+  guint index;
+
+  gtk_tree_model_get (model, iter, COLUMN_INDEX, &index, -1);
+  g_return_val_if_fail (index < data->num_devices, NULL);
+  return &data->devices[index];
+}
+
+static void
+name_cell_func (GtkTreeViewColumn *column,
+                GtkCellRenderer   *renderer,
+                GtkTreeModel      *model,
+                GtkTreeIter       *iter,
+                gpointer           user_data)
+{
+  DialogData *data = user_data;
+  BMDevice *device;
+  guint color;
+  gchar *markup;
+  gchar *s;
+
+  device = get_device_for_iter (data, model, iter);
+  color = (device - data->devices) % G_N_ELEMENTS (device_colors);
+
+  s = g_markup_escape_text (device->name, -1);
+  /* the bullet is the color of the device in the graph */
+  markup = g_strdup_printf ("<span foreground=\"#%02x%02x%02x\">●</span> %s",
+                            (guint) (device_colors[color].red * 255),
+                            (guint) (device_colors[color].green * 255),
+                            (guint) (device_colors[color].blue * 255),
+                            s);
+  g_object_set (renderer,
+                "markup", markup,
+                NULL);
+  g_free (markup);
+  g_free (s);
+}
+
+static void
+read_rate_cell_func (GtkTreeViewColumn *column,
+                     GtkCellRenderer   *renderer,
+                     GtkTreeModel      *model,
+                     GtkTreeIter       *iter,
+                     gpointer           user_data)
+{
+  DialogData *data = user_data;
+  goffset rate_offset = GPOINTER_TO_SIZE (g_object_get_data (G_OBJECT (column), "rate-offset"));
+  BMDevice *device;
+  gdouble rate;
+  gdouble median;
+  gchar *markup = NULL;
+
+  device = get_device_for_iter (data, model, iter);
+
+  G_LOCK (bm_lock);
+  rate = G_STRUCT_MEMBER (gdouble, device, rate_offset);
+  median = get_median_read_rate (data, rate_offset);
+  G_UNLOCK (bm_lock);
+
+  if (rate == 0.0)
+    {
+      markup = g_strdup ("—");
+    }
+  else
+    {
+      gchar *s;
+      gdouble deviation;
+
+      s = gdu_benchmark_format_transfer_rate (rate);
+      deviation = (rate - median) * 100.0 / median;
+      if (fabs (deviation) > OUTLIER_THRESHOLD_PERCENT)
+        {
+          /* Translators: Used for the read rate of an outlier when benchmarking several devices.
+           * The %s is the read rate, e.g. "42 MB/s" and %+.0f is how many percent it is off from
+           * the median of all the devices, e.g. "-23"
+           */
+          markup = g_strdup_printf (C_("benchmark-multiple", "<b>%s</b> <small>(%+.0f%%)</small>"), s, deviation);
+        }
+      else
+        {
+          markup = g_strdup (s);
+        }
+      g_free (s);
+    }
+
+  g_object_set (renderer,
+                "markup", markup,
+                NULL);
+  g_free (markup);
+}
+
+static void
+access_time_cell_func (GtkTreeViewColumn *column,
+                       GtkCellRenderer   *renderer,
+                       GtkTreeModel      *model,
+                       GtkTreeIter       *iter,
+                       gpointer           user_data)
+{
+  DialogData *data = user_data;
+  BMDevice *device;
+  gdouble access_time;
+  gchar *markup = NULL;
+
+  device = get_device_for_iter (data, model, iter);
+
+  G_LOCK (bm_lock);
+  access_time = device->access_time;
+  G_UNLOCK (bm_lock);
+
+  if (access_time == 0.0)
+    {
+      markup = g_strdup ("—");
+    }
+  else
+    {
+      /* Translators: %.2f is number of milliseconds and msec means "milli-second" */
+      markup = g_strdup_printf (C_("benchmark-access-time", "%.2f msec"), access_time * 1000.0);
+    }
+
+  g_object_set (renderer,
+                "markup", markup,
+                NULL);
+  g_free (markup);
+}
+
+static void
+state_cell_func (GtkTreeViewColumn *column,
+                 GtkCellRenderer   *renderer,
+                 GtkTreeModel      *model,
+                 GtkTreeIter       *iter,
+                 gpointer           user_data)
+{
+  DialogData *data = user_data;
+  BMDevice *device;
+  gchar *markup = NULL;
+
+  device = get_device_for_iter (data, model, iter);
+
+  G_LOCK (bm_lock);
+  switch (device->state)
+    {
+    case BM_DEVICE_STATE_NONE:
+      markup = g_strdup ("—");
+      break;
+
+    case BM_DEVICE_STATE_WAITING:
+      /* Translators: State of a device waiting for its turn when benchmarking several devices */
+      markup = g_strdup (C_("benchmark-multiple-state", "Waiting"));
+      break;
+
+    case BM_DEVICE_STATE_OPENING_DEVICE:
+      markup = g_strdup (C_("benchmark-multiple-state", "Opening Device…"));
+      break;
+
+    case BM_DEVICE_STATE_TRANSFER_RATE:
+      /* Translators: %2.1f is how far the transfer rate measurement is, in percent */
+      markup = g_strdup_printf (C_("benchmark-multiple-state", "Measuring transfer rate (%2.1f%% complete)…"),
+                                device->read_samples->len * 100.0 / data->bm_num_samples);
+      break;
+
+    case BM_DEVICE_STATE_ACCESS_TIME:
+      markup = g_strdup (C_("benchmark-multiple-state", "Measuring access time…"));
+      break;
+
+    case BM_DEVICE_STATE_DONE:
+      markup = g_strdup (C_("benchmark-multiple-state", "Done"));
+      break;
+
+    case BM_DEVICE_STATE_FAILED:
+      markup = g_markup_printf_escaped ("<span foreground=\"#ff0000\">%s</span>", device->error_message);
+      break;
+    }
+  G_UNLOCK (bm_lock);
+
+  g_object_set (renderer,
+                "markup", markup,
+                NULL);
+  g_free (markup);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gchar *
+format_summary (DialogData *data)
+{
+  GString *str;
+  gdouble total_together = 0.0;
+  gdouble sum_alone = 0.0;
+  gdouble sum_together = 0.0;
+  guint num_together = 0;
+  guint num_both = 0;
+  guint n;
+  gchar *s;
+
+  G_LOCK (bm_lock);
+  for (n = 0; n < data->num_devices; n++)
+    {
+      BMDevice *device = &data->devices[n];
+      if (device->read_rate_together > 0.0)
+        {
+          total_together += device->read_rate_together;
+          num_together++;
+        }
+      if (device->read_rate_alone > 0.0 && device->read_rate_together > 0.0)
+        {
+          sum_alone += device->read_rate_alone;
+          sum_together += device->read_rate_together;
+          num_both++;
+        }
+    }
+  G_UNLOCK (bm_lock);
+
+  str = g_string_new (NULL);
+  if (num_together > 1)
+    {
+      s = gdu_benchmark_format_transfer_rate (total_together);
+      /* Translators: Used when benchmarking several devices. The %s is the sum of the read
+       * rates of the devices benchmarked at the same time, e.g. "1.2 GB/s"
+       */
+      g_string_append_printf (str, C_("benchmark-multiple", "Combined read rate all at once: %s"), s);
+      g_free (s);
+    }
+
+  if (num_both > 0)
+    {
+      gdouble ratio = sum_together / sum_alone;
+      if (str->len > 0)
+        g_string_append_c (str, '\n');
+      if (ratio < BOTTLENECK_RATIO)
+        {
+          /* Translators: Used when benchmarking several devices and they were a lot slower
+           * all at once than one at a time. The %.0f is how much slower, in percent, e.g. "38"
+           */
+          g_string_append_printf (str,
+                                  C_("benchmark-multiple",
+                                     "<b>The devices are %.0f%% slower all at once than one at a time</b> — the controller or bus they are attached to is likely the bottleneck"),
+                                  (1.0 - ratio) * 100.0);
+        }
+      else
+        {
+          g_string_append (str,
+                           C_("benchmark-multiple",
+                              "The devices are about as fast all at once as one at a time"));
+        }
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+static void
+update_dialog (DialogData *data)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (data->store);
+  GtkTreeIter iter;
+  gboolean in_progress;
+  gchar *s;
+
+  G_LOCK (bm_lock);
+  in_progress = data->bm_in_progress;
+  G_UNLOCK (bm_lock);
+
+  if (in_progress)
+    {
+      gtk_widget_hide (data->start_benchmark_button);
+      gtk_widget_show (data->stop_benchmark_button);
+    }
+  else
+    {
+      gtk_widget_show (data->start_benchmark_button);
+      gtk_widget_hide (data->stop_benchmark_button);
+    }
+  gtk_widget_set_sensitive (data->num_samples_spinbutton, !in_progress);
+  gtk_widget_set_sensitive (data->sample_size_spinbutton, !in_progress);
+  gtk_widget_set_sensitive (data->num_access_samples_spinbutton, !in_progress);
+  gtk_widget_set_sensitive (data->one_at_a_time_checkbutton, !in_progress);
+
+  /* the cell data functions get everything from the devices */
+  if (gtk_tree_model_get_iter_first (model, &iter))
+    {
+      do
+        {
+          GtkTreePath *path = gtk_tree_model_get_path (model, &iter);
+          gtk_tree_model_row_changed (model, path, &iter);
+          gtk_tree_path_free (path);
+        }
+      while (gtk_tree_model_iter_next (model, &iter));
+    }
+
+  s = format_summary (data);
+  gtk_label_set_markup (GTK_LABEL (data->summary_label), s);
+  gtk_widget_set_visible (data->summary_label, strlen (s) > 0);
+  g_free (s);
+
+  gtk_widget_queue_draw (data->graph_drawing_area);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called on main / UI thread */
+static gboolean
+bmt_on_timeout (gpointer user_data)
+{
+  DialogData *data = user_data;
+  update_dialog (data);
+  G_LOCK (bm_lock);
+  data->bm_update_timeout_pending = FALSE;
+  G_UNLOCK (bm_lock);
+  dialog_data_unref (data);
+  return FALSE; /* don't run again */
+}
+
+static void
+bmt_schedule_update (DialogData *data)
+{
+  /* rate-limit updates */
+  G_LOCK (bm_lock);
+  if (!data->bm_update_timeout_pending)
+    {
+      g_timeout_add (200, /* ms */
+                     bmt_on_timeout,
+                     dialog_data_ref (data));
+      data->bm_update_timeout_pending = TRUE;
+    }
+  G_UNLOCK (bm_lock);
+}
+
+static void
+bmt_set_device_state (DialogData    *data,
+                      BMDevice      *device,
+                      BMDeviceState  state)
+{
+  G_LOCK (bm_lock);
+  device->state = state;
+  G_UNLOCK (bm_lock);
+  bmt_schedule_update (data);
+}
+
+/* Benchmarks @device, called in a benchmark thread */
+static gboolean
+benchmark_device (DialogData  *data,
+                  BMDevice    *device,
+                  GError     **error)
+{
+  gboolean ret = FALSE;
+  GVariant *fd_index = NULL;
+  GUnixFDList *fd_list = NULL;
+  GVariantBuilder options_builder;
+  GduBenchmarkWorkload workload = {0};
+  GduBenchmarkResult result = {0};
+  guint64 disk_size;
+  long page_size;
+  gint fd = -1;
+  gint n;
+
+  bmt_set_device_state (data, device, BM_DEVICE_STATE_OPENING_DEVICE);
+
+  g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&options_builder, "{sv}", "writable", g_variant_new_boolean (FALSE));
+  if (!udisks_block_call_open_for_benchmark_sync (device->block,
+                                                  g_variant_builder_end (&options_builder),
+                                                  NULL, /* fd_list */
+                                                  &fd_index,
+                                                  &fd_list,
+                                                  data->bm_cancellable,
+                                                  error))
+    goto out;
+
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+  if (fd == -1)
+    goto out;
+
+  if (ioctl (fd, BLKGETSIZE64, &disk_size) != 0)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error getting size of device: %m"));
+      goto out;
+    }
+
+  page_size = sysconf (_SC_PAGESIZE);
+  if (page_size < 1)
+    page_size = 4096;
+
+  if (disk_size < data->bm_sample_size)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   C_("benchmarking", "The device is too small for the benchmark"));
+      goto out;
+    }
+
+  G_LOCK (bm_lock);
+  device->size = disk_size;
+  device->state = BM_DEVICE_STATE_TRANSFER_RATE;
+  G_UNLOCK (bm_lock);
+
+  /* transfer rate, one sample at a time, spread evenly from the start to the end of the device */
+  workload.pattern = GDU_BENCHMARK_PATTERN_SEQUENTIAL;
+  workload.size = data->bm_sample_size;
+  workload.block_size = data->bm_sample_size;
+  workload.queue_depth = 1;
+  workload.max_ops = 1;
+  for (n = 0; n < data->bm_num_samples; n++)
+    {
+      GduBenchmarkSample sample;
+
+      workload.offset = n * ((disk_size - data->bm_sample_size) / (data->bm_num_samples - 1));
+      workload.offset &= ~((guint64) page_size - 1);
+      if (!gdu_benchmark_engine_run (fd, &workload, &result, data->bm_cancellable, error))
+        goto out;
+
+      sample.offset = workload.offset;
+      sample.value = gdu_benchmark_result_get_bytes_per_sec (&result);
+      G_LOCK (bm_lock);
+      g_array_append_val (device->read_samples, sample);
+      G_UNLOCK (bm_lock);
+      bmt_schedule_update (data);
+    }
+
+  /* access time, from random reads of a page each anywhere on the device */
+  bmt_set_device_state (data, device, BM_DEVICE_STATE_ACCESS_TIME);
+  workload.pattern = GDU_BENCHMARK_PATTERN_RANDOM;
+  workload.offset = 0;
+  workload.size = disk_size;
+  workload.block_size = page_size;
+  workload.max_ops = data->bm_num_access_samples;
+  if (!gdu_benchmark_engine_run (fd, &workload, &result, data->bm_cancellable, error))
+    goto out;
+
+  G_LOCK (bm_lock);
+  if (result.num_ops > 0)
+    device->access_time = ((gdouble) result.elapsed_usec) / result.num_ops / G_USEC_PER_SEC;
+  if (data->bm_one_at_a_time)
+    device->read_rate_alone = gdu_benchmark_get_average (device->read_samples);
+  else
+    device->read_rate_together = gdu_benchmark_get_average (device->read_samples);
+  device->state = BM_DEVICE_STATE_DONE;
+  G_UNLOCK (bm_lock);
+
+  ret = TRUE;
+
+ out:
+  if (fd != -1)
+    close (fd);
+  g_clear_object (&fd_list);
+  if (fd_index != NULL)
+    g_variant_unref (fd_index);
+  return ret;
+}
+
+typedef struct
+{
+  DialogData *data;
+  guint first_device;
+  guint num_devices;
+} BenchmarkThreadData;
+
+/* Benchmarks the devices given in @user_data one after another */
+static gpointer
+benchmark_thread (gpointer user_data)
+{
+  BenchmarkThreadData *thread_data = user_data;
+  DialogData *data = thread_data->data;
+  guint n;
+
+  for (n = thread_data->first_device; n < thread_data->first_device + thread_data->num_devices; n++)
+    {
+      BMDevice *device = &data->devices[n];
+      GError *error = NULL;
+
+      if (!benchmark_device (data, device, &error))
+        {
+          G_LOCK (bm_lock);
+          device->state = BM_DEVICE_STATE_FAILED;
+          device->error_message = g_strdup (error->message);
+          g_array_set_size (device->read_samples, 0);
+          G_UNLOCK (bm_lock);
+          g_clear_error (&error);
+        }
+      bmt_schedule_update (data);
+    }
+
+  G_LOCK (bm_lock);
+  data->bm_num_threads--;
+  if (data->bm_num_threads == 0)
+    data->bm_in_progress = FALSE;
+  G_UNLOCK (bm_lock);
+  bmt_schedule_update (data);
+
+  dialog_data_unref (data);
+  g_free (thread_data);
+  return NULL;
+}
+
+static void
+start_benchmark_thread (DialogData *data,
+                        guint       first_device,
+                        guint       num_devices)
+{
+  BenchmarkThreadData *thread_data;
+
+  thread_data = g_new0 (BenchmarkThreadData, 1);
+  thread_data->data = dialog_data_ref (data);
+  thread_data->first_device = first_device;
+  thread_data->num_devices = num_devices;
+  g_thread_unref (g_thread_new ("benchmark-thread", benchmark_thread, thread_data));
+}
+
+static void
+start_benchmark (DialogData *data)
+{
+  guint n;
+
+  data->bm_num_samples = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (data->num_samples_spinbutton));
+  data->bm_sample_size = ((guint64) gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (data->sample_size_spinbutton))) * 1024 * 1024;
+  data->bm_num_access_samples = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (data->num_access_samples_spinbutton));
+  data->bm_one_at_a_time = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (data->one_at_a_time_checkbutton));
+
+  G_LOCK (bm_lock);
+  for (n = 0; n < data->num_devices; n++)
+    {
+      BMDevice *device = &data->devices[n];
+      device->state = BM_DEVICE_STATE_WAITING;
+      device->size = 0;
+      g_array_set_size (device->read_samples, 0);
+      device->access_time = 0.0;
+      if (data->bm_one_at_a_time)
+        device->read_rate_alone = 0.0;
+      else
+        device->read_rate_together = 0.0;
+      g_free (device->error_message);
+      device->error_message = NULL;
+    }
+  data->bm_in_progress = TRUE;
+  data->bm_num_threads = data->bm_one_at_a_time ? 1 : data->num_devices;
+  g_cancellable_reset (data->bm_cancellable);
+  G_UNLOCK (bm_lock);
+
+  if (data->bm_one_at_a_time)
+    {
+      start_benchmark_thread (data, 0, data->num_devices);
+    }
+  else
+    {
+      for (n = 0; n < data->num_devices; n++)
+        start_benchmark_thread (data, n, 1);
+    }
+
+  update_dialog (data);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+init_treeview (DialogData *data)
+{
+  GtkTreeViewColumn *column;
+  GtkCellRenderer *renderer;
+  guint n;
+
+  data->store = gtk_list_store_new (N_COLUMNS, G_TYPE_UINT);
+  for (n = 0; n < data->num_devices; n++)
+    gtk_list_store_insert_with_values (data->store, NULL, G_MAXINT,
+                                       COLUMN_INDEX, n,
+                                       -1);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (data->treeview), GTK_TREE_MODEL (data->store));
+
+  column = gtk_tree_view_column_new ();
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->treeview), column);
+  /* Translators: column name for the devices being benchmarked */
+  gtk_tree_view_column_set_title (column, C_("benchmark-multiple", "Device"));
+  gtk_tree_view_column_set_expand (column, TRUE);
+  renderer = gtk_cell_renderer_text_new ();
+  g_object_set (G_OBJECT (renderer),
+                "ellipsize", PANGO_ELLIPSIZE_MIDDLE,
+                NULL);
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func (column,
+                                           renderer,
+                                           name_cell_func,
+                                           data,  /* user_data */
+                                           NULL); /* user_data GDestroyNotify */
+
+  column = gtk_tree_view_column_new ();
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->treeview), column);
+  /* Translators: column name for the average read rate of devices benchmarked at the same time */
+  gtk_tree_view_column_set_title (column, C_("benchmark-multiple", "Read Rate All at Once"));
+  g_object_set_data (G_OBJECT (column), "rate-offset",
+                     GSIZE_TO_POINTER (G_STRUCT_OFFSET (BMDevice, read_rate_together)));
+  renderer = gtk_cell_renderer_text_new ();
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func (column,
+                                           renderer,
+                                           read_rate_cell_func,
+                                           data,  /* user_data */
+                                           NULL); /* user_data GDestroyNotify */
+
+  column = gtk_tree_view_column_new ();
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->treeview), column);
+  /* Translators: column name for the average read rate of devices benchmarked one after another */
+  gtk_tree_view_column_set_title (column, C_("benchmark-multiple", "Read Rate One at a Time"));
+  g_object_set_data (G_OBJECT (column), "rate-offset",
+                     GSIZE_TO_POINTER (G_STRUCT_OFFSET (BMDevice, read_rate_alone)));
+  renderer = gtk_cell_renderer_text_new ();
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func (column,
+                                           renderer,
+                                           read_rate_cell_func,
+                                           data,  /* user_data */
+                                           NULL); /* user_data GDestroyNotify */
+
+  column = gtk_tree_view_column_new ();
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->treeview), column);
+  /* Translators: column name for the average access time of the devices being benchmarked */
+  gtk_tree_view_column_set_title (column, C_("benchmark-multiple", "Access Time"));
+  renderer = gtk_cell_renderer_text_new ();
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func (column,
+                                           renderer,
+                                           access_time_cell_func,
+                                           data,  /* user_data */
+                                           NULL); /* user_data GDestroyNotify */
+
+  column = gtk_tree_view_column_new ();
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->treeview), column);
+  /* Translators: column name for how far the benchmark of a device is */
+  gtk_tree_view_column_set_title (column, C_("benchmark-multiple", "State"));
+  renderer = gtk_cell_renderer_text_new ();
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func (column,
+                                           renderer,
+                                           state_cell_func,
+                                           data,  /* user_data */
+                                           NULL); /* user_data GDestroyNotify */
+}
+
+/**
+ * gdu_benchmark_multiple_dialog_show:
+ * @window: A #GduWindow.
+ * @blocks: A list of #UDisksBlock instances.
+ *
+ * Shows a dialog for benchmarking all of @blocks and comparing them.
+ */
+void
+gdu_benchmark_multiple_dialog_show (GduWindow *window,
+                                    GList     *blocks)
+{
+  DialogData *data;
+  UDisksClient *client;
+  GList *l;
+  guint n;
+
+  client = gdu_window_get_client (window);
+
+  data = g_new0 (DialogData, 1);
+  data->ref_count = 1;
+  data->window = g_object_ref (window);
+  data->bm_cancellable = g_cancellable_new ();
+
+  data->devices = g_new0 (BMDevice, g_list_length (blocks));
+  for (l = blocks; l != NULL; l = l->next)
+    {
+      UDisksBlock *block = UDISKS_BLOCK (l->data);
+      UDisksObject *object;
+      UDisksObjectInfo *info;
+      BMDevice *device;
+
+      object = (UDisksObject *) g_dbus_interface_dup_object (G_DBUS_INTERFACE (block));
+      if (object == NULL)
+        continue;
+
+      device = &data->devices[data->num_devices++];
+      device->object = object;
+      device->block = udisks_object_peek_block (object);
+      info = udisks_client_get_object_info (client, object);
+      device->name = g_strdup (udisks_object_info_get_one_liner (info));
+      g_object_unref (info);
+      device->read_samples = g_array_new (FALSE, /* zero-terminated */
+                                          FALSE, /* clear */
+                                          sizeof (GduBenchmarkSample));
+    }
+
+  data->dialog = GTK_WIDGET (gdu_application_new_widget (gdu_window_get_application (window),
+                                                         "benchmark-multiple-dialog.ui",
+                                                         "dialog1",
+                                                         &data->builder));
+  for (n = 0; widget_mapping[n].name != NULL; n++)
+    {
+      gpointer *p = (gpointer *) ((char *) data + widget_mapping[n].offset);
+      *p = GTK_WIDGET (gtk_builder_get_object (data->builder, widget_mapping[n].name));
+    }
+
+  gtk_window_set_transient_for (GTK_WINDOW (data->dialog), GTK_WINDOW (window));
+
+  data->start_benchmark_button = gtk_dialog_get_widget_for_response (GTK_DIALOG (data->dialog), 0);
+  data->stop_benchmark_button = gtk_dialog_get_widget_for_response (GTK_DIALOG (data->dialog), 1);
+
+  init_treeview (data);
+
+  g_signal_connect (data->graph_drawing_area,
+                    "draw",
+                    G_CALLBACK (on_drawing_area_draw),
+                    data);
+
+  /* set minimum size for the graph */
+  gtk_widget_set_size_request (data->graph_drawing_area,
+                               600,
+                               250);
+
+  update_dialog (data);
+
+  while (TRUE)
+    {
+      gint response;
+      response = gtk_dialog_run (GTK_DIALOG (data->dialog));
+      /* Keep in sync with .ui file */
+      switch (response)
+        {
+        case 0: /* start benchmark */
+          start_benchmark (data);
+          break;
+
+        case 1: /* abort benchmark */
+          g_cancellable_cancel (data->bm_cancellable);
+          break;
+        }
+
+      if (response < 0)
+        break;
+    }
+
+  /* the benchmark threads hold a reference until they are done */
+  g_cancellable_cancel (data->bm_cancellable);
+  gtk_widget_hide (data->dialog);
+  dialog_data_unref (data);
+}
@@ -0,0 +1,231 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "gdubenchmarkseekprofile.h"
+
+/* The seek profile measures how the access time grows with how far
+ * the heads have to move. For each of seek_distances[], in percent of
+ * the device, SEEK_DISTANCE_NUM_SAMPLES pairs of reads that far apart
+ * are made and the median time of the second read is kept. For each
+ * of seek_strokes[], in percent of the device from its start,
+ * SEEK_STROKE_NUM_SAMPLES random reads within the stroke are made and
+ * the SEEK_STROKE_PERCENTILE percentile is kept - that's what a
+ * partition of that size at the start of the device would see.
+ *
+ * Both read a page at a time and expect the page cache to be bypassed
+ * since it would hide the seeks.
+ */
+static const gdouble seek_distances[] = {0.01, 0.1, 0.5, 1.0, 2.0, 5.0, 10.0, 20.0, 35.0, 50.0, 75.0, 100.0};
+static const gdouble seek_strokes[] = {1.0, 2.0, 5.0, 10.0, 15.0, 20.0, 30.0, 40.0, 50.0, 60.0, 75.0, 100.0};
+
+#define SEEK_DISTANCE_NUM_SAMPLES 100
+#define SEEK_STROKE_NUM_SAMPLES 200
+#define SEEK_STROKE_PERCENTILE 99.0
+
+G_STATIC_ASSERT (G_N_ELEMENTS (seek_distances) == G_N_ELEMENTS (seek_strokes));
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Reads @size bytes at @offset into @buffer and returns how long it
+ * took in seconds, or a negative number if @error is set
+ */
+static gdouble
+timed_read (gint        fd,
+            guchar     *buffer,
+            gsize       size,
+            guint64     offset,
+            GError    **error)
+{
+  gint64 begin_usec;
+  gint64 end_usec;
+
+  begin_usec = g_get_monotonic_time ();
+  if (pread (fd, buffer, size, offset) < 0)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error reading %lld bytes from offset %lld"),
+                   (long long int) size,
+                   (long long int) offset);
+      return -1.0;
+    }
+  end_usec = g_get_monotonic_time ();
+  return (end_usec - begin_usec) / ((gdouble) G_USEC_PER_SEC);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Returns how many samples each of gdu_benchmark_measure_seek_distances()
+ * and gdu_benchmark_measure_seek_strokes() take
+ */
+guint
+gdu_benchmark_seek_profile_get_num_steps (void)
+{
+  return G_N_ELEMENTS (seek_distances);
+}
+
+/* Measures the access time over each of seek_distances[] and passes
+ * the median, in seconds, to @func with the distance in bytes as the
+ * offset
+ */
+gboolean
+gdu_benchmark_measure_seek_distances (gint                     fd,
+                                      guint64                  disk_size,
+                                      long                     page_size,
+                                      GduBenchmarkSampleFunc   func,
+                                      gpointer                 user_data,
+                                      GCancellable            *cancellable,
+                                      GError                 **error)
+{
+  gboolean ret = FALSE;
+  guchar *buffer_unaligned;
+  guchar *buffer;
+  GArray *latencies;
+  GRand *rand;
+  guint64 last_offset;
+  guint n;
+  guint m;
+
+  latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  rand = g_rand_new ();
+
+  /* page-aligned so it can be used with O_DIRECT */
+  buffer_unaligned = g_new0 (guchar, 2 * page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+
+  last_offset = (disk_size - page_size) & ~((guint64) page_size - 1);
+
+  for (n = 0; n < G_N_ELEMENTS (seek_distances); n++)
+    {
+      GduBenchmarkSample sample = {0};
+      guint64 distance;
+
+      distance = ((guint64) (disk_size * seek_distances[n] / 100.0)) & ~((guint64) page_size - 1);
+      distance = CLAMP (distance, (guint64) page_size, last_offset);
+
+      g_array_set_size (latencies, 0);
+      for (m = 0; m < SEEK_DISTANCE_NUM_SAMPLES; m++)
+        {
+          guint64 from;
+          guint64 to;
+          gdouble latency;
+
+          if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            goto out;
+
+          from = (guint64) g_rand_double_range (rand, 0, (gdouble) (last_offset - distance + 1));
+          from &= ~((guint64) page_size - 1);
+          to = from + distance;
+          /* seek both ways */
+          if (g_rand_boolean (rand))
+            {
+              guint64 tmp = from;
+              from = to;
+              to = tmp;
+            }
+
+          if (timed_read (fd, buffer, page_size, from, error) < 0.0)
+            goto out;
+          latency = timed_read (fd, buffer, page_size, to, error);
+          if (latency < 0.0)
+            goto out;
+          g_array_append_val (latencies, latency);
+        }
+
+      sample.offset = distance;
+      sample.value = gdu_benchmark_get_median_of_doubles (latencies);
+      func (&sample, user_data);
+    }
+
+  ret = TRUE;
+
+ out:
+  g_free (buffer_unaligned);
+  g_rand_free (rand);
+  g_array_unref (latencies);
+  return ret;
+}
+
+/* Measures the access time within each of seek_strokes[] and passes
+ * the SEEK_STROKE_PERCENTILE percentile, in seconds, to @func with
+ * the stroke in bytes as the offset
+ */
+gboolean
+gdu_benchmark_measure_seek_strokes (gint                     fd,
+                                    guint64                  disk_size,
+                                    long                     page_size,
+                                    GduBenchmarkSampleFunc   func,
+                                    gpointer                 user_data,
+                                    GCancellable            *cancellable,
+                                    GError                 **error)
+{
+  gboolean ret = FALSE;
+  guchar *buffer_unaligned;
+  guchar *buffer;
+  GArray *latencies;
+  GRand *rand;
+  guint64 last_offset;
+  guint n;
+  guint m;
+
+  latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  rand = g_rand_new ();
+
+  /* page-aligned so it can be used with O_DIRECT */
+  buffer_unaligned = g_new0 (guchar, 2 * page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+
+  last_offset = (disk_size - page_size) & ~((guint64) page_size - 1);
+
+  for (n = 0; n < G_N_ELEMENTS (seek_strokes); n++)
+    {
+      GduBenchmarkSample sample = {0};
+      guint64 stroke;
+
+      stroke = ((guint64) (disk_size * seek_strokes[n] / 100.0)) & ~((guint64) page_size - 1);
+      stroke = CLAMP (stroke, (guint64) page_size, last_offset + page_size);
+
+      g_array_set_size (latencies, 0);
+      for (m = 0; m < SEEK_STROKE_NUM_SAMPLES; m++)
+        {
+          guint64 offset;
+          gdouble latency;
+
+          if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            goto out;
+
+          offset = (guint64) g_rand_double_range (rand, 0, (gdouble) (stroke - page_size + 1));
+          offset &= ~((guint64) page_size - 1);
+          latency = timed_read (fd, buffer, page_size, offset, error);
+          if (latency < 0.0)
+            goto out;
+          g_array_append_val (latencies, latency);
+        }
+
+      sample.offset = stroke;
+      sample.value = gdu_benchmark_get_percentile_of_doubles (latencies, SEEK_STROKE_PERCENTILE);
+      func (&sample, user_data);
+    }
+
+  ret = TRUE;
+
+ out:
+  g_free (buffer_unaligned);
+  g_rand_free (rand);
+  g_array_unref (latencies);
+  return ret;
+}
@@ -0,0 +1,39 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BENCHMARK_SEEK_PROFILE_H__
+#define __GDU_BENCHMARK_SEEK_PROFILE_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+#include "gdubenchmarkutils.h"
+
+G_BEGIN_DECLS
+
+guint     gdu_benchmark_seek_profile_get_num_steps  (void);
+
+gboolean  gdu_benchmark_measure_seek_distances      (gint                     fd,
+                                                     guint64                  disk_size,
+                                                     long                     page_size,
+                                                     GduBenchmarkSampleFunc   func,
+                                                     gpointer                 user_data,
+                                                     GCancellable            *cancellable,
+                                                     GError                 **error);
+
+gboolean  gdu_benchmark_measure_seek_strokes        (gint                     fd,
+                                                     guint64                  disk_size,
+                                                     long                     page_size,
+                                                     GduBenchmarkSampleFunc   func,
+                                                     gpointer                 user_data,
+                                                     GCancellable            *cancellable,
+                                                     GError                 **error);
+
+G_END_DECLS
+
+#endif /* __GDU_BENCHMARK_SEEK_PROFILE_H__ */
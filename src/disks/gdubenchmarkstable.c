@@ -0,0 +1,114 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <math.h>
+
+#include "gdubenchmarkstable.h"
+#include "gdubenchmarkutils.h"
+
+/* In the "until stable" mode, the transfer rate and the access time
+ * are measured in passes over the device, and another pass is made for
+ * as long as the 95% confidence interval of the average of the samples
+ * is wider than the target and the time budget allows for it.
+ */
+
+/* The 97.5th percentile of Student's t-distribution for 1 to 30
+ * degrees of freedom, for the 95% confidence interval of the average
+ * of the samples. See gdu_benchmark_get_confidence_interval().
+ */
+static const gdouble t_distribution_975[] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Returns the half-width of the 95% confidence interval of the average
+ * of the values in @samples of GduBenchmarkSample, relative to the
+ * average, or 0 if there are fewer than two values
+ */
+gdouble
+gdu_benchmark_get_confidence_interval (GArray *samples)
+{
+  gdouble avg;
+  gdouble sum = 0.0;
+  gdouble t;
+  guint df;
+  guint n;
+
+  if (samples->len < 2)
+    return 0.0;
+
+  avg = gdu_benchmark_get_average (samples);
+  if (avg == 0.0)
+    return 0.0;
+  for (n = 0; n < samples->len; n++)
+    {
+      gdouble d = g_array_index (samples, GduBenchmarkSample, n).value - avg;
+      sum += d * d;
+    }
+
+  /* beyond the table, a first-order expansion around the normal distribution is close enough */
+  df = samples->len - 1;
+  if (df <= G_N_ELEMENTS (t_distribution_975))
+    t = t_distribution_975[df - 1];
+  else
+    t = 1.96 + (1.96 * 1.96 * 1.96 + 1.96) / (4.0 * df);
+
+  return t * sqrt (sum / df / samples->len) / avg;
+}
+
+/* Returns %TRUE if another pass should be made after @num_passes
+ * passes made since @begin_usec, that is, the confidence interval of
+ * @samples (and of @more_samples unless %NULL or empty) isn't within
+ * @target_percent yet and another pass, taking as long as the ones
+ * before did on average, fits in @budget_sec
+ */
+gboolean
+gdu_benchmark_take_another_pass (GArray   *samples,
+                                 GArray   *more_samples,
+                                 guint     num_passes,
+                                 gint64    begin_usec,
+                                 gdouble   target_percent,
+                                 gint      budget_sec)
+{
+  gdouble target;
+  gint64 elapsed_usec;
+
+  elapsed_usec = g_get_monotonic_time () - begin_usec;
+  if (elapsed_usec + elapsed_usec / num_passes > budget_sec * G_USEC_PER_SEC)
+    return FALSE;
+
+  target = target_percent / 100.0;
+  return gdu_benchmark_get_confidence_interval (samples) > target ||
+    (more_samples != NULL && gdu_benchmark_get_confidence_interval (more_samples) > target);
+}
+
+/* Returns where in its slice of the device a pass over it reads, as a
+ * fraction of the slice: 0, 1/2, 1/4, 3/4, 1/8 and so on. So without
+ * direct I/O, each pass reads other parts of the device than the ones
+ * before it, which are likely in the page cache, and is spread out as
+ * evenly as the first one.
+ */
+gdouble
+gdu_benchmark_get_pass_fraction (guint pass)
+{
+  gdouble ret = 0.0;
+  gdouble fraction;
+
+  for (fraction = 0.5; pass > 0; pass >>= 1, fraction /= 2.0)
+    {
+      if (pass & 1)
+        ret += fraction;
+    }
+  return ret;
+}
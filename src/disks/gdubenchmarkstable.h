@@ -0,0 +1,31 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BENCHMARK_STABLE_H__
+#define __GDU_BENCHMARK_STABLE_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+gdouble   gdu_benchmark_get_confidence_interval  (GArray   *samples);
+
+gboolean  gdu_benchmark_take_another_pass        (GArray   *samples,
+                                                  GArray   *more_samples,
+                                                  guint     num_passes,
+                                                  gint64    begin_usec,
+                                                  gdouble   target_percent,
+                                                  gint      budget_sec);
+
+gdouble   gdu_benchmark_get_pass_fraction        (guint     pass);
+
+G_END_DECLS
+
+#endif /* __GDU_BENCHMARK_STABLE_H__ */
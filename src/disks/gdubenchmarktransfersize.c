@@ -0,0 +1,165 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include "gdubenchmarktransfersize.h"
+#include "gdubenchmarkengine.h"
+#include "gduzones.h"
+
+/* The transfer size sweep reads, and writes if allowed, sequentially
+ * with one request in flight for TRANSFER_SIZE_STEP_USEC with each
+ * request size from GDU_BENCHMARK_TRANSFER_SIZE_MIN, doubling it for
+ * each of the GDU_BENCHMARK_TRANSFER_SIZE_NUM_STEPS steps. Reads go to
+ * a region of TRANSFER_SIZE_READ_REGION_SIZE of their own for each
+ * step, writes to the region they are given. The knee of the curve,
+ * the smallest request size reaching TRANSFER_SIZE_KNEE_PERCENT of the
+ * best rate, is what copying to and from the device should use.
+ *
+ * The page cache is expected to be bypassed since it would split and
+ * merge requests.
+ */
+#define TRANSFER_SIZE_STEP_USEC (G_USEC_PER_SEC)
+#define TRANSFER_SIZE_READ_REGION_SIZE (1024 * 1024 * 1024)
+#define TRANSFER_SIZE_KNEE_PERCENT 90.0
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Reads with each of the request sizes of the sweep and passes the
+ * transfer rate, in bytes per second, to @func with the request size
+ * as the offset
+ */
+gboolean
+gdu_benchmark_measure_transfer_size_reads (gint                     fd,
+                                           guint64                  disk_size,
+                                           long                     page_size,
+                                           GduBenchmarkSampleFunc   func,
+                                           gpointer                 user_data,
+                                           GCancellable            *cancellable,
+                                           GError                 **error)
+{
+  guint64 read_region_size;
+  guint n;
+
+  read_region_size = MIN (TRANSFER_SIZE_READ_REGION_SIZE, disk_size) & ~((guint64) page_size - 1);
+  for (n = 0; n < GDU_BENCHMARK_TRANSFER_SIZE_NUM_STEPS; n++)
+    {
+      GduBenchmarkWorkload workload = {0};
+      GduBenchmarkResult result = {0};
+      GduBenchmarkSample sample = {0};
+
+      workload.pattern = GDU_BENCHMARK_PATTERN_SEQUENTIAL;
+      workload.block_size = ((gsize) GDU_BENCHMARK_TRANSFER_SIZE_MIN) << n;
+      if (workload.block_size > read_region_size)
+        break;
+      /* a region of its own, so nothing the drive cached in the step before is read */
+      workload.offset = ((n * read_region_size) % (disk_size - read_region_size + 1)) & ~((guint64) page_size - 1);
+      workload.size = read_region_size;
+      workload.queue_depth = 1;
+      workload.max_usec = TRANSFER_SIZE_STEP_USEC;
+
+      if (!gdu_benchmark_engine_run (fd, &workload, &result, cancellable, error))
+        return FALSE;
+
+      sample.offset = workload.block_size;
+      sample.value = gdu_benchmark_result_get_bytes_per_sec (&result);
+      func (&sample, user_data);
+    }
+
+  return TRUE;
+}
+
+/* Writes @write_data, what is in the @size bytes at @offset, back
+ * with each of the request sizes of the sweep and passes the transfer
+ * rate, in bytes per second, to @func with the request size as the
+ * offset. On zoned devices, @scratch_zone is the empty zone the region
+ * is at the start of instead and it's reset after each step, also on
+ * failure.
+ */
+gboolean
+gdu_benchmark_measure_transfer_size_writes (gint                     fd,
+                                            guint64                  offset,
+                                            guint64                  size,
+                                            const guchar            *write_data,
+                                            const GduZone           *scratch_zone,
+                                            GduBenchmarkSampleFunc   func,
+                                            gpointer                 user_data,
+                                            GCancellable            *cancellable,
+                                            GError                 **error)
+{
+  gboolean ret = FALSE;
+  gboolean scratch_zone_dirty = FALSE;
+  guint n;
+
+  for (n = 0; n < GDU_BENCHMARK_TRANSFER_SIZE_NUM_STEPS; n++)
+    {
+      GduBenchmarkWorkload workload = {0};
+      GduBenchmarkResult result = {0};
+      GduBenchmarkSample sample = {0};
+
+      workload.pattern = GDU_BENCHMARK_PATTERN_SEQUENTIAL;
+      workload.block_size = ((gsize) GDU_BENCHMARK_TRANSFER_SIZE_MIN) << n;
+      if (workload.block_size > size)
+        break;
+      workload.offset = offset;
+      workload.size = size;
+      workload.queue_depth = 1;
+      workload.write_percentage = 100;
+      workload.write_data = write_data;
+      workload.sequential_writes = (scratch_zone != NULL);
+      workload.max_usec = TRANSFER_SIZE_STEP_USEC;
+      scratch_zone_dirty = (scratch_zone != NULL);
+
+      if (!gdu_benchmark_engine_run (fd, &workload, &result, cancellable, error))
+        goto out;
+
+      /* empty the zone again for the next request size */
+      if (scratch_zone_dirty)
+        {
+          if (!gdu_zones_reset (fd, scratch_zone, error))
+            goto out;
+          scratch_zone_dirty = FALSE;
+        }
+
+      sample.offset = workload.block_size;
+      sample.value = gdu_benchmark_result_get_bytes_per_sec (&result);
+      func (&sample, user_data);
+    }
+
+  ret = TRUE;
+
+ out:
+  /* don't leave anything behind in the zone, not even on failure */
+  if (scratch_zone_dirty)
+    gdu_zones_reset (fd, scratch_zone, NULL);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Returns the smallest request size in @samples, as passed by one of
+ * the functions above, reaching TRANSFER_SIZE_KNEE_PERCENT of the best
+ * transfer rate, or 0 if there are no samples
+ */
+guint64
+gdu_benchmark_get_transfer_size_knee (GArray *samples)
+{
+  gdouble max = 0.0;
+  guint n;
+
+  for (n = 0; n < samples->len; n++)
+    max = MAX (max, g_array_index (samples, GduBenchmarkSample, n).value);
+  for (n = 0; n < samples->len; n++)
+    {
+      GduBenchmarkSample *sample = &g_array_index (samples, GduBenchmarkSample, n);
+      if (sample->value >= max * TRANSFER_SIZE_KNEE_PERCENT / 100.0)
+        return sample->offset;
+    }
+  return 0;
+}
@@ -0,0 +1,45 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BENCHMARK_TRANSFER_SIZE_H__
+#define __GDU_BENCHMARK_TRANSFER_SIZE_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+#include "gdubenchmarkutils.h"
+
+G_BEGIN_DECLS
+
+/* the request sizes of the sweep, doubling from the smallest - that's 4 KiB to 16 MiB */
+#define GDU_BENCHMARK_TRANSFER_SIZE_MIN (4 * 1024)
+#define GDU_BENCHMARK_TRANSFER_SIZE_NUM_STEPS 13
+
+gboolean  gdu_benchmark_measure_transfer_size_reads   (gint                     fd,
+                                                       guint64                  disk_size,
+                                                       long                     page_size,
+                                                       GduBenchmarkSampleFunc   func,
+                                                       gpointer                 user_data,
+                                                       GCancellable            *cancellable,
+                                                       GError                 **error);
+
+gboolean  gdu_benchmark_measure_transfer_size_writes  (gint                     fd,
+                                                       guint64                  offset,
+                                                       guint64                  size,
+                                                       const guchar            *write_data,
+                                                       const GduZone           *scratch_zone,
+                                                       GduBenchmarkSampleFunc   func,
+                                                       gpointer                 user_data,
+                                                       GCancellable            *cancellable,
+                                                       GError                 **error);
+
+guint64   gdu_benchmark_get_transfer_size_knee        (GArray                  *samples);
+
+G_END_DECLS
+
+#endif /* __GDU_BENCHMARK_TRANSFER_SIZE_H__ */
@@ -0,0 +1,101 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+#include <math.h>
+
+#include "gdubenchmarkutils.h"
+
+/* Statistics and formatting helpers shared by the benchmark dialogs */
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gint
+compare_doubles (gconstpointer a,
+                 gconstpointer b)
+{
+  gdouble da = *((const gdouble *) a);
+  gdouble db = *((const gdouble *) b);
+  return (da > db) - (da < db);
+}
+
+/* Returns the average of the values in @samples of GduBenchmarkSample, 0 if empty */
+gdouble
+gdu_benchmark_get_average (GArray *samples)
+{
+  gdouble sum = 0.0;
+  guint n;
+
+  if (samples->len == 0)
+    return 0.0;
+  for (n = 0; n < samples->len; n++)
+    sum += g_array_index (samples, GduBenchmarkSample, n).value;
+  return sum / samples->len;
+}
+
+/* Returns the median of the values in @array of gdouble, 0 if empty. Sorts @array. */
+gdouble
+gdu_benchmark_get_median_of_doubles (GArray *array)
+{
+  if (array->len == 0)
+    return 0.0;
+  g_array_sort (array, compare_doubles);
+  if (array->len % 2 == 1)
+    return g_array_index (array, gdouble, array->len / 2);
+  return (g_array_index (array, gdouble, array->len / 2 - 1) + g_array_index (array, gdouble, array->len / 2)) / 2.0;
+}
+
+/* Returns the smallest value in @array of gdouble that @percentile
+ * percent of the values are at most, 0 if empty. Sorts @array.
+ */
+gdouble
+gdu_benchmark_get_percentile_of_doubles (GArray  *array,
+                                         gdouble  percentile)
+{
+  guint n;
+
+  if (array->len == 0)
+    return 0.0;
+  g_array_sort (array, compare_doubles);
+  n = (guint) ceil (array->len * percentile / 100.0);
+  return g_array_index (array, gdouble, CLAMP (n, 1, array->len) - 1);
+}
+
+/* Returns the median of the values in @samples of GduBenchmarkSample, 0 if empty */
+gdouble
+gdu_benchmark_get_median (GArray *samples)
+{
+  GArray *values;
+  gdouble ret;
+  guint n;
+
+  values = g_array_sized_new (FALSE, FALSE, sizeof (gdouble), samples->len);
+  for (n = 0; n < samples->len; n++)
+    g_array_append_val (values, g_array_index (samples, GduBenchmarkSample, n).value);
+  ret = gdu_benchmark_get_median_of_doubles (values);
+  g_array_unref (values);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+gchar *
+gdu_benchmark_format_transfer_rate (gdouble bytes_per_sec)
+{
+  gchar *ret = NULL;
+  gchar *s;
+
+  s = g_format_size ((guint64) bytes_per_sec);
+  /* Translators: %s is the formatted size, e.g. "42 MB" and the trailing "/s" means per second */
+  ret = g_strdup_printf (C_("benchmark-transfer-rate", "%s/s"), s);
+  g_free (s);
+  return ret;
+}
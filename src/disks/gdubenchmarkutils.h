@@ -0,0 +1,39 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BENCHMARK_UTILS_H__
+#define __GDU_BENCHMARK_UTILS_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* A sample taken while benchmarking - what @offset and @value are depends on the test */
+struct GduBenchmarkSample
+{
+  guint64  offset;
+  gdouble  value;
+};
+
+/* Called by the measurement passes for each sample they take, on the thread they run on */
+typedef void (*GduBenchmarkSampleFunc) (const GduBenchmarkSample *sample,
+                                        gpointer                  user_data);
+
+gdouble  gdu_benchmark_get_average               (GArray  *samples);
+gdouble  gdu_benchmark_get_median                (GArray  *samples);
+gdouble  gdu_benchmark_get_median_of_doubles     (GArray  *array);
+gdouble  gdu_benchmark_get_percentile_of_doubles (GArray  *array,
+                                                  gdouble  percentile);
+
+gchar   *gdu_benchmark_format_transfer_rate      (gdouble  bytes_per_sec);
+
+G_END_DECLS
+
+#endif /* __GDU_BENCHMARK_UTILS_H__ */
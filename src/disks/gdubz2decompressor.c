@@ -0,0 +1,594 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include "gdubz2decompressor.h"
+#include "gduparalleldecoder.h"
+
+#include <string.h>
+
+#include <bzlib.h>
+
+/* Handles bzip2 files consisting of several streams, e.g. files
+ * created by concatenating bzip2 files or by pbzip2.
+ *
+ * The blocks of a stream are independent of each other so they are
+ * decoded in parallel, see gduparalleldecoder.c. A block starts with
+ * a 48-bit magic number, which isn't necessarily on a byte boundary,
+ * and the stream ends with another one followed by the combined CRC
+ * of the blocks. Each block is turned into a stream of its own and
+ * decoded by libbz2. The block magic may also occur inside a block,
+ * although very rarely - if a block can't be decoded, it is tried
+ * again together with the next one.
+ *
+ * Since each block is checked by its own CRC, the combined CRC of a
+ * stream isn't checked.
+ */
+
+#define BLOCK_MAGIC G_GUINT64_CONSTANT (0x314159265359)
+#define EOS_MAGIC   G_GUINT64_CONSTANT (0x177245385090)
+#define MAGIC_MASK  G_GUINT64_CONSTANT (0xffffffffffff)
+#define MAGIC_BITS  48
+#define CRC_BITS    32
+
+/* A compressed block is never bigger than this, even at level 9 */
+#define MAX_BLOCK_SIZE (2 * 1024 * 1024)
+
+/* Don't buffer more output than this for each block */
+#define OUTPUT_LIMIT (8 * 1024 * 1024)
+#define OUTPUT_STEP (256 * 1024)
+
+typedef enum
+{
+  SCAN_STATE_HEADER,   /* expecting a stream header */
+  SCAN_STATE_BLOCKS,   /* looking for the magic of a block or of the end of the stream */
+  SCAN_STATE_TRAILER,  /* skipping the combined CRC and the padding */
+  SCAN_STATE_GARBAGE   /* ignoring what follows the last stream */
+} ScanState;
+
+static void gdu_bz2_decompressor_iface_init          (GConverterIface *iface);
+
+struct GduBz2Decompressor
+{
+  GObject parent_instance;
+
+  GduParallelDecoder *decoder;
+
+  /* input not yet handed to the decoder, starting at pending_offset */
+  GByteArray *pending;
+  guint64 pending_offset;
+
+  ScanState state;
+  guint64 scan_offset;      /* the next byte to look at */
+  guint64 bits;             /* the last bits looked at, the most recent ones in the lowest bits */
+  guint num_bits;           /* the number of valid bits in bits */
+  gchar level;              /* from the header of the current stream */
+  guint num_streams;        /* the number of streams ended so far */
+  guint64 stream_data_bit;  /* where the first block of the current stream starts */
+  gboolean in_block;
+  guint64 block_start_bit;
+  guint64 trailer_end;      /* where the next stream starts */
+};
+
+G_DEFINE_TYPE_WITH_CODE (GduBz2Decompressor, gdu_bz2_decompressor, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER,
+                                                gdu_bz2_decompressor_iface_init))
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  /* the bytes the block is in - it starts at bit_offset in the first byte */
+  GByteArray *data;
+  guint bit_offset;
+  guint64 num_bits;
+  gchar level;
+  guint stream_index;
+
+  /* the block as a stream of its own and the state of decoding it */
+  GByteArray *stream;
+  bz_stream bzstream;
+  gboolean started;
+} Bz2Unit;
+
+static void
+bz2_unit_reset (Bz2Unit *unit)
+{
+  if (unit->started)
+    BZ2_bzDecompressEnd (&unit->bzstream);
+  unit->started = FALSE;
+  if (unit->stream != NULL)
+    g_byte_array_unref (unit->stream);
+  unit->stream = NULL;
+}
+
+static void
+bz2_unit_free (gpointer unit_data)
+{
+  Bz2Unit *unit = unit_data;
+
+  bz2_unit_reset (unit);
+  g_byte_array_unref (unit->data);
+  g_free (unit);
+}
+
+static void
+put_bits (guchar  *data,
+          guint64 *pos,
+          guint64  value,
+          guint    num_bits)
+{
+  while (num_bits > 0)
+    {
+      num_bits--;
+      if ((value >> num_bits) & 1)
+        data[*pos / 8] |= 0x80 >> (*pos % 8);
+      (*pos)++;
+    }
+}
+
+/* Makes a stream of its own out of the block: the stream header, the
+ * block and the end of stream with the combined CRC - which, for a
+ * single block, is the CRC of the block right after its magic.
+ */
+static void
+bz2_unit_build_stream (Bz2Unit *unit)
+{
+  GByteArray *stream;
+  gsize num_bytes;
+  guint32 crc = 0;
+  guint64 pos;
+  gsize n;
+
+  num_bytes = (unit->num_bits + 7) / 8;
+  stream = g_byte_array_sized_new (4 + num_bytes + 11);
+  g_byte_array_set_size (stream, 4 + num_bytes + 11);
+  memset (stream->data, 0, stream->len);
+
+  stream->data[0] = 'B';
+  stream->data[1] = 'Z';
+  stream->data[2] = 'h';
+  stream->data[3] = unit->level;
+
+  /* the block starts on a byte boundary in the new stream */
+  for (n = 0; n < num_bytes; n++)
+    {
+      guint value = unit->data->data[n] << 8;
+      if (n + 1 < unit->data->len)
+        value |= unit->data->data[n + 1];
+      stream->data[4 + n] = (value << unit->bit_offset) >> 8;
+    }
+  if (unit->num_bits % 8 != 0)
+    stream->data[4 + num_bytes - 1] &= 0xff << (8 - unit->num_bits % 8);
+
+  if (unit->num_bits >= MAGIC_BITS + CRC_BITS)
+    crc = (stream->data[10] << 24) | (stream->data[11] << 16) | (stream->data[12] << 8) | stream->data[13];
+
+  pos = 32 + unit->num_bits;
+  put_bits (stream->data, &pos, EOS_MAGIC, MAGIC_BITS);
+  put_bits (stream->data, &pos, crc, CRC_BITS);
+  g_byte_array_set_size (stream, (pos + 7) / 8);
+
+  unit->stream = stream;
+}
+
+/* runs on a thread of the pool */
+static GduParallelDecoderResult
+bz2_unit_decode (gpointer        unit_data,
+                 GByteArray     *output,
+                 gsize           output_limit,
+                 volatile gint  *cancelled,
+                 GError        **error)
+{
+  Bz2Unit *unit = unit_data;
+  int res;
+
+  if (!unit->started)
+    {
+      bz2_unit_build_stream (unit);
+      memset (&unit->bzstream, 0, sizeof unit->bzstream);
+      res = BZ2_bzDecompressInit (&unit->bzstream,
+                                  0,  /* verbosity */
+                                  0); /* small */
+      if (res != BZ_OK)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               _("Not enough memory"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+      unit->bzstream.next_in = (char *) unit->stream->data;
+      unit->bzstream.avail_in = unit->stream->len;
+      unit->started = TRUE;
+    }
+
+  while (TRUE)
+    {
+      gsize offset = output->len;
+      guint avail_in;
+
+      if (g_atomic_int_get (cancelled))
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                               _("Operation was cancelled"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+      if (output->len >= output_limit)
+        return GDU_PARALLEL_DECODER_RESULT_PAUSED;
+
+      g_byte_array_set_size (output, offset + OUTPUT_STEP);
+      unit->bzstream.next_out = (char *) output->data + offset;
+      unit->bzstream.avail_out = OUTPUT_STEP;
+      avail_in = unit->bzstream.avail_in;
+
+      res = BZ2_bzDecompress (&unit->bzstream);
+
+      g_byte_array_set_size (output, offset + OUTPUT_STEP - unit->bzstream.avail_out);
+
+      if (res == BZ_STREAM_END)
+        return GDU_PARALLEL_DECODER_RESULT_DONE;
+
+      if (res == BZ_DATA_ERROR || res == BZ_DATA_ERROR_MAGIC)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                               _("Invalid compressed data"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+
+      if (res == BZ_MEM_ERROR)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               _("Not enough memory"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+
+      if (res != BZ_OK)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                       _("Internal error"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+
+      /* no progress at all means the block was cut short */
+      if (output->len == offset && unit->bzstream.avail_in == avail_in)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                               _("Invalid compressed data"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+    }
+}
+
+/* If the first block couldn't be decoded, it may have been split at
+ * something looking like a block magic - try again with the next
+ * block appended. Nothing of it must have been used, though.
+ */
+static gboolean
+bz2_unit_join (gpointer                  head_data,
+               gpointer                  next_data,
+               GduParallelDecoderResult  result,
+               gboolean                  head_emitted)
+{
+  Bz2Unit *head = head_data;
+  Bz2Unit *next = next_data;
+  GByteArray *data;
+  guint64 head_end_bit;
+
+  if (result != GDU_PARALLEL_DECODER_RESULT_ERROR || head_emitted ||
+      head->stream_index != next->stream_index ||
+      head->num_bits + next->num_bits > MAX_BLOCK_SIZE * 8)
+    return FALSE;
+
+  /* the last byte of the first block is also the first byte of the next one */
+  head_end_bit = head->bit_offset + head->num_bits;
+  data = g_byte_array_sized_new (head_end_bit / 8 + next->data->len);
+  g_byte_array_append (data, head->data->data, head_end_bit / 8);
+  g_byte_array_append (data, next->data->data, next->data->len);
+
+  bz2_unit_reset (next);
+  g_byte_array_unref (next->data);
+  next->data = data;
+  next->bit_offset = head->bit_offset;
+  next->num_bits += head->num_bits;
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Hands the block from block_start_bit to @end_bit to the decoder */
+static void
+add_block (GduBz2Decompressor *decompressor,
+           guint64             end_bit)
+{
+  Bz2Unit *unit;
+  guint64 first;
+  guint64 last;
+
+  first = decompressor->block_start_bit / 8;
+  last = (end_bit + 7) / 8;
+
+  unit = g_new0 (Bz2Unit, 1);
+  unit->data = g_byte_array_sized_new (last - first);
+  g_byte_array_append (unit->data,
+                       decompressor->pending->data + (first - decompressor->pending_offset),
+                       last - first);
+  unit->bit_offset = decompressor->block_start_bit % 8;
+  unit->num_bits = end_bit - decompressor->block_start_bit;
+  unit->level = decompressor->level;
+  unit->stream_index = decompressor->num_streams;
+  gdu_parallel_decoder_add_unit (decompressor->decoder, unit, TRUE);
+}
+
+/* Looks at the next byte of a stream, checking all bit positions for
+ * the magic of a block or of the end of the stream
+ */
+static gboolean
+scan_byte (GduBz2Decompressor  *decompressor,
+           guchar               byte,
+           GError             **error)
+{
+  guint64 end_bit;
+  gint k;
+
+  decompressor->bits = (decompressor->bits << 8) | byte;
+  decompressor->num_bits = MIN (decompressor->num_bits + 8, 64);
+  decompressor->scan_offset++;
+  end_bit = decompressor->scan_offset * 8;
+
+  /* earliest first */
+  for (k = 7; k >= 0; k--)
+    {
+      guint64 window;
+      guint64 start_bit;
+
+      if (decompressor->num_bits < MAGIC_BITS + k)
+        continue;
+      window = (decompressor->bits >> k) & MAGIC_MASK;
+      start_bit = end_bit - k - MAGIC_BITS;
+
+      if (window == BLOCK_MAGIC)
+        {
+          if (decompressor->in_block)
+            add_block (decompressor, start_bit);
+          decompressor->in_block = TRUE;
+          decompressor->block_start_bit = start_bit;
+        }
+      else if (window == EOS_MAGIC)
+        {
+          if (decompressor->in_block)
+            add_block (decompressor, start_bit);
+          decompressor->in_block = FALSE;
+          decompressor->num_streams++;
+          /* the next stream starts on the byte boundary after the combined CRC */
+          decompressor->trailer_end = (start_bit + MAGIC_BITS + CRC_BITS + 7) / 8;
+          decompressor->state = SCAN_STATE_TRAILER;
+          return TRUE;
+        }
+    }
+
+  /* a stream must start with a block or end right away and blocks are limited in size */
+  if ((!decompressor->in_block && end_bit >= decompressor->stream_data_bit + MAGIC_BITS) ||
+      (decompressor->in_block && end_bit - decompressor->block_start_bit > MAX_BLOCK_SIZE * 8))
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           _("Invalid compressed data"));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* runs on the thread reading from the stream */
+static gboolean
+bz2_feed (gpointer       user_data,
+          const guchar  *data,
+          gsize          size,
+          gboolean       at_end,
+          GError       **error)
+{
+  GduBz2Decompressor *decompressor = GDU_BZ2_DECOMPRESSOR (user_data);
+  guint64 end;
+  guint64 keep;
+
+  if (decompressor->state == SCAN_STATE_GARBAGE)
+    return TRUE;
+
+  g_byte_array_append (decompressor->pending, data, size);
+  end = decompressor->pending_offset + decompressor->pending->len;
+
+  while (decompressor->scan_offset < end && decompressor->state != SCAN_STATE_GARBAGE)
+    {
+      const guchar *p = decompressor->pending->data + (decompressor->scan_offset - decompressor->pending_offset);
+
+      switch (decompressor->state)
+        {
+        case SCAN_STATE_HEADER:
+          if (end - decompressor->scan_offset < 4)
+            goto out_scan;
+          if (memcmp (p, "BZh", 3) == 0 && p[3] >= '1' && p[3] <= '9')
+            {
+              decompressor->level = p[3];
+              decompressor->scan_offset += 4;
+              decompressor->stream_data_bit = decompressor->scan_offset * 8;
+              decompressor->bits = 0;
+              decompressor->num_bits = 0;
+              decompressor->in_block = FALSE;
+              decompressor->state = SCAN_STATE_BLOCKS;
+            }
+          else if (decompressor->num_streams > 0)
+            {
+              /* Like bzip2(1), ignore trailing garbage after a stream */
+              decompressor->state = SCAN_STATE_GARBAGE;
+            }
+          else
+            {
+              g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                                   _("Invalid compressed data"));
+              return FALSE;
+            }
+          break;
+
+        case SCAN_STATE_BLOCKS:
+          if (!scan_byte (decompressor, *p, error))
+            return FALSE;
+          break;
+
+        case SCAN_STATE_TRAILER:
+          decompressor->scan_offset = MIN (decompressor->trailer_end, end);
+          if (decompressor->scan_offset == decompressor->trailer_end)
+            decompressor->state = SCAN_STATE_HEADER;
+          break;
+
+        case SCAN_STATE_GARBAGE:
+          break;
+        }
+    }
+
+ out_scan:
+  if (decompressor->state == SCAN_STATE_GARBAGE)
+    {
+      g_byte_array_set_size (decompressor->pending, 0);
+      decompressor->pending_offset = end;
+      return TRUE;
+    }
+
+  /* only keep what the current block, or the first one of the stream, is in */
+  if (decompressor->in_block)
+    keep = decompressor->block_start_bit / 8;
+  else if (decompressor->state == SCAN_STATE_BLOCKS)
+    keep = decompressor->stream_data_bit / 8;
+  else
+    keep = decompressor->scan_offset;
+  keep = MIN (keep, end);
+  g_byte_array_remove_range (decompressor->pending, 0, keep - decompressor->pending_offset);
+  decompressor->pending_offset = keep;
+
+  if (at_end)
+    {
+      /* anything but a complete stream, at the end or followed by garbage, is cut short */
+      if (decompressor->num_streams == 0 || decompressor->state != SCAN_STATE_HEADER)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                               _("Need more input"));
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static const GduParallelDecoderFuncs bz2_funcs =
+{
+  bz2_unit_decode,
+  bz2_unit_join,
+  bz2_unit_free,
+  NULL, /* promote */
+  bz2_feed
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+init_decoder (GduBz2Decompressor *decompressor)
+{
+  decompressor->decoder = gdu_parallel_decoder_new (&bz2_funcs, decompressor, OUTPUT_LIMIT);
+  decompressor->pending = g_byte_array_new ();
+  decompressor->pending_offset = 0;
+  decompressor->state = SCAN_STATE_HEADER;
+  decompressor->scan_offset = 0;
+  decompressor->bits = 0;
+  decompressor->num_bits = 0;
+  decompressor->num_streams = 0;
+  decompressor->in_block = FALSE;
+}
+
+static void
+free_decoder (GduBz2Decompressor *decompressor)
+{
+  gdu_parallel_decoder_free (decompressor->decoder);
+  decompressor->decoder = NULL;
+  g_byte_array_unref (decompressor->pending);
+  decompressor->pending = NULL;
+}
+
+static void
+gdu_bz2_decompressor_finalize (GObject *object)
+{
+  GduBz2Decompressor *decompressor = GDU_BZ2_DECOMPRESSOR (object);
+
+  free_decoder (decompressor);
+
+  G_OBJECT_CLASS (gdu_bz2_decompressor_parent_class)->finalize (object);
+}
+
+static void
+gdu_bz2_decompressor_init (GduBz2Decompressor *decompressor)
+{
+  init_decoder (decompressor);
+}
+
+static void
+gdu_bz2_decompressor_class_init (GduBz2DecompressorClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gdu_bz2_decompressor_finalize;
+}
+
+GduBz2Decompressor *
+gdu_bz2_decompressor_new (void)
+{
+  GduBz2Decompressor *decompressor;
+
+  decompressor = g_object_new (GDU_TYPE_BZ2_DECOMPRESSOR,
+                               NULL);
+
+  return decompressor;
+}
+
+static void
+gdu_bz2_decompressor_reset (GConverter *converter)
+{
+  GduBz2Decompressor *decompressor = GDU_BZ2_DECOMPRESSOR (converter);
+  free_decoder (decompressor);
+  init_decoder (decompressor);
+}
+
+static GConverterResult
+gdu_bz2_decompressor_convert (GConverter *converter,
+                              const void *inbuf,
+                              gsize       inbuf_size,
+                              void       *outbuf,
+                              gsize       outbuf_size,
+                              GConverterFlags flags,
+                              gsize      *bytes_read,
+                              gsize      *bytes_written,
+                              GError    **error)
+{
+  GduBz2Decompressor *decompressor = GDU_BZ2_DECOMPRESSOR (converter);
+
+  return gdu_parallel_decoder_convert (decompressor->decoder,
+                                       inbuf,
+                                       inbuf_size,
+                                       outbuf,
+                                       outbuf_size,
+                                       flags,
+                                       bytes_read,
+                                       bytes_written,
+                                       error);
+}
+
+static void
+gdu_bz2_decompressor_iface_init (GConverterIface *iface)
+{
+  iface->convert = gdu_bz2_decompressor_convert;
+  iface->reset = gdu_bz2_decompressor_reset;
+}
@@ -0,0 +1,36 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BZ2_DECOMPRESSOR_H__
+#define __GDU_BZ2_DECOMPRESSOR_H__
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+#define GDU_TYPE_BZ2_DECOMPRESSOR         (gdu_bz2_decompressor_get_type ())
+#define GDU_BZ2_DECOMPRESSOR(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), GDU_TYPE_BZ2_DECOMPRESSOR, GduBz2Decompressor))
+#define GDU_BZ2_DECOMPRESSOR_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST((k), GDU_TYPE_BZ2_DECOMPRESSOR, GduBz2DecompressorClass))
+#define GDU_IS_BZ2_DECOMPRESSOR(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), GDU_TYPE_BZ2_DECOMPRESSOR))
+#define GDU_IS_BZ2_DECOMPRESSOR_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), GDU_TYPE_BZ2_DECOMPRESSOR))
+#define GDU_BZ2_DECOMPRESSOR_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), GDU_TYPE_BZ2_DECOMPRESSOR, GduBz2DecompressorClass))
+
+typedef struct GduBz2DecompressorClass   GduBz2DecompressorClass;
+
+struct GduBz2DecompressorClass
+{
+  GObjectClass parent_class;
+};
+
+GType               gdu_bz2_decompressor_get_type  (void) G_GNUC_CONST;
+GduBz2Decompressor *gdu_bz2_decompressor_new       (void);
+
+G_END_DECLS
+
+#endif /* __GDU_BZ2_DECOMPRESSOR_H__ */
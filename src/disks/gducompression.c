@@ -0,0 +1,356 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gducompression.h"
+#include "gduxzdecompressor.h"
+#ifdef HAVE_ZLIB
+#include "gdugzdecompressor.h"
+#endif
+#ifdef HAVE_BZIP2
+#include "gdubz2decompressor.h"
+#endif
+#ifdef HAVE_ZSTD
+#include "gduzstddecompressor.h"
+#endif
+
+/* Compressed disk images are recognized by their magic bytes, not by
+ * the file name or content type.
+ */
+
+#define ZSTD_MAGIC           0xfd2fb528
+#define ZSTD_SKIPPABLE_MAGIC 0x184d2a50 /* lower four bits are user-defined */
+
+GduCompressionType
+gdu_compression_detect (GFile *file)
+{
+  GduCompressionType ret = GDU_COMPRESSION_TYPE_NONE;
+  GInputStream *stream = NULL;
+  guchar buf[6];
+  gsize num_read = 0;
+
+  stream = (GInputStream *) g_file_read (file, NULL, NULL);
+  if (stream == NULL)
+    goto out;
+  if (!g_input_stream_read_all (stream, buf, sizeof buf, &num_read, NULL, NULL))
+    goto out;
+
+  if (num_read >= 6 && memcmp (buf, "\xfd" "7zXZ\x00", 6) == 0)
+    ret = GDU_COMPRESSION_TYPE_XZ;
+  else if (num_read >= 2 && buf[0] == 0x1f && buf[1] == 0x8b)
+    ret = GDU_COMPRESSION_TYPE_GZIP;
+  else if (num_read >= 4 && memcmp (buf, "BZh", 3) == 0 && buf[3] >= '1' && buf[3] <= '9')
+    ret = GDU_COMPRESSION_TYPE_BZIP2;
+  else if (num_read >= 4 && (buf[0] | buf[1] << 8 | buf[2] << 16 | ((guint32) buf[3]) << 24) == ZSTD_MAGIC)
+    ret = GDU_COMPRESSION_TYPE_ZSTD;
+
+ out:
+  g_clear_object (&stream);
+  return ret;
+}
+
+gboolean
+gdu_compression_is_supported (GduCompressionType type)
+{
+#ifndef HAVE_ZLIB
+  if (type == GDU_COMPRESSION_TYPE_GZIP)
+    return FALSE;
+#endif
+#ifndef HAVE_BZIP2
+  if (type == GDU_COMPRESSION_TYPE_BZIP2)
+    return FALSE;
+#endif
+#ifndef HAVE_ZSTD
+  if (type == GDU_COMPRESSION_TYPE_ZSTD)
+    return FALSE;
+#endif
+  return TRUE;
+}
+
+/* returns a name suitable for use in messages, e.g. "XZ" */
+const gchar *
+gdu_compression_get_name (GduCompressionType type)
+{
+  switch (type)
+    {
+    case GDU_COMPRESSION_TYPE_XZ:
+      return "XZ";
+    case GDU_COMPRESSION_TYPE_GZIP:
+      return "gzip";
+    case GDU_COMPRESSION_TYPE_BZIP2:
+      return "bzip2";
+    case GDU_COMPRESSION_TYPE_ZSTD:
+      return "Zstandard";
+    default:
+      return NULL;
+    }
+}
+
+/* returns NULL if @type is GDU_COMPRESSION_TYPE_NONE or not supported */
+GConverter *
+gdu_compression_new_decompressor (GduCompressionType type)
+{
+  GConverter *ret = NULL;
+
+  switch (type)
+    {
+    case GDU_COMPRESSION_TYPE_XZ:
+      ret = G_CONVERTER (gdu_xz_decompressor_new ());
+      break;
+#ifdef HAVE_ZLIB
+    case GDU_COMPRESSION_TYPE_GZIP:
+      ret = G_CONVERTER (gdu_gz_decompressor_new ());
+      break;
+#endif
+#ifdef HAVE_BZIP2
+    case GDU_COMPRESSION_TYPE_BZIP2:
+      ret = G_CONVERTER (gdu_bz2_decompressor_new ());
+      break;
+#endif
+#ifdef HAVE_ZSTD
+    case GDU_COMPRESSION_TYPE_ZSTD:
+      ret = G_CONVERTER (gdu_zstd_decompressor_new ());
+      break;
+#endif
+    default:
+      break;
+    }
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The zstd size is found by reading the headers of all frames and
+ * blocks. They are read through a buffer of this size so there is no
+ * system call for each one.
+ */
+#define ZSTD_SCAN_BUFFER_SIZE (1024 * 1024)
+
+/* deflate doesn't compress better than this */
+#define DEFLATE_MAX_RATIO 1032
+
+static gboolean
+read_exactly (GInputStream *stream,
+              guchar       *buf,
+              gsize         size)
+{
+  gsize num_read;
+
+  if (!g_input_stream_read_all (stream, buf, size, &num_read, NULL, NULL))
+    return FALSE;
+  return num_read == size;
+}
+
+static gboolean
+skip_exactly (GInputStream *stream,
+              gsize         size)
+{
+  while (size > 0)
+    {
+      gssize num_skipped;
+
+      num_skipped = g_input_stream_skip (stream, size, NULL, NULL);
+      if (num_skipped <= 0)
+        return FALSE;
+      size -= num_skipped;
+    }
+  return TRUE;
+}
+
+/* Every zstd frame normally records the size of its content in the
+ * frame header, as the Frame_Content_Size field. Walk all frames -
+ * and, to find the end of each frame, all block headers - and add it
+ * up. Only the headers are read. If a frame doesn't record its size,
+ * it isn't known.
+ */
+static guint64
+get_zstd_uncompressed_size (GFile *file)
+{
+  guint64 ret = 0;
+  GFileInputStream *file_stream = NULL;
+  GInputStream *stream = NULL;
+
+  file_stream = g_file_read (file, NULL, NULL);
+  if (file_stream == NULL)
+    goto fail;
+  stream = g_buffered_input_stream_new_sized (G_INPUT_STREAM (file_stream), ZSTD_SCAN_BUFFER_SIZE);
+
+  while (TRUE)
+    {
+      static const guint dict_id_sizes[4] = {0, 1, 2, 4};
+      guchar buf[8];
+      gsize num_read;
+      guint32 magic;
+      guint fhd;
+      gboolean single_segment;
+      gboolean has_checksum;
+      guint fcs_size;
+      guint64 fcs;
+      gboolean last_block;
+      guint n;
+
+      if (!g_input_stream_read_all (stream, buf, 4, &num_read, NULL, NULL))
+        goto fail;
+      if (num_read == 0)
+        break;
+      if (num_read < 4)
+        goto fail;
+      magic = buf[0] | buf[1] << 8 | buf[2] << 16 | ((guint32) buf[3]) << 24;
+
+      if ((magic & 0xfffffff0) == ZSTD_SKIPPABLE_MAGIC)
+        {
+          if (!read_exactly (stream, buf, 4))
+            goto fail;
+          if (!skip_exactly (stream, buf[0] | buf[1] << 8 | buf[2] << 16 | ((guint32) buf[3]) << 24))
+            goto fail;
+          continue;
+        }
+      if (magic != ZSTD_MAGIC)
+        goto fail;
+
+      if (!read_exactly (stream, buf, 1))
+        goto fail;
+      fhd = buf[0];
+      single_segment = (fhd >> 5) & 1;
+      has_checksum = (fhd >> 2) & 1;
+      if (fhd & (1<<3)) /* reserved bit */
+        goto fail;
+      if ((fhd >> 6) == 0)
+        fcs_size = single_segment ? 1 : 0;
+      else
+        fcs_size = 1 << (fhd >> 6);
+      /* the frame doesn't say how big it is */
+      if (fcs_size == 0)
+        goto fail;
+
+      if (!skip_exactly (stream, (single_segment ? 0 : 1) + dict_id_sizes[fhd & 3]))
+        goto fail;
+      if (!read_exactly (stream, buf, fcs_size))
+        goto fail;
+      fcs = 0;
+      for (n = 0; n < fcs_size; n++)
+        fcs |= ((guint64) buf[n]) << (8 * n);
+      if (fcs_size == 2)
+        fcs += 256;
+      ret += fcs;
+
+      /* skip all blocks of the frame */
+      do
+        {
+          guint32 block_header;
+          guint block_type;
+          guint32 block_size;
+
+          if (!read_exactly (stream, buf, 3))
+            goto fail;
+          block_header = buf[0] | buf[1] << 8 | buf[2] << 16;
+          last_block = block_header & 1;
+          block_type = (block_header >> 1) & 3;
+          block_size = block_header >> 3;
+          if (block_type == 3) /* reserved */
+            goto fail;
+          /* RLE blocks only store a single byte */
+          if (!skip_exactly (stream, block_type == 1 ? 1 : block_size))
+            goto fail;
+        }
+      while (!last_block);
+
+      if (has_checksum && !skip_exactly (stream, 4))
+        goto fail;
+    }
+
+ out:
+  g_clear_object (&stream);
+  g_clear_object (&file_stream);
+  return ret;
+
+ fail:
+  ret = 0;
+  goto out;
+}
+
+/* The gzip trailer has the size of the last member modulo 2^32. That
+ * is the size of the file if there is only one member and the file is
+ * too small for the size to be 2^32 bytes or more, given that deflate
+ * compresses no better than DEFLATE_MAX_RATIO:1. Such files are small
+ * enough to be read in full to make sure there is no other member.
+ */
+static guint64
+get_gzip_uncompressed_size (GFile *file)
+{
+  guint64 ret = 0;
+  GFileInfo *info;
+  gchar *contents = NULL;
+  gsize length;
+  const guchar *p;
+
+  info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  if (info == NULL)
+    goto out;
+  if (g_file_info_get_size (info) > G_MAXUINT32 / DEFLATE_MAX_RATIO)
+    goto out;
+  if (!g_file_load_contents (file, NULL, &contents, &length, NULL, NULL))
+    goto out;
+  /* the fixed part of the header and the trailer, and the file may have changed */
+  if (length < 10 + 8 || length > G_MAXUINT32 / DEFLATE_MAX_RATIO)
+    goto out;
+
+  /* anything that looks like the start of another member, even if in the compressed data */
+  for (p = (const guchar *) contents + 10; p + 3 <= (const guchar *) contents + length - 8; p++)
+    {
+      p = memchr (p, 0x1f, (const guchar *) contents + length - 8 - p);
+      if (p == NULL)
+        break;
+      if (p[1] == 0x8b && p[2] == 8)
+        goto out;
+    }
+
+  p = (const guchar *) contents + length - 4;
+  ret = p[0] | p[1] << 8 | p[2] << 16 | ((guint32) p[3]) << 24;
+
+ out:
+  g_clear_object (&info);
+  g_free (contents);
+  return ret;
+}
+
+/* Returns 0 if the size isn't known without decompressing the whole file.
+ *
+ * For gzip, the trailer only has the size modulo 2^32 of the last
+ * member, so the size is only known for small files. bzip2 doesn't
+ * record the size at all - neither the stream nor the blocks have it -
+ * so it is never known for that.
+ */
+guint64
+gdu_compression_get_uncompressed_size (GFile              *file,
+                                       GduCompressionType  type)
+{
+  guint64 ret = 0;
+
+  switch (type)
+    {
+    case GDU_COMPRESSION_TYPE_XZ:
+      ret = gdu_xz_decompressor_get_uncompressed_size (file);
+      break;
+    case GDU_COMPRESSION_TYPE_ZSTD:
+      ret = get_zstd_uncompressed_size (file);
+      break;
+    case GDU_COMPRESSION_TYPE_GZIP:
+      ret = get_gzip_uncompressed_size (file);
+      break;
+    default:
+      break;
+    }
+
+  return ret;
+}
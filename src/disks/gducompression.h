@@ -0,0 +1,27 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_COMPRESSION_H__
+#define __GDU_COMPRESSION_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+GduCompressionType  gdu_compression_detect                 (GFile              *file);
+gboolean            gdu_compression_is_supported           (GduCompressionType  type);
+const gchar        *gdu_compression_get_name               (GduCompressionType  type);
+GConverter         *gdu_compression_new_decompressor       (GduCompressionType  type);
+guint64             gdu_compression_get_uncompressed_size  (GFile              *file,
+                                                            GduCompressionType  type);
+
+G_END_DECLS
+
+#endif /* __GDU_COMPRESSION_H__ */
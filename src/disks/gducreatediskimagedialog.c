@@ -30,6 +30,7 @@
 #include "gducreatefilesystemwidget.h"
 #include "gduestimator.h"
 #include "gdulocaljob.h"
+#include "gdubenchmarkdialog.h"
 
 #include "gdudvdsupport.h"
 
@@ -70,6 +71,7 @@ typedef struct
   GCancellable *cancellable;
   GFile *output_file;
   GFileOutputStream *output_file_stream;
+  gsize buffer_size;
 
   /* must hold copy_lock when reading/writing these */
   GMutex copy_lock;
@@ -643,11 +645,10 @@ copy_thread_func (gpointer user_data)
   GError *error2 = NULL;
   gint64 last_update_usec = -1;
   gint fd = -1;
-  gint buffer_size;
+  gsize buffer_size;
   guint64 num_bytes_completed = 0;
 
-  /* default to 1 MiB blocks */
-  buffer_size = (1 * 1024 * 1024);
+  buffer_size = data->buffer_size;
 
   /* Most OSes put ACLs for logged-in users on /dev/sr* nodes (this is
    * so CD burning tools etc. work) so see if we can open the device
@@ -994,6 +995,14 @@ start_copying (DialogData *data)
   /* now that we know the user picked a folder, update file chooser settings */
   gdu_utils_file_chooser_for_disk_images_update_settings (GTK_FILE_CHOOSER (data->folder_fcbutton));
 
+  /* default to 1 MiB blocks, or bigger ones if the benchmark found the device to need them
+   * to read at full speed (see gdu_benchmark_dialog_get_transfer_size())
+   */
+  data->buffer_size = gdu_benchmark_dialog_get_transfer_size (gdu_window_get_client (data->window),
+                                                              data->block,
+                                                              FALSE); /* for_writing */
+  data->buffer_size = CLAMP (data->buffer_size, 1 * 1024 * 1024, 16 * 1024 * 1024);
+
   data->inhibit_cookie = gtk_application_inhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
                                                   GTK_WINDOW (data->dialog),
                                                   GTK_APPLICATION_INHIBIT_SUSPEND |
@@ -0,0 +1,90 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <sys/sysmacros.h>
+
+#include "gdudiskstats.h"
+
+/* The counters are read from /sys/dev/block/MAJ:MIN/stat which has
+ * the same fields as /proc/diskstats minus the device number and
+ * name. They only ever go up (until they wrap around) so to get what
+ * happened during some time, read them before and after and subtract.
+ */
+
+/**
+ * gdu_disk_stats_read:
+ * @device_number: The device number of a block device.
+ * @stats: Return location for the counters.
+ * @error: Return location for error or %NULL.
+ *
+ * Reads the I/O counters of the block device @device_number.
+ *
+ * Returns: %TRUE if @stats was set, %FALSE if @error is set.
+ */
+gboolean
+gdu_disk_stats_read (dev_t          device_number,
+                     GduDiskStats  *stats,
+                     GError       **error)
+{
+  gboolean ret = FALSE;
+  gchar *filename;
+  gchar *contents = NULL;
+  guint64 read_merges;
+  guint64 write_merges;
+
+  g_return_val_if_fail (stats != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  filename = g_strdup_printf ("/sys/dev/block/%u:%u/stat", major (device_number), minor (device_number));
+  if (!g_file_get_contents (filename, &contents, NULL, error))
+    goto out;
+
+  if (sscanf (contents,
+              "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+              " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+              &stats->read_ios, &read_merges, &stats->read_sectors, &stats->read_ticks_msec,
+              &stats->write_ios, &write_merges, &stats->write_sectors, &stats->write_ticks_msec) != 8)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Error parsing %s", filename);
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  g_free (contents);
+  g_free (filename);
+  return ret;
+}
+
+/**
+ * gdu_disk_stats_subtract:
+ * @after: The counters read last.
+ * @before: The counters read first.
+ * @delta: Return location for what happened in between.
+ *
+ * Sets @delta to @after minus @before. Counters that went down, e.g.
+ * because they wrapped around, are taken to be zero.
+ */
+void
+gdu_disk_stats_subtract (const GduDiskStats *after,
+                         const GduDiskStats *before,
+                         GduDiskStats       *delta)
+{
+  delta->read_ios = after->read_ios >= before->read_ios ? after->read_ios - before->read_ios : 0;
+  delta->read_sectors = after->read_sectors >= before->read_sectors ? after->read_sectors - before->read_sectors : 0;
+  delta->read_ticks_msec = after->read_ticks_msec >= before->read_ticks_msec ? after->read_ticks_msec - before->read_ticks_msec : 0;
+  delta->write_ios = after->write_ios >= before->write_ios ? after->write_ios - before->write_ios : 0;
+  delta->write_sectors = after->write_sectors >= before->write_sectors ? after->write_sectors - before->write_sectors : 0;
+  delta->write_ticks_msec = after->write_ticks_msec >= before->write_ticks_msec ? after->write_ticks_msec - before->write_ticks_msec : 0;
+}
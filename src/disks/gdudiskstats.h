@@ -0,0 +1,42 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_DISK_STATS_H__
+#define __GDU_DISK_STATS_H__
+
+#include <gtk/gtk.h>
+#include <sys/types.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* The I/O counters the kernel keeps for a block device, see
+ * Documentation/block/stat.txt in the kernel sources
+ */
+struct GduDiskStats
+{
+  guint64  read_ios;
+  guint64  read_sectors;      /* always 512-byte sectors */
+  guint64  read_ticks_msec;   /* summed over all read requests */
+  guint64  write_ios;
+  guint64  write_sectors;
+  guint64  write_ticks_msec;
+};
+
+gboolean  gdu_disk_stats_read      (dev_t                device_number,
+                                    GduDiskStats        *stats,
+                                    GError             **error);
+
+void      gdu_disk_stats_subtract  (const GduDiskStats  *after,
+                                    const GduDiskStats  *before,
+                                    GduDiskStats        *delta);
+
+G_END_DECLS
+
+#endif /* __GDU_DISK_STATS_H__ */
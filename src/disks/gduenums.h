@@ -41,6 +41,46 @@ typedef enum
   GDU_DEVICE_TREE_MODEL_FLAGS_INCLUDE_NONE_ITEM   = (1<<5),
 } GduDeviceTreeModelFlags;
 
+typedef enum
+{
+  GDU_COMPRESSION_TYPE_NONE,
+  GDU_COMPRESSION_TYPE_XZ,
+  GDU_COMPRESSION_TYPE_GZIP,
+  GDU_COMPRESSION_TYPE_BZIP2,
+  GDU_COMPRESSION_TYPE_ZSTD
+} GduCompressionType;
+
+typedef enum
+{
+  GDU_PARALLEL_DECODER_RESULT_DONE,             /* all input decoded, the next unit starts afresh */
+  GDU_PARALLEL_DECODER_RESULT_PAUSED,           /* the output limit was reached */
+  GDU_PARALLEL_DECODER_RESULT_NEEDS_MORE,       /* all input decoded, the next unit continues this one */
+  GDU_PARALLEL_DECODER_RESULT_TRAILING_GARBAGE, /* the rest of the input is to be ignored */
+  GDU_PARALLEL_DECODER_RESULT_ERROR
+} GduParallelDecoderResult;
+
+typedef enum
+{
+  GDU_VIRTUAL_DISK_FORMAT_NONE,
+  GDU_VIRTUAL_DISK_FORMAT_QCOW2,
+  GDU_VIRTUAL_DISK_FORMAT_VHD,
+  GDU_VIRTUAL_DISK_FORMAT_VHDX,
+  GDU_VIRTUAL_DISK_FORMAT_VMDK
+} GduVirtualDiskFormat;
+
+typedef enum
+{
+  GDU_BENCHMARK_PATTERN_SEQUENTIAL,
+  GDU_BENCHMARK_PATTERN_RANDOM
+} GduBenchmarkPattern;
+
+typedef enum
+{
+  GDU_ZONED_MODEL_NONE,
+  GDU_ZONED_MODEL_HOST_AWARE,
+  GDU_ZONED_MODEL_HOST_MANAGED
+} GduZonedModel;
+
 G_END_DECLS
 
 #endif /* __GDU_ENUMS_H__ */
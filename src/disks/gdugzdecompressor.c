@@ -0,0 +1,428 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include "gdugzdecompressor.h"
+#include "gduparalleldecoder.h"
+
+#include <string.h>
+
+#include <zlib.h>
+
+/* Unlike GZlibDecompressor, this handles gzip files consisting of
+ * several members, e.g. files created by concatenating gzip files or
+ * by compressors that split the input into independent members.
+ *
+ * Such members are decoded in parallel, see gduparalleldecoder.c. The
+ * input is split into units of at least MIN_UNIT_SIZE bytes where
+ * something that looks like a member header follows. A unit may hold
+ * several members. Without a member header, e.g. in a file with a
+ * single member - the common case - the input is split every
+ * MAX_UNIT_SIZE bytes and the units are decoded one after the other.
+ *
+ * A unit only counts as starting after a member once the unit before
+ * it has ended right there - until then, what looks like a member
+ * header may just be part of the compressed data. Like gzip(1),
+ * garbage after a member, e.g. zero padding, is ignored.
+ */
+
+#define MIN_UNIT_SIZE (1 * 1024 * 1024)
+#define MAX_UNIT_SIZE (4 * 1024 * 1024)
+
+/* Don't buffer more output than this for each unit */
+#define OUTPUT_LIMIT (16 * 1024 * 1024)
+#define OUTPUT_STEP (256 * 1024)
+
+/* The fixed part of a member header */
+#define HEADER_SIZE 10
+
+static void gdu_gz_decompressor_iface_init          (GConverterIface *iface);
+
+struct GduGzDecompressor
+{
+  GObject parent_instance;
+
+  GduParallelDecoder *decoder;
+
+  /* input not yet handed to the decoder */
+  GByteArray *pending;
+  /* where to look for the next member header in pending */
+  gsize search_pos;
+  /* FALSE if pending doesn't start with something that looks like a member header */
+  gboolean pending_independent;
+};
+
+G_DEFINE_TYPE_WITH_CODE (GduGzDecompressor, gdu_gz_decompressor, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER,
+                                                gdu_gz_decompressor_iface_init))
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  GByteArray *input;
+  gsize input_pos;
+
+  z_stream zstream;
+
+  /* TRUE if the last member ended and no data of the next one has been seen */
+  gboolean at_member_boundary;
+  /* TRUE if zlib may have more output without more input */
+  gboolean output_pending;
+  /* TRUE if decoding failed before any input was used up */
+  gboolean failed_at_start;
+} GzUnit;
+
+static GzUnit *
+gz_unit_new (const guchar *data,
+             gsize         size)
+{
+  GzUnit *unit;
+  int ret;
+
+  unit = g_new0 (GzUnit, 1);
+  unit->input = g_byte_array_sized_new (size);
+  g_byte_array_append (unit->input, data, size);
+  /* 16 + MAX_WBITS: only accept the gzip format */
+  ret = inflateInit2 (&unit->zstream, 16 + MAX_WBITS);
+  if (ret != Z_OK)
+    g_critical ("Error initalizing zlib decoder: %d", ret);
+  /* see gz_unit_promote() */
+  unit->at_member_boundary = FALSE;
+  return unit;
+}
+
+static void
+gz_unit_free (gpointer unit_data)
+{
+  GzUnit *unit = unit_data;
+
+  inflateEnd (&unit->zstream);
+  g_byte_array_unref (unit->input);
+  g_free (unit);
+}
+
+/* runs on a thread of the pool */
+static GduParallelDecoderResult
+gz_unit_decode (gpointer        unit_data,
+                GByteArray     *output,
+                gsize           output_limit,
+                volatile gint  *cancelled,
+                GError        **error)
+{
+  GzUnit *unit = unit_data;
+
+  while (unit->input_pos < unit->input->len || unit->output_pending)
+    {
+      gsize offset = output->len;
+      gsize avail_in;
+      gsize num_read;
+      int res;
+
+      if (g_atomic_int_get (cancelled))
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                               _("Operation was cancelled"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+      if (output->len >= output_limit)
+        return GDU_PARALLEL_DECODER_RESULT_PAUSED;
+
+      g_byte_array_set_size (output, offset + OUTPUT_STEP);
+      avail_in = MIN (unit->input->len - unit->input_pos, G_MAXUINT);
+      unit->zstream.next_in = unit->input->data + unit->input_pos;
+      unit->zstream.avail_in = avail_in;
+      unit->zstream.next_out = output->data + offset;
+      unit->zstream.avail_out = OUTPUT_STEP;
+
+      res = inflate (&unit->zstream, Z_NO_FLUSH);
+
+      num_read = avail_in - unit->zstream.avail_in;
+      unit->input_pos += num_read;
+      g_byte_array_set_size (output, offset + OUTPUT_STEP - unit->zstream.avail_out);
+      unit->output_pending = (unit->zstream.avail_out == 0);
+
+      if (res == Z_DATA_ERROR || res == Z_NEED_DICT)
+        {
+          if (unit->at_member_boundary)
+            return GDU_PARALLEL_DECODER_RESULT_TRAILING_GARBAGE;
+          unit->failed_at_start = (unit->input_pos == num_read);
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                               _("Invalid compressed data"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+
+      if (res == Z_MEM_ERROR)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               _("Not enough memory"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+
+      /* no progress is possible without more input */
+      if (res == Z_BUF_ERROR && avail_in == 0)
+        {
+          unit->output_pending = FALSE;
+          break;
+        }
+
+      if (res != Z_OK && res != Z_STREAM_END)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                       _("Internal error"));
+          return GDU_PARALLEL_DECODER_RESULT_ERROR;
+        }
+
+      if (num_read > 0)
+        unit->at_member_boundary = FALSE;
+
+      if (res == Z_STREAM_END)
+        {
+          /* The next member, if any, starts right after this one */
+          inflateReset (&unit->zstream);
+          unit->at_member_boundary = TRUE;
+          unit->output_pending = FALSE;
+        }
+    }
+
+  return unit->at_member_boundary ? GDU_PARALLEL_DECODER_RESULT_DONE : GDU_PARALLEL_DECODER_RESULT_NEEDS_MORE;
+}
+
+/* A member can only be decoded from its start so when the first unit
+ * ends in the middle of one, the next unit continues with a copy of
+ * its state. There is nothing to retry on errors.
+ */
+static gboolean
+gz_unit_join (gpointer                  head_data,
+              gpointer                  next_data,
+              GduParallelDecoderResult  result,
+              gboolean                  head_emitted)
+{
+  GzUnit *head = head_data;
+  GzUnit *next = next_data;
+
+  if (result != GDU_PARALLEL_DECODER_RESULT_NEEDS_MORE)
+    return FALSE;
+
+  inflateEnd (&next->zstream);
+  memset (&next->zstream, 0, sizeof next->zstream);
+  if (inflateCopy (&next->zstream, &head->zstream) != Z_OK)
+    return FALSE;
+  next->input_pos = 0;
+  next->at_member_boundary = head->at_member_boundary;
+  next->output_pending = head->output_pending;
+  next->failed_at_start = FALSE;
+  return TRUE;
+}
+
+/* The unit before ended right where this one starts, so what it starts
+ * with comes after a member. That only makes a difference if it failed
+ * to decode right away: it may be trailing garbage.
+ */
+static gboolean
+gz_unit_promote (gpointer unit_data)
+{
+  GzUnit *unit = unit_data;
+
+  if (unit->input_pos > 0 && !unit->failed_at_start)
+    return FALSE;
+
+  inflateReset (&unit->zstream);
+  unit->input_pos = 0;
+  unit->at_member_boundary = TRUE;
+  unit->output_pending = FALSE;
+  unit->failed_at_start = FALSE;
+  return TRUE;
+}
+
+/* Checks the fixed part of a member header: the magic, the deflate
+ * method, no reserved flags, known extra flags and a known OS
+ */
+static gboolean
+looks_like_member_header (const guchar *data)
+{
+  return data[0] == 0x1f && data[1] == 0x8b && data[2] == 8 &&
+    (data[3] & 0xe0) == 0 &&
+    (data[8] == 0 || data[8] == 2 || data[8] == 4) &&
+    (data[9] <= 13 || data[9] == 255);
+}
+
+/* runs on the thread reading from the stream */
+static gboolean
+gz_feed (gpointer       user_data,
+         const guchar  *data,
+         gsize          size,
+         gboolean       at_end,
+         GError       **error)
+{
+  GduGzDecompressor *decompressor = GDU_GZ_DECOMPRESSOR (user_data);
+  GByteArray *pending = decompressor->pending;
+
+  g_byte_array_append (pending, data, size);
+
+  while (pending->len >= MIN_UNIT_SIZE)
+    {
+      gboolean independent = TRUE;
+      gsize cut = 0;
+
+      decompressor->search_pos = MAX (decompressor->search_pos, MIN_UNIT_SIZE);
+      while (decompressor->search_pos + HEADER_SIZE <= pending->len)
+        {
+          const guchar *p;
+
+          p = memchr (pending->data + decompressor->search_pos,
+                      0x1f,
+                      pending->len - HEADER_SIZE + 1 - decompressor->search_pos);
+          if (p == NULL)
+            {
+              decompressor->search_pos = pending->len - HEADER_SIZE + 1;
+              break;
+            }
+          decompressor->search_pos = p - pending->data;
+          if (looks_like_member_header (p))
+            {
+              cut = decompressor->search_pos;
+              break;
+            }
+          decompressor->search_pos++;
+        }
+
+      if (cut == 0)
+        {
+          if (pending->len < MAX_UNIT_SIZE)
+            break;
+          /* no member seems to start here so the next unit continues this one */
+          cut = decompressor->search_pos;
+          independent = FALSE;
+        }
+
+      gdu_parallel_decoder_add_unit (decompressor->decoder,
+                                     gz_unit_new (pending->data, cut),
+                                     decompressor->pending_independent);
+      g_byte_array_remove_range (pending, 0, cut);
+      decompressor->search_pos = 0;
+      decompressor->pending_independent = independent;
+    }
+
+  if (at_end && pending->len > 0)
+    {
+      gdu_parallel_decoder_add_unit (decompressor->decoder,
+                                     gz_unit_new (pending->data, pending->len),
+                                     decompressor->pending_independent);
+      g_byte_array_set_size (pending, 0);
+    }
+
+  return TRUE;
+}
+
+static const GduParallelDecoderFuncs gz_funcs =
+{
+  gz_unit_decode,
+  gz_unit_join,
+  gz_unit_free,
+  gz_unit_promote,
+  gz_feed
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+init_decoder (GduGzDecompressor *decompressor)
+{
+  decompressor->decoder = gdu_parallel_decoder_new (&gz_funcs, decompressor, OUTPUT_LIMIT);
+  decompressor->pending = g_byte_array_new ();
+  decompressor->search_pos = 0;
+  decompressor->pending_independent = TRUE;
+}
+
+static void
+free_decoder (GduGzDecompressor *decompressor)
+{
+  gdu_parallel_decoder_free (decompressor->decoder);
+  decompressor->decoder = NULL;
+  g_byte_array_unref (decompressor->pending);
+  decompressor->pending = NULL;
+}
+
+static void
+gdu_gz_decompressor_finalize (GObject *object)
+{
+  GduGzDecompressor *decompressor = GDU_GZ_DECOMPRESSOR (object);
+
+  free_decoder (decompressor);
+
+  G_OBJECT_CLASS (gdu_gz_decompressor_parent_class)->finalize (object);
+}
+
+static void
+gdu_gz_decompressor_init (GduGzDecompressor *decompressor)
+{
+  init_decoder (decompressor);
+}
+
+static void
+gdu_gz_decompressor_class_init (GduGzDecompressorClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gdu_gz_decompressor_finalize;
+}
+
+GduGzDecompressor *
+gdu_gz_decompressor_new (void)
+{
+  GduGzDecompressor *decompressor;
+
+  decompressor = g_object_new (GDU_TYPE_GZ_DECOMPRESSOR,
+                               NULL);
+
+  return decompressor;
+}
+
+static void
+gdu_gz_decompressor_reset (GConverter *converter)
+{
+  GduGzDecompressor *decompressor = GDU_GZ_DECOMPRESSOR (converter);
+  free_decoder (decompressor);
+  init_decoder (decompressor);
+}
+
+static GConverterResult
+gdu_gz_decompressor_convert (GConverter *converter,
+                             const void *inbuf,
+                             gsize       inbuf_size,
+                             void       *outbuf,
+                             gsize       outbuf_size,
+                             GConverterFlags flags,
+                             gsize      *bytes_read,
+                             gsize      *bytes_written,
+                             GError    **error)
+{
+  GduGzDecompressor *decompressor = GDU_GZ_DECOMPRESSOR (converter);
+
+  return gdu_parallel_decoder_convert (decompressor->decoder,
+                                       inbuf,
+                                       inbuf_size,
+                                       outbuf,
+                                       outbuf_size,
+                                       flags,
+                                       bytes_read,
+                                       bytes_written,
+                                       error);
+}
+
+static void
+gdu_gz_decompressor_iface_init (GConverterIface *iface)
+{
+  iface->convert = gdu_gz_decompressor_convert;
+  iface->reset = gdu_gz_decompressor_reset;
+}
@@ -0,0 +1,305 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gduhistogram.h"
+
+/* A histogram of non-negative integer values (typically latencies in
+ * micro-seconds) in the style of HdrHistogram: values below
+ * SUB_BUCKET_COUNT each get their own bucket and every power-of-two
+ * range above that is split into SUB_BUCKET_COUNT / 2 equally wide
+ * buckets. Every value is therefore known to within 1 / 16 (about 6%)
+ * of itself no matter how big it is, and the histogram uses the same
+ * amount of memory no matter how many values are recorded.
+ *
+ * Values of MAX_VALUE_BITS bits or more (which for micro-seconds is
+ * more than 12 days) are recorded in the last bucket.
+ *
+ * When serialized it's a GVariant of type a{sv} with the following
+ * keys
+ *
+ *  sub-bucket-bits  (u)     - SUB_BUCKET_BITS
+ *  min              (t)     - smallest value recorded
+ *  max              (t)     - largest value recorded
+ *  sum              (t)     - sum of all values recorded
+ *  buckets          (a(ut)) - bucket number and count of non-empty buckets
+ */
+
+#define SUB_BUCKET_BITS 5
+#define SUB_BUCKET_COUNT (1 << SUB_BUCKET_BITS)
+#define SUB_BUCKET_HALF_COUNT (SUB_BUCKET_COUNT / 2)
+#define MAX_VALUE_BITS 40
+#define NUM_BUCKETS (SUB_BUCKET_COUNT + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * SUB_BUCKET_HALF_COUNT)
+
+struct GduHistogram
+{
+  guint64 count;
+  guint64 min;
+  guint64 max;
+  guint64 sum;
+  guint64 buckets[NUM_BUCKETS];
+};
+
+static guint
+get_bucket_for_value (guint64 value)
+{
+  guint msb;
+  guint shift;
+
+  if (value < SUB_BUCKET_COUNT)
+    return value;
+
+  /* gulong may only be 32 bits */
+  if ((value >> 32) != 0)
+    msb = 32 + g_bit_nth_msf (value >> 32, -1);
+  else
+    msb = g_bit_nth_msf (value, -1);
+  if (msb >= MAX_VALUE_BITS)
+    return NUM_BUCKETS - 1;
+
+  /* value >> shift is in [SUB_BUCKET_HALF_COUNT, SUB_BUCKET_COUNT) */
+  shift = msb - SUB_BUCKET_BITS + 1;
+  return SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF_COUNT + ((value >> shift) - SUB_BUCKET_HALF_COUNT);
+}
+
+static void
+get_values_for_bucket (guint     bucket,
+                       guint64  *out_lowest_value,
+                       guint64  *out_highest_value)
+{
+  guint shift;
+  guint64 sub_bucket;
+
+  if (bucket < SUB_BUCKET_COUNT)
+    {
+      *out_lowest_value = bucket;
+      *out_highest_value = bucket;
+      return;
+    }
+
+  shift = (bucket - SUB_BUCKET_COUNT) / SUB_BUCKET_HALF_COUNT + 1;
+  sub_bucket = (bucket - SUB_BUCKET_COUNT) % SUB_BUCKET_HALF_COUNT + SUB_BUCKET_HALF_COUNT;
+  *out_lowest_value = sub_bucket << shift;
+  *out_highest_value = ((sub_bucket + 1) << shift) - 1;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+GduHistogram *
+gdu_histogram_new (void)
+{
+  return g_new0 (GduHistogram, 1);
+}
+
+void
+gdu_histogram_free (GduHistogram *histogram)
+{
+  g_free (histogram);
+}
+
+void
+gdu_histogram_clear (GduHistogram *histogram)
+{
+  memset (histogram, 0, sizeof (GduHistogram));
+}
+
+void
+gdu_histogram_record (GduHistogram *histogram,
+                      guint64       value)
+{
+  if (histogram->count == 0 || value < histogram->min)
+    histogram->min = value;
+  if (histogram->count == 0 || value > histogram->max)
+    histogram->max = value;
+  histogram->count++;
+  histogram->sum += value;
+  histogram->buckets[get_bucket_for_value (value)]++;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+guint64
+gdu_histogram_get_count (GduHistogram *histogram)
+{
+  return histogram->count;
+}
+
+guint64
+gdu_histogram_get_min (GduHistogram *histogram)
+{
+  return histogram->min;
+}
+
+guint64
+gdu_histogram_get_max (GduHistogram *histogram)
+{
+  return histogram->max;
+}
+
+gdouble
+gdu_histogram_get_mean (GduHistogram *histogram)
+{
+  if (histogram->count == 0)
+    return 0.0;
+  return ((gdouble) histogram->sum) / histogram->count;
+}
+
+/**
+ * gdu_histogram_get_value_at_percentile:
+ * @histogram: A #GduHistogram.
+ * @percentile: A percentile between 0 and 100, e.g. 99.9.
+ *
+ * Gets the value that @percentile percent of the recorded values are
+ * less than or equal to. Since values are only known to within the
+ * bucket they were recorded in, this is the highest value of that
+ * bucket, but never more than the largest value recorded.
+ *
+ * Returns: The value or 0 if nothing was recorded.
+ */
+guint64
+gdu_histogram_get_value_at_percentile (GduHistogram *histogram,
+                                       gdouble       percentile)
+{
+  guint64 wanted;
+  guint64 seen;
+  guint n;
+
+  if (histogram->count == 0)
+    return 0;
+
+  percentile = CLAMP (percentile, 0.0, 100.0);
+  wanted = (guint64) ((percentile / 100.0) * histogram->count + 0.5);
+  wanted = CLAMP (wanted, 1, histogram->count);
+
+  seen = 0;
+  for (n = 0; n < NUM_BUCKETS; n++)
+    {
+      seen += histogram->buckets[n];
+      if (seen >= wanted)
+        {
+          guint64 lowest_value;
+          guint64 highest_value;
+          get_values_for_bucket (n, &lowest_value, &highest_value);
+          return MIN (highest_value, histogram->max);
+        }
+    }
+
+  return histogram->max;
+}
+
+guint
+gdu_histogram_get_num_buckets (GduHistogram *histogram)
+{
+  return NUM_BUCKETS;
+}
+
+/* Returns the number of values recorded in @bucket */
+guint64
+gdu_histogram_get_bucket (GduHistogram *histogram,
+                          guint         bucket,
+                          guint64      *out_lowest_value,
+                          guint64      *out_highest_value)
+{
+  guint64 lowest_value;
+  guint64 highest_value;
+
+  g_return_val_if_fail (bucket < NUM_BUCKETS, 0);
+
+  get_values_for_bucket (bucket, &lowest_value, &highest_value);
+  if (out_lowest_value != NULL)
+    *out_lowest_value = lowest_value;
+  if (out_highest_value != NULL)
+    *out_highest_value = highest_value;
+  return histogram->buckets[bucket];
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+GVariant *
+gdu_histogram_to_gvariant (GduHistogram *histogram)
+{
+  GVariantBuilder builder;
+  GVariantBuilder buckets_builder;
+  guint n;
+
+  g_variant_builder_init (&buckets_builder, G_VARIANT_TYPE ("a(ut)"));
+  for (n = 0; n < NUM_BUCKETS; n++)
+    {
+      if (histogram->buckets[n] > 0)
+        g_variant_builder_add (&buckets_builder, "(ut)", n, histogram->buckets[n]);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "sub-bucket-bits", g_variant_new_uint32 (SUB_BUCKET_BITS));
+  g_variant_builder_add (&builder, "{sv}", "min", g_variant_new_uint64 (histogram->min));
+  g_variant_builder_add (&builder, "{sv}", "max", g_variant_new_uint64 (histogram->max));
+  g_variant_builder_add (&builder, "{sv}", "sum", g_variant_new_uint64 (histogram->sum));
+  g_variant_builder_add (&builder, "{sv}", "buckets", g_variant_builder_end (&buckets_builder));
+  return g_variant_builder_end (&builder);
+}
+
+GduHistogram *
+gdu_histogram_new_from_gvariant (GVariant  *variant,
+                                 GError   **error)
+{
+  GduHistogram *ret = NULL;
+  GduHistogram *histogram = NULL;
+  GVariant *buckets = NULL;
+  GVariantIter iter;
+  guint32 sub_bucket_bits;
+  guint32 bucket;
+  guint64 count;
+
+  histogram = gdu_histogram_new ();
+
+  if (!g_variant_is_of_type (variant, G_VARIANT_TYPE_VARDICT) ||
+      !g_variant_lookup (variant, "sub-bucket-bits", "u", &sub_bucket_bits) ||
+      !g_variant_lookup (variant, "min", "t", &histogram->min) ||
+      !g_variant_lookup (variant, "max", "t", &histogram->max) ||
+      !g_variant_lookup (variant, "sum", "t", &histogram->sum) ||
+      !g_variant_lookup (variant, "buckets", "@a(ut)", &buckets))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Malformed histogram");
+      goto out;
+    }
+
+  if (sub_bucket_bits != SUB_BUCKET_BITS)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Cannot decode histogram with %u sub-bucket bits", sub_bucket_bits);
+      goto out;
+    }
+
+  g_variant_iter_init (&iter, buckets);
+  while (g_variant_iter_next (&iter, "(ut)", &bucket, &count))
+    {
+      if (bucket >= NUM_BUCKETS)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Histogram bucket %u out of range", bucket);
+          goto out;
+        }
+      histogram->buckets[bucket] += count;
+      histogram->count += count;
+    }
+
+  ret = histogram;
+  histogram = NULL;
+
+ out:
+  if (buckets != NULL)
+    g_variant_unref (buckets);
+  if (histogram != NULL)
+    gdu_histogram_free (histogram);
+  return ret;
+}
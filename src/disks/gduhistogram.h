@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_HISTOGRAM_H__
+#define __GDU_HISTOGRAM_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+GduHistogram  *gdu_histogram_new                     (void);
+GduHistogram  *gdu_histogram_new_from_gvariant       (GVariant            *variant,
+                                                      GError             **error);
+void           gdu_histogram_free                    (GduHistogram        *histogram);
+GVariant      *gdu_histogram_to_gvariant             (GduHistogram        *histogram);
+
+void           gdu_histogram_clear                   (GduHistogram        *histogram);
+void           gdu_histogram_record                  (GduHistogram        *histogram,
+                                                      guint64              value);
+
+guint64        gdu_histogram_get_count               (GduHistogram        *histogram);
+guint64        gdu_histogram_get_min                 (GduHistogram        *histogram);
+guint64        gdu_histogram_get_max                 (GduHistogram        *histogram);
+gdouble        gdu_histogram_get_mean                (GduHistogram        *histogram);
+guint64        gdu_histogram_get_value_at_percentile (GduHistogram        *histogram,
+                                                      gdouble              percentile);
+
+guint          gdu_histogram_get_num_buckets         (GduHistogram        *histogram);
+guint64        gdu_histogram_get_bucket              (GduHistogram        *histogram,
+                                                      guint                bucket,
+                                                      guint64             *out_lowest_value,
+                                                      guint64             *out_highest_value);
+
+G_END_DECLS
+
+#endif /* __GDU_HISTOGRAM_H__ */
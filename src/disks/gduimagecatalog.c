@@ -0,0 +1,726 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "gduimagecatalog.h"
+#include "gducompression.h"
+#include "gduvirtualdisk.h"
+#include "gduimagemanifest.h"
+#include "gduimageprobe.h"
+
+/* The image catalogue caches what is known about disk images - finding
+ * out may involve decompressing or reading all over a multi-GB file -
+ * so the restore dialog can show it right away. Images in the folder
+ * disk images were last used from are examined in the background, see
+ * gdu_image_catalog_index_directory().
+ *
+ * Images are identified by device, inode and modification time so a
+ * changed image is examined again. The catalogue is stored in
+ * $XDG_CACHE_HOME/gnome-disks/image-catalog as a serialized GVariant
+ * of type a{sv} with the following keys
+ *
+ *  version  (i)          - currently 2
+ *  images   (a{sa{sv}})  - maps from image key to image
+ *
+ * where each image has the following keys
+ *
+ *  uri                  (s) - the URI the image was last seen at
+ *  last-used            (x) - when the image was last seen, seconds since the Epoch
+ *  virtual-disk-format  (u) - a GduVirtualDiskFormat
+ *  compression          (u) - a GduCompressionType
+ *  size                 (t) - size of the image contents, 0 if not known
+ *  layout               (a{sv}) - what is in the image, see below - empty if not known
+ *  manifest-mtime       (t) - modification time of the manifest, 0 if there is none
+ *  manifest-digest      (s) - SHA-256 of the manifest in hex
+ *
+ * and the layout has the following keys
+ *
+ *  partition-table      (s)        - "dos", "gpt" or "" if there is none
+ *  partitions           (a(uttss)) - number, offset, size, usage and type of each partition
+ *  usage                (s)        - usage of the whole image if there is no partition table
+ *  type                 (s)        - type of the whole image if there is no partition table
+ *
+ * where usage and type are "" if not recognized.
+ */
+
+/* images not seen for this long are dropped from the catalogue */
+#define MAX_AGE_SECONDS (30 * 24 * 3600)
+
+/* the same as gdu_utils_configure_file_chooser_for_disk_images() offers */
+static const gchar *image_patterns[] = {
+  "*.img", "*.raw-disk-image", "*.iso",
+  "*.img.xz", "*.raw-disk-image.xz",
+  "*.img.gz", "*.raw-disk-image.gz",
+  "*.img.bz2", "*.raw-disk-image.bz2",
+  "*.img.zst", "*.raw-disk-image.zst",
+  "*.qcow2", "*.vhd", "*.vhdx", "*.vmdk",
+  NULL
+};
+
+typedef struct
+{
+  GduImageCatalogEntry entry;
+  gchar *uri;
+  gint64 last_used;
+  guint64 manifest_mtime;
+} CachedImage;
+
+struct GduImageCatalog
+{
+  gchar *filename;
+
+  /* must hold lock when reading/writing these */
+  GMutex lock;
+  GHashTable *images; /* key -> CachedImage */
+  GThread *indexer_thread;
+  gboolean indexing;
+  /* the number of gdu_image_catalog_lookup() calls in progress, see gdu_image_catalog_free() */
+  guint num_lookups;
+  GCond lookups_cond;
+
+  /* cancels everything when the catalogue is freed */
+  GCancellable *cancellable;
+};
+
+static void
+cached_image_free (CachedImage *image)
+{
+  gdu_image_layout_free (image->entry.layout);
+  g_free (image->entry.manifest_digest);
+  g_free (image->uri);
+  g_free (image);
+}
+
+GduImageCatalogEntry *
+gdu_image_catalog_entry_copy (GduImageCatalogEntry *entry)
+{
+  GduImageCatalogEntry *ret;
+
+  ret = g_new (GduImageCatalogEntry, 1);
+  *ret = *entry;
+  ret->layout = entry->layout != NULL ? gdu_image_layout_copy (entry->layout) : NULL;
+  ret->manifest_digest = g_strdup (entry->manifest_digest);
+  return ret;
+}
+
+void
+gdu_image_catalog_entry_free (GduImageCatalogEntry *entry)
+{
+  if (entry == NULL)
+    return;
+  gdu_image_layout_free (entry->layout);
+  g_free (entry->manifest_digest);
+  g_free (entry);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static const gchar *
+empty_if_null (const gchar *s)
+{
+  return s != NULL ? s : "";
+}
+
+static gchar *
+null_if_empty (const gchar *s)
+{
+  return strlen (s) > 0 ? g_strdup (s) : NULL;
+}
+
+static GVariant *
+layout_to_variant (GduImageLayout *layout)
+{
+  GVariantBuilder builder;
+  GVariantBuilder partitions_builder;
+  guint n;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  if (layout == NULL)
+    goto out;
+
+  g_variant_builder_init (&partitions_builder, G_VARIANT_TYPE ("a(uttss)"));
+  for (n = 0; n < layout->num_partitions; n++)
+    {
+      GduImagePartition *partition = &layout->partitions[n];
+      g_variant_builder_add (&partitions_builder, "(uttss)",
+                             partition->number,
+                             partition->offset,
+                             partition->size,
+                             empty_if_null (partition->usage),
+                             empty_if_null (partition->type));
+    }
+  g_variant_builder_add (&builder, "{sv}", "partition-table", g_variant_new_string (empty_if_null (layout->partition_table)));
+  g_variant_builder_add (&builder, "{sv}", "partitions", g_variant_builder_end (&partitions_builder));
+  g_variant_builder_add (&builder, "{sv}", "usage", g_variant_new_string (empty_if_null (layout->usage)));
+  g_variant_builder_add (&builder, "{sv}", "type", g_variant_new_string (empty_if_null (layout->type)));
+
+ out:
+  return g_variant_builder_end (&builder);
+}
+
+static GduImageLayout *
+layout_from_variant (GVariant *value)
+{
+  GduImageLayout *ret = NULL;
+  const gchar *partition_table;
+  GVariant *partitions;
+  const gchar *usage;
+  const gchar *type;
+  GVariantIter iter;
+  guint n;
+
+  if (!g_variant_lookup (value, "partition-table", "&s", &partition_table) ||
+      !g_variant_lookup (value, "partitions", "@a(uttss)", &partitions))
+    goto out;
+  if (!g_variant_lookup (value, "usage", "&s", &usage) ||
+      !g_variant_lookup (value, "type", "&s", &type))
+    {
+      g_variant_unref (partitions);
+      goto out;
+    }
+
+  ret = g_new0 (GduImageLayout, 1);
+  ret->partition_table = null_if_empty (partition_table);
+  ret->usage = null_if_empty (usage);
+  ret->type = null_if_empty (type);
+  ret->num_partitions = g_variant_n_children (partitions);
+  ret->partitions = g_new0 (GduImagePartition, ret->num_partitions);
+  g_variant_iter_init (&iter, partitions);
+  for (n = 0; n < ret->num_partitions; n++)
+    {
+      GduImagePartition *partition = &ret->partitions[n];
+      const gchar *partition_usage;
+      const gchar *partition_type;
+
+      g_variant_iter_next (&iter, "(utt&s&s)",
+                           &partition->number,
+                           &partition->offset,
+                           &partition->size,
+                           &partition_usage,
+                           &partition_type);
+      partition->usage = null_if_empty (partition_usage);
+      partition->type = null_if_empty (partition_type);
+    }
+  g_variant_unref (partitions);
+
+ out:
+  return ret;
+}
+
+static void
+load (GduImageCatalog *catalog)
+{
+  gchar *variant_data = NULL;
+  gsize variant_size;
+  GVariant *value = NULL;
+  GVariant *images = NULL;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *dict;
+  gint32 version;
+
+  if (!g_file_get_contents (catalog->filename, &variant_data, &variant_size, NULL))
+    goto out;
+
+  value = g_variant_new_from_data (G_VARIANT_TYPE_VARDICT,
+                                   variant_data,
+                                   variant_size,
+                                   FALSE,
+                                   NULL, NULL);
+  if (!g_variant_lookup (value, "version", "i", &version) || version != 2)
+    goto out;
+  if (!g_variant_lookup (value, "images", "@a{sa{sv}}", &images))
+    goto out;
+
+  g_variant_iter_init (&iter, images);
+  while (g_variant_iter_next (&iter, "{&s@a{sv}}", &key, &dict))
+    {
+      CachedImage *image;
+      guint32 virtual_disk_format;
+      guint32 compression;
+      GVariant *layout = NULL;
+      const gchar *manifest_digest;
+
+      image = g_new0 (CachedImage, 1);
+      if (g_variant_lookup (dict, "uri", "s", &image->uri) &&
+          g_variant_lookup (dict, "last-used", "x", &image->last_used) &&
+          g_variant_lookup (dict, "virtual-disk-format", "u", &virtual_disk_format) &&
+          g_variant_lookup (dict, "compression", "u", &compression) &&
+          g_variant_lookup (dict, "size", "t", &image->entry.size) &&
+          g_variant_lookup (dict, "layout", "@a{sv}", &layout) &&
+          g_variant_lookup (dict, "manifest-mtime", "t", &image->manifest_mtime) &&
+          g_variant_lookup (dict, "manifest-digest", "&s", &manifest_digest))
+        {
+          image->entry.virtual_disk_format = virtual_disk_format;
+          image->entry.compression = compression;
+          image->entry.layout = layout_from_variant (layout);
+          g_variant_unref (layout);
+          if (strlen (manifest_digest) > 0)
+            image->entry.manifest_digest = g_strdup (manifest_digest);
+          g_hash_table_insert (catalog->images, g_strdup (key), image);
+        }
+      else
+        {
+          if (layout != NULL)
+            g_variant_unref (layout);
+          cached_image_free (image);
+        }
+      g_variant_unref (dict);
+    }
+
+ out:
+  if (images != NULL)
+    g_variant_unref (images);
+  if (value != NULL)
+    g_variant_unref (value);
+  g_free (variant_data);
+}
+
+static void
+save (GduImageCatalog *catalog)
+{
+  GVariantBuilder builder;
+  GVariantBuilder images_builder;
+  GHashTableIter iter;
+  const gchar *key;
+  CachedImage *image;
+  GVariant *value = NULL;
+  gchar *dirname = NULL;
+  gint64 now;
+  GError *error = NULL;
+
+  now = g_get_real_time () / G_USEC_PER_SEC;
+
+  g_variant_builder_init (&images_builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+  g_mutex_lock (&catalog->lock);
+  g_hash_table_iter_init (&iter, catalog->images);
+  while (g_hash_table_iter_next (&iter, (gpointer) &key, (gpointer) &image))
+    {
+      GVariantBuilder dict_builder;
+
+      if (now - image->last_used > MAX_AGE_SECONDS)
+        {
+          g_hash_table_iter_remove (&iter);
+          continue;
+        }
+
+      g_variant_builder_init (&dict_builder, G_VARIANT_TYPE_VARDICT);
+      g_variant_builder_add (&dict_builder, "{sv}", "uri", g_variant_new_string (image->uri));
+      g_variant_builder_add (&dict_builder, "{sv}", "last-used", g_variant_new_int64 (image->last_used));
+      g_variant_builder_add (&dict_builder, "{sv}", "virtual-disk-format",
+                             g_variant_new_uint32 (image->entry.virtual_disk_format));
+      g_variant_builder_add (&dict_builder, "{sv}", "compression", g_variant_new_uint32 (image->entry.compression));
+      g_variant_builder_add (&dict_builder, "{sv}", "size", g_variant_new_uint64 (image->entry.size));
+      g_variant_builder_add (&dict_builder, "{sv}", "layout", layout_to_variant (image->entry.layout));
+      g_variant_builder_add (&dict_builder, "{sv}", "manifest-mtime", g_variant_new_uint64 (image->manifest_mtime));
+      g_variant_builder_add (&dict_builder, "{sv}", "manifest-digest",
+                             g_variant_new_string (image->entry.manifest_digest != NULL ? image->entry.manifest_digest : ""));
+      g_variant_builder_add (&images_builder, "{s@a{sv}}", key, g_variant_builder_end (&dict_builder));
+    }
+  g_mutex_unlock (&catalog->lock);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "version", g_variant_new_int32 (2));
+  g_variant_builder_add (&builder, "{sv}", "images", g_variant_builder_end (&images_builder));
+  value = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  dirname = g_path_get_dirname (catalog->filename);
+  if (g_mkdir_with_parents (dirname, 0700) != 0)
+    {
+      g_warning ("Error creating directory %s: %m", dirname);
+      goto out;
+    }
+
+  if (!g_file_set_contents (catalog->filename,
+                            g_variant_get_data (value),
+                            g_variant_get_size (value),
+                            &error))
+    {
+      g_warning ("Error saving image catalogue: %s", error->message);
+      g_clear_error (&error);
+    }
+
+ out:
+  g_free (dirname);
+  g_variant_unref (value);
+}
+
+GduImageCatalog *
+gdu_image_catalog_new (void)
+{
+  GduImageCatalog *catalog;
+
+  catalog = g_new0 (GduImageCatalog, 1);
+  catalog->filename = g_build_filename (g_get_user_cache_dir (), "gnome-disks", "image-catalog", NULL);
+  g_mutex_init (&catalog->lock);
+  g_cond_init (&catalog->lookups_cond);
+  catalog->images = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, (GDestroyNotify) cached_image_free);
+  catalog->cancellable = g_cancellable_new ();
+  load (catalog);
+  return catalog;
+}
+
+void
+gdu_image_catalog_free (GduImageCatalog *catalog)
+{
+  if (catalog == NULL)
+    return;
+
+  g_cancellable_cancel (catalog->cancellable);
+  if (catalog->indexer_thread != NULL)
+    g_thread_join (catalog->indexer_thread);
+
+  /* lookups from other threads, e.g. the restore dialog's, are cancelled too */
+  g_mutex_lock (&catalog->lock);
+  while (catalog->num_lookups > 0)
+    g_cond_wait (&catalog->lookups_cond, &catalog->lock);
+  g_mutex_unlock (&catalog->lock);
+
+  g_object_unref (catalog->cancellable);
+  g_hash_table_unref (catalog->images);
+  g_cond_clear (&catalog->lookups_cond);
+  g_mutex_clear (&catalog->lock);
+  g_free (catalog->filename);
+  g_free (catalog);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+examine (GFile                 *file,
+         guint64                file_size,
+         GduImageCatalogEntry  *entry,
+         GCancellable          *cancellable,
+         GError               **error)
+{
+  gboolean ret = FALSE;
+  GduVirtualDisk *virtual_disk;
+  GError *local_error = NULL;
+
+  entry->size = file_size;
+  entry->virtual_disk_format = gdu_virtual_disk_detect (file);
+  if (entry->virtual_disk_format != GDU_VIRTUAL_DISK_FORMAT_NONE)
+    {
+      /* only reads the headers */
+      virtual_disk = gdu_virtual_disk_open (file, cancellable, error);
+      if (virtual_disk == NULL)
+        goto out;
+      entry->size = gdu_virtual_disk_get_size (virtual_disk);
+      gdu_virtual_disk_free (virtual_disk);
+    }
+  else
+    {
+      entry->compression = gdu_compression_detect (file);
+      if (entry->compression != GDU_COMPRESSION_TYPE_NONE)
+        {
+          /* nothing more to find out if we can't decompress it */
+          if (!gdu_compression_is_supported (entry->compression))
+            {
+              entry->size = 0;
+              ret = TRUE;
+              goto out;
+            }
+          entry->size = gdu_compression_get_uncompressed_size (file, entry->compression);
+        }
+    }
+
+  entry->layout = gdu_image_probe_layout (file,
+                                          entry->virtual_disk_format,
+                                          entry->compression,
+                                          cancellable,
+                                          &local_error);
+  if (entry->layout == NULL)
+    {
+      /* an image we can't look into is still worth knowing about */
+      if (local_error->domain == G_IO_ERROR && local_error->code == G_IO_ERROR_CANCELLED)
+        {
+          g_propagate_error (error, local_error);
+          goto out;
+        }
+      g_clear_error (&local_error);
+    }
+
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+/* must hold catalog->lock; the manifest may change without the image changing */
+static void
+update_manifest_digest_locked (CachedImage *image,
+                               GFile       *file)
+{
+  gchar *manifest_filename;
+  GStatBuf statbuf;
+  gchar *contents;
+  gsize length;
+
+  manifest_filename = gdu_image_manifest_get_filename_for_image (file);
+  if (manifest_filename == NULL || g_stat (manifest_filename, &statbuf) != 0)
+    {
+      image->manifest_mtime = 0;
+      g_free (image->entry.manifest_digest);
+      image->entry.manifest_digest = NULL;
+      goto out;
+    }
+
+  if ((guint64) statbuf.st_mtime == image->manifest_mtime && image->entry.manifest_digest != NULL)
+    goto out;
+
+  g_free (image->entry.manifest_digest);
+  image->entry.manifest_digest = NULL;
+  image->manifest_mtime = statbuf.st_mtime;
+  if (g_file_get_contents (manifest_filename, &contents, &length, NULL))
+    {
+      image->entry.manifest_digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *) contents, length);
+      g_free (contents);
+    }
+
+ out:
+  g_free (manifest_filename);
+}
+
+static GduImageCatalogEntry *
+lookup (GduImageCatalog  *catalog,
+        GFile            *file,
+        gboolean         *out_changed,
+        GCancellable     *cancellable,
+        GError          **error)
+{
+  GduImageCatalogEntry *ret = NULL;
+  GFileInfo *info;
+  gchar *key = NULL;
+  CachedImage *image;
+
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                            G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+                            G_FILE_ATTRIBUTE_UNIX_INODE,
+                            G_FILE_QUERY_INFO_NONE,
+                            cancellable,
+                            error);
+  if (info == NULL)
+    goto out;
+
+  /* not all file systems have inode numbers, those images are examined every time */
+  if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_INODE))
+    key = g_strdup_printf ("%u:%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+                           g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE),
+                           g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE),
+                           g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED));
+
+  g_mutex_lock (&catalog->lock);
+  image = key != NULL ? g_hash_table_lookup (catalog->images, key) : NULL;
+  if (image != NULL)
+    {
+      image->last_used = g_get_real_time () / G_USEC_PER_SEC;
+      g_free (image->uri);
+      image->uri = g_file_get_uri (file);
+      update_manifest_digest_locked (image, file);
+      ret = gdu_image_catalog_entry_copy (&image->entry);
+      g_mutex_unlock (&catalog->lock);
+      goto out;
+    }
+  g_mutex_unlock (&catalog->lock);
+
+  /* examining may take a while, don't hold the lock meanwhile */
+  image = g_new0 (CachedImage, 1);
+  if (!examine (file, g_file_info_get_size (info), &image->entry, cancellable, error))
+    {
+      cached_image_free (image);
+      goto out;
+    }
+  image->uri = g_file_get_uri (file);
+  image->last_used = g_get_real_time () / G_USEC_PER_SEC;
+
+  g_mutex_lock (&catalog->lock);
+  update_manifest_digest_locked (image, file);
+  ret = gdu_image_catalog_entry_copy (&image->entry);
+  if (key != NULL)
+    {
+      g_hash_table_replace (catalog->images, g_strdup (key), image);
+      *out_changed = TRUE;
+    }
+  else
+    {
+      cached_image_free (image);
+    }
+  g_mutex_unlock (&catalog->lock);
+
+ out:
+  g_clear_object (&info);
+  g_free (key);
+  return ret;
+}
+
+static void
+on_cancelled (GCancellable *cancellable,
+              gpointer      user_data)
+{
+  g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+/**
+ * gdu_image_catalog_lookup:
+ *
+ * Returns what is known about the disk image @file, examining it if it
+ * isn't in the catalogue. May block and may be called from any thread.
+ * The lookup is cancelled if @cancellable is or when the catalogue is
+ * freed, which waits for it.
+ *
+ * Returns: A #GduImageCatalogEntry to be freed with
+ * gdu_image_catalog_entry_free() or %NULL if @error is set.
+ */
+GduImageCatalogEntry *
+gdu_image_catalog_lookup (GduImageCatalog  *catalog,
+                          GFile            *file,
+                          GCancellable     *cancellable,
+                          GError          **error)
+{
+  GduImageCatalogEntry *ret;
+  GCancellable *lookup_cancellable;
+  gulong handler_id = 0;
+  gulong catalog_handler_id;
+  gboolean changed = FALSE;
+
+  g_mutex_lock (&catalog->lock);
+  catalog->num_lookups++;
+  g_mutex_unlock (&catalog->lock);
+
+  lookup_cancellable = g_cancellable_new ();
+  if (cancellable != NULL)
+    handler_id = g_cancellable_connect (cancellable, G_CALLBACK (on_cancelled), lookup_cancellable, NULL);
+  catalog_handler_id = g_cancellable_connect (catalog->cancellable, G_CALLBACK (on_cancelled), lookup_cancellable, NULL);
+
+  ret = lookup (catalog, file, &changed, lookup_cancellable, error);
+  if (changed)
+    save (catalog);
+
+  g_cancellable_disconnect (catalog->cancellable, catalog_handler_id);
+  if (cancellable != NULL)
+    g_cancellable_disconnect (cancellable, handler_id);
+  g_object_unref (lookup_cancellable);
+
+  g_mutex_lock (&catalog->lock);
+  catalog->num_lookups--;
+  g_cond_broadcast (&catalog->lookups_cond);
+  g_mutex_unlock (&catalog->lock);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  GduImageCatalog *catalog;
+  GFile *directory;
+} IndexerData;
+
+static gboolean
+is_image_name (const gchar *name)
+{
+  guint n;
+
+  for (n = 0; image_patterns[n] != NULL; n++)
+    {
+      if (g_pattern_match_simple (image_patterns[n], name))
+        return TRUE;
+    }
+  return FALSE;
+}
+
+static gpointer
+indexer_thread_func (gpointer user_data)
+{
+  IndexerData *data = user_data;
+  GduImageCatalog *catalog = data->catalog;
+  GFileEnumerator *enumerator;
+  GFileInfo *info;
+  gboolean changed = FALSE;
+
+  enumerator = g_file_enumerate_children (data->directory,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                          G_FILE_QUERY_INFO_NONE,
+                                          catalog->cancellable,
+                                          NULL);
+  if (enumerator == NULL)
+    goto out;
+
+  while ((info = g_file_enumerator_next_file (enumerator, catalog->cancellable, NULL)) != NULL)
+    {
+      if (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+          is_image_name (g_file_info_get_name (info)))
+        {
+          GFile *file;
+          file = g_file_get_child (data->directory, g_file_info_get_name (info));
+          gdu_image_catalog_entry_free (lookup (catalog, file, &changed, catalog->cancellable, NULL));
+          g_object_unref (file);
+        }
+      g_object_unref (info);
+    }
+  g_object_unref (enumerator);
+
+ out:
+  if (changed)
+    save (catalog);
+
+  g_mutex_lock (&catalog->lock);
+  catalog->indexing = FALSE;
+  g_mutex_unlock (&catalog->lock);
+
+  g_object_unref (data->directory);
+  g_free (data);
+  return NULL;
+}
+
+/**
+ * gdu_image_catalog_index_directory:
+ *
+ * Starts examining the disk images in @directory in the background,
+ * unless that is already going on.
+ */
+void
+gdu_image_catalog_index_directory (GduImageCatalog *catalog,
+                                   GFile           *directory)
+{
+  IndexerData *data;
+
+  g_mutex_lock (&catalog->lock);
+  if (catalog->indexing)
+    {
+      g_mutex_unlock (&catalog->lock);
+      goto out;
+    }
+  catalog->indexing = TRUE;
+  g_mutex_unlock (&catalog->lock);
+
+  /* the previous indexer is done */
+  if (catalog->indexer_thread != NULL)
+    g_thread_join (catalog->indexer_thread);
+
+  data = g_new0 (IndexerData, 1);
+  data->catalog = catalog;
+  data->directory = g_object_ref (directory);
+  catalog->indexer_thread = g_thread_new ("image-catalog-indexer",
+                                          indexer_thread_func,
+                                          data);
+
+ out:
+  ;
+}
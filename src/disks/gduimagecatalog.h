@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_IMAGE_CATALOG_H__
+#define __GDU_IMAGE_CATALOG_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* What is known about a disk image */
+struct GduImageCatalogEntry
+{
+  GduVirtualDiskFormat  virtual_disk_format;
+  GduCompressionType    compression;
+  guint64               size;             /* of the image contents, 0 if not known */
+  GduImageLayout       *layout;           /* NULL if not known */
+  gchar                *manifest_digest;  /* SHA-256 of the manifest in hex, NULL if there is none */
+};
+
+GduImageCatalog      *gdu_image_catalog_new              (void);
+void                  gdu_image_catalog_free             (GduImageCatalog       *catalog);
+
+GduImageCatalogEntry *gdu_image_catalog_lookup           (GduImageCatalog       *catalog,
+                                                          GFile                 *file,
+                                                          GCancellable          *cancellable,
+                                                          GError               **error);
+void                  gdu_image_catalog_index_directory  (GduImageCatalog       *catalog,
+                                                          GFile                 *directory);
+
+GduImageCatalogEntry *gdu_image_catalog_entry_copy       (GduImageCatalogEntry  *entry);
+void                  gdu_image_catalog_entry_free       (GduImageCatalogEntry  *entry);
+
+G_END_DECLS
+
+#endif /* __GDU_IMAGE_CATALOG_H__ */
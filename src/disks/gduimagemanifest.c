@@ -0,0 +1,333 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gduimagemanifest.h"
+
+/* A manifest is a list of SHA-256 digests, one for each @chunk_size
+ * bytes of the (uncompressed) disk image. The last chunk may be
+ * shorter than @chunk_size.
+ *
+ * On disk, the manifest is stored next to the disk image with the
+ * suffix ".gnome-disks-manifest" as a serialized GVariant of type
+ * a{sv} with the following keys
+ *
+ *  version     (i)  - currently 1
+ *  image-size  (t)  - size of the uncompressed disk image
+ *  chunk-size  (t)  - size of each chunk
+ *  digests     (ay) - concatenated SHA-256 digests
+ *
+ * Distinct chunks may be set or checked concurrently from different
+ * threads.
+ */
+
+/* Manifest files are not trusted, so chunks must be at least this
+ * big and a multiple of 512 bytes - a tiny chunk size would make for
+ * more digests than can be indexed
+ */
+#define MIN_CHUNK_SIZE 4096
+
+struct GduImageManifest
+{
+  guint64 image_size;
+  gsize chunk_size;
+  guint num_chunks;
+
+  guint8 *digests;
+  guint8 *have_digest;
+};
+
+/* Returns FALSE if there are too many chunks to index them with a
+ * guint or to allocate their digests
+ */
+static gboolean
+get_num_chunks (guint64  image_size,
+                guint64  chunk_size,
+                guint   *out_num_chunks)
+{
+  guint64 num_chunks;
+
+  num_chunks = image_size / chunk_size + (image_size % chunk_size != 0 ? 1 : 0);
+  if (num_chunks > G_MAXUINT || num_chunks > G_MAXSIZE / GDU_IMAGE_MANIFEST_DIGEST_SIZE)
+    return FALSE;
+  *out_num_chunks = num_chunks;
+  return TRUE;
+}
+
+GduImageManifest *
+gdu_image_manifest_new (guint64 image_size,
+                        gsize   chunk_size)
+{
+  GduImageManifest *manifest;
+  guint num_chunks = 0;
+
+  g_return_val_if_fail (chunk_size > 0, NULL);
+  g_return_val_if_fail (get_num_chunks (image_size, chunk_size, &num_chunks), NULL);
+
+  manifest = g_new0 (GduImageManifest, 1);
+  manifest->image_size = image_size;
+  manifest->chunk_size = chunk_size;
+  manifest->num_chunks = num_chunks;
+  manifest->digests = g_new0 (guint8, ((gsize) manifest->num_chunks) * GDU_IMAGE_MANIFEST_DIGEST_SIZE);
+  manifest->have_digest = g_new0 (guint8, manifest->num_chunks);
+  return manifest;
+}
+
+void
+gdu_image_manifest_free (GduImageManifest *manifest)
+{
+  if (manifest == NULL)
+    return;
+  g_free (manifest->digests);
+  g_free (manifest->have_digest);
+  g_free (manifest);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* returns NULL if the image is not on a local (or FUSE) filesystem */
+gchar *
+gdu_image_manifest_get_filename_for_image (GFile *image_file)
+{
+  gchar *ret = NULL;
+  gchar *path;
+
+  path = g_file_get_path (image_file);
+  if (path != NULL)
+    ret = g_strdup_printf ("%s.gnome-disks-manifest", path);
+  g_free (path);
+  return ret;
+}
+
+GduImageManifest *
+gdu_image_manifest_load (const gchar  *filename,
+                         GError      **error)
+{
+  GduImageManifest *ret = NULL;
+  gchar *variant_data = NULL;
+  gsize variant_size;
+  GVariant *value = NULL;
+  GVariant *digests_variant = NULL;
+  gint32 version;
+  guint64 image_size;
+  guint64 chunk_size;
+  gconstpointer digests;
+  gsize digests_size;
+  guint num_chunks;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (!g_file_get_contents (filename,
+                            &variant_data,
+                            &variant_size,
+                            error))
+    goto out;
+
+  value = g_variant_new_from_data (G_VARIANT_TYPE_VARDICT,
+                                   variant_data,
+                                   variant_size,
+                                   FALSE,
+                                   NULL, NULL);
+
+  if (!g_variant_lookup (value, "version", "i", &version))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "No version key");
+      goto out;
+    }
+  if (version != 1)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Cannot decode version %d manifest", version);
+      goto out;
+    }
+  if (!g_variant_lookup (value, "image-size", "t", &image_size) ||
+      !g_variant_lookup (value, "chunk-size", "t", &chunk_size) ||
+      chunk_size < MIN_CHUNK_SIZE || chunk_size % 512 != 0 || chunk_size > G_MAXSIZE ||
+      !get_num_chunks (image_size, chunk_size, &num_chunks))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "No or invalid image-size or chunk-size");
+      goto out;
+    }
+  if (!g_variant_lookup (value, "digests", "@ay", &digests_variant))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "No digests");
+      goto out;
+    }
+
+  digests = g_variant_get_fixed_array (digests_variant, &digests_size, sizeof (guint8));
+  if (digests_size != ((gsize) num_chunks) * GDU_IMAGE_MANIFEST_DIGEST_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Expected %u digests, got %" G_GSIZE_FORMAT " bytes of digest data",
+                   num_chunks, digests_size);
+      goto out;
+    }
+
+  ret = gdu_image_manifest_new (image_size, chunk_size);
+  memcpy (ret->digests, digests, digests_size);
+  memset (ret->have_digest, 1, ret->num_chunks);
+
+ out:
+  if (digests_variant != NULL)
+    g_variant_unref (digests_variant);
+  if (value != NULL)
+    g_variant_unref (value);
+  g_free (variant_data);
+  return ret;
+}
+
+gboolean
+gdu_image_manifest_save (GduImageManifest  *manifest,
+                         const gchar       *filename,
+                         GError           **error)
+{
+  gboolean ret = FALSE;
+  GVariantBuilder builder;
+  GVariant *value = NULL;
+
+  g_return_val_if_fail (manifest != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (!gdu_image_manifest_is_complete (manifest))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Manifest is incomplete");
+      goto out;
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "version", g_variant_new_int32 (1));
+  g_variant_builder_add (&builder, "{sv}", "image-size", g_variant_new_uint64 (manifest->image_size));
+  g_variant_builder_add (&builder, "{sv}", "chunk-size", g_variant_new_uint64 (manifest->chunk_size));
+  g_variant_builder_add (&builder, "{sv}", "digests",
+                         g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                                    manifest->digests,
+                                                    ((gsize) manifest->num_chunks) * GDU_IMAGE_MANIFEST_DIGEST_SIZE,
+                                                    sizeof (guint8)));
+  value = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  if (!g_file_set_contents (filename,
+                            g_variant_get_data (value),
+                            g_variant_get_size (value),
+                            error))
+    goto out;
+
+  ret = TRUE;
+
+ out:
+  if (value != NULL)
+    g_variant_unref (value);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+guint64
+gdu_image_manifest_get_image_size (GduImageManifest *manifest)
+{
+  return manifest->image_size;
+}
+
+gsize
+gdu_image_manifest_get_chunk_size (GduImageManifest *manifest)
+{
+  return manifest->chunk_size;
+}
+
+guint
+gdu_image_manifest_get_num_chunks (GduImageManifest *manifest)
+{
+  return manifest->num_chunks;
+}
+
+gboolean
+gdu_image_manifest_is_complete (GduImageManifest *manifest)
+{
+  guint n;
+  for (n = 0; n < manifest->num_chunks; n++)
+    {
+      if (!manifest->have_digest[n])
+        return FALSE;
+    }
+  return TRUE;
+}
+
+/* Used when the size of the image isn't known in advance - @image_size must not exceed the current size */
+void
+gdu_image_manifest_truncate (GduImageManifest *manifest,
+                             guint64           image_size)
+{
+  g_return_if_fail (image_size <= manifest->image_size);
+  manifest->image_size = image_size;
+  /* can't fail since there are no more chunks than before */
+  get_num_chunks (image_size, manifest->chunk_size, &manifest->num_chunks);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+compute_digest (const guchar *data,
+                gsize         size,
+                guint8       *out_digest)
+{
+  GChecksum *checksum;
+  gsize digest_len = GDU_IMAGE_MANIFEST_DIGEST_SIZE;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, data, size);
+  g_checksum_get_digest (checksum, out_digest, &digest_len);
+  g_checksum_free (checksum);
+  g_warn_if_fail (digest_len == GDU_IMAGE_MANIFEST_DIGEST_SIZE);
+}
+
+void
+gdu_image_manifest_set_chunk (GduImageManifest *manifest,
+                              guint             index,
+                              const guchar     *data,
+                              gsize             size)
+{
+  g_return_if_fail (index < manifest->num_chunks);
+  compute_digest (data, size, manifest->digests + index * GDU_IMAGE_MANIFEST_DIGEST_SIZE);
+  manifest->have_digest[index] = 1;
+}
+
+gboolean
+gdu_image_manifest_has_chunk (GduImageManifest *manifest,
+                              guint             index)
+{
+  g_return_val_if_fail (index < manifest->num_chunks, FALSE);
+  return manifest->have_digest[index] != 0;
+}
+
+/* returns FALSE if the chunk doesn't match or if no digest is known for the chunk */
+gboolean
+gdu_image_manifest_check_chunk (GduImageManifest *manifest,
+                                guint             index,
+                                const guchar     *data,
+                                gsize             size)
+{
+  guint8 digest[GDU_IMAGE_MANIFEST_DIGEST_SIZE];
+
+  g_return_val_if_fail (index < manifest->num_chunks, FALSE);
+
+  if (!manifest->have_digest[index])
+    return FALSE;
+
+  compute_digest (data, size, digest);
+  return memcmp (digest, manifest->digests + index * GDU_IMAGE_MANIFEST_DIGEST_SIZE,
+                 GDU_IMAGE_MANIFEST_DIGEST_SIZE) == 0;
+}
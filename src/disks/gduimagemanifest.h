@@ -0,0 +1,52 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_IMAGE_MANIFEST_H__
+#define __GDU_IMAGE_MANIFEST_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* SHA-256 */
+#define GDU_IMAGE_MANIFEST_DIGEST_SIZE 32
+
+GduImageManifest *gdu_image_manifest_new                   (guint64            image_size,
+                                                            gsize              chunk_size);
+void              gdu_image_manifest_free                  (GduImageManifest  *manifest);
+
+gchar            *gdu_image_manifest_get_filename_for_image (GFile            *image_file);
+GduImageManifest *gdu_image_manifest_load                  (const gchar       *filename,
+                                                            GError           **error);
+gboolean          gdu_image_manifest_save                  (GduImageManifest  *manifest,
+                                                            const gchar       *filename,
+                                                            GError           **error);
+
+guint64           gdu_image_manifest_get_image_size        (GduImageManifest  *manifest);
+gsize             gdu_image_manifest_get_chunk_size        (GduImageManifest  *manifest);
+guint             gdu_image_manifest_get_num_chunks        (GduImageManifest  *manifest);
+gboolean          gdu_image_manifest_is_complete           (GduImageManifest  *manifest);
+void              gdu_image_manifest_truncate              (GduImageManifest  *manifest,
+                                                            guint64            image_size);
+
+void              gdu_image_manifest_set_chunk             (GduImageManifest  *manifest,
+                                                            guint              index,
+                                                            const guchar      *data,
+                                                            gsize              size);
+gboolean          gdu_image_manifest_has_chunk             (GduImageManifest  *manifest,
+                                                            guint              index);
+gboolean          gdu_image_manifest_check_chunk           (GduImageManifest  *manifest,
+                                                            guint              index,
+                                                            const guchar      *data,
+                                                            gsize              size);
+
+G_END_DECLS
+
+#endif /* __GDU_IMAGE_MANIFEST_H__ */
@@ -0,0 +1,596 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gduimageprobe.h"
+#include "gducompression.h"
+#include "gduvirtualdisk.h"
+
+/* Finds out what is in a disk image - the partition table, and the
+ * filesystem in each partition - without setting up a loop device.
+ * Only the partition table and the superblocks are read.
+ *
+ * Compressed images can only be read from the start. The first
+ * HEAD_SIZE bytes, where partition tables are, are kept so they can
+ * be read in any order. Beyond that, the image is decompressed up to
+ * what is read next - which is why superblocks are probed in the
+ * order they are in - but not beyond MAX_DECOMPRESSED_SIZE bytes;
+ * filesystems in partitions further in are not recognized.
+ */
+
+#define HEAD_SIZE (4 * 1024 * 1024)
+#define MAX_DECOMPRESSED_SIZE (G_GUINT64_CONSTANT (1024) * 1024 * 1024)
+
+/* enough for all superblocks we look at, the btrfs one at 64 KiB being the furthest away */
+#define SUPERBLOCK_AREA_SIZE (68 * 1024)
+
+/* limits for what we are willing to believe a partition table says */
+#define MAX_GPT_ENTRIES 1024
+#define MAX_LOGICAL_PARTITIONS 128
+
+typedef struct
+{
+  GInputStream *stream;          /* for raw images */
+  GduVirtualDisk *virtual_disk;  /* for virtual disk images */
+  guchar *head;                  /* for compressed images */
+  gsize head_size;
+  GInputStream *decompressed_stream;  /* NULL once the end or an error was reached */
+  guint64 decompressed_pos;
+  GCancellable *cancellable;
+} Reader;
+
+/* Reads from the decompressed stream, which can't go backwards */
+static gsize
+reader_read_forward (Reader  *reader,
+                     guint64  offset,
+                     guchar  *buf,
+                     gsize    size)
+{
+  gsize ret = 0;
+
+  if (reader->decompressed_stream == NULL ||
+      offset < reader->decompressed_pos ||
+      offset >= MAX_DECOMPRESSED_SIZE)
+    goto out;
+  size = MIN (size, MAX_DECOMPRESSED_SIZE - offset);
+
+  while (reader->decompressed_pos < offset)
+    {
+      gssize num_skipped;
+
+      num_skipped = g_input_stream_skip (reader->decompressed_stream,
+                                         MIN (offset - reader->decompressed_pos, G_MAXSSIZE),
+                                         reader->cancellable,
+                                         NULL);
+      if (num_skipped <= 0)
+        goto fail;
+      reader->decompressed_pos += num_skipped;
+    }
+
+  if (!g_input_stream_read_all (reader->decompressed_stream, buf, size, &ret, reader->cancellable, NULL) ||
+      ret < size)
+    {
+      /* what was read before the error or the end is still good */
+      reader->decompressed_pos += ret;
+      goto fail;
+    }
+  reader->decompressed_pos += ret;
+
+ out:
+  return ret;
+
+ fail:
+  g_clear_object (&reader->decompressed_stream);
+  goto out;
+}
+
+/* returns the number of bytes read, which is less than @size only at the end of what can be read */
+static gsize
+reader_read (Reader  *reader,
+             guint64  offset,
+             guchar  *buf,
+             gsize    size)
+{
+  gsize ret = 0;
+
+  if (reader->virtual_disk != NULL)
+    {
+      guint64 disk_size = gdu_virtual_disk_get_size (reader->virtual_disk);
+      if (offset >= disk_size)
+        goto out;
+      size = MIN (size, disk_size - offset);
+      if (gdu_virtual_disk_read (reader->virtual_disk, offset, buf, size, NULL, reader->cancellable, NULL))
+        ret = size;
+    }
+  else if (reader->head != NULL)
+    {
+      if (offset < reader->head_size)
+        {
+          ret = MIN (size, reader->head_size - offset);
+          memcpy (buf, reader->head + offset, ret);
+        }
+      if (ret < size)
+        ret += reader_read_forward (reader, offset + ret, buf + ret, size - ret);
+    }
+  else
+    {
+      if (!g_seekable_seek (G_SEEKABLE (reader->stream), offset, G_SEEK_SET, reader->cancellable, NULL))
+        goto out;
+      if (!g_input_stream_read_all (reader->stream, buf, size, &ret, reader->cancellable, NULL))
+        ret = 0;
+    }
+
+ out:
+  return ret;
+}
+
+static gboolean
+reader_open (Reader                *reader,
+             GFile                 *file,
+             GduVirtualDiskFormat   virtual_disk_format,
+             GduCompressionType     compression,
+             GCancellable          *cancellable,
+             GError               **error)
+{
+  gboolean ret = FALSE;
+  GConverter *decompressor;
+
+  memset (reader, 0, sizeof (Reader));
+  reader->cancellable = cancellable;
+
+  if (virtual_disk_format != GDU_VIRTUAL_DISK_FORMAT_NONE)
+    {
+      reader->virtual_disk = gdu_virtual_disk_open (file, cancellable, error);
+      ret = reader->virtual_disk != NULL;
+      goto out;
+    }
+
+  reader->stream = (GInputStream *) g_file_read (file, cancellable, error);
+  if (reader->stream == NULL)
+    goto out;
+
+  if (compression != GDU_COMPRESSION_TYPE_NONE)
+    {
+      decompressor = gdu_compression_new_decompressor (compression);
+      if (decompressor == NULL)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                       "Decompressing %s is not supported",
+                       gdu_compression_get_name (compression));
+          goto out;
+        }
+      reader->decompressed_stream = g_converter_input_stream_new (reader->stream, decompressor);
+      g_object_unref (decompressor);
+      g_clear_object (&reader->stream);
+
+      reader->head = g_malloc (HEAD_SIZE);
+      /* a truncated image is still worth looking at */
+      if (!g_input_stream_read_all (reader->decompressed_stream, reader->head, HEAD_SIZE, &reader->head_size,
+                                    cancellable, NULL) ||
+          reader->head_size < HEAD_SIZE)
+        {
+          g_clear_object (&reader->decompressed_stream);
+          if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            goto out;
+        }
+      reader->decompressed_pos = reader->head_size;
+    }
+
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+static void
+reader_close (Reader *reader)
+{
+  g_clear_object (&reader->stream);
+  g_clear_object (&reader->decompressed_stream);
+  gdu_virtual_disk_free (reader->virtual_disk);
+  g_free (reader->head);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static guint32
+get_le32 (const guchar *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | ((guint32) p[3]) << 24;
+}
+
+static guint64
+get_le64 (const guchar *p)
+{
+  return get_le32 (p) | ((guint64) get_le32 (p + 4)) << 32;
+}
+
+static gboolean
+has_magic (const guchar *buf,
+           gsize         size,
+           gsize         offset,
+           const gchar  *magic,
+           gsize         magic_size)
+{
+  return offset + magic_size <= size && memcmp (buf + offset, magic, magic_size) == 0;
+}
+
+/* Sets *out_usage and *out_type to static strings, or NULL if nothing is recognized */
+static void
+probe_superblocks (Reader        *reader,
+                   guint64        offset,
+                   guint64        size,
+                   const gchar  **out_usage,
+                   const gchar  **out_type)
+{
+  const gchar *usage = NULL;
+  const gchar *type = NULL;
+  guchar *buf;
+  gsize len;
+
+  buf = g_malloc (SUPERBLOCK_AREA_SIZE);
+  len = reader_read (reader, offset, buf, MIN (size, SUPERBLOCK_AREA_SIZE));
+
+  if (has_magic (buf, len, 0, "LUKS\xba\xbe", 6))
+    {
+      usage = "crypto";
+      type = "crypto_LUKS";
+    }
+  else if (has_magic (buf, len, 0, "XFSB", 4))
+    {
+      usage = "filesystem";
+      type = "xfs";
+    }
+  else if (has_magic (buf, len, 0, "hsqs", 4))
+    {
+      usage = "filesystem";
+      type = "squashfs";
+    }
+  else if (has_magic (buf, len, 3, "NTFS    ", 8))
+    {
+      usage = "filesystem";
+      type = "ntfs";
+    }
+  else if (has_magic (buf, len, 3, "EXFAT   ", 8))
+    {
+      usage = "filesystem";
+      type = "exfat";
+    }
+  else if (len >= 1024 + 100 && has_magic (buf, len, 1024 + 56, "\x53\xef", 2))
+    {
+      guint32 compat = get_le32 (buf + 1024 + 92);
+      guint32 incompat = get_le32 (buf + 1024 + 96);
+
+      usage = "filesystem";
+      /* extents, 64bit or flex_bg */
+      if (incompat & (0x0040 | 0x0080 | 0x0200))
+        type = "ext4";
+      /* has_journal */
+      else if (compat & 0x0004)
+        type = "ext3";
+      else
+        type = "ext2";
+    }
+  else if (len >= 1028 && get_le32 (buf + 1024) == 0xf2f52010)
+    {
+      usage = "filesystem";
+      type = "f2fs";
+    }
+  else if (has_magic (buf, len, 65536 + 64, "_BHRfS_M", 8))
+    {
+      usage = "filesystem";
+      type = "btrfs";
+    }
+  else if (has_magic (buf, len, 32769, "CD001", 5))
+    {
+      usage = "filesystem";
+      type = "iso9660";
+    }
+  else if (has_magic (buf, len, 4096 - 10, "SWAPSPACE2", 10) ||
+           has_magic (buf, len, 4096 - 10, "SWAP-SPACE", 10))
+    {
+      usage = "other";
+      type = "swap";
+    }
+  else if (has_magic (buf, len, 512, "LABELONE", 8) && has_magic (buf, len, 512 + 24, "LVM2 001", 8))
+    {
+      usage = "raid";
+      type = "LVM2_member";
+    }
+  /* md superblock version 1.1 is at the start, version 1.2 at 4 KiB */
+  else if ((len >= 4 && get_le32 (buf) == 0xa92b4efc) ||
+           (len >= 4096 + 4 && get_le32 (buf + 4096) == 0xa92b4efc))
+    {
+      usage = "raid";
+      type = "linux_raid_member";
+    }
+  else if (has_magic (buf, len, 510, "\x55\xaa", 2) &&
+           (has_magic (buf, len, 54, "FAT1", 4) || has_magic (buf, len, 82, "FAT32   ", 8)))
+    {
+      usage = "filesystem";
+      type = "vfat";
+    }
+
+  g_free (buf);
+  *out_usage = usage;
+  *out_type = type;
+}
+
+static void
+add_partition (GArray  *partitions,
+               guint    number,
+               guint64  offset,
+               guint64  size)
+{
+  GduImagePartition partition;
+
+  memset (&partition, 0, sizeof (GduImagePartition));
+  partition.number = number;
+  partition.offset = offset;
+  partition.size = size;
+  g_array_append_val (partitions, partition);
+}
+
+static gboolean
+probe_gpt (Reader       *reader,
+           const guchar *buf,
+           gsize         size,
+           GArray       *partitions)
+{
+  guint sector_size;
+  guint n;
+
+  /* the GPT header is in the second sector */
+  for (sector_size = 512; sector_size <= 4096; sector_size *= 8)
+    {
+      guint64 entries_lba;
+      guint32 num_entries;
+      guint32 entry_size;
+      guchar *entries;
+      gsize entries_len;
+
+      if (!has_magic (buf, size, sector_size, "EFI PART", 8) || 2 * sector_size > size)
+        continue;
+
+      entries_lba = get_le64 (buf + sector_size + 72);
+      num_entries = MIN (get_le32 (buf + sector_size + 80), MAX_GPT_ENTRIES);
+      entry_size = get_le32 (buf + sector_size + 84);
+      if (entry_size < 128 || entry_size > 4096)
+        continue;
+
+      entries = g_malloc (num_entries * entry_size);
+      entries_len = reader_read (reader, entries_lba * sector_size, entries, num_entries * entry_size);
+      for (n = 0; n < num_entries && (n + 1) * entry_size <= entries_len; n++)
+        {
+          const guchar *entry = entries + n * entry_size;
+          guint64 first_lba;
+          guint64 last_lba;
+          guint m;
+
+          /* unused entries have an all-zero partition type GUID */
+          for (m = 0; m < 16 && entry[m] == 0; m++)
+            ;
+          if (m == 16)
+            continue;
+
+          first_lba = get_le64 (entry + 32);
+          last_lba = get_le64 (entry + 40);
+          if (last_lba < first_lba)
+            continue;
+          add_partition (partitions, n + 1, first_lba * sector_size, (last_lba - first_lba + 1) * sector_size);
+        }
+      g_free (entries);
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+probe_logical_partitions (Reader  *reader,
+                          guint64  extended_lba,
+                          GArray  *partitions)
+{
+  guint64 ebr_lba = extended_lba;
+  guint n;
+
+  for (n = 0; n < MAX_LOGICAL_PARTITIONS; n++)
+    {
+      guchar ebr[512];
+      const guchar *entry;
+      const guchar *next;
+
+      if (reader_read (reader, ebr_lba * 512, ebr, 512) != 512 || ebr[510] != 0x55 || ebr[511] != 0xaa)
+        break;
+
+      /* the first entry is relative to the EBR, the second links to the next EBR */
+      entry = ebr + 446;
+      next = ebr + 462;
+      if (entry[4] != 0x00)
+        add_partition (partitions, 5 + n,
+                       (ebr_lba + get_le32 (entry + 8)) * 512,
+                       ((guint64) get_le32 (entry + 12)) * 512);
+      if (next[4] == 0x00 || get_le32 (next + 8) == 0)
+        break;
+      ebr_lba = extended_lba + get_le32 (next + 8);
+    }
+}
+
+static gboolean
+probe_mbr (Reader       *reader,
+           const guchar *buf,
+           gsize         size,
+           GArray       *partitions)
+{
+  guint num_used = 0;
+  guint n;
+
+  if (!has_magic (buf, size, 510, "\x55\xaa", 2))
+    return FALSE;
+
+  /* FAT and NTFS boot sectors also end with 0x55 0xaa - those don't have valid boot indicators */
+  for (n = 0; n < 4; n++)
+    {
+      const guchar *entry = buf + 446 + n * 16;
+      if (entry[0] != 0x00 && entry[0] != 0x80)
+        return FALSE;
+      if (entry[4] != 0x00)
+        num_used++;
+    }
+  if (num_used == 0)
+    return FALSE;
+
+  for (n = 0; n < 4; n++)
+    {
+      const guchar *entry = buf + 446 + n * 16;
+      guint8 type = entry[4];
+
+      if (type == 0x00)
+        continue;
+      if (type == 0x05 || type == 0x0f || type == 0x85)
+        probe_logical_partitions (reader, get_le32 (entry + 8), partitions);
+      else
+        add_partition (partitions, n + 1,
+                       ((guint64) get_le32 (entry + 8)) * 512,
+                       ((guint64) get_le32 (entry + 12)) * 512);
+    }
+  return TRUE;
+}
+
+static gint
+compare_partition_offsets (gconstpointer a,
+                           gconstpointer b)
+{
+  const GduImagePartition *pa = *((GduImagePartition **) a);
+  const GduImagePartition *pb = *((GduImagePartition **) b);
+
+  if (pa->offset < pb->offset)
+    return -1;
+  if (pa->offset > pb->offset)
+    return 1;
+  return 0;
+}
+
+/**
+ * gdu_image_probe_layout:
+ *
+ * Finds out what is in the disk image @file. May block.
+ *
+ * Returns: A #GduImageLayout to be freed with gdu_image_layout_free()
+ * or %NULL if @error is set.
+ */
+GduImageLayout *
+gdu_image_probe_layout (GFile                 *file,
+                        GduVirtualDiskFormat   virtual_disk_format,
+                        GduCompressionType     compression,
+                        GCancellable          *cancellable,
+                        GError               **error)
+{
+  GduImageLayout *ret = NULL;
+  Reader reader;
+  guchar buf[8192];
+  gsize len;
+  GArray *partitions = NULL;
+  GPtrArray *sorted;
+  const gchar *usage;
+  const gchar *type;
+  guint n;
+
+  if (!reader_open (&reader, file, virtual_disk_format, compression, cancellable, error))
+    goto out;
+
+  ret = g_new0 (GduImageLayout, 1);
+  partitions = g_array_new (FALSE, FALSE, sizeof (GduImagePartition));
+
+  len = reader_read (&reader, 0, buf, sizeof buf);
+  if (probe_gpt (&reader, buf, len, partitions))
+    {
+      ret->partition_table = g_strdup ("gpt");
+    }
+  else if (probe_mbr (&reader, buf, len, partitions))
+    {
+      ret->partition_table = g_strdup ("dos");
+    }
+  else
+    {
+      probe_superblocks (&reader, 0, G_MAXUINT64, &usage, &type);
+      ret->usage = g_strdup (usage);
+      ret->type = g_strdup (type);
+    }
+
+  /* in the order they are in the image, see reader_read_forward() */
+  sorted = g_ptr_array_new ();
+  for (n = 0; n < partitions->len; n++)
+    g_ptr_array_add (sorted, &g_array_index (partitions, GduImagePartition, n));
+  g_ptr_array_sort (sorted, compare_partition_offsets);
+  for (n = 0; n < sorted->len; n++)
+    {
+      GduImagePartition *partition = sorted->pdata[n];
+      probe_superblocks (&reader, partition->offset, partition->size, &usage, &type);
+      partition->usage = g_strdup (usage);
+      partition->type = g_strdup (type);
+    }
+  g_ptr_array_unref (sorted);
+
+  ret->num_partitions = partitions->len;
+  ret->partitions = (GduImagePartition *) g_array_free (partitions, FALSE);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+      gdu_image_layout_free (ret);
+      ret = NULL;
+    }
+
+ out:
+  reader_close (&reader);
+  return ret;
+}
+
+GduImageLayout *
+gdu_image_layout_copy (GduImageLayout *layout)
+{
+  GduImageLayout *ret;
+  guint n;
+
+  ret = g_new0 (GduImageLayout, 1);
+  ret->partition_table = g_strdup (layout->partition_table);
+  ret->usage = g_strdup (layout->usage);
+  ret->type = g_strdup (layout->type);
+  ret->num_partitions = layout->num_partitions;
+  ret->partitions = g_new0 (GduImagePartition, layout->num_partitions);
+  for (n = 0; n < layout->num_partitions; n++)
+    {
+      ret->partitions[n] = layout->partitions[n];
+      ret->partitions[n].usage = g_strdup (layout->partitions[n].usage);
+      ret->partitions[n].type = g_strdup (layout->partitions[n].type);
+    }
+  return ret;
+}
+
+void
+gdu_image_layout_free (GduImageLayout *layout)
+{
+  guint n;
+
+  if (layout == NULL)
+    return;
+  for (n = 0; n < layout->num_partitions; n++)
+    {
+      g_free (layout->partitions[n].usage);
+      g_free (layout->partitions[n].type);
+    }
+  g_free (layout->partitions);
+  g_free (layout->partition_table);
+  g_free (layout->usage);
+  g_free (layout->type);
+  g_free (layout);
+}
@@ -0,0 +1,52 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_IMAGE_PROBE_H__
+#define __GDU_IMAGE_PROBE_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* The usage and type of a filesystem (or other content) use the same
+ * names as the IdUsage and IdType properties in udisks, e.g. "filesystem"
+ * and "ext4", and are NULL if not recognized.
+ */
+
+struct GduImagePartition
+{
+  guint     number;
+  guint64   offset;
+  guint64   size;
+  gchar    *usage;
+  gchar    *type;
+};
+
+struct GduImageLayout
+{
+  gchar              *partition_table;  /* "dos" or "gpt", NULL if there is none */
+  GduImagePartition  *partitions;
+  guint               num_partitions;
+  gchar              *usage;            /* of the whole image, only set if there is no partition table */
+  gchar              *type;
+};
+
+GduImageLayout  *gdu_image_probe_layout  (GFile                 *file,
+                                          GduVirtualDiskFormat   virtual_disk_format,
+                                          GduCompressionType     compression,
+                                          GCancellable          *cancellable,
+                                          GError               **error);
+
+GduImageLayout  *gdu_image_layout_copy   (GduImageLayout        *layout);
+void             gdu_image_layout_free   (GduImageLayout        *layout);
+
+G_END_DECLS
+
+#endif /* __GDU_IMAGE_PROBE_H__ */
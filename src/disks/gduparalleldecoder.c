@@ -0,0 +1,445 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "gduparalleldecoder.h"
+
+/* Decodes a compressed stream on a pool of threads and returns the
+ * output in order. This is for formats whose streams consist of parts
+ * that can be decoded on their own - the members of a multi-member
+ * gzip file or the blocks of a bzip2 file.
+ *
+ * The feed() function of the format splits the input into units as
+ * it arrives. An independent unit is decoded right away but only
+ * speculatively: where it starts is found by looking for magic bytes
+ * that may also occur in compressed data. So its output is only used
+ * once the unit before it has been decoded and turned out to end
+ * right where it starts. Only then does the unit know it starts after
+ * the end of the one before, and promote() is called to tell it - if
+ * it already failed to decode, it may be decoded again. If the first
+ * unit can't be decoded on its own, join() is called to make the next
+ * unit continue where it left off. Units that aren't independent are
+ * only ever decoded that way or after promote().
+ *
+ * Once the output of a unit reaches output_limit bytes, decoding it
+ * pauses until its output has been read. That way data compressing
+ * extremely well, e.g. zeroes, doesn't use up all memory.
+ */
+
+/* Don't use more threads than this */
+#define MAX_THREADS 8
+
+typedef struct
+{
+  GduParallelDecoder *decoder;
+  gpointer data;
+
+  /* must hold decoder->lock when reading/writing these - the output
+   * is only touched by the pool thread while queued is TRUE
+   */
+  gboolean queued;
+  gboolean has_result;
+  GduParallelDecoderResult result;
+  GError *error;
+  GByteArray *output;
+  gsize output_pos;
+  gboolean emitted;
+  /* the unit before ended right where this one starts but it was decoded before that was known */
+  gboolean promoted;
+
+  volatile gint cancelled;
+} Unit;
+
+struct GduParallelDecoder
+{
+  const GduParallelDecoderFuncs *funcs;
+  gpointer user_data;
+  gsize output_limit;
+  guint max_units;
+  GThreadPool *pool;
+
+  GMutex lock;
+  GCond cond;
+  GQueue units; /* in stream order, output is read from the first one */
+  gboolean input_ended;
+  gboolean finished;
+  GError *error;
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+unit_free (Unit *unit)
+{
+  unit->decoder->funcs->free (unit->data);
+  g_byte_array_unref (unit->output);
+  g_clear_error (&unit->error);
+  g_free (unit);
+}
+
+/* must hold decoder->lock */
+static void
+unit_push_locked (Unit *unit)
+{
+  g_byte_array_set_size (unit->output, 0);
+  unit->output_pos = 0;
+  g_clear_error (&unit->error);
+  unit->has_result = FALSE;
+  unit->queued = TRUE;
+  g_atomic_int_set (&unit->cancelled, 0);
+  g_thread_pool_push (unit->decoder->pool, unit, NULL);
+}
+
+static void
+pool_func (gpointer task_data,
+           gpointer user_data)
+{
+  Unit *unit = task_data;
+  GduParallelDecoder *decoder = user_data;
+  GduParallelDecoderResult result;
+  GError *error = NULL;
+
+  result = decoder->funcs->decode (unit->data,
+                                   unit->output,
+                                   decoder->output_limit,
+                                   &unit->cancelled,
+                                   &error);
+
+  g_mutex_lock (&decoder->lock);
+  unit->result = result;
+  unit->error = error;
+  unit->has_result = TRUE;
+  unit->queued = FALSE;
+  g_cond_broadcast (&decoder->cond);
+  g_mutex_unlock (&decoder->lock);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * gdu_parallel_decoder_new:
+ * @funcs: The functions for the format.
+ * @user_data: User data passed to @funcs->feed.
+ * @output_limit: How much output to buffer for each unit at most.
+ *
+ * Creates a new decoder. The functions in @funcs, except for feed(),
+ * are called with the data passed to gdu_parallel_decoder_add_unit().
+ *
+ * Returns: A #GduParallelDecoder. Free with gdu_parallel_decoder_free().
+ */
+GduParallelDecoder *
+gdu_parallel_decoder_new (const GduParallelDecoderFuncs *funcs,
+                          gpointer                       user_data,
+                          gsize                          output_limit)
+{
+  GduParallelDecoder *decoder;
+  glong num_threads;
+
+  num_threads = sysconf (_SC_NPROCESSORS_ONLN);
+  num_threads = CLAMP (num_threads, 1, MAX_THREADS);
+
+  decoder = g_new0 (GduParallelDecoder, 1);
+  decoder->funcs = funcs;
+  decoder->user_data = user_data;
+  decoder->output_limit = output_limit;
+  /* enough to keep all threads busy while the output of the first unit is being read */
+  decoder->max_units = 2 * num_threads;
+  g_mutex_init (&decoder->lock);
+  g_cond_init (&decoder->cond);
+  g_queue_init (&decoder->units);
+  decoder->pool = g_thread_pool_new (pool_func,
+                                     decoder,
+                                     num_threads,
+                                     FALSE, /* exclusive */
+                                     NULL); /* GError */
+  return decoder;
+}
+
+void
+gdu_parallel_decoder_free (GduParallelDecoder *decoder)
+{
+  Unit *unit;
+  GList *l;
+
+  if (decoder == NULL)
+    return;
+
+  g_mutex_lock (&decoder->lock);
+  for (l = decoder->units.head; l != NULL; l = l->next)
+    g_atomic_int_set (&((Unit *) l->data)->cancelled, 1);
+  g_mutex_unlock (&decoder->lock);
+
+  /* drops the units not started yet and waits for the others */
+  g_thread_pool_free (decoder->pool, TRUE, TRUE);
+
+  while ((unit = g_queue_pop_head (&decoder->units)) != NULL)
+    unit_free (unit);
+  g_clear_error (&decoder->error);
+  g_cond_clear (&decoder->cond);
+  g_mutex_clear (&decoder->lock);
+  g_free (decoder);
+}
+
+/**
+ * gdu_parallel_decoder_add_unit:
+ * @decoder: A #GduParallelDecoder.
+ * @unit_data: The data of the unit, freed with the free() function of the format.
+ * @independent: Whether the unit can be decoded before the one before it.
+ *
+ * Adds a unit after the ones added so far. Called from the feed()
+ * function of the format.
+ */
+void
+gdu_parallel_decoder_add_unit (GduParallelDecoder *decoder,
+                               gpointer            unit_data,
+                               gboolean            independent)
+{
+  Unit *unit;
+
+  unit = g_new0 (Unit, 1);
+  unit->decoder = decoder;
+  unit->data = unit_data;
+  unit->output = g_byte_array_new ();
+
+  g_mutex_lock (&decoder->lock);
+  g_queue_push_tail (&decoder->units, unit);
+  if (independent)
+    unit_push_locked (unit);
+  g_mutex_unlock (&decoder->lock);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Returns the number of bytes put in @buffer or 0 if there is no
+ * output because the end has been reached, more input is needed or,
+ * unless @block is TRUE, the first unit hasn't been decoded yet.
+ *
+ * Must hold decoder->lock.
+ */
+static gssize
+read_locked (GduParallelDecoder  *decoder,
+             guchar              *buffer,
+             gsize                size,
+             gboolean             block,
+             GError             **error)
+{
+  while (TRUE)
+    {
+      Unit *head;
+      Unit *next;
+      gsize num_bytes;
+
+      if (decoder->error != NULL)
+        {
+          g_propagate_error (error, g_error_copy (decoder->error));
+          return -1;
+        }
+      if (decoder->finished)
+        return 0;
+
+      head = g_queue_peek_head (&decoder->units);
+      if (head == NULL)
+        {
+          if (decoder->input_ended)
+            decoder->finished = TRUE;
+          return 0;
+        }
+
+      if (head->promoted && head->has_result)
+        {
+          head->promoted = FALSE;
+          if (head->result == GDU_PARALLEL_DECODER_RESULT_ERROR && decoder->funcs->promote (head->data))
+            {
+              unit_push_locked (head);
+              continue;
+            }
+        }
+
+      if (!head->has_result)
+        {
+          /* units that aren't independent are only decoded once they are first */
+          if (!head->queued)
+            unit_push_locked (head);
+          if (!block)
+            return 0;
+          g_cond_wait (&decoder->cond, &decoder->lock);
+          continue;
+        }
+
+      if (head->output_pos < head->output->len)
+        {
+          num_bytes = MIN (size, head->output->len - head->output_pos);
+          memcpy (buffer, head->output->data + head->output_pos, num_bytes);
+          head->output_pos += num_bytes;
+          head->emitted = TRUE;
+          return num_bytes;
+        }
+
+      switch (head->result)
+        {
+        case GDU_PARALLEL_DECODER_RESULT_DONE:
+          g_queue_pop_head (&decoder->units);
+          unit_free (head);
+          next = g_queue_peek_head (&decoder->units);
+          if (next != NULL && decoder->funcs->promote != NULL)
+            {
+              /* the unit data is only touched by the pool thread while queued */
+              if (next->queued || next->has_result)
+                next->promoted = TRUE;
+              else
+                decoder->funcs->promote (next->data);
+            }
+          break;
+
+        case GDU_PARALLEL_DECODER_RESULT_PAUSED:
+          unit_push_locked (head);
+          break;
+
+        case GDU_PARALLEL_DECODER_RESULT_TRAILING_GARBAGE:
+          decoder->finished = TRUE;
+          break;
+
+        case GDU_PARALLEL_DECODER_RESULT_NEEDS_MORE:
+        case GDU_PARALLEL_DECODER_RESULT_ERROR:
+          next = g_queue_peek_nth (&decoder->units, 1);
+          if (next == NULL)
+            {
+              /* the unit may still be joined with one that is yet to be cut */
+              if (!decoder->input_ended)
+                return 0;
+              if (head->result == GDU_PARALLEL_DECODER_RESULT_ERROR)
+                decoder->error = g_error_copy (head->error);
+              else
+                decoder->error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                                                      _("Need more input"));
+              break;
+            }
+
+          /* whatever the next unit was decoded to is of no use */
+          g_atomic_int_set (&next->cancelled, 1);
+          while (next->queued)
+            g_cond_wait (&decoder->cond, &decoder->lock);
+
+          if (!decoder->funcs->join (head->data, next->data, head->result, head->emitted))
+            {
+              if (head->error != NULL)
+                decoder->error = g_error_copy (head->error);
+              else
+                decoder->error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                                                      _("Invalid compressed data"));
+              break;
+            }
+          g_queue_pop_head (&decoder->units);
+          unit_free (head);
+          unit_push_locked (next);
+          break;
+        }
+    }
+}
+
+/**
+ * gdu_parallel_decoder_convert:
+ * @decoder: A #GduParallelDecoder.
+ *
+ * Implements g_converter_convert() for the decompressor @decoder
+ * belongs to. Hands the input to the feed() function of the format
+ * and returns the output in order, blocking only if there is enough
+ * input being decoded already.
+ *
+ * Returns: A #GConverterResult.
+ */
+GConverterResult
+gdu_parallel_decoder_convert (GduParallelDecoder  *decoder,
+                              const void          *inbuf,
+                              gsize                inbuf_size,
+                              void                *outbuf,
+                              gsize                outbuf_size,
+                              GConverterFlags      flags,
+                              gsize               *bytes_read,
+                              gsize               *bytes_written,
+                              GError             **error)
+{
+  gboolean at_end = (flags & G_CONVERTER_INPUT_AT_END) != 0;
+  gboolean finished;
+  gboolean wants_input;
+  gssize num_bytes;
+
+  *bytes_read = 0;
+  *bytes_written = 0;
+
+  /* output that is ready comes first */
+  g_mutex_lock (&decoder->lock);
+  num_bytes = read_locked (decoder, outbuf, outbuf_size, FALSE, error);
+  finished = decoder->finished;
+  wants_input = !decoder->input_ended && g_queue_get_length (&decoder->units) < decoder->max_units;
+  g_mutex_unlock (&decoder->lock);
+
+  if (num_bytes < 0)
+    return G_CONVERTER_ERROR;
+  if (num_bytes > 0)
+    {
+      *bytes_written = num_bytes;
+      return G_CONVERTER_CONVERTED;
+    }
+  if (finished)
+    {
+      /* only trailing garbage is left, if anything */
+      *bytes_read = inbuf_size;
+      return G_CONVERTER_FINISHED;
+    }
+
+  if (wants_input)
+    {
+      if (inbuf_size == 0 && !at_end)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                               _("Need more input"));
+          return G_CONVERTER_ERROR;
+        }
+      if (!decoder->funcs->feed (decoder->user_data, inbuf, inbuf_size, at_end, error))
+        return G_CONVERTER_ERROR;
+      *bytes_read = inbuf_size;
+      if (at_end)
+        {
+          g_mutex_lock (&decoder->lock);
+          decoder->input_ended = TRUE;
+          g_cond_broadcast (&decoder->cond);
+          g_mutex_unlock (&decoder->lock);
+        }
+      if (inbuf_size > 0)
+        return G_CONVERTER_CONVERTED;
+    }
+
+  /* enough is being decoded already (or all of it) - wait for output */
+  g_mutex_lock (&decoder->lock);
+  num_bytes = read_locked (decoder, outbuf, outbuf_size, TRUE, error);
+  finished = decoder->finished;
+  g_mutex_unlock (&decoder->lock);
+
+  if (num_bytes < 0)
+    return G_CONVERTER_ERROR;
+  if (num_bytes > 0)
+    {
+      *bytes_written = num_bytes;
+      return G_CONVERTER_CONVERTED;
+    }
+  if (finished)
+    return G_CONVERTER_FINISHED;
+
+  /* the first unit needs the input of the next one */
+  g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                       _("Need more input"));
+  return G_CONVERTER_ERROR;
+}
@@ -0,0 +1,64 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_PARALLEL_DECODER_H__
+#define __GDU_PARALLEL_DECODER_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* What a format has to provide, see gduparalleldecoder.c */
+struct GduParallelDecoderFuncs
+{
+  /* decodes a unit on a worker thread, appending to @output */
+  GduParallelDecoderResult  (*decode) (gpointer                   unit_data,
+                                       GByteArray                *output,
+                                       gsize                      output_limit,
+                                       volatile gint             *cancelled,
+                                       GError                   **error);
+  /* makes @next continue where @head, which couldn't be decoded on its own, left off */
+  gboolean                  (*join)   (gpointer                   head,
+                                       gpointer                   next,
+                                       GduParallelDecoderResult   result,
+                                       gboolean                   head_emitted);
+  void                      (*free)   (gpointer                   unit_data);
+  /* may be NULL - called when the unit before turned out to end right where this one
+   * starts, returns TRUE if an already decoded unit has to be decoded again
+   */
+  gboolean                  (*promote) (gpointer                  unit_data);
+  /* splits the input into units, @size may be 0 if @at_end is TRUE */
+  gboolean                  (*feed)   (gpointer                   user_data,
+                                       const guchar              *data,
+                                       gsize                      size,
+                                       gboolean                   at_end,
+                                       GError                   **error);
+};
+
+GduParallelDecoder *gdu_parallel_decoder_new       (const GduParallelDecoderFuncs  *funcs,
+                                                    gpointer                        user_data,
+                                                    gsize                           output_limit);
+void                gdu_parallel_decoder_free      (GduParallelDecoder             *decoder);
+void                gdu_parallel_decoder_add_unit  (GduParallelDecoder             *decoder,
+                                                    gpointer                        unit_data,
+                                                    gboolean                        independent);
+GConverterResult    gdu_parallel_decoder_convert   (GduParallelDecoder             *decoder,
+                                                    const void                     *inbuf,
+                                                    gsize                           inbuf_size,
+                                                    void                           *outbuf,
+                                                    gsize                           outbuf_size,
+                                                    GConverterFlags                 flags,
+                                                    gsize                          *bytes_read,
+                                                    gsize                          *bytes_written,
+                                                    GError                        **error);
+
+G_END_DECLS
+
+#endif /* __GDU_PARALLEL_DECODER_H__ */
@@ -9,7 +9,11 @@
 
 #include "config.h"
 
+#define _GNU_SOURCE
+#include <fcntl.h>
+
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gio/gunixfdlist.h>
 #include <gio/gunixoutputstream.h>
 
@@ -26,11 +30,66 @@
 #include "gduestimator.h"
 #include "gdulocaljob.h"
 #include "gdudevicetreemodel.h"
-#include "gduxzdecompressor.h"
+#include "gducompression.h"
+#include "gduimagemanifest.h"
+#include "gdurestorejournal.h"
+#include "gduvirtualdisk.h"
+#include "gduimagecatalog.h"
+#include "gduimageprobe.h"
+#include "gduzones.h"
+#include "gdubenchmarkdialog.h"
+
+/* Size of each chunk the disk image is read in, unless the benchmark
+ * found the targets to need bigger writes to reach full speed (see
+ * gdu_benchmark_dialog_get_transfer_size()) - then up to MAX_CHUNK_SIZE
+ */
+#define CHUNK_SIZE (1 * 1024 * 1024)
+#define MAX_CHUNK_SIZE (16 * 1024 * 1024)
+
+/* Number of chunks shared between the reader and the writers - this
+ * bounds how far the fastest target can get ahead of the slowest one
+ */
+#define NUM_CHUNKS 32
+
+/* Number of writes in flight for each target when using O_DIRECT */
+#define WRITE_QUEUE_DEPTH 4
+
+/* How often to sync the device and record progress in the restore journal */
+#define JOURNAL_INTERVAL_USEC (5 * G_USEC_PER_SEC)
+
+/* Don't use manifests with chunks bigger than this */
+#define MAX_MANIFEST_CHUNK_SIZE (64 * 1024 * 1024)
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  guint64 offset;
+  guint64 size;
+} MismatchRange;
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+typedef struct DialogData DialogData;
+
+/* What is known about the chosen disk image. Unless the image is in
+ * the catalogue, finding out involves reading from the image - which
+ * may be big and on a slow file system - so it's done in a thread, see
+ * image_info_start().
+ */
 typedef struct
+{
+  DialogData *data;  /* only set while the thread is running */
+  GduImageCatalog *catalog;
+  GFile *file;
+  GCancellable *cancellable;
+  gboolean done;
+
+  GduImageCatalogEntry *entry;  /* NULL on error */
+  gchar *error_message;  /* set if the image can't be restored */
+} ImageInfo;
+
+struct DialogData
 {
   volatile gint ref_count;
 
@@ -42,6 +101,9 @@ typedef struct
   UDisksBlock *block;
   UDisksDrive *drive;
 
+  /* only set when restoring to several devices at once */
+  GList *objects;
+
   GtkBuilder *builder;
   GtkWidget *dialog;
 
@@ -58,12 +120,18 @@ typedef struct
 
   GtkWidget *image_size_key_label;
   GtkWidget *image_size_label;
+  GtkWidget *image_contents_key_label;
+  GtkWidget *image_contents_label;
+  ImageInfo *image_info;
 
   GtkWidget *destination_key_label;
   GtkWidget *destination_label;
   GtkWidget *selectable_destination_label;
   GtkWidget *selectable_destination_combobox;
 
+  GtkWidget *verify_checkbutton;
+  GtkWidget *delta_checkbutton;
+
   GtkWidget *start_copying_button;
   GtkWidget *cancel_button;
 
@@ -72,18 +140,30 @@ typedef struct
   gint64 end_time_usec;
 
   GCancellable *cancellable;
-  GOutputStream *block_stream;
   GInputStream *input_stream;
-  guint64 input_size;
-
-  guchar *buffer;
-  guint64 total_bytes_read;
-  guint64 buffer_bytes_written;
-  guint64 buffer_bytes_to_write;
+  guint64 input_size; /* 0 if not known in advance, e.g. for gzip-compressed images */
+  /* non-NULL if restoring a virtual machine disk image, which is read from instead of input_stream */
+  GduVirtualDisk *virtual_disk;
+
+  /* array of RestoreTarget - elements are only added before the copy thread starts */
+  GPtrArray *targets;
+  GAsyncQueue *free_chunks;
+  guint num_chunks;
+  gsize chunk_size; /* what the disk image is read in, see CHUNK_SIZE */
+
+  gboolean verify;
+  gboolean delta;
+  /* TRUE once the copy thread has been started - only used on the main thread */
+  gboolean copying;
+  gchar *image_id;
+  guint64 resume_offset;
+  gchar *manifest_filename;
+  GduImageManifest *manifest;
+  gboolean manifest_from_file;
+  GThreadPool *hash_pool;
 
   /* must hold copy_lock when reading/writing these */
   GMutex copy_lock;
-  GduEstimator *estimator;
   guint update_id;
   GError *copy_error;
 
@@ -91,10 +171,78 @@ typedef struct
 
   gulong response_signal_handler_id;
   gboolean completed;
+};
 
+typedef struct RestoreChunk RestoreChunk;
+
+/* A device the disk image is being restored to */
+typedef struct
+{
+  DialogData *data;
+  UDisksObject *object;
+  UDisksBlock *block;
+  gint fd;
+  guint64 size;
+  gint logical_block_size;
+  gboolean direct_io;
+  gboolean wipe_on_error;
+  volatile gint zeroout_unsupported;
+  /* the zones of the device, NULL if it isn't zoned - then chunks are written one at a time, in order */
+  GArray *zones;
+
+  /* the writers for this target - with O_DIRECT, several chunks are written at the same time */
+  GThreadPool *writer_pool;
+  /* unaligned buffers for reading what is on the device, one per writer thread - only used for delta restores */
+  GAsyncQueue *compare_buffers;
+
+  /* without O_DIRECT, the range written before the last one - only used on the single writer thread */
+  guint64 writeback_offset;
+  gsize writeback_size;
+  gboolean writeback_unsupported;
+
+  /* for resuming an interrupted restore - journal_filename is NULL if the device can't be identified */
+  gchar *journal_device_id;
+  gchar *journal_filename;
+  guint64 resume_offset;
+  GMutex journal_lock;
+  GduRestoreJournal *journal;
+
+  /* must hold data->copy_lock when reading/writing these */
+  GduEstimator *estimator;
+  gint64 last_update_usec;
+  guint64 num_bytes_written;
+  guint64 num_bytes_skipped;
+  guint64 synced_offset; /* everything before this offset has been written */
+  GHashTable *written_chunks; /* chunk index -> size, for chunks written after synced_offset */
+  gint64 last_journal_usec;
+  gboolean verifying;
+  guint64 num_mismatch_bytes;
+  GArray *mismatches;
+  GError *error; /* non-NULL if the target has been dropped */
+
+  /* only used on the main thread */
   GduLocalJob *local_job;
-} DialogData;
+} RestoreTarget;
+
+/* A chunk of the disk image, shared between the reader, the writers
+ * for all targets and the hash pool. It is put back on the list of
+ * free chunks when the last reference is dropped.
+ */
+struct RestoreChunk
+{
+  volatile gint ref_count;
+  DialogData *data;
 
+  guchar *buffer_unaligned;
+  guchar *buffer;
+  guint64 offset;
+  gsize size;
+  guint index; /* in the manifest */
+  gboolean is_zero; /* TRUE if the chunk is unallocated in a virtual machine disk image */
+
+  /* non-NULL if the chunk was read back from a target for verification */
+  RestoreTarget *verify_target;
+};
 
 static const struct {
   goffset offset;
@@ -109,12 +257,17 @@ static const struct {
 
   {G_STRUCT_OFFSET (DialogData, image_size_key_label), "image-size-key-label"},
   {G_STRUCT_OFFSET (DialogData, image_size_label), "image-size-label"},
+  {G_STRUCT_OFFSET (DialogData, image_contents_key_label), "image-contents-key-label"},
+  {G_STRUCT_OFFSET (DialogData, image_contents_label), "image-contents-label"},
 
   {G_STRUCT_OFFSET (DialogData, destination_key_label), "destination-key-label"},
   {G_STRUCT_OFFSET (DialogData, destination_label), "destination-label"},
   {G_STRUCT_OFFSET (DialogData, selectable_destination_label), "selectable-destination-label"},
   {G_STRUCT_OFFSET (DialogData, selectable_destination_combobox), "selectable-destination-combobox"},
 
+  {G_STRUCT_OFFSET (DialogData, verify_checkbutton), "verify-checkbutton"},
+  {G_STRUCT_OFFSET (DialogData, delta_checkbutton), "delta-checkbutton"},
+
   {G_STRUCT_OFFSET (DialogData, start_copying_button), "start-copying-button"},
   {G_STRUCT_OFFSET (DialogData, cancel_button), "cancel-button"},
   {0, NULL}
@@ -122,6 +275,139 @@ static const struct {
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Returns an identifier for @object that doesn't change when the
+ * device is plugged in again, or NULL if there is none.
+ */
+static gchar *
+get_journal_device_id (DialogData   *data,
+                       UDisksObject *object)
+{
+  gchar *ret = NULL;
+  UDisksDrive *drive;
+  UDisksPartition *partition;
+
+  drive = udisks_client_get_drive_for_block (gdu_window_get_client (data->window),
+                                             udisks_object_peek_block (object));
+  if (drive == NULL || strlen (udisks_drive_get_id (drive)) == 0)
+    goto out;
+
+  partition = udisks_object_peek_partition (object);
+  if (partition != NULL)
+    ret = g_strdup_printf ("%s-part%u", udisks_drive_get_id (drive), udisks_partition_get_number (partition));
+  else
+    ret = g_strdup (udisks_drive_get_id (drive));
+
+ out:
+  g_clear_object (&drive);
+  return ret;
+}
+
+static RestoreTarget *
+restore_target_new (DialogData   *data,
+                    UDisksObject *object)
+{
+  RestoreTarget *target;
+
+  target = g_new0 (RestoreTarget, 1);
+  target->data = data;
+  target->object = g_object_ref (object);
+  target->block = udisks_object_get_block (object);
+  g_assert (target->block != NULL);
+  target->fd = -1;
+  /* A delta restore only overwrites what differs, so if it stops
+   * early the device holds its old contents with some updates -
+   * wiping it would destroy what the restore is meant to keep
+   */
+  target->wipe_on_error = !data->delta;
+  target->mismatches = g_array_new (FALSE, /* zero-terminated */
+                                    FALSE, /* clear */
+                                    sizeof (MismatchRange));
+  target->journal_device_id = get_journal_device_id (data, object);
+  if (target->journal_device_id != NULL && data->image_id != NULL)
+    target->journal_filename = gdu_restore_journal_get_filename (target->journal_device_id);
+  g_mutex_init (&target->journal_lock);
+  target->written_chunks = g_hash_table_new (g_direct_hash, g_direct_equal);
+  return target;
+}
+
+static void
+restore_target_free (RestoreTarget *target)
+{
+  /* the local job is destroyed in dialog_data_terminate_job() */
+  g_warn_if_fail (target->local_job == NULL);
+  g_warn_if_fail (target->writer_pool == NULL);
+  g_warn_if_fail (target->compare_buffers == NULL);
+  g_warn_if_fail (target->fd == -1);
+  g_clear_object (&target->object);
+  g_clear_object (&target->block);
+  g_clear_object (&target->estimator);
+  g_array_unref (target->mismatches);
+  g_clear_error (&target->error);
+  g_free (target->journal_device_id);
+  g_free (target->journal_filename);
+  gdu_restore_journal_free (target->journal);
+  g_mutex_clear (&target->journal_lock);
+  g_hash_table_unref (target->written_chunks);
+  if (target->zones != NULL)
+    g_array_unref (target->zones);
+  g_free (target);
+}
+
+/* Drops @target from the restore operation - the other targets are
+ * not affected. Takes ownership of @error.
+ */
+static void
+restore_target_fail (RestoreTarget *target,
+                     GError        *error)
+{
+  g_mutex_lock (&target->data->copy_lock);
+  if (target->error == NULL)
+    target->error = error;
+  else
+    g_error_free (error);
+  g_mutex_unlock (&target->data->copy_lock);
+}
+
+static gboolean
+restore_target_is_alive (RestoreTarget *target)
+{
+  gboolean ret;
+  g_mutex_lock (&target->data->copy_lock);
+  ret = (target->error == NULL);
+  g_mutex_unlock (&target->data->copy_lock);
+  return ret;
+}
+
+static guint
+count_alive_targets (DialogData *data)
+{
+  guint ret = 0;
+  guint n;
+
+  for (n = 0; n < data->targets->len; n++)
+    {
+      if (restore_target_is_alive (data->targets->pdata[n]))
+        ret++;
+    }
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+image_info_free (ImageInfo *info)
+{
+  if (info == NULL)
+    return;
+  g_object_unref (info->file);
+  g_object_unref (info->cancellable);
+  gdu_image_catalog_entry_free (info->entry);
+  g_free (info->error_message);
+  g_free (info);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static DialogData *
 dialog_data_ref (DialogData *data)
 {
@@ -132,10 +418,16 @@ dialog_data_ref (DialogData *data)
 static void
 dialog_data_terminate_job (DialogData *data)
 {
-  if (data->local_job != NULL)
+  guint n;
+
+  for (n = 0; n < data->targets->len; n++)
     {
-      gdu_application_destroy_local_job (gdu_window_get_application (data->window), data->local_job);
-      data->local_job = NULL;
+      RestoreTarget *target = data->targets->pdata[n];
+      if (target->local_job != NULL)
+        {
+          gdu_application_destroy_local_job (gdu_window_get_application (data->window), target->local_job);
+          target->local_job = NULL;
+        }
     }
 }
 
@@ -160,6 +452,8 @@ dialog_data_hide (DialogData *data)
         g_signal_handler_disconnect (data->dialog, data->response_signal_handler_id);
       dialog = data->dialog;
       data->dialog = NULL;
+      if (data->image_info != NULL)
+        g_cancellable_cancel (data->image_info->cancellable);
       gtk_widget_hide (dialog);
       gtk_widget_destroy (dialog);
       data->dialog = NULL;
@@ -181,15 +475,20 @@ dialog_data_unref (DialogData *data)
       g_clear_object (&data->object);
       g_clear_object (&data->block);
       g_clear_object (&data->drive);
+      g_list_free_full (data->objects, g_object_unref);
       g_free (data->disk_image_filename);
       if (data->builder != NULL)
         g_object_unref (data->builder);
-      g_free (data->buffer);
-      g_clear_object (&data->estimator);
+      g_ptr_array_unref (data->targets);
+      g_free (data->manifest_filename);
+      g_free (data->image_id);
+      gdu_image_manifest_free (data->manifest);
 
       g_clear_object (&data->cancellable);
       g_clear_object (&data->input_stream);
-      g_clear_object (&data->block_stream);
+      gdu_virtual_disk_free (data->virtual_disk);
+      /* can't still be running, it holds a reference */
+      image_info_free (data->image_info);
       g_mutex_clear (&data->copy_lock);
       g_free (data);
     }
@@ -228,6 +527,137 @@ dialog_data_complete_and_unref (DialogData *data)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void restore_disk_image_update (DialogData *data);
+
+static gboolean
+on_image_info_done (gpointer user_data)
+{
+  ImageInfo *info = user_data;
+  DialogData *data = info->data;
+
+  info->data = NULL;
+  info->done = TRUE;
+  if (data->image_info == info)
+    restore_disk_image_update (data);
+  else
+    image_info_free (info); /* another image was chosen meanwhile */
+  dialog_data_unref (data);
+  return FALSE; /* remove source */
+}
+
+static gpointer
+image_info_thread_func (gpointer user_data)
+{
+  ImageInfo *info = user_data;
+  GError *error = NULL;
+
+  info->entry = gdu_image_catalog_lookup (info->catalog, info->file, info->cancellable, &error);
+  if (info->entry == NULL)
+    {
+      info->error_message = g_strdup (error->message);
+      g_clear_error (&error);
+    }
+  else if (info->entry->compression != GDU_COMPRESSION_TYPE_NONE &&
+           !gdu_compression_is_supported (info->entry->compression))
+    {
+      /* Translators: Shown when the disk image uses a compression format support wasn't built for.
+       *              The %s is the name of the format (ex. "Zstandard").
+       */
+      info->error_message = g_strdup_printf (_("Disk images compressed with %s are not supported"),
+                                             gdu_compression_get_name (info->entry->compression));
+    }
+
+  g_idle_add (on_image_info_done, info);
+  return NULL;
+}
+
+/* Examines @file in a thread and calls restore_disk_image_update() when done */
+static void
+image_info_start (DialogData *data,
+                  GFile      *file)
+{
+  ImageInfo *info;
+
+  if (data->image_info != NULL)
+    {
+      g_cancellable_cancel (data->image_info->cancellable);
+      /* otherwise freed in on_image_info_done() */
+      if (data->image_info->done)
+        image_info_free (data->image_info);
+      data->image_info = NULL;
+    }
+
+  info = g_new0 (ImageInfo, 1);
+  info->data = dialog_data_ref (data);
+  info->catalog = gdu_application_get_image_catalog (gdu_window_get_application (data->window));
+  info->file = g_object_ref (file);
+  info->cancellable = g_cancellable_new ();
+  data->image_info = info;
+
+  g_thread_new ("examine-disk-image-thread",
+                image_info_thread_func,
+                info);
+}
+
+static gchar *
+get_contents_for_display (DialogData           *data,
+                          GduImageCatalogEntry *entry)
+{
+  UDisksClient *client = gdu_window_get_client (data->window);
+  GduImageLayout *layout = entry->layout;
+  GString *str;
+  guint n;
+
+  str = g_string_new (NULL);
+  if (layout != NULL && layout->partition_table != NULL)
+    {
+      g_string_append (str, udisks_client_get_partition_table_type_for_display (client, layout->partition_table));
+      for (n = 0; n < layout->num_partitions; n++)
+        {
+          GduImagePartition *partition = &layout->partitions[n];
+          gchar *size_str;
+          gchar *type_str;
+
+          size_str = udisks_client_get_size_for_display (client, partition->size, FALSE, FALSE);
+          if (partition->type != NULL)
+            type_str = udisks_client_get_id_for_display (client, partition->usage, partition->type, "", FALSE);
+          else
+            /* Translators: Shown for a partition in the "Contents" field if its contents are not known */
+            type_str = g_strdup (_("Unknown"));
+          g_string_append_c (str, '\n');
+          /* Translators: Describes a partition in the "Contents" field.
+           *              The %u is the partition number.
+           *              The first %s is the size (ex. "512 MB").
+           *              The second %s is the contents (ex. "FAT").
+           */
+          g_string_append_printf (str, _("Partition %u: %s, %s"), partition->number, size_str, type_str);
+          g_free (type_str);
+          g_free (size_str);
+        }
+    }
+  else if (layout != NULL && layout->type != NULL)
+    {
+      gchar *s;
+      s = udisks_client_get_id_for_display (client, layout->usage, layout->type, "", FALSE);
+      g_string_append (str, s);
+      g_free (s);
+    }
+  else
+    {
+      /* Translators: Shown in the "Contents" field if no partition table or filesystem was found */
+      g_string_append (str, _("Unknown"));
+    }
+
+  if (entry->manifest_digest != NULL)
+    {
+      g_string_append_c (str, '\n');
+      /* Translators: Shown in the "Contents" field if there are checksums to verify the disk image with */
+      g_string_append (str, _("Checksums available for verification"));
+    }
+
+  return g_string_free (str, FALSE);
+}
+
 static void
 restore_disk_image_update (DialogData *data)
 {
@@ -235,13 +665,15 @@ restore_disk_image_update (DialogData *data)
   gchar *restore_warning = NULL;
   gchar *restore_error = NULL;
   gchar *image_size_str = NULL;
+  gchar *image_contents_str = NULL;
+  gboolean size_unknown = FALSE;
   GFile *restore_file = NULL;
 
   if (data->dialog == NULL)
     goto out;
 
   /* don't update if we're already copying */
-  if (data->buffer != NULL)
+  if (data->copying)
     goto out;
 
   /* Check if we have a file */
@@ -250,42 +682,60 @@ restore_disk_image_update (DialogData *data)
   else
     restore_file = gtk_file_chooser_get_file (GTK_FILE_CHOOSER (data->selectable_image_fcbutton));
 
-  if (restore_file != NULL)
+  if (restore_file != NULL && (data->image_info == NULL || !g_file_equal (data->image_info->file, restore_file)))
+    image_info_start (data, restore_file);
+
+  if (restore_file != NULL && !data->image_info->done)
     {
-      gboolean is_xz_compressed = FALSE;
-      GFileInfo *info;
-      guint64 size;
+      /* Translators: Shown in the "Size" field while the disk image is being examined */
+      image_size_str = g_strdup (_("Determining size…"));
+    }
+  else if (restore_file != NULL)
+    {
+      ImageInfo *info = data->image_info;
+      guint64 size = 0;
       gchar *s;
 
-      info = g_file_query_info (restore_file,
-                                G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
-                                G_FILE_ATTRIBUTE_STANDARD_SIZE,
-                                G_FILE_QUERY_INFO_NONE,
-                                NULL,
-                                NULL);
-      if (g_str_has_suffix (g_file_info_get_content_type (info), "-xz-compressed"))
-        is_xz_compressed = TRUE;
-      size = g_file_info_get_size (info);
-      g_object_unref (info);
-
-      if (is_xz_compressed)
+      if (info->entry != NULL)
+        {
+          size = info->entry->size;
+          image_contents_str = get_contents_for_display (data, info->entry);
+        }
+
+      if (info->error_message != NULL)
         {
-          gsize uncompressed_size;
-          uncompressed_size = gdu_xz_decompressor_get_uncompressed_size (restore_file);
-          if (uncompressed_size == 0)
+          restore_error = g_strdup (info->error_message);
+          size = 0;
+        }
+      else if (info->entry->virtual_disk_format != GDU_VIRTUAL_DISK_FORMAT_NONE)
+        {
+          s = udisks_client_get_size_for_display (gdu_window_get_client (data->window), size, FALSE, TRUE);
+          /* Translators: Shown for a virtual machine disk image in the "Size" field.
+           *              The first %s is the size of the virtual disk as a long string, e.g. "4.2 MB (4,300,123 bytes)".
+           *              The second %s is the name of the format (ex. "QCOW2").
+           */
+          image_size_str = g_strdup_printf (_("%s (%s virtual disk)"), s,
+                                            gdu_virtual_disk_format_get_name (info->entry->virtual_disk_format));
+          g_free (s);
+        }
+      else if (info->entry->compression != GDU_COMPRESSION_TYPE_NONE)
+        {
+          if (size == 0)
             {
-              restore_error = g_strdup (_("File does not appear to be XZ compressed"));
-              size = 0;
+              /* Translators: Shown for a compressed disk image in the "Size" field if the
+               *              uncompressed size can't be determined without decompressing it.
+               */
+              image_size_str = g_strdup (_("Unknown until decompressed"));
+              size_unknown = TRUE;
             }
           else
             {
-              s = udisks_client_get_size_for_display (gdu_window_get_client (data->window), uncompressed_size, FALSE, TRUE);
+              s = udisks_client_get_size_for_display (gdu_window_get_client (data->window), size, FALSE, TRUE);
               /* Translators: Shown for a compressed disk image in the "Size" field.
                *              The %s is the uncompressed size as a long string, e.g. "4.2 MB (4,300,123 bytes)".
                */
               image_size_str = g_strdup_printf (_("%s when decompressed"), s);
               g_free (s);
-              size = uncompressed_size;
             }
         }
       else
@@ -293,7 +743,13 @@ restore_disk_image_update (DialogData *data)
           image_size_str = udisks_client_get_size_for_display (gdu_window_get_client (data->window), size, FALSE, TRUE);
         }
 
-      if (data->block_size > 0)
+      if (data->block_size > 0 && size_unknown)
+        {
+          restore_warning = g_strdup (_("The size of the decompressed disk image is not known in advance. "
+                                        "Restoring will fail if it is bigger than the target device"));
+          can_proceed = TRUE;
+        }
+      else if (data->block_size > 0)
         {
           if (size == 0)
             {
@@ -348,11 +804,13 @@ restore_disk_image_update (DialogData *data)
     }
 
   gtk_label_set_text (GTK_LABEL (data->image_size_label), image_size_str != NULL ? image_size_str : "—");
+  gtk_label_set_text (GTK_LABEL (data->image_contents_label), image_contents_str != NULL ? image_contents_str : "—");
 
   g_free (restore_warning);
   g_free (restore_error);
   g_clear_object (&restore_file);
   g_free (image_size_str);
+  g_free (image_contents_str);
 
   gtk_dialog_set_response_sensitive (GTK_DIALOG (data->dialog), GTK_RESPONSE_OK, can_proceed);
 
@@ -535,7 +993,28 @@ restore_disk_image_populate (DialogData *data)
     }
 
   /* Destination: Show label if device is known, otherwise show a combobox */
-  if (data->object != NULL)
+  if (data->objects != NULL)
+    {
+      GString *str;
+      GList *l;
+
+      str = g_string_new (NULL);
+      for (l = data->objects; l != NULL; l = l->next)
+        {
+          UDisksObjectInfo *info;
+          info = udisks_client_get_object_info (gdu_window_get_client (data->window), UDISKS_OBJECT (l->data));
+          if (str->len > 0)
+            g_string_append (str, "\n");
+          g_string_append (str, udisks_object_info_get_one_liner (info));
+          g_clear_object (&info);
+        }
+      gtk_label_set_text (GTK_LABEL (data->destination_label), str->str);
+      g_string_free (str, TRUE);
+
+      gtk_widget_hide (data->selectable_destination_label);
+      gtk_widget_hide (data->selectable_destination_combobox);
+    }
+  else if (data->object != NULL)
     {
       UDisksObjectInfo *info;
       info = udisks_client_get_object_info (gdu_window_get_client (data->window), data->object);
@@ -557,49 +1036,117 @@ restore_disk_image_populate (DialogData *data)
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
-update_job (DialogData *data,
-            gboolean    done)
+update_job_for_target (RestoreTarget *target,
+                       gboolean       done)
 {
+  DialogData *data = target->data;
+  gchar *extra_markup = NULL;
   guint64 bytes_completed = 0;
   guint64 bytes_target = 0;
   guint64 bytes_per_sec = 0;
   guint64 usec_remaining = 0;
+  guint64 num_mismatch_bytes = 0;
+  guint64 num_bytes_skipped = 0;
+  gboolean verifying = FALSE;
+  gboolean failed = FALSE;
   gdouble progress = 0.0;
 
   g_mutex_lock (&data->copy_lock);
-  if (data->estimator != NULL)
+  if (target->estimator != NULL)
     {
-      bytes_per_sec = gdu_estimator_get_bytes_per_sec (data->estimator);
-      usec_remaining = gdu_estimator_get_usec_remaining (data->estimator);
-      bytes_completed = gdu_estimator_get_completed_bytes (data->estimator);
-      bytes_target = gdu_estimator_get_target_bytes (data->estimator);
+      bytes_per_sec = gdu_estimator_get_bytes_per_sec (target->estimator);
+      usec_remaining = gdu_estimator_get_usec_remaining (target->estimator);
+      bytes_completed = gdu_estimator_get_completed_bytes (target->estimator);
+      bytes_target = gdu_estimator_get_target_bytes (target->estimator);
     }
-  data->update_id = 0;
+  verifying = target->verifying;
+  num_mismatch_bytes = target->num_mismatch_bytes;
+  num_bytes_skipped = target->num_bytes_skipped;
+  failed = (target->error != NULL);
   g_mutex_unlock (&data->copy_lock);
 
-  if (data->local_job != NULL)
+  if (target->local_job == NULL)
+    goto out;
+
+  /* the target has been dropped - the other targets carry on */
+  if (failed)
     {
-      udisks_job_set_bytes (UDISKS_JOB (data->local_job), bytes_target);
-      udisks_job_set_rate (UDISKS_JOB (data->local_job), bytes_per_sec);
+      gdu_application_destroy_local_job (gdu_window_get_application (data->window), target->local_job);
+      target->local_job = NULL;
+      goto out;
+    }
 
-      if (done)
-        {
-          progress = 1.0;
-        }
-      else
-        {
-          if (bytes_target != 0)
-            progress = ((gdouble) bytes_completed) / ((gdouble) bytes_target);
-          else
-            progress = 0.0;
-        }
-      udisks_job_set_progress (UDISKS_JOB (data->local_job), progress);
+  if (num_mismatch_bytes > 0)
+    {
+      gchar *s, *s2;
+      s = g_format_size (num_mismatch_bytes);
+      /* Translators: Shown when verifying a restored disk image finds differences.
+       *              The %s is the amount of data that differs (ex. "2 MB").
+       */
+      s2 = g_strdup_printf (_("%s differs from the disk image"), s);
+      /* TODO: once https://bugzilla.gnome.org/show_bug.cgi?id=657194 is resolved, use that instead
+       * of hard-coding the color
+       */
+      extra_markup = g_strdup_printf ("<span foreground=\"#ff0000\">%s</span>", s2);
+      g_free (s2);
+      g_free (s);
+    }
+  else if (num_bytes_skipped > 0)
+    {
+      gchar *s;
+      s = g_format_size (num_bytes_skipped);
+      /* Translators: Shown when only writing the parts of the disk image that differ from
+       *              what is on the device. The %s is the amount of data that was already
+       *              on the device (ex. "2 GB").
+       */
+      extra_markup = g_strdup_printf (_("%s unchanged"), s);
+      g_free (s);
+    }
+
+  if (verifying)
+    {
+      /* Translators: this is the description of the job while reading back the restored data */
+      gdu_local_job_set_description (target->local_job, _("Verifying Disk Image"));
+    }
+  gdu_local_job_set_extra_markup (target->local_job, extra_markup);
+
+  udisks_job_set_bytes (UDISKS_JOB (target->local_job), bytes_target);
+  udisks_job_set_rate (UDISKS_JOB (target->local_job), bytes_per_sec);
 
-      if (usec_remaining == 0)
-        udisks_job_set_expected_end_time (UDISKS_JOB (data->local_job), 0);
+  if (done)
+    {
+      progress = 1.0;
+    }
+  else
+    {
+      if (bytes_target != 0)
+        progress = ((gdouble) bytes_completed) / ((gdouble) bytes_target);
       else
-        udisks_job_set_expected_end_time (UDISKS_JOB (data->local_job), usec_remaining + g_get_real_time ());
+        progress = 0.0;
     }
+  udisks_job_set_progress (UDISKS_JOB (target->local_job), progress);
+
+  if (usec_remaining == 0)
+    udisks_job_set_expected_end_time (UDISKS_JOB (target->local_job), 0);
+  else
+    udisks_job_set_expected_end_time (UDISKS_JOB (target->local_job), usec_remaining + g_get_real_time ());
+
+ out:
+  g_free (extra_markup);
+}
+
+static void
+update_job (DialogData *data,
+            gboolean    done)
+{
+  guint n;
+
+  g_mutex_lock (&data->copy_lock);
+  data->update_id = 0;
+  g_mutex_unlock (&data->copy_lock);
+
+  for (n = 0; n < data->targets->len; n++)
+    update_job_for_target (data->targets->pdata[n], done);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -676,170 +1223,1550 @@ on_success (gpointer user_data)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static gpointer
-copy_thread_func (gpointer user_data)
+/* Update GUI - but only every 200 ms and only if last update isn't pending.
+ *
+ * Must be called with copy_lock held.
+ */
+static void
+maybe_schedule_update_locked (RestoreTarget *target,
+                              guint64        num_bytes_completed)
 {
-  DialogData *data = user_data;
-  guchar *buffer_unaligned = NULL;
-  guchar *buffer = NULL;
-  guint64 block_device_size = 0;
-  long page_size;
-  GError *error = NULL;
-  GError *error2 = NULL;
-  gint64 last_update_usec = -1;
-  gint fd = -1;
-  gint buffer_size;
-  guint64 num_bytes_completed = 0;
+  DialogData *data = target->data;
+  gint64 now_usec;
 
-  /* default to 1 MiB blocks */
-  buffer_size = (1 * 1024 * 1024);
-
-  /* Most OSes put ACLs for logged-in users on /dev/sr* nodes (this is
-   * so CD burning tools etc. work) so see if we can open the device
-   * file ourselves. If so, great, since this avoids a polkit dialog.
-   *
-   * As opposed to udisks' OpenForBackup() we also avoid O_EXCL since
-   * the disc is read-only by its very nature. As a side-effect this
-   * allows creating a disk image of a mounted disc.
-   */
-  if (g_str_has_prefix (udisks_block_get_device (data->block), "/dev/sr"))
+  now_usec = g_get_monotonic_time ();
+  if (now_usec - target->last_update_usec > 200 * G_USEC_PER_SEC / 1000 || target->last_update_usec < 0)
     {
-      fd = open (udisks_block_get_device (data->block), O_RDONLY);
+      if (num_bytes_completed > 0)
+        gdu_estimator_add_sample (target->estimator, num_bytes_completed);
+      if (data->update_id == 0)
+        data->update_id = g_idle_add (on_update_job, dialog_data_ref (data));
+      target->last_update_usec = now_usec;
     }
+}
 
-  /* Otherwise, request the fd from udisks */
-  if (fd == -1)
+static void
+maybe_schedule_update (RestoreTarget *target,
+                       guint64        num_bytes_completed)
+{
+  g_mutex_lock (&target->data->copy_lock);
+  maybe_schedule_update_locked (target, num_bytes_completed);
+  g_mutex_unlock (&target->data->copy_lock);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static RestoreChunk *
+chunk_ref (RestoreChunk *chunk)
+{
+  g_atomic_int_inc (&chunk->ref_count);
+  return chunk;
+}
+
+static void
+chunk_unref (RestoreChunk *chunk)
+{
+  if (g_atomic_int_dec_and_test (&chunk->ref_count))
     {
-      GUnixFDList *fd_list = NULL;
-      GVariant *fd_index = NULL;
-      if (!udisks_block_call_open_for_restore_sync (data->block,
-                                                    g_variant_new ("a{sv}", NULL), /* options */
-                                                    NULL, /* fd_list */
-                                                    &fd_index,
-                                                    &fd_list,
-                                                    NULL, /* cancellable */
-                                                    &error))
-        goto out;
+      chunk->verify_target = NULL;
+      g_async_queue_push (chunk->data->free_chunks, chunk);
+    }
+}
 
-      fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), &error);
-      if (error != NULL)
+/* Blocks until a chunk is available. The returned chunk has a reference count of 1. */
+static RestoreChunk *
+chunk_get_free (DialogData *data)
+{
+  RestoreChunk *chunk;
+  chunk = g_async_queue_pop (data->free_chunks);
+  chunk->ref_count = 1;
+  chunk->is_zero = FALSE;
+  return chunk;
+}
+
+static void
+chunks_alloc (DialogData *data,
+              gsize       chunk_size)
+{
+  long page_size;
+  guint n;
+
+  page_size = sysconf (_SC_PAGESIZE);
+  data->free_chunks = g_async_queue_new ();
+  /* don't use more memory than NUM_CHUNKS regular chunks if the manifest uses huge chunks */
+  data->num_chunks = MAX (NUM_CHUNKS * (guint64) CHUNK_SIZE / chunk_size, 4);
+  for (n = 0; n < data->num_chunks; n++)
+    {
+      RestoreChunk *chunk = g_new0 (RestoreChunk, 1);
+      chunk->data = data;
+      chunk->buffer_unaligned = g_new0 (guchar, chunk_size + page_size);
+      chunk->buffer = (guchar*) (((gintptr) (chunk->buffer_unaligned + page_size)) & (~(page_size - 1)));
+      g_async_queue_push (data->free_chunks, chunk);
+    }
+}
+
+/* Blocks until all chunks handed out so far have been released, e.g. written and hashed */
+static void
+chunks_wait_for_all (DialogData *data)
+{
+  RestoreChunk **chunks;
+  guint n;
+
+  chunks = g_new0 (RestoreChunk *, data->num_chunks);
+  for (n = 0; n < data->num_chunks; n++)
+    chunks[n] = g_async_queue_pop (data->free_chunks);
+  for (n = 0; n < data->num_chunks; n++)
+    g_async_queue_push (data->free_chunks, chunks[n]);
+  g_free (chunks);
+}
+
+static void
+chunks_free (DialogData *data)
+{
+  RestoreChunk *chunk;
+
+  if (data->free_chunks == NULL)
+    return;
+
+  /* all chunks must have been released at this point */
+  g_warn_if_fail (g_async_queue_length (data->free_chunks) == (gint) data->num_chunks);
+  while ((chunk = g_async_queue_try_pop (data->free_chunks)) != NULL)
+    {
+      g_free (chunk->buffer_unaligned);
+      g_free (chunk);
+    }
+  g_async_queue_unref (data->free_chunks);
+  data->free_chunks = NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* runs on one of the threads in the hash pool */
+static void
+hash_pool_func (gpointer task_data,
+                gpointer user_data)
+{
+  DialogData *data = user_data;
+  RestoreChunk *chunk = task_data;
+  RestoreTarget *target = chunk->verify_target;
+
+  if (target == NULL)
+    {
+      gdu_image_manifest_set_chunk (data->manifest, chunk->index, chunk->buffer, chunk->size);
+    }
+  else if (!gdu_image_manifest_check_chunk (data->manifest, chunk->index, chunk->buffer, chunk->size))
+    {
+      MismatchRange range;
+      range.offset = chunk->offset;
+      range.size = chunk->size;
+      g_mutex_lock (&data->copy_lock);
+      g_array_append_val (target->mismatches, range);
+      target->num_mismatch_bytes += range.size;
+      g_mutex_unlock (&data->copy_lock);
+    }
+
+  chunk_unref (chunk);
+}
+
+static void
+hash_pool_start (DialogData *data)
+{
+  glong num_threads;
+
+  num_threads = sysconf (_SC_NPROCESSORS_ONLN);
+  num_threads = CLAMP (num_threads, 1, 8);
+  data->hash_pool = g_thread_pool_new (hash_pool_func,
+                                       data,
+                                       num_threads,
+                                       FALSE, /* exclusive */
+                                       NULL); /* GError */
+}
+
+/* Blocks until all chunks pushed have been hashed */
+static void
+hash_pool_stop (DialogData *data)
+{
+  if (data->hash_pool == NULL)
+    return;
+  g_thread_pool_free (data->hash_pool, FALSE, TRUE);
+  data->hash_pool = NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gint
+compare_mismatch_ranges (gconstpointer a,
+                         gconstpointer b)
+{
+  const MismatchRange *ra = a;
+  const MismatchRange *rb = b;
+  if (ra->offset < rb->offset)
+    return -1;
+  else if (ra->offset > rb->offset)
+    return 1;
+  return 0;
+}
+
+/* Returns a string like "0-1048576, 8388608-9437184" with mismatched (and coalesced) byte ranges */
+static gchar *
+format_mismatches (RestoreTarget *target)
+{
+  GString *str;
+  guint n;
+  guint num_ranges = 0;
+  guint64 cur_offset = 0;
+  guint64 cur_end = 0;
+
+  str = g_string_new (NULL);
+  g_mutex_lock (&target->data->copy_lock);
+  g_array_sort (target->mismatches, compare_mismatch_ranges);
+  for (n = 0; n <= target->mismatches->len; n++)
+    {
+      MismatchRange *range = NULL;
+
+      if (n < target->mismatches->len)
+        {
+          range = &g_array_index (target->mismatches, MismatchRange, n);
+          if (n > 0 && range->offset == cur_end)
+            {
+              cur_end += range->size;
+              continue;
+            }
+        }
+
+      if (n > 0)
+        {
+          if (num_ranges < 10)
+            {
+              if (str->len > 0)
+                g_string_append (str, ", ");
+              g_string_append_printf (str, "%" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT, cur_offset, cur_end);
+            }
+          num_ranges++;
+        }
+
+      if (range != NULL)
+        {
+          cur_offset = range->offset;
+          cur_end = range->offset + range->size;
+        }
+    }
+  g_mutex_unlock (&target->data->copy_lock);
+
+  if (num_ranges > 10)
+    g_string_append (str, ", …");
+
+  return g_string_free (str, FALSE);
+}
+
+/* Reads back the device (bypassing the page cache if possible) and
+ * hands it, chunk by chunk, to the hash pool for comparison with the
+ * manifest. The result is only known once the hash pool has been
+ * stopped, see check_mismatches().
+ *
+ * Must be called after the data written has been synced and the fd
+ * used for writing has been closed.
+ */
+static gboolean
+verify_target (RestoreTarget  *target,
+               GError        **error)
+{
+  DialogData *data = target->data;
+  gboolean ret = FALSE;
+  GUnixFDList *fd_list = NULL;
+  GVariant *fd_index = NULL;
+  gint fd = -1;
+  gint flags;
+  gint logical_block_size = 0;
+  gboolean direct_io = FALSE;
+  gsize chunk_size;
+  guint num_chunks;
+  guint n;
+  guint64 num_bytes_completed = 0;
+
+  if (!udisks_block_call_open_for_backup_sync (target->block,
+                                               g_variant_new ("a{sv}", NULL), /* options */
+                                               NULL, /* fd_list */
+                                               &fd_index,
+                                               &fd_list,
+                                               data->cancellable,
+                                               error))
+    goto out;
+
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+  if (fd == -1)
+    {
+      g_prefix_error (error,
+                      "Error extracing fd with handle %d from D-Bus message: ",
+                      g_variant_get_handle (fd_index));
+      goto out;
+    }
+
+  if (ioctl (fd, BLKSSZGET, &logical_block_size) != 0 || logical_block_size <= 0)
+    logical_block_size = 512;
+
+  chunk_size = gdu_image_manifest_get_chunk_size (data->manifest);
+  num_chunks = gdu_image_manifest_get_num_chunks (data->manifest);
+
+  /* We want what is on the device, not what is in the page cache. Not
+   * all devices support O_DIRECT so if that fails, at least try to
+   * drop the cached pages.
+   */
+  flags = fcntl (fd, F_GETFL);
+  if (flags != -1 &&
+      chunk_size % logical_block_size == 0 &&
+      fcntl (fd, F_SETFL, flags | O_DIRECT) == 0)
+    direct_io = TRUE;
+  else
+    posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+
+  g_mutex_lock (&data->copy_lock);
+  g_clear_object (&target->estimator);
+  target->estimator = gdu_estimator_new (data->input_size);
+  target->verifying = TRUE;
+  target->last_update_usec = -1;
+  g_mutex_unlock (&data->copy_lock);
+
+  for (n = 0; n < num_chunks; n++)
+    {
+      RestoreChunk *chunk;
+      guint64 offset;
+      gsize size;
+      gsize size_to_read;
+      gsize num_bytes_read;
+
+      if (g_cancellable_set_error_if_cancelled (data->cancellable, error))
+        goto out;
+
+      /* the user may have canceled just this target */
+      if (!restore_target_is_alive (target))
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Operation was cancelled");
+          goto out;
+        }
+
+      maybe_schedule_update (target, num_bytes_completed);
+
+      offset = ((guint64) n) * chunk_size;
+      size = MIN (chunk_size, data->input_size - offset);
+      size_to_read = size;
+      if (direct_io)
+        {
+          /* O_DIRECT requires I/O in multiples of the logical block size */
+          size_to_read = ((size + logical_block_size - 1) / logical_block_size) * logical_block_size;
+          if (offset + size_to_read > target->size)
+            size_to_read = target->size - offset;
+        }
+
+      chunk = chunk_get_free (data);
+      chunk->offset = offset;
+      chunk->size = size;
+      chunk->index = n;
+      chunk->verify_target = target;
+      num_bytes_read = 0;
+      while (num_bytes_read < size)
+        {
+          ssize_t rc;
+          rc = pread (fd, chunk->buffer + num_bytes_read, size_to_read - num_bytes_read, offset + num_bytes_read);
+          if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+          if (rc <= 0)
+            {
+              g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           "Error reading %" G_GSIZE_FORMAT " bytes from offset %" G_GUINT64_FORMAT ": %s",
+                           size_to_read - num_bytes_read,
+                           offset + num_bytes_read,
+                           rc < 0 ? strerror (errno) : "Unexpected end of device");
+              chunk_unref (chunk);
+              goto out;
+            }
+          num_bytes_read += rc;
+        }
+      g_thread_pool_push (data->hash_pool, chunk, NULL);
+
+      num_bytes_completed += size;
+    }
+
+  ret = TRUE;
+
+ out:
+  if (fd != -1)
+    {
+      if (close (fd) != 0)
+        g_warning ("Error closing fd: %m");
+    }
+  if (fd_index != NULL)
+    g_variant_unref (fd_index);
+  g_clear_object (&fd_list);
+  return ret;
+}
+
+/* Drops @target if verification found differences - must be called after the hash pool has been stopped */
+static void
+check_mismatches (RestoreTarget *target)
+{
+  guint64 num_mismatch_bytes;
+
+  g_mutex_lock (&target->data->copy_lock);
+  num_mismatch_bytes = target->num_mismatch_bytes;
+  g_mutex_unlock (&target->data->copy_lock);
+  if (num_mismatch_bytes > 0)
+    {
+      gchar *s, *s2;
+      s = g_format_size (num_mismatch_bytes);
+      s2 = format_mismatches (target);
+      /* Translators: Shown in the error dialog when verification of a restored disk image fails.
+       *              The first %s is the amount of data that differs (ex. "2 MB").
+       *              The second %s is a list of byte ranges (ex. "0-1048576, 8388608-9437184").
+       */
+      restore_target_fail (target,
+                           g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED,
+                                        _("Verification failed: %s on the device differs from the disk image (byte ranges %s)"),
+                                        s, s2));
+      g_free (s2);
+      g_free (s);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* @max_size is what fits on the smallest target - used if the size of the image isn't known */
+static void
+prepare_manifest (DialogData *data,
+                  guint64     max_size)
+{
+  GError *error = NULL;
+
+  if (data->manifest_filename != NULL)
+    {
+      data->manifest = gdu_image_manifest_load (data->manifest_filename, &error);
+      if (data->manifest == NULL)
+        {
+          /* don't complain about a missing manifest */
+          if (!(error->domain == G_FILE_ERROR && error->code == G_FILE_ERROR_NOENT))
+            g_warning ("Error loading manifest %s: %s (%s, %d)",
+                       data->manifest_filename,
+                       error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+      else if ((data->input_size != 0 && gdu_image_manifest_get_image_size (data->manifest) != data->input_size) ||
+               (data->input_size == 0 && gdu_image_manifest_get_image_size (data->manifest) > max_size) ||
+               gdu_image_manifest_get_chunk_size (data->manifest) > MAX_MANIFEST_CHUNK_SIZE)
+        {
+          g_warning ("Ignoring manifest %s since it does not match the disk image",
+                     data->manifest_filename);
+          gdu_image_manifest_free (data->manifest);
+          data->manifest = NULL;
+        }
+      else
+        {
+          data->manifest_from_file = TRUE;
+          /* the manifest also tells us the size, if not otherwise known */
+          data->input_size = gdu_image_manifest_get_image_size (data->manifest);
+        }
+    }
+
+  /* Otherwise hash the image while it's being written. If the size
+   * isn't known, make room for what fits and truncate it later.
+   */
+  if (data->manifest == NULL)
+    data->manifest = gdu_image_manifest_new (data->input_size != 0 ? data->input_size : max_size, data->chunk_size);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Checks if restoring the disk image to @target was interrupted
+ * earlier and if the device still has what was written back then. If
+ * so, sets target->resume_offset to where to resume.
+ *
+ * Must be called before the device is opened for writing.
+ */
+static void
+restore_target_load_journal (RestoreTarget *target)
+{
+  DialogData *data = target->data;
+  GduRestoreJournal *journal = NULL;
+  GUnixFDList *fd_list = NULL;
+  GVariant *fd_index = NULL;
+  GError *error = NULL;
+  guchar *buffer_unaligned = NULL;
+  guchar *buffer;
+  long page_size;
+  guint64 offset;
+  gsize size;
+  guint64 device_size;
+  gsize num_bytes_read;
+  gint fd = -1;
+
+  if (target->journal_filename == NULL)
+    goto out;
+
+  journal = gdu_restore_journal_load (target->journal_filename, &error);
+  if (journal == NULL)
+    {
+      if (!(error->domain == G_FILE_ERROR && error->code == G_FILE_ERROR_NOENT))
+        g_warning ("Error loading restore journal from %s: %s (%s, %d)",
+                   target->journal_filename, error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  offset = gdu_restore_journal_get_last_chunk_offset (journal);
+  size = gdu_restore_journal_get_last_chunk_size (journal);
+  if (!gdu_restore_journal_matches (journal, data->image_id, target->journal_device_id) ||
+      size == 0 || size > MAX_CHUNK_SIZE)
+    goto out;
+
+  /* The fd from OpenForRestore() is write-only so read what is on the device with a separate fd */
+  if (!udisks_block_call_open_for_backup_sync (target->block,
+                                               g_variant_new ("a{sv}", NULL), /* options */
+                                               NULL, /* fd_list */
+                                               &fd_index,
+                                               &fd_list,
+                                               data->cancellable,
+                                               &error))
+    goto out;
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), &error);
+  if (fd == -1)
+    goto out;
+
+  if (ioctl (fd, BLKGETSIZE64, &device_size) != 0 ||
+      device_size != gdu_restore_journal_get_device_size (journal))
+    goto out;
+
+  /* what was written was synced so it's on the device, not just in the page cache */
+  posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+
+  page_size = sysconf (_SC_PAGESIZE);
+  buffer_unaligned = g_new0 (guchar, size + page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+  num_bytes_read = 0;
+  while (num_bytes_read < size)
+    {
+      ssize_t rc;
+      rc = pread (fd, buffer + num_bytes_read, size - num_bytes_read, offset + num_bytes_read);
+      if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+        continue;
+      if (rc <= 0)
+        goto out;
+      num_bytes_read += rc;
+    }
+
+  if (gdu_restore_journal_check_last_chunk (journal, buffer, size))
+    target->resume_offset = gdu_restore_journal_get_offset (journal);
+
+ out:
+  if (error != NULL)
+    {
+      g_warning ("Error checking device for resuming restore: %s (%s, %d)",
+                 error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+  if (fd != -1)
+    {
+      if (close (fd) != 0)
+        g_warning ("Error closing fd: %m");
+    }
+  if (fd_index != NULL)
+    g_variant_unref (fd_index);
+  g_clear_object (&fd_list);
+  g_free (buffer_unaligned);
+  gdu_restore_journal_free (journal);
+}
+
+static gboolean
+restore_target_open (RestoreTarget  *target,
+                     GError        **error)
+{
+  DialogData *data = target->data;
+  gboolean ret = FALSE;
+
+  /* Most OSes put ACLs for logged-in users on /dev/sr* nodes (this is
+   * so CD burning tools etc. work) so see if we can open the device
+   * file ourselves. If so, great, since this avoids a polkit dialog.
+   *
+   * As opposed to udisks' OpenForBackup() we also avoid O_EXCL since
+   * the disc is read-only by its very nature. As a side-effect this
+   * allows creating a disk image of a mounted disc.
+   */
+  if (g_str_has_prefix (udisks_block_get_device (target->block), "/dev/sr"))
+    {
+      target->fd = open (udisks_block_get_device (target->block), O_RDONLY);
+    }
+
+  /* Otherwise, request the fd from udisks. The fd from OpenForRestore()
+   * is write-only so for delta restores, where what is on the device
+   * is read first, use OpenForBenchmark() which can give us a
+   * read-write fd.
+   *
+   * Note that OpenForBenchmark() opens the device with O_SYNC, which
+   * F_SETFL can't clear, so each chunk that differs is written
+   * synchronously, i.e. only completes once it is on stable storage. This
+   * makes delta restores of mostly changed images slower than full
+   * ones.
+   */
+  if (target->fd == -1 && data->delta)
+    {
+      GUnixFDList *fd_list = NULL;
+      GVariant *fd_index = NULL;
+      GVariantBuilder options_builder;
+
+      g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
+      g_variant_builder_add (&options_builder, "{sv}", "writable", g_variant_new_boolean (TRUE));
+      if (!udisks_block_call_open_for_benchmark_sync (target->block,
+                                                      g_variant_builder_end (&options_builder),
+                                                      NULL, /* fd_list */
+                                                      &fd_index,
+                                                      &fd_list,
+                                                      NULL, /* cancellable */
+                                                      error))
+        goto out;
+
+      target->fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+      if (target->fd == -1)
+        {
+          g_prefix_error (error,
+                          "Error extracing fd with handle %d from D-Bus message: ",
+                          g_variant_get_handle (fd_index));
+          g_variant_unref (fd_index);
+          g_clear_object (&fd_list);
+          goto out;
+        }
+      if (fd_index != NULL)
+        g_variant_unref (fd_index);
+      g_clear_object (&fd_list);
+    }
+  else if (target->fd == -1)
+    {
+      GUnixFDList *fd_list = NULL;
+      GVariant *fd_index = NULL;
+      if (!udisks_block_call_open_for_restore_sync (target->block,
+                                                    g_variant_new ("a{sv}", NULL), /* options */
+                                                    NULL, /* fd_list */
+                                                    &fd_index,
+                                                    &fd_list,
+                                                    NULL, /* cancellable */
+                                                    error))
+        goto out;
+
+      target->fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+      if (target->fd == -1)
+        {
+          g_prefix_error (error,
+                          "Error extracing fd with handle %d from D-Bus message: ",
+                          g_variant_get_handle (fd_index));
+          g_variant_unref (fd_index);
+          g_clear_object (&fd_list);
+          goto out;
+        }
+      if (fd_index != NULL)
+        g_variant_unref (fd_index);
+      g_clear_object (&fd_list);
+    }
+
+  g_assert (target->fd != -1);
+
+  /* We can't use udisks_block_get_size() because the media may have
+   * changed and udisks may not have noticed. TODO: maybe have a
+   * Block.GetSize() method instead...
+   */
+  if (ioctl (target->fd, BLKGETSIZE64, &target->size) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "%s", strerror (errno));
+      g_prefix_error (error, _("Error determining size of device: "));
+      goto out;
+    }
+
+  if (target->size == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   _("Device is size 0"));
+      goto out;
+    }
+
+  if (target->size < data->input_size)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   _("The disk image is bigger than the target device"));
+      goto out;
+    }
+
+  if (ioctl (target->fd, BLKSSZGET, &target->logical_block_size) != 0 || target->logical_block_size <= 0)
+    target->logical_block_size = 512;
+
+  /* Zoned devices only allow writing sequential zones at their write
+   * pointer, see restore_target_reset_zones()
+   */
+  if (gdu_zones_get_model (udisks_block_get_device_number (target->block)) != GDU_ZONED_MODEL_NONE)
+    {
+      target->zones = gdu_zones_report (target->fd, error);
+      if (target->zones == NULL)
+        {
+          g_prefix_error (error, _("Error getting zones of device: "));
+          goto out;
+        }
+    }
+
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+/* Bypass the page cache so dirty pages don't pile up (only to be
+ * flushed when the device is closed) and so progress reflects what
+ * has actually been written to the device. Chunks are page-aligned
+ * and, except for the last one, a multiple of the logical block size,
+ * see get_chunk_size().
+ *
+ * The fd from OpenForBenchmark() already has O_DIRECT set so clear
+ * it if it can't be used.
+ */
+static gboolean
+restore_target_set_direct_io (RestoreTarget  *target,
+                              GError        **error)
+{
+  gboolean ret = FALSE;
+  gint flags;
+
+  flags = fcntl (target->fd, F_GETFL);
+  if (flags != -1)
+    {
+      if (target->data->chunk_size % target->logical_block_size == 0 &&
+          fcntl (target->fd, F_SETFL, flags | O_DIRECT) == 0)
+        target->direct_io = TRUE;
+      else
+        fcntl (target->fd, F_SETFL, flags & ~O_DIRECT);
+    }
+
+  /* Sequential zones must be written in order, which writeback from
+   * the page cache doesn't guarantee
+   */
+  if (target->zones != NULL && !target->direct_io)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   _("The device is zoned but can't be written to without going through the page cache"));
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+static gboolean
+write_all (RestoreTarget *target,
+           const guchar  *buffer,
+           gsize          size,
+           guint64        offset)
+{
+  gsize num_bytes_written;
+  ssize_t rc;
+
+  num_bytes_written = 0;
+  while (num_bytes_written < size)
+    {
+      rc = pwrite (target->fd,
+                   buffer + num_bytes_written,
+                   size - num_bytes_written,
+                   offset + num_bytes_written);
+      if (rc < 0)
+        {
+          if (errno == EAGAIN || errno == EINTR)
+            continue;
+
+          restore_target_fail (target,
+                               g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED,
+                                            "Error writing %" G_GSIZE_FORMAT " bytes to offset %" G_GUINT64_FORMAT ": %m",
+                                            size - num_bytes_written,
+                                            offset + num_bytes_written));
+          return FALSE;
+        }
+      num_bytes_written += rc;
+    }
+  return TRUE;
+}
+
+/* Without O_DIRECT, writes only go to the page cache and would pile
+ * up there - making the rate shown meaningless and the final fsync()
+ * take minutes. So writeback of each chunk is started right after it
+ * has been written, the chunk before it is waited for and then dropped
+ * from the page cache. This keeps at most two chunks dirty and paces
+ * the copy to what the device sustains.
+ *
+ * There is a single writer thread without O_DIRECT so chunks are
+ * written in order.
+ */
+static void
+writeback_window (RestoreTarget *target,
+                  guint64        offset,
+                  gsize          size)
+{
+  if (target->writeback_unsupported)
+    goto out;
+
+  if (sync_file_range (target->fd, offset, size, SYNC_FILE_RANGE_WRITE) != 0)
+    goto fail;
+
+  if (target->writeback_size > 0)
+    {
+      if (sync_file_range (target->fd, target->writeback_offset, target->writeback_size,
+                           SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) != 0)
+        goto fail;
+      posix_fadvise (target->fd, target->writeback_offset, target->writeback_size, POSIX_FADV_DONTNEED);
+    }
+  target->writeback_offset = offset;
+  target->writeback_size = size;
+
+ out:
+  return;
+
+ fail:
+  /* the fsync() when done still makes sure everything is written */
+  g_warning ("Error starting writeback, disabling: %m");
+  target->writeback_unsupported = TRUE;
+  goto out;
+}
+
+static void
+compare_buffers_alloc (RestoreTarget *target,
+                       guint          num_buffers)
+{
+  long page_size;
+  guint n;
+
+  page_size = sysconf (_SC_PAGESIZE);
+  target->compare_buffers = g_async_queue_new_full (g_free);
+  for (n = 0; n < num_buffers; n++)
+    g_async_queue_push (target->compare_buffers, g_new0 (guchar, target->data->chunk_size + page_size));
+}
+
+static void
+compare_buffers_free (RestoreTarget *target)
+{
+  if (target->compare_buffers != NULL)
+    {
+      g_async_queue_unref (target->compare_buffers);
+      target->compare_buffers = NULL;
+    }
+}
+
+/* Checks if the device already has the contents of @chunk. If the
+ * device can't be read, it is assumed to differ - writing the chunk
+ * may well fix that.
+ */
+static gboolean
+chunk_is_on_target (RestoreTarget *target,
+                    RestoreChunk  *chunk)
+{
+  gboolean ret = FALSE;
+  long page_size;
+  guchar *buffer_unaligned;
+  guchar *buffer;
+  gsize size_to_read;
+  gsize num_bytes_read;
+
+  page_size = sysconf (_SC_PAGESIZE);
+  /* there is a buffer for each writer thread so this never blocks */
+  buffer_unaligned = g_async_queue_pop (target->compare_buffers);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+
+  size_to_read = chunk->size;
+  if (target->direct_io)
+    {
+      /* O_DIRECT requires I/O in multiples of the logical block size */
+      size_to_read = ((chunk->size + target->logical_block_size - 1) / target->logical_block_size) * target->logical_block_size;
+      if (chunk->offset + size_to_read > target->size)
+        size_to_read = target->size - chunk->offset;
+    }
+
+  num_bytes_read = 0;
+  while (num_bytes_read < chunk->size)
+    {
+      ssize_t rc;
+      rc = pread (target->fd, buffer + num_bytes_read, size_to_read - num_bytes_read, chunk->offset + num_bytes_read);
+      if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+        continue;
+      if (rc <= 0)
+        goto out;
+      num_bytes_read += rc;
+    }
+
+  ret = (memcmp (buffer, chunk->buffer, chunk->size) == 0);
+
+ out:
+  g_async_queue_push (target->compare_buffers, buffer_unaligned);
+  return ret;
+}
+
+/* Syncs the device and records that everything before @offset has
+ * been written. Called on the writer thread that wrote @chunk, which
+ * is before @offset.
+ */
+static void
+update_journal (RestoreTarget *target,
+                RestoreChunk  *chunk,
+                guint64        offset)
+{
+  GError *error = NULL;
+
+  g_mutex_lock (&target->journal_lock);
+
+  /* another writer may have gotten further in the meantime */
+  if (offset <= gdu_restore_journal_get_offset (target->journal))
+    goto out;
+
+  if (fdatasync (target->fd) != 0)
+    {
+      restore_target_fail (target,
+                           g_error_new (G_IO_ERROR, g_io_error_from_errno (errno),
+                                        "Error syncing device: %m"));
+      goto out;
+    }
+
+  gdu_restore_journal_set_progress (target->journal, offset, chunk->offset, chunk->buffer, chunk->size);
+  if (!gdu_restore_journal_save (target->journal, target->journal_filename, &error))
+    {
+      g_warning ("Error saving restore journal to %s: %s (%s, %d)",
+                 target->journal_filename, error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  /* there is something to resume so don't wipe the device if the restore fails */
+  target->wipe_on_error = FALSE;
+
+ out:
+  g_mutex_unlock (&target->journal_lock);
+}
+
+/* Called when @chunk has been written to @target - or was skipped because the device already had it */
+static void
+chunk_done (RestoreTarget *target,
+            RestoreChunk  *chunk,
+            gboolean       skipped)
+{
+  DialogData *data = target->data;
+  gboolean journal_due = FALSE;
+  guint64 synced_offset = 0;
+  gint64 now_usec;
+
+  g_mutex_lock (&data->copy_lock);
+
+  /* chunks may complete out of order so report the number of bytes written, not the offset */
+  target->num_bytes_written += chunk->size;
+  if (skipped)
+    target->num_bytes_skipped += chunk->size;
+  maybe_schedule_update_locked (target, target->num_bytes_written);
+
+  /* only what is before the first chunk still being written can be recorded in the journal */
+  if (chunk->offset == target->synced_offset)
+    {
+      gpointer size;
+      target->synced_offset += chunk->size;
+      while (g_hash_table_lookup_extended (target->written_chunks,
+                                           GUINT_TO_POINTER (target->synced_offset / data->chunk_size),
+                                           NULL,
+                                           &size))
+        {
+          g_hash_table_remove (target->written_chunks, GUINT_TO_POINTER (target->synced_offset / data->chunk_size));
+          target->synced_offset += GPOINTER_TO_SIZE (size);
+        }
+
+      now_usec = g_get_monotonic_time ();
+      if (target->journal != NULL && now_usec - target->last_journal_usec > JOURNAL_INTERVAL_USEC)
+        {
+          journal_due = TRUE;
+          synced_offset = target->synced_offset;
+          target->last_journal_usec = now_usec;
+        }
+    }
+  else
+    {
+      g_hash_table_insert (target->written_chunks,
+                           GUINT_TO_POINTER (chunk->offset / data->chunk_size),
+                           GSIZE_TO_POINTER (chunk->size));
+    }
+
+  g_mutex_unlock (&data->copy_lock);
+
+  if (journal_due)
+    update_journal (target, chunk, synced_offset);
+}
+
+/* The sequential zones of zoned devices can only be written from the
+ * start, so reset the zones the disk image goes to, from @offset on,
+ * before writing. Zones whose capacity is less than their size can't
+ * hold a contiguous image.
+ */
+static gboolean
+restore_target_reset_zones (RestoreTarget  *target,
+                            guint64         offset,
+                            guint64         size,
+                            GError        **error)
+{
+  gboolean ret = FALSE;
+  guint n;
+
+  for (n = 0; n < target->zones->len; n++)
+    {
+      const GduZone *zone = &g_array_index (target->zones, GduZone, n);
+
+      if (!zone->sequential || zone->offset + zone->size <= offset || zone->offset >= offset + size)
+        continue;
+
+      if (zone->capacity < zone->size && zone->offset + zone->capacity < offset + size)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                       _("The disk image can't be restored to a device with zones that can only be partly written"));
+          goto out;
+        }
+      if (!zone->empty && !gdu_zones_reset (target->fd, zone, error))
+        goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+/* Zeroes a range of the device without sending zeroes to it - e.g.
+ * by discarding, if the device guarantees that discarded blocks read
+ * as zeroes. Returns FALSE if the zeroes have to be written instead.
+ */
+static gboolean
+zero_range (RestoreTarget *target,
+            guint64        offset,
+            guint64        size)
+{
+  guint64 range[2];
+
+  if (g_atomic_int_get (&target->zeroout_unsupported) || offset % 512 != 0 || size % 512 != 0)
+    return FALSE;
+
+  range[0] = offset;
+  range[1] = size;
+  if (ioctl (target->fd, BLKZEROOUT, range) != 0)
+    {
+      g_atomic_int_set (&target->zeroout_unsupported, TRUE);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* O_DIRECT only allows writing whole logical blocks so the end of the
+ * last chunk is padded to the next logical block boundary. For delta
+ * restores, the fd is readable and the padding is what is already on
+ * the device - otherwise it is zeroes, which only touches the part of
+ * the device right after the image.
+ *
+ * Writing the end through the page cache instead isn't possible for
+ * zoned devices and would mean clearing O_DIRECT on the fd shared by
+ * all the writer threads.
+ */
+static gboolean
+write_tail (RestoreTarget *target,
+            RestoreChunk  *chunk,
+            gsize          num_aligned)
+{
+  gboolean ret = FALSE;
+  long page_size;
+  guchar *buffer_unaligned;
+  guchar *buffer;
+  gsize block_size = target->logical_block_size;
+
+  page_size = sysconf (_SC_PAGESIZE);
+  buffer_unaligned = g_malloc0 (block_size + page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+
+  if (target->compare_buffers != NULL &&
+      pread (target->fd, buffer, block_size, chunk->offset + num_aligned) != (ssize_t) block_size)
+    memset (buffer, 0, block_size);
+  memcpy (buffer, chunk->buffer + num_aligned, chunk->size - num_aligned);
+
+  if (!write_all (target, buffer, block_size, chunk->offset + num_aligned))
+    goto out;
+
+  ret = TRUE;
+
+ out:
+  g_free (buffer_unaligned);
+  return ret;
+}
+
+/* runs on one of the writer threads for the target */
+static void
+writer_pool_func (gpointer task_data,
+                  gpointer user_data)
+{
+  RestoreChunk *chunk = task_data;
+  RestoreTarget *target = user_data;
+  gsize num_aligned;
+
+  if (g_cancellable_is_cancelled (target->data->cancellable) || !restore_target_is_alive (target))
+    goto out;
+
+  /* for delta restores, only write what differs from what is already on the device */
+  if (target->compare_buffers != NULL && chunk_is_on_target (target, chunk))
+    {
+      chunk_done (target, chunk, TRUE);
+      goto out;
+    }
+
+  /* unallocated parts of virtual machine disk images are zeroed in bulk */
+  if (chunk->is_zero && zero_range (target, chunk->offset, chunk->size))
+    {
+      chunk_done (target, chunk, FALSE);
+      goto out;
+    }
+
+  num_aligned = chunk->size;
+  if (target->direct_io)
+    num_aligned -= chunk->size % target->logical_block_size;
+
+  if (!write_all (target, chunk->buffer, num_aligned, chunk->offset))
+    goto out;
+  /* only the last chunk can be unaligned */
+  if (num_aligned < chunk->size && !write_tail (target, chunk, num_aligned))
+    goto out;
+  if (!target->direct_io)
+    writeback_window (target, chunk->offset, chunk->size);
+
+  chunk_done (target, chunk, FALSE);
+
+ out:
+  chunk_unref (chunk);
+}
+
+/* Syncs and closes the device and, if requested, reads it back for verification */
+static gpointer
+finish_thread_func (gpointer user_data)
+{
+  RestoreTarget *target = user_data;
+  DialogData *data = target->data;
+  GError *error = NULL;
+
+  if (target->fd == -1)
+    goto out;
+
+  if (restore_target_is_alive (target) && fsync (target->fd) != 0)
+    {
+      restore_target_fail (target,
+                           g_error_new (G_IO_ERROR, g_io_error_from_errno (errno),
+                                        "Error syncing device: %s", strerror (errno)));
+    }
+
+  /* everything has been written - there is nothing left to resume */
+  if (target->journal_filename != NULL && restore_target_is_alive (target))
+    g_unlink (target->journal_filename);
+
+  if (close (target->fd) != 0)
+    g_warning ("Error closing fd: %m");
+  target->fd = -1;
+
+  if (data->verify && restore_target_is_alive (target))
+    {
+      /* Everything was written so don't wipe the device if verification fails - the user
+       * may want to inspect it
+       */
+      target->wipe_on_error = FALSE;
+      if (!verify_target (target, &error))
+        restore_target_fail (target, error);
+    }
+
+ out:
+  return NULL;
+}
+
+static guint64
+get_smallest_target_size (DialogData *data)
+{
+  guint64 ret = G_MAXUINT64;
+  guint n;
+
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+      if (restore_target_is_alive (target))
+        ret = MIN (ret, target->size);
+    }
+  return ret;
+}
+
+/* Returns the error to show to the user or NULL if all targets either succeeded or were cancelled */
+static GError *
+build_copy_error (DialogData *data)
+{
+  GError *ret = NULL;
+  GString *str = NULL;
+  guint n;
+
+  g_mutex_lock (&data->copy_lock);
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+
+      if (target->error == NULL ||
+          (target->error->domain == G_IO_ERROR && target->error->code == G_IO_ERROR_CANCELLED))
+        continue;
+
+      if (data->targets->len == 1)
         {
-          g_prefix_error (&error,
-                          "Error extracing fd with handle %d from D-Bus message: ",
-                          g_variant_get_handle (fd_index));
+          ret = g_error_copy (target->error);
           goto out;
         }
-      if (fd_index != NULL)
-        g_variant_unref (fd_index);
-      g_clear_object (&fd_list);
+
+      if (str == NULL)
+        str = g_string_new (NULL);
+      else
+        g_string_append_c (str, '\n');
+      g_string_append_printf (str, "%s: %s",
+                              udisks_block_get_preferred_device (target->block),
+                              target->error->message);
     }
 
-  g_assert (fd != -1);
+  if (str != NULL)
+    ret = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED, str->str);
 
-  /* We can't use udisks_block_get_size() because the media may have
-   * changed and udisks may not have noticed. TODO: maybe have a
-   * Block.GetSize() method instead...
+ out:
+  g_mutex_unlock (&data->copy_lock);
+  if (str != NULL)
+    g_string_free (str, TRUE);
+  return ret;
+}
+
+/* The disk image is decoded once, on this thread, into chunks that
+ * are shared by the writers for all targets. A target that fails is
+ * dropped without affecting the others.
+ */
+/* Use bigger chunks if any of the targets needs them to write at full
+ * speed. This reads what the benchmark found, so it's done on the copy
+ * thread rather than on the main thread. Chunks must be a multiple of
+ * the logical block size of each target to use O_DIRECT.
+ */
+static gsize
+get_chunk_size (DialogData *data)
+{
+  UDisksClient *client = gdu_window_get_client (data->window);
+  gsize chunk_size = CHUNK_SIZE;
+  gsize block_size = 512;
+  guint n;
+
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+      gsize transfer_size;
+
+      if (!restore_target_is_alive (target))
+        continue;
+      transfer_size = gdu_benchmark_dialog_get_transfer_size (client,
+                                                              target->block,
+                                                              TRUE); /* for_writing */
+      chunk_size = MAX (chunk_size, MIN (transfer_size, MAX_CHUNK_SIZE));
+      block_size = MAX (block_size, (gsize) target->logical_block_size);
+    }
+
+  /* logical block sizes are powers of two so this is a multiple of all of them */
+  chunk_size -= chunk_size % block_size;
+  return MAX (chunk_size, block_size);
+}
+
+static gpointer
+copy_thread_func (gpointer user_data)
+{
+  DialogData *data = user_data;
+  GThread **finish_threads = NULL;
+  GError *error = NULL;
+  GError *error2 = NULL;
+  guint64 num_bytes_completed = 0;
+  guint64 max_size;
+  gboolean size_known;
+  guint num_writers;
+  guint n;
+
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+      restore_target_load_journal (target);
+      if (!restore_target_open (target, &error))
+        {
+          restore_target_fail (target, error);
+          error = NULL;
+        }
+    }
+  if (count_alive_targets (data) == 0)
+    goto out;
+  max_size = get_smallest_target_size (data);
+
+  data->chunk_size = get_chunk_size (data);
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+      if (restore_target_is_alive (target) && !restore_target_set_direct_io (target, &error))
+        {
+          restore_target_fail (target, error);
+          error = NULL;
+        }
+    }
+  if (count_alive_targets (data) == 0)
+    goto out;
+
+  /* The image is only decoded once so resuming is only possible if
+   * every target has gotten at least that far.
    */
-  if (ioctl (fd, BLKGETSIZE64, &block_device_size) != 0)
+  data->resume_offset = G_MAXUINT64;
+  for (n = 0; n < data->targets->len; n++)
     {
-      error = g_error_new (G_IO_ERROR, g_io_error_from_errno (errno),
-                           "%s", strerror (errno));
-      g_prefix_error (&error, _("Error determining size of device: "));
-      goto out;
+      RestoreTarget *target = data->targets->pdata[n];
+      if (restore_target_is_alive (target))
+        data->resume_offset = MIN (data->resume_offset, target->resume_offset);
+    }
+  /* zones are reset before they are written so resume from the start of one */
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+      const GduZone *zone;
+
+      if (!restore_target_is_alive (target) || target->zones == NULL)
+        continue;
+      zone = gdu_zones_lookup (target->zones, data->resume_offset);
+      if (zone != NULL)
+        data->resume_offset = zone->offset;
     }
+  data->resume_offset -= data->resume_offset % data->chunk_size;
 
-  if (block_device_size == 0)
+  for (n = 0; n < data->targets->len; n++)
     {
-      error = g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED,
-                           _("Device is size 0"));
-      goto out;
+      RestoreTarget *target = data->targets->pdata[n];
+
+      if (!restore_target_is_alive (target) || target->zones == NULL)
+        continue;
+      if (!restore_target_reset_zones (target,
+                                       data->resume_offset,
+                                       (data->input_size != 0 ? data->input_size : target->size) - data->resume_offset,
+                                       &error))
+        {
+          restore_target_fail (target, error);
+          error = NULL;
+        }
+      /* the old contents are gone, even for a delta restore */
+      target->wipe_on_error = TRUE;
     }
-  data->block_size = block_device_size;
+  if (count_alive_targets (data) == 0)
+    goto out;
 
-  page_size = sysconf (_SC_PAGESIZE);
-  buffer_unaligned = g_new0 (guchar, buffer_size + page_size);
-  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+      if (target->journal_filename == NULL)
+        continue;
+      target->journal = gdu_restore_journal_new (data->image_id, target->journal_device_id, target->size);
+      if (target->resume_offset > 0)
+        {
+          /* the journal on disk is still valid until the first update */
+          target->wipe_on_error = FALSE;
+        }
+      else
+        {
+          /* an old journal, if any, no longer matches what is on the device */
+          g_unlink (target->journal_filename);
+        }
+    }
+
+  if (data->verify)
+    {
+      prepare_manifest (data, max_size);
+      hash_pool_start (data);
+      chunks_alloc (data, MAX (data->chunk_size, gdu_image_manifest_get_chunk_size (data->manifest)));
+    }
+  else
+    {
+      chunks_alloc (data, data->chunk_size);
+    }
 
   g_mutex_lock (&data->copy_lock);
-  data->estimator = gdu_estimator_new (data->input_size);
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+      /* if the size of the image isn't known, show progress relative to the size of the device */
+      target->estimator = gdu_estimator_new (data->input_size != 0 ? data->input_size : target->size);
+      target->last_update_usec = -1;
+      target->num_bytes_written = data->resume_offset;
+      target->synced_offset = data->resume_offset;
+      target->last_journal_usec = g_get_monotonic_time ();
+      num_writers = target->direct_io && target->zones == NULL ? WRITE_QUEUE_DEPTH : 1;
+      /* the zones have been reset so there is nothing to compare with */
+      if (data->delta && target->zones == NULL)
+        compare_buffers_alloc (target, num_writers);
+      target->writer_pool = g_thread_pool_new (writer_pool_func,
+                                               target,
+                                               num_writers,
+                                               TRUE, /* exclusive */
+                                               NULL); /* GError */
+    }
   data->update_id = 0;
   data->start_time_usec = g_get_real_time ();
   g_mutex_unlock (&data->copy_lock);
 
-  /* Read huge (e.g. 1 MiB) blocks and write it to the output
-   * device even if it was only partially read.
+  /* Read huge (e.g. 1 MiB) chunks and hand them to all the writers. If
+   * the size of the image isn't known, read until the end of the stream.
    */
+  size_known = (data->input_size != 0);
   num_bytes_completed = 0;
-  while (num_bytes_completed < data->input_size)
+
+  /* When resuming, chunks before the resume offset are only read if they need to be hashed */
+  if (data->resume_offset > 0 &&
+      (data->hash_pool == NULL || data->manifest_from_file) &&
+      data->virtual_disk != NULL)
+    {
+      num_bytes_completed = data->resume_offset;
+    }
+  else if (data->resume_offset > 0 &&
+           (data->hash_pool == NULL || data->manifest_from_file) &&
+           G_IS_SEEKABLE (data->input_stream) &&
+           g_seekable_can_seek (G_SEEKABLE (data->input_stream)))
+    {
+      if (!g_seekable_seek (G_SEEKABLE (data->input_stream),
+                            data->resume_offset,
+                            G_SEEK_SET,
+                            data->cancellable,
+                            &error))
+        {
+          g_prefix_error (&error, "Error seeking to offset %" G_GUINT64_FORMAT ": ", data->resume_offset);
+          goto out;
+        }
+      num_bytes_completed = data->resume_offset;
+    }
+
+  while (!size_known || num_bytes_completed < data->input_size)
     {
+      RestoreChunk *chunk;
       gsize num_bytes_to_read;
       gsize num_bytes_read;
-      ssize_t num_bytes_written;
-      gint64 now_usec;
+      gboolean read_ok;
+
+      if (count_alive_targets (data) == 0)
+        break;
 
-      num_bytes_to_read = buffer_size;
-      if (num_bytes_to_read + num_bytes_completed > data->input_size)
+      num_bytes_to_read = data->chunk_size;
+      if (size_known && num_bytes_to_read + num_bytes_completed > data->input_size)
         num_bytes_to_read = data->input_size - num_bytes_completed;
 
-      /* Update GUI - but only every 200 ms and only if last update isn't pending */
-      g_mutex_lock (&data->copy_lock);
-      now_usec = g_get_monotonic_time ();
-      if (now_usec - last_update_usec > 200 * G_USEC_PER_SEC / 1000 || last_update_usec < 0)
+      /* blocks if the slowest target is too far behind */
+      chunk = chunk_get_free (data);
+      chunk->offset = num_bytes_completed;
+      chunk->index = num_bytes_completed / data->chunk_size;
+
+      if (data->virtual_disk != NULL)
         {
-          if (num_bytes_completed > 0)
-            gdu_estimator_add_sample (data->estimator, num_bytes_completed);
-          if (data->update_id == 0)
-            data->update_id = g_idle_add (on_update_job, dialog_data_ref (data));
-          last_update_usec = now_usec;
+          read_ok = gdu_virtual_disk_read (data->virtual_disk,
+                                           num_bytes_completed,
+                                           chunk->buffer,
+                                           num_bytes_to_read,
+                                           &chunk->is_zero,
+                                           data->cancellable,
+                                           &error);
+          num_bytes_read = num_bytes_to_read;
         }
-      g_mutex_unlock (&data->copy_lock);
-
-      if (!g_input_stream_read_all (data->input_stream,
-                                    buffer,
-                                    num_bytes_to_read,
-                                    &num_bytes_read,
-                                    data->cancellable,
-                                    &error))
+      else
+        {
+          read_ok = g_input_stream_read_all (data->input_stream,
+                                             chunk->buffer,
+                                             num_bytes_to_read,
+                                             &num_bytes_read,
+                                             data->cancellable,
+                                             &error);
+        }
+      if (!read_ok)
         {
           g_prefix_error (&error,
                           "Error reading %" G_GSIZE_FORMAT " bytes from offset %" G_GUINT64_FORMAT ": ",
                           num_bytes_to_read,
                           num_bytes_completed);
+          chunk_unref (chunk);
           goto out;
         }
-      if (num_bytes_read != num_bytes_to_read)
+      if (!size_known)
+        {
+          if (num_bytes_read == 0)
+            {
+              chunk_unref (chunk);
+              break;
+            }
+          if (num_bytes_completed + num_bytes_read > max_size)
+            {
+              g_set_error (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           _("The disk image is bigger than the target device"));
+              chunk_unref (chunk);
+              goto out;
+            }
+        }
+      else if (num_bytes_read != num_bytes_to_read)
         {
           g_set_error (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
                        "Requested %" G_GSIZE_FORMAT " bytes from offset %" G_GUINT64_FORMAT " but only read %" G_GSIZE_FORMAT " bytes",
                        num_bytes_read,
                        num_bytes_completed,
                        num_bytes_to_read);
+          chunk_unref (chunk);
           goto out;
         }
+      chunk->size = num_bytes_read;
 
-    copy_write_again:
-      num_bytes_written = write (fd, buffer, num_bytes_read);
-      if (num_bytes_written < 0)
-        {
-          if (errno == EAGAIN || errno == EINTR)
-            goto copy_write_again;
+      /* hash the chunk on the pool while it's being written */
+      if (data->hash_pool != NULL && !data->manifest_from_file)
+        g_thread_pool_push (data->hash_pool, chunk_ref (chunk), NULL);
 
-          g_set_error (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                       "Error writing %" G_GSIZE_FORMAT " bytes to offset %" G_GUINT64_FORMAT ": %m",
-                       num_bytes_read,
-                       num_bytes_completed);
-          goto out;
+      for (n = 0; n < data->targets->len; n++)
+        {
+          RestoreTarget *target = data->targets->pdata[n];
+          if (restore_target_is_alive (target) && chunk->offset >= data->resume_offset)
+            g_thread_pool_push (target->writer_pool, chunk_ref (chunk), NULL);
         }
+      chunk_unref (chunk);
 
-      /*g_print ("copied %" G_GUINT64_FORMAT " bytes at offset %" G_GUINT64_FORMAT "\n",
-               (guint64) num_bytes_written,
-               num_bytes_completed);*/
+      num_bytes_completed += num_bytes_read;
+
+      /* a short read means the end of the stream was reached */
+      if (!size_known && num_bytes_read < num_bytes_to_read)
+        break;
+    }
 
-      num_bytes_completed += num_bytes_written;
+  /* now we know how big the image is */
+  if (!size_known && count_alive_targets (data) > 0)
+    {
+      data->input_size = num_bytes_completed;
+      if (data->manifest != NULL && !data->manifest_from_file)
+        gdu_image_manifest_truncate (data->manifest, data->input_size);
     }
 
  out:
-  data->end_time_usec = g_get_real_time ();
+  /* an error reading the disk image affects all targets */
+  if (error != NULL)
+    {
+      for (n = 0; n < data->targets->len; n++)
+        restore_target_fail (data->targets->pdata[n], g_error_copy (error));
+      g_clear_error (&error);
+    }
+
+  /* wait for the writers */
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+      if (target->writer_pool != NULL)
+        {
+          g_thread_pool_free (target->writer_pool, FALSE, TRUE);
+          target->writer_pool = NULL;
+        }
+      compare_buffers_free (target);
+    }
+
+  /* make sure the whole image has been hashed before reading anything back */
+  if (data->free_chunks != NULL)
+    chunks_wait_for_all (data);
 
   /* in either case, close the stream */
   if (!g_input_stream_close (G_INPUT_STREAM (data->input_stream),
@@ -852,24 +2779,35 @@ copy_thread_func (gpointer user_data)
     }
   g_clear_object (&data->input_stream);
 
-  if (fd != -1 )
+  /* sync, close and verify all targets in parallel */
+  finish_threads = g_new0 (GThread *, data->targets->len);
+  for (n = 0; n < data->targets->len; n++)
+    finish_threads[n] = g_thread_new ("restore-disk-image-finish-thread",
+                                      finish_thread_func,
+                                      data->targets->pdata[n]);
+  for (n = 0; n < data->targets->len; n++)
+    g_thread_join (finish_threads[n]);
+  g_free (finish_threads);
+
+  hash_pool_stop (data);
+  chunks_free (data);
+
+  if (data->verify)
     {
-      if (close (fd) != 0)
-        g_warning ("Error closing fd: %m");
+      for (n = 0; n < data->targets->len; n++)
+        check_mismatches (data->targets->pdata[n]);
     }
 
-  if (error != NULL)
+  data->end_time_usec = g_get_real_time ();
+
+  for (n = 0; n < data->targets->len; n++)
     {
-      /* show error in GUI */
-      if (!(error->domain == G_IO_ERROR && error->code == G_IO_ERROR_CANCELLED))
-        {
-          data->copy_error = error; error = NULL;
-          g_idle_add (on_show_error, dialog_data_ref (data));
-        }
-      g_clear_error (&error);
+      RestoreTarget *target = data->targets->pdata[n];
 
       /* Wipe the device */
-      if (!udisks_block_call_format_sync (data->block,
+      if (!restore_target_is_alive (target) &&
+          target->wipe_on_error &&
+          !udisks_block_call_format_sync (target->block,
                                           "empty",
                                           g_variant_new ("a{sv}", NULL), /* options */
                                           NULL, /* cancellable */
@@ -879,24 +2817,27 @@ copy_thread_func (gpointer user_data)
                      error2->message, g_quark_to_string (error2->domain), error2->code);
           g_clear_error (&error2);
         }
-    }
-  else
-    {
-      /* success */
-      g_idle_add (on_success, dialog_data_ref (data));
-    }
 
-  g_free (buffer_unaligned);
+      /* finally, request that the core OS / kernel rescans the device */
+      if (!udisks_block_call_rescan_sync (target->block,
+                                          g_variant_new ("a{sv}", NULL), /* options */
+                                          NULL, /* cancellable */
+                                          &error2))
+        {
+          g_warning ("Error rescanning device: %s (%s, %d)",
+                     error2->message, g_quark_to_string (error2->domain), error2->code);
+          g_clear_error (&error2);
+        }
+    }
 
-  /* finally, request that the core OS / kernel rescans the device */
-  if (!udisks_block_call_rescan_sync (data->block,
-                                      g_variant_new ("a{sv}", NULL), /* options */
-                                      NULL, /* cancellable */
-                                      &error2))
+  /* if everything was cancelled, the dialog has already been completed */
+  if (!g_cancellable_is_cancelled (data->cancellable))
     {
-      g_warning ("Error rescanning device: %s (%s, %d)",
-                 error2->message, g_quark_to_string (error2->domain), error2->code);
-      g_clear_error (&error2);
+      data->copy_error = build_copy_error (data);
+      if (data->copy_error != NULL)
+        g_idle_add (on_show_error, dialog_data_ref (data));
+      else
+        g_idle_add (on_success, dialog_data_ref (data));
     }
 
   dialog_data_unref_in_idle (data); /* unref on main thread */
@@ -909,12 +2850,21 @@ static void
 on_local_job_canceled (GduLocalJob  *job,
                        gpointer      user_data)
 {
-  DialogData *data = user_data;
+  RestoreTarget *target = user_data;
+  DialogData *data = target->data;
   if (!data->completed)
     {
-      dialog_data_terminate_job (data);
-      dialog_data_complete_and_unref (data);
-      update_job (data, FALSE);
+      restore_target_fail (target, g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "Operation was cancelled"));
+      gdu_application_destroy_local_job (gdu_window_get_application (data->window), target->local_job);
+      target->local_job = NULL;
+
+      /* only stop everything once the last target has been canceled */
+      if (count_alive_targets (data) == 0)
+        {
+          dialog_data_terminate_job (data);
+          dialog_data_complete_and_unref (data);
+          update_job (data, FALSE);
+        }
     }
 }
 
@@ -924,7 +2874,10 @@ start_copying (DialogData *data)
   GFile *file = NULL;
   gboolean ret = FALSE;
   GFileInfo *info;
+  GduCompressionType compression;
   GError *error;
+  GList *l;
+  guint n;
 
   error = NULL;
   if (data->disk_image_filename != NULL)
@@ -944,7 +2897,6 @@ start_copying (DialogData *data)
 
   error = NULL;
   info = g_file_query_info (file,
-                            G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
                             G_FILE_ATTRIBUTE_STANDARD_SIZE,
                             G_FILE_QUERY_INFO_NONE,
                             NULL,
@@ -957,16 +2909,35 @@ start_copying (DialogData *data)
       goto out;
     }
   data->input_size = g_file_info_get_size (info);
-  if (g_str_has_suffix (g_file_info_get_content_type (info), "-xz-compressed"))
+  data->image_id = gdu_restore_journal_get_image_id (file);
+  /* the dialog can't be confirmed before the image has been examined, see restore_disk_image_update() */
+  g_assert (data->image_info != NULL && data->image_info->done && data->image_info->entry != NULL);
+  compression = data->image_info->entry->compression;
+  if (data->image_info->entry->virtual_disk_format != GDU_VIRTUAL_DISK_FORMAT_NONE)
+    {
+      data->virtual_disk = gdu_virtual_disk_open (file, NULL, &error);
+      if (data->virtual_disk == NULL)
+        {
+          gdu_utils_show_error (GTK_WINDOW (data->dialog), _("Error opening file for reading"), error);
+          g_error_free (error);
+          g_object_unref (info);
+          dialog_data_complete_and_unref (data);
+          goto out;
+        }
+      data->input_size = gdu_virtual_disk_get_size (data->virtual_disk);
+    }
+  if (compression != GDU_COMPRESSION_TYPE_NONE)
     {
-      GduXzDecompressor *decompressor;
+      GConverter *decompressor;
       GInputStream *decompressed_input_stream;
 
-      data->input_size = gdu_xz_decompressor_get_uncompressed_size (file);
+      /* may be 0, the copy thread copes with that */
+      data->input_size = data->image_info->entry->size;
 
-      decompressor = gdu_xz_decompressor_new ();
+      decompressor = gdu_compression_new_decompressor (compression);
+      g_assert (decompressor != NULL); /* checked in restore_disk_image_update() */
       decompressed_input_stream = g_converter_input_stream_new (G_INPUT_STREAM (data->input_stream),
-                                                                G_CONVERTER (decompressor));
+                                                                decompressor);
       g_clear_object (&decompressor);
 
       g_object_unref (data->input_stream);
@@ -974,6 +2945,11 @@ start_copying (DialogData *data)
     }
   g_object_unref (info);
 
+  data->verify = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (data->verify_checkbutton));
+  data->delta = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (data->delta_checkbutton));
+  if (data->verify)
+    data->manifest_filename = gdu_image_manifest_get_filename_for_image (file);
+
   data->inhibit_cookie = gtk_application_inhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
                                                   GTK_WINDOW (data->dialog),
                                                   GTK_APPLICATION_INHIBIT_SUSPEND |
@@ -981,22 +2957,38 @@ start_copying (DialogData *data)
                                                   /* Translators: Reason why suspend/logout is being inhibited */
                                                   C_("restore-inhibit-message", "Copying disk image to device"));
 
-  data->local_job = gdu_application_create_local_job (gdu_window_get_application (data->window),
-                                                      data->object);
-  udisks_job_set_operation (UDISKS_JOB (data->local_job), "x-gdu-restore-disk-image");
-  /* Translators: this is the description of the job */
-  gdu_local_job_set_description (data->local_job, _("Restoring Disk Image"));
-  udisks_job_set_progress_valid (UDISKS_JOB (data->local_job), TRUE);
-  udisks_job_set_cancelable (UDISKS_JOB (data->local_job), TRUE);
-  g_signal_connect (data->local_job, "canceled",
-                    G_CALLBACK (on_local_job_canceled),
-                    data);
+  if (data->objects != NULL)
+    {
+      for (l = data->objects; l != NULL; l = l->next)
+        g_ptr_array_add (data->targets, restore_target_new (data, UDISKS_OBJECT (l->data)));
+    }
+  else
+    {
+      g_ptr_array_add (data->targets, restore_target_new (data, data->object));
+    }
+
+  /* each target has its own job so it can be followed - and canceled - separately */
+  for (n = 0; n < data->targets->len; n++)
+    {
+      RestoreTarget *target = data->targets->pdata[n];
+      target->local_job = gdu_application_create_local_job (gdu_window_get_application (data->window),
+                                                            target->object);
+      udisks_job_set_operation (UDISKS_JOB (target->local_job), "x-gdu-restore-disk-image");
+      /* Translators: this is the description of the job */
+      gdu_local_job_set_description (target->local_job, _("Restoring Disk Image"));
+      udisks_job_set_progress_valid (UDISKS_JOB (target->local_job), TRUE);
+      udisks_job_set_cancelable (UDISKS_JOB (target->local_job), TRUE);
+      g_signal_connect (target->local_job, "canceled",
+                        G_CALLBACK (on_local_job_canceled),
+                        target);
+    }
 
   dialog_data_hide (data);
 
   if (data->switch_to_object)
     gdu_window_select_object (data->window, data->object);
 
+  data->copying = TRUE;
   g_thread_new ("copy-disk-image-thread",
                 copy_thread_func,
                 dialog_data_ref (data));
@@ -1013,7 +3005,7 @@ ensure_unused_cb (GduWindow     *window,
                   gpointer       user_data)
 {
   DialogData *data = user_data;
-  if (gdu_window_ensure_unused_finish (window, res, NULL))
+  if (gdu_window_ensure_unused_list_finish (window, res, NULL))
     {
       start_copying (data);
     }
@@ -1030,17 +3022,36 @@ on_dialog_response (GtkDialog     *dialog,
 {
   DialogData *data = user_data;
   GList *objects = NULL;
+  gchar *message = NULL;
 
   if (data->dialog == NULL)
     goto out;
 
-  objects = g_list_append (NULL, data->object);
+  if (data->objects != NULL)
+    objects = g_list_copy (data->objects);
+  else
+    objects = g_list_append (NULL, data->object);
 
   switch (response)
     {
     case GTK_RESPONSE_OK:
+      if (data->objects != NULL)
+        {
+          /* Translators: Heading for the confirmation dialog when restoring to several devices at once.
+           *              The %d is the number of devices (e.g. 4).
+           */
+          message = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                                  "Are you sure you want to write the disk image to %d device?",
+                                                  "Are you sure you want to write the disk image to %d devices?",
+                                                  g_list_length (objects)),
+                                     g_list_length (objects));
+        }
+      else
+        {
+          message = g_strdup (_("Are you sure you want to write the disk image to the device?"));
+        }
       if (!gdu_utils_show_confirmation (GTK_WINDOW (data->dialog),
-                                        _("Are you sure you want to write the disk image to the device?"),
+                                        message,
                                         _("All existing data will be lost"),
                                         _("_Restore"),
                                         NULL, NULL,
@@ -1053,12 +3064,12 @@ on_dialog_response (GtkDialog     *dialog,
       /* now that we know the user picked a folder, update file chooser settings */
       gdu_utils_file_chooser_for_disk_images_update_settings (GTK_FILE_CHOOSER (data->selectable_image_fcbutton));
 
-      /* ensure the device is unused (e.g. unmounted) before copying data to it... */
-      gdu_window_ensure_unused (data->window,
-                                data->object,
-                                (GAsyncReadyCallback) ensure_unused_cb,
-                                NULL, /* GCancellable */
-                                data);
+      /* ensure the devices are unused (e.g. unmounted) before copying data to them... */
+      gdu_window_ensure_unused_list (data->window,
+                                     objects,
+                                     (GAsyncReadyCallback) ensure_unused_cb,
+                                     NULL, /* GCancellable */
+                                     data);
       break;
 
     default: /* explicit fallthrough */
@@ -1067,26 +3078,30 @@ on_dialog_response (GtkDialog     *dialog,
       break;
     }
  out:
+  g_free (message);
   g_list_free (objects);
 }
 
-void
-gdu_restore_disk_image_dialog_show (GduWindow    *window,
-                                    UDisksObject *object,
-                                    const gchar  *disk_image_filename)
+static DialogData *
+dialog_data_new (GduWindow   *window,
+                 const gchar *disk_image_filename)
 {
-  guint n;
   DialogData *data;
 
   data = g_new0 (DialogData, 1);
   data->ref_count = 1;
   g_mutex_init (&data->copy_lock);
   data->window = g_object_ref (window);
-  set_destination_object (data, object);
-  if (object == NULL)
-    data->switch_to_object = TRUE;
   data->disk_image_filename = g_strdup (disk_image_filename);
   data->cancellable = g_cancellable_new ();
+  data->targets = g_ptr_array_new_with_free_func ((GDestroyNotify) restore_target_free);
+  return data;
+}
+
+static void
+dialog_data_show (DialogData *data)
+{
+  guint n;
 
   data->dialog = GTK_WIDGET (gdu_application_new_widget (gdu_window_get_application (data->window),
                                                          "restore-disk-image-dialog.ui",
@@ -1112,6 +3127,23 @@ gdu_restore_disk_image_dialog_show (GduWindow    *window,
   restore_disk_image_populate (data);
   restore_disk_image_update (data);
 
+  /* The application started indexing when it started - do it again in
+   * case images were added since, so the ones the user is likely to
+   * choose have been examined by then
+   */
+  if (data->disk_image_filename == NULL)
+    {
+      gchar *image_dir_uri;
+      GFile *image_dir;
+
+      image_dir_uri = gdu_utils_get_image_dir_uri ();
+      image_dir = g_file_new_for_uri (image_dir_uri);
+      gdu_image_catalog_index_directory (gdu_application_get_image_catalog (gdu_window_get_application (data->window)),
+                                         image_dir);
+      g_object_unref (image_dir);
+      g_free (image_dir_uri);
+    }
+
   /* unfortunately, GtkFileChooserButton:file-set is not emitted when the user
    * unselects a file but we can work around that.. (TODO: file bug against gtk+)
    */
@@ -1123,11 +3155,58 @@ gdu_restore_disk_image_dialog_show (GduWindow    *window,
                                                        G_CALLBACK (on_dialog_response),
                                                        data);
 
-  gtk_window_set_transient_for (GTK_WINDOW (data->dialog), GTK_WINDOW (window));
+  gtk_window_set_transient_for (GTK_WINDOW (data->dialog), GTK_WINDOW (data->window));
   gtk_window_present (GTK_WINDOW (data->dialog));
 
   gtk_widget_realize (data->selectable_destination_combobox);
   gtk_widget_grab_focus (data->selectable_destination_combobox);
 }
 
+void
+gdu_restore_disk_image_dialog_show (GduWindow    *window,
+                                    UDisksObject *object,
+                                    const gchar  *disk_image_filename)
+{
+  DialogData *data;
+
+  data = dialog_data_new (window, disk_image_filename);
+  set_destination_object (data, object);
+  if (object == NULL)
+    data->switch_to_object = TRUE;
+  dialog_data_show (data);
+}
+
+/* Like gdu_restore_disk_image_dialog_show() but writes the disk image
+ * to all of @blocks at the same time. The image must fit on the
+ * smallest of them.
+ */
+void
+gdu_restore_disk_image_dialog_show_for_blocks (GduWindow   *window,
+                                               GList       *blocks,
+                                               const gchar *disk_image_filename)
+{
+  DialogData *data;
+  GList *l;
+
+  g_return_if_fail (blocks != NULL);
+
+  data = dialog_data_new (window, disk_image_filename);
+  for (l = blocks; l != NULL; l = l->next)
+    {
+      UDisksBlock *block = UDISKS_BLOCK (l->data);
+      UDisksObject *object;
+      guint64 size;
+
+      object = (UDisksObject *) g_dbus_interface_dup_object (G_DBUS_INTERFACE (block));
+      if (object == NULL)
+        continue;
+      data->objects = g_list_append (data->objects, object);
+
+      size = udisks_block_get_size (block);
+      if (data->block_size == 0 || size < data->block_size)
+        data->block_size = size;
+    }
+  dialog_data_show (data);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
@@ -19,6 +19,10 @@ void     gdu_restore_disk_image_dialog_show (GduWindow    *window,
                                              UDisksObject *object,
                                              const gchar  *disk_image_filename);
 
+void     gdu_restore_disk_image_dialog_show_for_blocks (GduWindow    *window,
+                                                        GList        *blocks,
+                                                        const gchar  *disk_image_filename);
+
 G_END_DECLS
 
 #endif /* __GDU_RESTORE_DISK_IMAGE_DIALOG_H__ */
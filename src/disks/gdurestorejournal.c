@@ -0,0 +1,352 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "gdurestorejournal.h"
+
+/* A restore journal records how far restoring a disk image to a
+ * device has durably progressed, so an interrupted restore can be
+ * resumed instead of started over.
+ *
+ * The journal for a device is stored in
+ * $XDG_CACHE_HOME/gnome-disks/restore/ as a serialized GVariant of
+ * type a{sv} with the following keys
+ *
+ *  version            (i)  - currently 1
+ *  image-id           (s)  - identifies the disk image, see gdu_restore_journal_get_image_id()
+ *  device-id          (s)  - identifies the device
+ *  device-size        (t)  - size of the device
+ *  offset             (t)  - everything before this offset has been written and synced
+ *  last-chunk-offset  (t)  - offset of the last chunk written before syncing
+ *  last-chunk-size    (t)  - size of that chunk
+ *  last-chunk-digest  (ay) - SHA-256 digest of that chunk
+ *
+ * The last chunk is used to check that the device still has what was
+ * written to it before resuming.
+ */
+
+#define DIGEST_SIZE 32
+
+struct GduRestoreJournal
+{
+  gchar *image_id;
+  gchar *device_id;
+  guint64 device_size;
+
+  guint64 offset;
+  guint64 last_chunk_offset;
+  gsize last_chunk_size;
+  guint8 last_chunk_digest[DIGEST_SIZE];
+};
+
+/* returns NULL if the image can't be identified */
+gchar *
+gdu_restore_journal_get_image_id (GFile *image_file)
+{
+  gchar *ret = NULL;
+  GFileInfo *info;
+  gchar *uri;
+
+  info = g_file_query_info (image_file,
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                            G_FILE_ATTRIBUTE_UNIX_INODE,
+                            G_FILE_QUERY_INFO_NONE,
+                            NULL,
+                            NULL);
+  if (info == NULL)
+    goto out;
+
+  uri = g_file_get_uri (image_file);
+  ret = g_strdup_printf ("%s:%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+                         uri,
+                         (guint64) g_file_info_get_size (info),
+                         g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+                         g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE));
+  g_free (uri);
+  g_object_unref (info);
+
+ out:
+  return ret;
+}
+
+gchar *
+gdu_restore_journal_get_filename (const gchar *device_id)
+{
+  gchar *ret;
+  gchar *checksum;
+  gchar *basename;
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, device_id, -1);
+  basename = g_strdup_printf ("%s.journal", checksum);
+  ret = g_build_filename (g_get_user_cache_dir (), "gnome-disks", "restore", basename, NULL);
+  g_free (basename);
+  g_free (checksum);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+GduRestoreJournal *
+gdu_restore_journal_new (const gchar *image_id,
+                         const gchar *device_id,
+                         guint64      device_size)
+{
+  GduRestoreJournal *journal;
+
+  g_return_val_if_fail (image_id != NULL, NULL);
+  g_return_val_if_fail (device_id != NULL, NULL);
+
+  journal = g_new0 (GduRestoreJournal, 1);
+  journal->image_id = g_strdup (image_id);
+  journal->device_id = g_strdup (device_id);
+  journal->device_size = device_size;
+  return journal;
+}
+
+void
+gdu_restore_journal_free (GduRestoreJournal *journal)
+{
+  if (journal == NULL)
+    return;
+  g_free (journal->image_id);
+  g_free (journal->device_id);
+  g_free (journal);
+}
+
+GduRestoreJournal *
+gdu_restore_journal_load (const gchar  *filename,
+                          GError      **error)
+{
+  GduRestoreJournal *ret = NULL;
+  gchar *variant_data = NULL;
+  gsize variant_size;
+  GVariant *value = NULL;
+  GVariant *digest_variant = NULL;
+  gint32 version;
+  const gchar *image_id;
+  const gchar *device_id;
+  guint64 device_size;
+  guint64 offset;
+  guint64 last_chunk_offset;
+  guint64 last_chunk_size;
+  gconstpointer digest;
+  gsize digest_size;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (!g_file_get_contents (filename,
+                            &variant_data,
+                            &variant_size,
+                            error))
+    goto out;
+
+  value = g_variant_new_from_data (G_VARIANT_TYPE_VARDICT,
+                                   variant_data,
+                                   variant_size,
+                                   FALSE,
+                                   NULL, NULL);
+
+  if (!g_variant_lookup (value, "version", "i", &version))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "No version key");
+      goto out;
+    }
+  if (version != 1)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Cannot decode version %d journal", version);
+      goto out;
+    }
+  if (!g_variant_lookup (value, "image-id", "&s", &image_id) ||
+      !g_variant_lookup (value, "device-id", "&s", &device_id) ||
+      !g_variant_lookup (value, "device-size", "t", &device_size))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "No image-id, device-id or device-size");
+      goto out;
+    }
+  if (!g_variant_lookup (value, "offset", "t", &offset) ||
+      !g_variant_lookup (value, "last-chunk-offset", "t", &last_chunk_offset) ||
+      !g_variant_lookup (value, "last-chunk-size", "t", &last_chunk_size) ||
+      !g_variant_lookup (value, "last-chunk-digest", "@ay", &digest_variant) ||
+      last_chunk_size > G_MAXSIZE ||
+      last_chunk_offset + last_chunk_size > offset)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "No or invalid progress");
+      goto out;
+    }
+  digest = g_variant_get_fixed_array (digest_variant, &digest_size, sizeof (guint8));
+  if (digest_size != DIGEST_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Expected %d bytes of digest data, got %" G_GSIZE_FORMAT,
+                   DIGEST_SIZE, digest_size);
+      goto out;
+    }
+
+  ret = gdu_restore_journal_new (image_id, device_id, device_size);
+  ret->offset = offset;
+  ret->last_chunk_offset = last_chunk_offset;
+  ret->last_chunk_size = last_chunk_size;
+  memcpy (ret->last_chunk_digest, digest, DIGEST_SIZE);
+
+ out:
+  if (digest_variant != NULL)
+    g_variant_unref (digest_variant);
+  if (value != NULL)
+    g_variant_unref (value);
+  g_free (variant_data);
+  return ret;
+}
+
+gboolean
+gdu_restore_journal_save (GduRestoreJournal  *journal,
+                          const gchar        *filename,
+                          GError            **error)
+{
+  gboolean ret = FALSE;
+  GVariantBuilder builder;
+  GVariant *value = NULL;
+  gchar *dirname = NULL;
+
+  g_return_val_if_fail (journal != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  dirname = g_path_get_dirname (filename);
+  if (g_mkdir_with_parents (dirname, 0700) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error creating directory %s: %m", dirname);
+      goto out;
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "version", g_variant_new_int32 (1));
+  g_variant_builder_add (&builder, "{sv}", "image-id", g_variant_new_string (journal->image_id));
+  g_variant_builder_add (&builder, "{sv}", "device-id", g_variant_new_string (journal->device_id));
+  g_variant_builder_add (&builder, "{sv}", "device-size", g_variant_new_uint64 (journal->device_size));
+  g_variant_builder_add (&builder, "{sv}", "offset", g_variant_new_uint64 (journal->offset));
+  g_variant_builder_add (&builder, "{sv}", "last-chunk-offset", g_variant_new_uint64 (journal->last_chunk_offset));
+  g_variant_builder_add (&builder, "{sv}", "last-chunk-size", g_variant_new_uint64 (journal->last_chunk_size));
+  g_variant_builder_add (&builder, "{sv}", "last-chunk-digest",
+                         g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                                    journal->last_chunk_digest,
+                                                    DIGEST_SIZE,
+                                                    sizeof (guint8)));
+  value = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  /* g_file_set_contents() replaces the file atomically so an old journal is never half-overwritten */
+  if (!g_file_set_contents (filename,
+                            g_variant_get_data (value),
+                            g_variant_get_size (value),
+                            error))
+    goto out;
+
+  ret = TRUE;
+
+ out:
+  if (value != NULL)
+    g_variant_unref (value);
+  g_free (dirname);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* returns TRUE if @journal is for restoring the same disk image to the same device */
+gboolean
+gdu_restore_journal_matches (GduRestoreJournal *journal,
+                             const gchar       *image_id,
+                             const gchar       *device_id)
+{
+  return g_strcmp0 (journal->image_id, image_id) == 0 &&
+    g_strcmp0 (journal->device_id, device_id) == 0;
+}
+
+guint64
+gdu_restore_journal_get_device_size (GduRestoreJournal *journal)
+{
+  return journal->device_size;
+}
+
+guint64
+gdu_restore_journal_get_offset (GduRestoreJournal *journal)
+{
+  return journal->offset;
+}
+
+guint64
+gdu_restore_journal_get_last_chunk_offset (GduRestoreJournal *journal)
+{
+  return journal->last_chunk_offset;
+}
+
+gsize
+gdu_restore_journal_get_last_chunk_size (GduRestoreJournal *journal)
+{
+  return journal->last_chunk_size;
+}
+
+static void
+compute_digest (const guchar *data,
+                gsize         size,
+                guint8       *out_digest)
+{
+  GChecksum *checksum;
+  gsize digest_len = DIGEST_SIZE;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, data, size);
+  g_checksum_get_digest (checksum, out_digest, &digest_len);
+  g_checksum_free (checksum);
+  g_warn_if_fail (digest_len == DIGEST_SIZE);
+}
+
+/* Must only be called once everything before @offset - including the
+ * chunk at @last_chunk_offset - has been written and synced.
+ */
+void
+gdu_restore_journal_set_progress (GduRestoreJournal *journal,
+                                  guint64            offset,
+                                  guint64            last_chunk_offset,
+                                  const guchar      *last_chunk_data,
+                                  gsize              last_chunk_size)
+{
+  g_return_if_fail (last_chunk_offset + last_chunk_size <= offset);
+
+  journal->offset = offset;
+  journal->last_chunk_offset = last_chunk_offset;
+  journal->last_chunk_size = last_chunk_size;
+  compute_digest (last_chunk_data, last_chunk_size, journal->last_chunk_digest);
+}
+
+/* checks @data, read from the device at the last chunk offset, against what was written there */
+gboolean
+gdu_restore_journal_check_last_chunk (GduRestoreJournal *journal,
+                                      const guchar      *data,
+                                      gsize              size)
+{
+  guint8 digest[DIGEST_SIZE];
+
+  if (size != journal->last_chunk_size)
+    return FALSE;
+
+  compute_digest (data, size, digest);
+  return memcmp (digest, journal->last_chunk_digest, DIGEST_SIZE) == 0;
+}
@@ -0,0 +1,51 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_RESTORE_JOURNAL_H__
+#define __GDU_RESTORE_JOURNAL_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+gchar             *gdu_restore_journal_get_image_id         (GFile              *image_file);
+gchar             *gdu_restore_journal_get_filename         (const gchar        *device_id);
+
+GduRestoreJournal *gdu_restore_journal_new                  (const gchar        *image_id,
+                                                             const gchar        *device_id,
+                                                             guint64             device_size);
+void               gdu_restore_journal_free                 (GduRestoreJournal  *journal);
+
+GduRestoreJournal *gdu_restore_journal_load                 (const gchar        *filename,
+                                                             GError            **error);
+gboolean           gdu_restore_journal_save                 (GduRestoreJournal  *journal,
+                                                             const gchar        *filename,
+                                                             GError            **error);
+
+gboolean           gdu_restore_journal_matches              (GduRestoreJournal  *journal,
+                                                             const gchar        *image_id,
+                                                             const gchar        *device_id);
+guint64            gdu_restore_journal_get_device_size      (GduRestoreJournal  *journal);
+guint64            gdu_restore_journal_get_offset           (GduRestoreJournal  *journal);
+guint64            gdu_restore_journal_get_last_chunk_offset (GduRestoreJournal *journal);
+gsize              gdu_restore_journal_get_last_chunk_size  (GduRestoreJournal  *journal);
+
+void               gdu_restore_journal_set_progress         (GduRestoreJournal  *journal,
+                                                             guint64             offset,
+                                                             guint64             last_chunk_offset,
+                                                             const guchar       *last_chunk_data,
+                                                             gsize               last_chunk_size);
+gboolean           gdu_restore_journal_check_last_chunk     (GduRestoreJournal  *journal,
+                                                             const guchar       *data,
+                                                             gsize               size);
+
+G_END_DECLS
+
+#endif /* __GDU_RESTORE_JOURNAL_H__ */
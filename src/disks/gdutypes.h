@@ -49,6 +49,66 @@ typedef struct GduLocalJob GduLocalJob;
 struct GduXzDecompressor;
 typedef struct GduXzDecompressor GduXzDecompressor;
 
+struct GduGzDecompressor;
+typedef struct GduGzDecompressor GduGzDecompressor;
+
+struct GduBz2Decompressor;
+typedef struct GduBz2Decompressor GduBz2Decompressor;
+
+struct GduZstdDecompressor;
+typedef struct GduZstdDecompressor GduZstdDecompressor;
+
+struct GduParallelDecoder;
+typedef struct GduParallelDecoder GduParallelDecoder;
+
+struct GduParallelDecoderFuncs;
+typedef struct GduParallelDecoderFuncs GduParallelDecoderFuncs;
+
+struct GduImageManifest;
+typedef struct GduImageManifest GduImageManifest;
+
+struct GduRestoreJournal;
+typedef struct GduRestoreJournal GduRestoreJournal;
+
+struct GduVirtualDisk;
+typedef struct GduVirtualDisk GduVirtualDisk;
+
+struct GduImageCatalog;
+typedef struct GduImageCatalog GduImageCatalog;
+
+struct GduImageCatalogEntry;
+typedef struct GduImageCatalogEntry GduImageCatalogEntry;
+
+struct GduImageLayout;
+typedef struct GduImageLayout GduImageLayout;
+
+struct GduImagePartition;
+typedef struct GduImagePartition GduImagePartition;
+
+struct GduBenchmarkWorkload;
+typedef struct GduBenchmarkWorkload GduBenchmarkWorkload;
+
+struct GduBenchmarkResult;
+typedef struct GduBenchmarkResult GduBenchmarkResult;
+
+struct GduHistogram;
+typedef struct GduHistogram GduHistogram;
+
+struct GduBenchmarkHistory;
+typedef struct GduBenchmarkHistory GduBenchmarkHistory;
+
+struct GduDiskStats;
+typedef struct GduDiskStats GduDiskStats;
+
+struct GduBenchmarkGraphSeries;
+typedef struct GduBenchmarkGraphSeries GduBenchmarkGraphSeries;
+
+struct GduZone;
+typedef struct GduZone GduZone;
+
+struct GduBenchmarkSample;
+typedef struct GduBenchmarkSample GduBenchmarkSample;
+
 G_END_DECLS
 
 #endif /* __GDU_TYPES_H__ */
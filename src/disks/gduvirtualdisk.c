@@ -0,0 +1,1289 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "gduvirtualdisk.h"
+
+/* Reader for the disk image formats used by virtual machines - QCOW2,
+ * VHD, VHDX and VMDK. Offsets in the virtual disk are translated to
+ * offsets in the file through the allocation tables of each format so
+ * the disk image can be restored without first converting it to a
+ * raw disk image.
+ *
+ * Each format allocates the virtual disk in fixed-size blocks (QCOW2
+ * clusters, VHD/VHDX blocks and VMDK grains). A block is either
+ * stored as-is, stored compressed (QCOW2 and stream-optimized VMDK)
+ * or not allocated, in which case it reads as zeroes.
+ *
+ * Images that depend on other files (backing files, differencing
+ * disks, split extents), encrypted images and images with pending
+ * log entries are not supported.
+ */
+
+typedef enum
+{
+  EXTENT_TYPE_ZERO,
+  EXTENT_TYPE_DATA,
+  EXTENT_TYPE_COMPRESSED
+} ExtentType;
+
+/* Where a block of the virtual disk is stored */
+typedef struct
+{
+  ExtentType type;
+  guint64 file_offset;
+  gsize compressed_size; /* only for EXTENT_TYPE_COMPRESSED */
+} Extent;
+
+struct GduVirtualDisk
+{
+  GduVirtualDiskFormat format;
+  GInputStream *stream;
+  guint64 file_size;
+
+  guint64 size;
+  guint64 block_size;
+  guint64 num_blocks;
+  gboolean tables_loaded;
+
+  /* for compressed blocks */
+  gint window_bits;
+  guchar *compressed_buffer;
+  gsize compressed_buffer_size;
+  guchar *block_buffer;
+  guint64 block_buffer_index; /* G_MAXUINT64 if block_buffer is not valid */
+
+  /* QCOW2 */
+  guint cluster_bits;
+  gboolean qcow2_v3;
+  guint32 l1_size;
+  guint64 l1_table_offset;
+  guint64 *l1_table;
+  guint64 *l2_table;
+  guint64 l2_table_offset; /* of the cached L2 table, 0 if none */
+
+  /* VHD and VHDX */
+  gboolean vhd_fixed;
+  guint64 bat_offset;
+  guint64 bat_size;
+  guint32 *vhd_bat;
+  guint64 vhd_bitmap_size;
+  guint64 *vhdx_bat;
+  guint64 vhdx_chunk_ratio;
+
+  /* VMDK */
+  gboolean vmdk_compressed;
+  gboolean vmdk_zeroed_grain_gte;
+  guint64 gd_offset;
+  guint32 num_gd_entries;
+  guint32 num_gtes_per_gt;
+  guint32 *gd;
+  guint32 *gt;
+  guint32 gt_sector; /* of the cached grain table, 0 if none */
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+#define QCOW2_MAGIC               "QFI\xfb"
+#define QCOW2_OFLAG_COMPRESSED    (G_GUINT64_CONSTANT (1) << 62)
+#define QCOW2_OFLAG_ZERO          (G_GUINT64_CONSTANT (1))
+#define QCOW2_OFFSET_MASK         G_GUINT64_CONSTANT (0x00fffffffffffe00)
+#define QCOW2_INCOMPAT_DIRTY      (G_GUINT64_CONSTANT (1) << 0)
+#define QCOW2_INCOMPAT_COMPRESSION (G_GUINT64_CONSTANT (1) << 3)
+
+#define VHD_COOKIE                "conectix"
+#define VHD_DYNAMIC_COOKIE        "cxsparse"
+#define VHD_DISK_TYPE_FIXED       2
+#define VHD_DISK_TYPE_DYNAMIC     3
+#define VHD_BAT_UNUSED            0xffffffff
+
+#define VHDX_SIGNATURE            "vhdxfile"
+#define VHDX_HEADER_SIZE          4096
+#define VHDX_REGION_TABLE_SIZE    (64 * 1024)
+#define VHDX_BAT_STATE_ZERO       2
+#define VHDX_BAT_STATE_UNMAPPED   3
+#define VHDX_BAT_STATE_NOT_PRESENT 0
+#define VHDX_BAT_STATE_UNDEFINED  1
+#define VHDX_BAT_STATE_FULLY_PRESENT 6
+
+#define VMDK_MAGIC                "KDMV"
+#define VMDK_DESCRIPTOR_MAGIC     "# Disk DescriptorFile"
+#define VMDK_FLAG_ZEROED_GRAIN_GTE (1 << 2)
+#define VMDK_FLAG_COMPRESSED      (1 << 16)
+#define VMDK_GD_AT_END            G_GUINT64_CONSTANT (0xffffffffffffffff)
+
+/* GUIDs as stored on disk - the first three fields are little-endian */
+static const guchar vhdx_bat_guid[16] =
+  {0x66, 0x77, 0xc2, 0x2d, 0x23, 0xf6, 0x00, 0x42, 0x9d, 0x64, 0x11, 0x5e, 0x9b, 0xfd, 0x4a, 0x08};
+static const guchar vhdx_metadata_guid[16] =
+  {0x06, 0xa2, 0x7c, 0x8b, 0x90, 0x47, 0x9a, 0x4b, 0xb8, 0xfe, 0x57, 0x5f, 0x05, 0x0f, 0x88, 0x6e};
+static const guchar vhdx_file_parameters_guid[16] =
+  {0x37, 0x67, 0xa1, 0xca, 0x36, 0xfa, 0x43, 0x4d, 0xb3, 0xb6, 0x33, 0xf0, 0xaa, 0x44, 0xe7, 0x6b};
+static const guchar vhdx_virtual_disk_size_guid[16] =
+  {0x24, 0x42, 0xa5, 0x2f, 0x1b, 0xcd, 0x76, 0x48, 0xb2, 0x11, 0x5d, 0xbe, 0xd8, 0x3b, 0xf4, 0xb8};
+static const guchar vhdx_logical_sector_size_guid[16] =
+  {0x1d, 0xbf, 0x41, 0x81, 0x6f, 0xa9, 0x09, 0x47, 0xba, 0x47, 0xf2, 0x33, 0xa8, 0xfa, 0xab, 0x5f};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static guint32
+get_be32 (const guchar *p)
+{
+  return ((guint32) p[0]) << 24 | ((guint32) p[1]) << 16 | ((guint32) p[2]) << 8 | p[3];
+}
+
+static guint64
+get_be64 (const guchar *p)
+{
+  return ((guint64) get_be32 (p)) << 32 | get_be32 (p + 4);
+}
+
+static guint16
+get_le16 (const guchar *p)
+{
+  return ((guint16) p[1]) << 8 | p[0];
+}
+
+static guint32
+get_le32 (const guchar *p)
+{
+  return ((guint32) p[3]) << 24 | ((guint32) p[2]) << 16 | ((guint32) p[1]) << 8 | p[0];
+}
+
+static guint64
+get_le64 (const guchar *p)
+{
+  return ((guint64) get_le32 (p + 4)) << 32 | get_le32 (p);
+}
+
+/* CRC-32C as used by VHDX - @data is small so a table isn't worth it */
+static guint32
+crc32c (const guchar *data,
+        gsize         size)
+{
+  guint32 crc = 0xffffffff;
+  gsize n;
+  guint k;
+
+  for (n = 0; n < size; n++)
+    {
+      crc ^= data[n];
+      for (k = 0; k < 8; k++)
+        crc = (crc >> 1) ^ (0x82f63b78 & (-(crc & 1)));
+    }
+  return ~crc;
+}
+
+/* checks the CRC-32C at @checksum_offset which is computed with the field itself set to zero */
+static gboolean
+vhdx_check_crc (guchar *data,
+                gsize   size,
+                gsize   checksum_offset)
+{
+  guint32 expected;
+  guint32 crc;
+
+  expected = get_le32 (data + checksum_offset);
+  memset (data + checksum_offset, 0, 4);
+  crc = crc32c (data, size);
+  data[checksum_offset + 0] = expected & 0xff;
+  data[checksum_offset + 1] = (expected >> 8) & 0xff;
+  data[checksum_offset + 2] = (expected >> 16) & 0xff;
+  data[checksum_offset + 3] = (expected >> 24) & 0xff;
+  return crc == expected;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+read_at (GduVirtualDisk  *disk,
+         guint64          offset,
+         guchar          *buffer,
+         gsize            size,
+         GCancellable    *cancellable,
+         GError         **error)
+{
+  gsize num_read;
+
+  if (!g_seekable_seek (G_SEEKABLE (disk->stream), offset, G_SEEK_SET, cancellable, error))
+    return FALSE;
+  if (!g_input_stream_read_all (disk->stream, buffer, size, &num_read, cancellable, error))
+    return FALSE;
+  if (num_read != size)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Unexpected end of file reading %" G_GSIZE_FORMAT " bytes at offset %" G_GUINT64_FORMAT,
+                   size, offset);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static void
+set_unsupported_error (GError      **error,
+                       const gchar  *message)
+{
+  g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, message);
+}
+
+static void
+set_invalid_error (GduVirtualDisk  *disk,
+                   GError         **error)
+{
+  /* Translators: Shown when a virtual machine disk image is damaged.
+   *              The %s is the name of the format (ex. "VHDX").
+   */
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+               _("The %s disk image is damaged"),
+               gdu_virtual_disk_format_get_name (disk->format));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+GduVirtualDiskFormat
+gdu_virtual_disk_detect (GFile *file)
+{
+  GduVirtualDiskFormat ret = GDU_VIRTUAL_DISK_FORMAT_NONE;
+  GFileInputStream *stream = NULL;
+  GFileInfo *info = NULL;
+  guchar buf[512];
+  gsize num_read = 0;
+  goffset size;
+
+  stream = g_file_read (file, NULL, NULL);
+  if (stream == NULL)
+    goto out;
+  if (!g_input_stream_read_all (G_INPUT_STREAM (stream), buf, 32, &num_read, NULL, NULL) || num_read < 32)
+    goto out;
+
+  if (memcmp (buf, QCOW2_MAGIC, 4) == 0)
+    ret = GDU_VIRTUAL_DISK_FORMAT_QCOW2;
+  else if (memcmp (buf, VHDX_SIGNATURE, 8) == 0)
+    ret = GDU_VIRTUAL_DISK_FORMAT_VHDX;
+  else if (memcmp (buf, VHD_COOKIE, 8) == 0)
+    ret = GDU_VIRTUAL_DISK_FORMAT_VHD;
+  else if (memcmp (buf, VMDK_MAGIC, 4) == 0 || memcmp (buf, VMDK_DESCRIPTOR_MAGIC, strlen (VMDK_DESCRIPTOR_MAGIC)) == 0)
+    ret = GDU_VIRTUAL_DISK_FORMAT_VMDK;
+  if (ret != GDU_VIRTUAL_DISK_FORMAT_NONE)
+    goto out;
+
+  /* A fixed VHD is a raw disk image followed by a 512 byte footer */
+  info = g_file_input_stream_query_info (stream, G_FILE_ATTRIBUTE_STANDARD_SIZE, NULL, NULL);
+  if (info == NULL)
+    goto out;
+  size = g_file_info_get_size (info);
+  if (size < 1024 || size % 512 != 0)
+    goto out;
+  if (!g_seekable_seek (G_SEEKABLE (stream), size - 512, G_SEEK_SET, NULL, NULL))
+    goto out;
+  if (!g_input_stream_read_all (G_INPUT_STREAM (stream), buf, 512, &num_read, NULL, NULL) || num_read < 512)
+    goto out;
+  if (memcmp (buf, VHD_COOKIE, 8) == 0 && get_be32 (buf + 60) == VHD_DISK_TYPE_FIXED)
+    ret = GDU_VIRTUAL_DISK_FORMAT_VHD;
+
+ out:
+  g_clear_object (&info);
+  g_clear_object (&stream);
+  return ret;
+}
+
+/* returns a name suitable for use in messages, e.g. "VMDK" */
+const gchar *
+gdu_virtual_disk_format_get_name (GduVirtualDiskFormat format)
+{
+  switch (format)
+    {
+    case GDU_VIRTUAL_DISK_FORMAT_QCOW2:
+      return "QCOW2";
+    case GDU_VIRTUAL_DISK_FORMAT_VHD:
+      return "VHD";
+    case GDU_VIRTUAL_DISK_FORMAT_VHDX:
+      return "VHDX";
+    case GDU_VIRTUAL_DISK_FORMAT_VMDK:
+      return "VMDK";
+    default:
+      return NULL;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+qcow2_open (GduVirtualDisk  *disk,
+            GCancellable    *cancellable,
+            GError         **error)
+{
+  guchar header[112];
+  guint32 version;
+  guint64 incompatible_features = 0;
+
+  if (!read_at (disk, 0, header, 72, cancellable, error))
+    return FALSE;
+
+  version = get_be32 (header + 4);
+  if (version != 2 && version != 3)
+    {
+      set_unsupported_error (error, _("This version of the QCOW2 format is not supported"));
+      return FALSE;
+    }
+  disk->qcow2_v3 = (version == 3);
+
+  if (get_be64 (header + 8) != 0)
+    {
+      set_unsupported_error (error, _("Disk images with a backing file are not supported"));
+      return FALSE;
+    }
+  if (get_be32 (header + 32) != 0)
+    {
+      set_unsupported_error (error, _("Encrypted disk images are not supported"));
+      return FALSE;
+    }
+
+  disk->cluster_bits = get_be32 (header + 20);
+  disk->size = get_be64 (header + 24);
+  disk->l1_size = get_be32 (header + 36);
+  disk->l1_table_offset = get_be64 (header + 40);
+  if (disk->cluster_bits < 9 || disk->cluster_bits > 21)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+
+  if (disk->qcow2_v3)
+    {
+      guint32 header_length;
+      if (!read_at (disk, 72, header + 72, 32, cancellable, error))
+        return FALSE;
+      incompatible_features = get_be64 (header + 72);
+      header_length = get_be32 (header + 100);
+      if (incompatible_features & QCOW2_INCOMPAT_COMPRESSION)
+        {
+          /* only zlib (0) is supported */
+          if (header_length < 105 || !read_at (disk, 104, header + 104, 1, cancellable, error) || header[104] != 0)
+            {
+              g_clear_error (error);
+              set_unsupported_error (error, _("Disk images compressed with Zstandard are not supported"));
+              return FALSE;
+            }
+        }
+      /* the dirty bit only means the refcounts may be out of date - they aren't used here */
+      if ((incompatible_features & ~(QCOW2_INCOMPAT_DIRTY | QCOW2_INCOMPAT_COMPRESSION)) != 0)
+        {
+          set_unsupported_error (error, _("The disk image uses QCOW2 features that are not supported"));
+          return FALSE;
+        }
+    }
+
+  disk->block_size = G_GUINT64_CONSTANT (1) << disk->cluster_bits;
+  /* compressed clusters are raw deflate streams */
+  disk->window_bits = -12;
+  return TRUE;
+}
+
+static gboolean
+qcow2_load_tables (GduVirtualDisk  *disk,
+                   GCancellable    *cancellable,
+                   GError         **error)
+{
+  guint64 num_l2_entries = disk->block_size / 8;
+  guint64 num_l1_entries;
+  guchar *buf;
+  guint64 n;
+
+  num_l1_entries = (disk->num_blocks + num_l2_entries - 1) / num_l2_entries;
+  if (num_l1_entries > disk->l1_size)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+
+  buf = g_malloc (num_l1_entries * 8 + 1);
+  if (!read_at (disk, disk->l1_table_offset, buf, num_l1_entries * 8, cancellable, error))
+    {
+      g_free (buf);
+      return FALSE;
+    }
+  disk->l1_size = num_l1_entries;
+  disk->l1_table = g_new (guint64, num_l1_entries + 1);
+  for (n = 0; n < num_l1_entries; n++)
+    disk->l1_table[n] = get_be64 (buf + n * 8) & QCOW2_OFFSET_MASK;
+  g_free (buf);
+
+  disk->l2_table = g_new (guint64, num_l2_entries);
+  return TRUE;
+}
+
+static gboolean
+qcow2_map_block (GduVirtualDisk  *disk,
+                 guint64          block_index,
+                 Extent          *extent,
+                 GCancellable    *cancellable,
+                 GError         **error)
+{
+  guint l2_bits = disk->cluster_bits - 3;
+  guint64 l1_index = block_index >> l2_bits;
+  guint64 l2_index = block_index & ((G_GUINT64_CONSTANT (1) << l2_bits) - 1);
+  guint64 l2_offset;
+  guint64 entry;
+
+  extent->type = EXTENT_TYPE_ZERO;
+
+  l2_offset = disk->l1_table[l1_index];
+  if (l2_offset == 0)
+    return TRUE;
+
+  if (disk->l2_table_offset != l2_offset)
+    {
+      guint64 n;
+      disk->l2_table_offset = 0;
+      if (!read_at (disk, l2_offset, (guchar *) disk->l2_table, disk->block_size, cancellable, error))
+        return FALSE;
+      for (n = 0; n < disk->block_size / 8; n++)
+        disk->l2_table[n] = get_be64 ((guchar *) (disk->l2_table + n));
+      disk->l2_table_offset = l2_offset;
+    }
+  entry = disk->l2_table[l2_index];
+
+  if (entry & QCOW2_OFLAG_COMPRESSED)
+    {
+      guint csize_shift = 62 - (disk->cluster_bits - 8);
+      guint64 csize_mask = (G_GUINT64_CONSTANT (1) << (disk->cluster_bits - 8)) - 1;
+      guint64 nb_csectors;
+
+      extent->type = EXTENT_TYPE_COMPRESSED;
+      extent->file_offset = entry & ((G_GUINT64_CONSTANT (1) << csize_shift) - 1);
+      nb_csectors = ((entry >> csize_shift) & csize_mask) + 1;
+      extent->compressed_size = nb_csectors * 512 - (extent->file_offset & 511);
+    }
+  else if (disk->qcow2_v3 && (entry & QCOW2_OFLAG_ZERO))
+    {
+      /* reads as zeroes even if a cluster is allocated */
+    }
+  else if ((entry & QCOW2_OFFSET_MASK) != 0)
+    {
+      extent->type = EXTENT_TYPE_DATA;
+      extent->file_offset = entry & QCOW2_OFFSET_MASK;
+    }
+
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+vhd_open (GduVirtualDisk  *disk,
+          GCancellable    *cancellable,
+          GError         **error)
+{
+  guchar footer[512];
+  guchar header[1024];
+  guint32 disk_type;
+  guint64 dynamic_header_offset;
+
+  /* dynamic disks have a copy of the footer at the start of the file */
+  if (!read_at (disk, 0, footer, sizeof footer, cancellable, error))
+    return FALSE;
+  if (memcmp (footer, VHD_COOKIE, 8) != 0)
+    {
+      if (disk->file_size < 512 || !read_at (disk, disk->file_size - 512, footer, sizeof footer, cancellable, error))
+        return FALSE;
+      if (memcmp (footer, VHD_COOKIE, 8) != 0)
+        {
+          set_invalid_error (disk, error);
+          return FALSE;
+        }
+    }
+
+  disk->size = get_be64 (footer + 48);
+  disk_type = get_be32 (footer + 60);
+
+  if (disk_type == VHD_DISK_TYPE_FIXED)
+    {
+      /* the data is stored as-is, followed by the footer */
+      disk->vhd_fixed = TRUE;
+      disk->block_size = 2 * 1024 * 1024;
+      if (disk->size > disk->file_size - 512)
+        {
+          set_invalid_error (disk, error);
+          return FALSE;
+        }
+      return TRUE;
+    }
+  else if (disk_type != VHD_DISK_TYPE_DYNAMIC)
+    {
+      set_unsupported_error (error, _("Differencing disk images are not supported"));
+      return FALSE;
+    }
+
+  dynamic_header_offset = get_be64 (footer + 16);
+  if (!read_at (disk, dynamic_header_offset, header, sizeof header, cancellable, error))
+    return FALSE;
+  if (memcmp (header, VHD_DYNAMIC_COOKIE, 8) != 0)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+  disk->bat_offset = get_be64 (header + 16);
+  disk->bat_size = get_be32 (header + 28);
+  disk->block_size = get_be32 (header + 32);
+  if (disk->block_size < 512 || disk->block_size % 512 != 0)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+  /* one bit per sector, padded to a whole sector */
+  disk->vhd_bitmap_size = ((disk->block_size / 512 / 8) + 511) / 512 * 512;
+  return TRUE;
+}
+
+static gboolean
+vhd_load_tables (GduVirtualDisk  *disk,
+                 GCancellable    *cancellable,
+                 GError         **error)
+{
+  guchar *buf;
+  guint64 n;
+
+  if (disk->vhd_fixed)
+    return TRUE;
+
+  if (disk->num_blocks > disk->bat_size)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+  buf = g_malloc (disk->num_blocks * 4 + 1);
+  if (!read_at (disk, disk->bat_offset, buf, disk->num_blocks * 4, cancellable, error))
+    {
+      g_free (buf);
+      return FALSE;
+    }
+  disk->vhd_bat = g_new (guint32, disk->num_blocks + 1);
+  for (n = 0; n < disk->num_blocks; n++)
+    disk->vhd_bat[n] = get_be32 (buf + n * 4);
+  g_free (buf);
+  return TRUE;
+}
+
+static gboolean
+vhd_map_block (GduVirtualDisk  *disk,
+               guint64          block_index,
+               Extent          *extent,
+               GCancellable    *cancellable,
+               GError         **error)
+{
+  if (disk->vhd_fixed)
+    {
+      extent->type = EXTENT_TYPE_DATA;
+      extent->file_offset = block_index * disk->block_size;
+    }
+  else if (disk->vhd_bat[block_index] == VHD_BAT_UNUSED)
+    {
+      extent->type = EXTENT_TYPE_ZERO;
+    }
+  else
+    {
+      /* Like other implementations, ignore the sector bitmap - in a
+       * dynamic disk, sectors that were never written are zero
+       */
+      extent->type = EXTENT_TYPE_DATA;
+      extent->file_offset = ((guint64) disk->vhd_bat[block_index]) * 512 + disk->vhd_bitmap_size;
+    }
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+vhdx_read_metadata (GduVirtualDisk  *disk,
+                    guint64          metadata_offset,
+                    guint32          metadata_length,
+                    GCancellable    *cancellable,
+                    GError         **error)
+{
+  gboolean ret = FALSE;
+  guchar *metadata = NULL;
+  guint entry_count;
+  guint32 logical_sector_size = 0;
+  gboolean have_parameters = FALSE;
+  gboolean have_size = FALSE;
+  guint n;
+
+  if (metadata_length < 32 || metadata_length > 1024 * 1024 * 1024)
+    {
+      set_invalid_error (disk, error);
+      goto out;
+    }
+  metadata = g_malloc (metadata_length);
+  if (!read_at (disk, metadata_offset, metadata, metadata_length, cancellable, error))
+    goto out;
+  if (memcmp (metadata, "metadata", 8) != 0)
+    {
+      set_invalid_error (disk, error);
+      goto out;
+    }
+
+  entry_count = get_le16 (metadata + 10);
+  for (n = 0; n < entry_count; n++)
+    {
+      const guchar *entry = metadata + 32 + n * 32;
+      guint32 offset;
+      guint32 length;
+
+      if (32 + (n + 1) * 32 > metadata_length)
+        break;
+      offset = get_le32 (entry + 16);
+      length = get_le32 (entry + 20);
+      if (((guint64) offset) + length > metadata_length)
+        continue;
+
+      if (memcmp (entry, vhdx_file_parameters_guid, 16) == 0 && length >= 8)
+        {
+          disk->block_size = get_le32 (metadata + offset);
+          /* HasParent */
+          if (get_le32 (metadata + offset + 4) & (1 << 1))
+            {
+              set_unsupported_error (error, _("Differencing disk images are not supported"));
+              goto out;
+            }
+          have_parameters = TRUE;
+        }
+      else if (memcmp (entry, vhdx_virtual_disk_size_guid, 16) == 0 && length >= 8)
+        {
+          disk->size = get_le64 (metadata + offset);
+          have_size = TRUE;
+        }
+      else if (memcmp (entry, vhdx_logical_sector_size_guid, 16) == 0 && length >= 4)
+        {
+          logical_sector_size = get_le32 (metadata + offset);
+        }
+    }
+
+  if (!have_parameters || !have_size ||
+      (logical_sector_size != 512 && logical_sector_size != 4096) ||
+      disk->block_size < 1024 * 1024 || disk->block_size > 256 * 1024 * 1024 ||
+      (disk->block_size & (disk->block_size - 1)) != 0)
+    {
+      set_invalid_error (disk, error);
+      goto out;
+    }
+
+  /* every chunk of payload blocks is followed by a sector bitmap block in the BAT */
+  disk->vhdx_chunk_ratio = (G_GUINT64_CONSTANT (1) << 23) * logical_sector_size / disk->block_size;
+  ret = TRUE;
+
+ out:
+  g_free (metadata);
+  return ret;
+}
+
+static gboolean
+vhdx_open (GduVirtualDisk  *disk,
+           GCancellable    *cancellable,
+           GError         **error)
+{
+  gboolean ret = FALSE;
+  guchar *headers[2] = {NULL, NULL};
+  guchar *header = NULL;
+  guchar *region_table = NULL;
+  guint64 best_sequence_number = 0;
+  guint64 metadata_offset = 0;
+  guint32 metadata_length = 0;
+  guint entry_count;
+  guint n;
+
+  /* there are two headers so one is always intact - use the most recent valid one */
+  for (n = 0; n < 2; n++)
+    {
+      headers[n] = g_malloc (VHDX_HEADER_SIZE);
+      if (!read_at (disk, (n + 1) * 64 * 1024, headers[n], VHDX_HEADER_SIZE, cancellable, error))
+        goto out;
+      if (memcmp (headers[n], "head", 4) != 0 ||
+          !vhdx_check_crc (headers[n], VHDX_HEADER_SIZE, 4) ||
+          get_le16 (headers[n] + 66) != 1)
+        continue;
+      if (header == NULL || get_le64 (headers[n] + 8) > best_sequence_number)
+        {
+          header = headers[n];
+          best_sequence_number = get_le64 (headers[n] + 8);
+        }
+    }
+  if (header == NULL)
+    {
+      set_invalid_error (disk, error);
+      goto out;
+    }
+
+  /* a non-zero log GUID means the log has to be replayed before the disk image can be used */
+  for (n = 48; n < 64; n++)
+    {
+      if (header[n] != 0)
+        {
+          set_unsupported_error (error, _("The disk image was not closed properly. Open it with the program that created it first"));
+          goto out;
+        }
+    }
+
+  region_table = g_malloc (VHDX_REGION_TABLE_SIZE);
+  if (!read_at (disk, 192 * 1024, region_table, VHDX_REGION_TABLE_SIZE, cancellable, error))
+    goto out;
+  if (memcmp (region_table, "regi", 4) != 0 || !vhdx_check_crc (region_table, VHDX_REGION_TABLE_SIZE, 4))
+    {
+      /* try the copy */
+      if (!read_at (disk, 256 * 1024, region_table, VHDX_REGION_TABLE_SIZE, cancellable, error))
+        goto out;
+      if (memcmp (region_table, "regi", 4) != 0 || !vhdx_check_crc (region_table, VHDX_REGION_TABLE_SIZE, 4))
+        {
+          set_invalid_error (disk, error);
+          goto out;
+        }
+    }
+
+  entry_count = MIN (get_le32 (region_table + 8), (VHDX_REGION_TABLE_SIZE - 16) / 32);
+  for (n = 0; n < entry_count; n++)
+    {
+      const guchar *entry = region_table + 16 + n * 32;
+      if (memcmp (entry, vhdx_bat_guid, 16) == 0)
+        {
+          disk->bat_offset = get_le64 (entry + 16);
+          disk->bat_size = get_le32 (entry + 24) / 8;
+        }
+      else if (memcmp (entry, vhdx_metadata_guid, 16) == 0)
+        {
+          metadata_offset = get_le64 (entry + 16);
+          metadata_length = get_le32 (entry + 24);
+        }
+      else if (get_le32 (entry + 28) & 1)
+        {
+          /* a required region we don't know about */
+          set_unsupported_error (error, _("The disk image uses VHDX features that are not supported"));
+          goto out;
+        }
+    }
+  if (disk->bat_offset == 0 || metadata_offset == 0)
+    {
+      set_invalid_error (disk, error);
+      goto out;
+    }
+
+  if (!vhdx_read_metadata (disk, metadata_offset, metadata_length, cancellable, error))
+    goto out;
+
+  ret = TRUE;
+
+ out:
+  g_free (headers[0]);
+  g_free (headers[1]);
+  g_free (region_table);
+  return ret;
+}
+
+static gboolean
+vhdx_load_tables (GduVirtualDisk  *disk,
+                  GCancellable    *cancellable,
+                  GError         **error)
+{
+  guint64 num_entries;
+  guchar *buf;
+  guint64 n;
+
+  num_entries = disk->num_blocks;
+  if (disk->num_blocks > 0)
+    num_entries += (disk->num_blocks - 1) / disk->vhdx_chunk_ratio;
+  if (num_entries > disk->bat_size)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+
+  buf = g_malloc (num_entries * 8 + 1);
+  if (!read_at (disk, disk->bat_offset, buf, num_entries * 8, cancellable, error))
+    {
+      g_free (buf);
+      return FALSE;
+    }
+  disk->vhdx_bat = g_new (guint64, num_entries + 1);
+  for (n = 0; n < num_entries; n++)
+    disk->vhdx_bat[n] = get_le64 (buf + n * 8);
+  g_free (buf);
+  return TRUE;
+}
+
+static gboolean
+vhdx_map_block (GduVirtualDisk  *disk,
+                guint64          block_index,
+                Extent          *extent,
+                GCancellable    *cancellable,
+                GError         **error)
+{
+  guint64 entry;
+
+  entry = disk->vhdx_bat[block_index + block_index / disk->vhdx_chunk_ratio];
+  switch (entry & 7)
+    {
+    case VHDX_BAT_STATE_NOT_PRESENT:
+    case VHDX_BAT_STATE_UNDEFINED:
+    case VHDX_BAT_STATE_ZERO:
+    case VHDX_BAT_STATE_UNMAPPED:
+      extent->type = EXTENT_TYPE_ZERO;
+      break;
+
+    case VHDX_BAT_STATE_FULLY_PRESENT:
+      extent->type = EXTENT_TYPE_DATA;
+      /* in units of 1 MiB */
+      extent->file_offset = (entry >> 20) << 20;
+      break;
+
+    default:
+      /* partially present blocks only exist in differencing disks */
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+vmdk_open (GduVirtualDisk  *disk,
+           GCancellable    *cancellable,
+           GError         **error)
+{
+  guchar header[512];
+  guint32 flags;
+  guint64 grain_size;
+  guint64 num_gts;
+
+  if (!read_at (disk, 0, header, sizeof header, cancellable, error))
+    return FALSE;
+  if (memcmp (header, VMDK_MAGIC, 4) != 0)
+    {
+      /* a text descriptor that refers to separate extent files */
+      set_unsupported_error (error, _("Only VMDK disk images consisting of a single sparse file are supported"));
+      return FALSE;
+    }
+
+  /* stream-optimized images write the grain directory last and keep the real header in the footer */
+  if (get_le64 (header + 56) == VMDK_GD_AT_END)
+    {
+      if (disk->file_size < 1024 ||
+          !read_at (disk, disk->file_size - 1024, header, sizeof header, cancellable, error))
+        return FALSE;
+      if (memcmp (header, VMDK_MAGIC, 4) != 0)
+        {
+          set_invalid_error (disk, error);
+          return FALSE;
+        }
+    }
+
+  if (get_le32 (header + 4) > 3)
+    {
+      set_unsupported_error (error, _("This version of the VMDK format is not supported"));
+      return FALSE;
+    }
+
+  flags = get_le32 (header + 8);
+  disk->size = get_le64 (header + 12) * 512;
+  grain_size = get_le64 (header + 20);
+  disk->num_gtes_per_gt = get_le32 (header + 44);
+  disk->gd_offset = get_le64 (header + 56) * 512;
+  disk->vmdk_compressed = (flags & VMDK_FLAG_COMPRESSED) != 0;
+  disk->vmdk_zeroed_grain_gte = (flags & VMDK_FLAG_ZEROED_GRAIN_GTE) != 0;
+
+  if (grain_size < 1 || grain_size > 2048 || (grain_size & (grain_size - 1)) != 0 ||
+      disk->num_gtes_per_gt == 0 || disk->num_gtes_per_gt > 65536 ||
+      disk->gd_offset == 0)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+  if (disk->vmdk_compressed && get_le16 (header + 77) != 1)
+    {
+      set_unsupported_error (error, _("The disk image uses VMDK features that are not supported"));
+      return FALSE;
+    }
+
+  disk->block_size = grain_size * 512;
+  num_gts = (disk->size / disk->block_size + disk->num_gtes_per_gt - 1) / disk->num_gtes_per_gt;
+  if (num_gts > G_MAXUINT32)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+  disk->num_gd_entries = num_gts;
+  /* compressed grains are zlib streams */
+  disk->window_bits = 15;
+  return TRUE;
+}
+
+static gboolean
+vmdk_load_tables (GduVirtualDisk  *disk,
+                  GCancellable    *cancellable,
+                  GError         **error)
+{
+  guchar *buf;
+  guint64 n;
+
+  buf = g_malloc (((gsize) disk->num_gd_entries) * 4 + 1);
+  if (!read_at (disk, disk->gd_offset, buf, ((gsize) disk->num_gd_entries) * 4, cancellable, error))
+    {
+      g_free (buf);
+      return FALSE;
+    }
+  disk->gd = g_new (guint32, disk->num_gd_entries + 1);
+  for (n = 0; n < disk->num_gd_entries; n++)
+    disk->gd[n] = get_le32 (buf + n * 4);
+  g_free (buf);
+
+  disk->gt = g_new (guint32, disk->num_gtes_per_gt);
+  return TRUE;
+}
+
+static gboolean
+vmdk_map_block (GduVirtualDisk  *disk,
+                guint64          block_index,
+                Extent          *extent,
+                GCancellable    *cancellable,
+                GError         **error)
+{
+  guint64 gd_index = block_index / disk->num_gtes_per_gt;
+  guint64 gt_index = block_index % disk->num_gtes_per_gt;
+  guint32 gt_sector;
+  guint32 grain_sector;
+
+  extent->type = EXTENT_TYPE_ZERO;
+
+  if (gd_index >= disk->num_gd_entries)
+    return TRUE;
+  gt_sector = disk->gd[gd_index];
+  if (gt_sector == 0)
+    return TRUE;
+
+  if (disk->gt_sector != gt_sector)
+    {
+      guint n;
+      disk->gt_sector = 0;
+      if (!read_at (disk, ((guint64) gt_sector) * 512, (guchar *) disk->gt, disk->num_gtes_per_gt * 4, cancellable, error))
+        return FALSE;
+      for (n = 0; n < disk->num_gtes_per_gt; n++)
+        disk->gt[n] = get_le32 ((guchar *) (disk->gt + n));
+      disk->gt_sector = gt_sector;
+    }
+
+  grain_sector = disk->gt[gt_index];
+  if (grain_sector == 0 || (grain_sector == 1 && disk->vmdk_zeroed_grain_gte))
+    return TRUE;
+
+  if (disk->vmdk_compressed)
+    {
+      guchar marker[12];
+
+      /* each compressed grain is preceded by its LBA and compressed size */
+      if (!read_at (disk, ((guint64) grain_sector) * 512, marker, sizeof marker, cancellable, error))
+        return FALSE;
+      extent->type = EXTENT_TYPE_COMPRESSED;
+      extent->file_offset = ((guint64) grain_sector) * 512 + sizeof marker;
+      extent->compressed_size = get_le32 (marker + 8);
+    }
+  else
+    {
+      extent->type = EXTENT_TYPE_DATA;
+      extent->file_offset = ((guint64) grain_sector) * 512;
+    }
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+GduVirtualDisk *
+gdu_virtual_disk_open (GFile         *file,
+                       GCancellable  *cancellable,
+                       GError       **error)
+{
+  GduVirtualDisk *disk;
+  GFileInfo *info;
+  gboolean ok = FALSE;
+
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  disk = g_new0 (GduVirtualDisk, 1);
+  disk->block_buffer_index = G_MAXUINT64;
+  disk->format = gdu_virtual_disk_detect (file);
+
+  disk->stream = (GInputStream *) g_file_read (file, cancellable, error);
+  if (disk->stream == NULL)
+    goto out;
+  info = g_file_input_stream_query_info (G_FILE_INPUT_STREAM (disk->stream),
+                                         G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                         cancellable,
+                                         error);
+  if (info == NULL)
+    goto out;
+  disk->file_size = g_file_info_get_size (info);
+  g_object_unref (info);
+
+  switch (disk->format)
+    {
+    case GDU_VIRTUAL_DISK_FORMAT_QCOW2:
+      ok = qcow2_open (disk, cancellable, error);
+      break;
+    case GDU_VIRTUAL_DISK_FORMAT_VHD:
+      ok = vhd_open (disk, cancellable, error);
+      break;
+    case GDU_VIRTUAL_DISK_FORMAT_VHDX:
+      ok = vhdx_open (disk, cancellable, error);
+      break;
+    case GDU_VIRTUAL_DISK_FORMAT_VMDK:
+      ok = vmdk_open (disk, cancellable, error);
+      break;
+    default:
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Not a virtual machine disk image");
+      break;
+    }
+  if (ok)
+    disk->num_blocks = (disk->size + disk->block_size - 1) / disk->block_size;
+
+ out:
+  if (!ok)
+    {
+      gdu_virtual_disk_free (disk);
+      disk = NULL;
+    }
+  return disk;
+}
+
+void
+gdu_virtual_disk_free (GduVirtualDisk *disk)
+{
+  if (disk == NULL)
+    return;
+  g_clear_object (&disk->stream);
+  g_free (disk->compressed_buffer);
+  g_free (disk->block_buffer);
+  g_free (disk->l1_table);
+  g_free (disk->l2_table);
+  g_free (disk->vhd_bat);
+  g_free (disk->vhdx_bat);
+  g_free (disk->gd);
+  g_free (disk->gt);
+  g_free (disk);
+}
+
+GduVirtualDiskFormat
+gdu_virtual_disk_get_format (GduVirtualDisk *disk)
+{
+  return disk->format;
+}
+
+/* the size of the disk as seen by the virtual machine */
+guint64
+gdu_virtual_disk_get_size (GduVirtualDisk *disk)
+{
+  return disk->size;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The allocation tables are only loaded when the data is needed, so
+ * opening a disk image to find out its size is fast
+ */
+static gboolean
+load_tables (GduVirtualDisk  *disk,
+             GCancellable    *cancellable,
+             GError         **error)
+{
+  switch (disk->format)
+    {
+    case GDU_VIRTUAL_DISK_FORMAT_QCOW2:
+      return qcow2_load_tables (disk, cancellable, error);
+    case GDU_VIRTUAL_DISK_FORMAT_VHD:
+      return vhd_load_tables (disk, cancellable, error);
+    case GDU_VIRTUAL_DISK_FORMAT_VHDX:
+      return vhdx_load_tables (disk, cancellable, error);
+    case GDU_VIRTUAL_DISK_FORMAT_VMDK:
+      return vmdk_load_tables (disk, cancellable, error);
+    default:
+      g_assert_not_reached ();
+    }
+  return FALSE;
+}
+
+static gboolean
+map_block (GduVirtualDisk  *disk,
+           guint64          block_index,
+           Extent          *extent,
+           GCancellable    *cancellable,
+           GError         **error)
+{
+  switch (disk->format)
+    {
+    case GDU_VIRTUAL_DISK_FORMAT_QCOW2:
+      return qcow2_map_block (disk, block_index, extent, cancellable, error);
+    case GDU_VIRTUAL_DISK_FORMAT_VHD:
+      return vhd_map_block (disk, block_index, extent, cancellable, error);
+    case GDU_VIRTUAL_DISK_FORMAT_VHDX:
+      return vhdx_map_block (disk, block_index, extent, cancellable, error);
+    case GDU_VIRTUAL_DISK_FORMAT_VMDK:
+      return vmdk_map_block (disk, block_index, extent, cancellable, error);
+    default:
+      g_assert_not_reached ();
+    }
+  return FALSE;
+}
+
+/* Decompresses the block at @block_index into disk->block_buffer */
+#ifdef HAVE_ZLIB
+static gboolean
+decompress_block (GduVirtualDisk  *disk,
+                  guint64          block_index,
+                  Extent          *extent,
+                  GCancellable    *cancellable,
+                  GError         **error)
+{
+  z_stream zstream;
+  gsize num_read;
+  int rc;
+
+  if (disk->block_buffer_index == block_index)
+    return TRUE;
+  disk->block_buffer_index = G_MAXUINT64;
+
+  if (extent->compressed_size > 2 * disk->block_size + 4096)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+  if (disk->compressed_buffer_size < extent->compressed_size)
+    {
+      g_free (disk->compressed_buffer);
+      disk->compressed_buffer = g_malloc (extent->compressed_size);
+      disk->compressed_buffer_size = extent->compressed_size;
+    }
+  if (disk->block_buffer == NULL)
+    disk->block_buffer = g_malloc (disk->block_size);
+
+  /* for QCOW2 the compressed size is rounded up to whole sectors so the last one may be cut short by the end of the file */
+  if (!g_seekable_seek (G_SEEKABLE (disk->stream), extent->file_offset, G_SEEK_SET, cancellable, error))
+    return FALSE;
+  if (!g_input_stream_read_all (disk->stream, disk->compressed_buffer, extent->compressed_size,
+                                &num_read, cancellable, error))
+    return FALSE;
+
+  memset (&zstream, 0, sizeof zstream);
+  if (inflateInit2 (&zstream, disk->window_bits) != Z_OK)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, _("Not enough memory"));
+      return FALSE;
+    }
+  zstream.next_in = disk->compressed_buffer;
+  zstream.avail_in = num_read;
+  zstream.next_out = disk->block_buffer;
+  zstream.avail_out = disk->block_size;
+  rc = inflate (&zstream, Z_FINISH);
+  inflateEnd (&zstream);
+  /* QCOW2 streams aren't terminated so a full block is what matters */
+  if ((rc != Z_STREAM_END && rc != Z_OK && rc != Z_BUF_ERROR) || zstream.avail_out != 0)
+    {
+      set_invalid_error (disk, error);
+      return FALSE;
+    }
+
+  disk->block_buffer_index = block_index;
+  return TRUE;
+}
+#else
+static gboolean
+decompress_block (GduVirtualDisk  *disk,
+                  guint64          block_index,
+                  Extent          *extent,
+                  GCancellable    *cancellable,
+                  GError         **error)
+{
+  set_unsupported_error (error, _("Compressed disk images are not supported"));
+  return FALSE;
+}
+#endif
+
+/* Reads @size bytes at @offset of the virtual disk into @buffer. If
+ * @out_is_zero is not NULL, it is set to TRUE if the whole range is
+ * unallocated (and @buffer has been zeroed).
+ *
+ * Must not be called from more than one thread at a time.
+ */
+gboolean
+gdu_virtual_disk_read (GduVirtualDisk  *disk,
+                       guint64          offset,
+                       guchar          *buffer,
+                       gsize            size,
+                       gboolean        *out_is_zero,
+                       GCancellable    *cancellable,
+                       GError         **error)
+{
+  gboolean is_zero = TRUE;
+  gsize pos;
+
+  g_return_val_if_fail (offset + size <= disk->size, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (!disk->tables_loaded)
+    {
+      if (!load_tables (disk, cancellable, error))
+        return FALSE;
+      disk->tables_loaded = TRUE;
+    }
+
+  pos = 0;
+  while (pos < size)
+    {
+      guint64 block_index = (offset + pos) / disk->block_size;
+      guint64 offset_in_block = (offset + pos) % disk->block_size;
+      gsize len = MIN (size - pos, disk->block_size - offset_in_block);
+      Extent extent;
+
+      if (!map_block (disk, block_index, &extent, cancellable, error))
+        return FALSE;
+
+      switch (extent.type)
+        {
+        case EXTENT_TYPE_ZERO:
+          memset (buffer + pos, 0, len);
+          break;
+
+        case EXTENT_TYPE_DATA:
+          is_zero = FALSE;
+          if (!read_at (disk, extent.file_offset + offset_in_block, buffer + pos, len, cancellable, error))
+            return FALSE;
+          break;
+
+        case EXTENT_TYPE_COMPRESSED:
+          is_zero = FALSE;
+          if (!decompress_block (disk, block_index, &extent, cancellable, error))
+            return FALSE;
+          memcpy (buffer + pos, disk->block_buffer + offset_in_block, len);
+          break;
+        }
+
+      pos += len;
+    }
+
+  if (out_is_zero != NULL)
+    *out_is_zero = is_zero;
+  return TRUE;
+}
@@ -0,0 +1,38 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_VIRTUAL_DISK_H__
+#define __GDU_VIRTUAL_DISK_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+GduVirtualDiskFormat  gdu_virtual_disk_detect           (GFile                 *file);
+const gchar          *gdu_virtual_disk_format_get_name  (GduVirtualDiskFormat   format);
+
+GduVirtualDisk       *gdu_virtual_disk_open             (GFile                 *file,
+                                                         GCancellable          *cancellable,
+                                                         GError               **error);
+void                  gdu_virtual_disk_free             (GduVirtualDisk        *disk);
+
+GduVirtualDiskFormat  gdu_virtual_disk_get_format       (GduVirtualDisk        *disk);
+guint64               gdu_virtual_disk_get_size         (GduVirtualDisk        *disk);
+gboolean              gdu_virtual_disk_read             (GduVirtualDisk        *disk,
+                                                         guint64                offset,
+                                                         guchar                *buffer,
+                                                         gsize                  size,
+                                                         gboolean              *out_is_zero,
+                                                         GCancellable          *cancellable,
+                                                         GError               **error);
+
+G_END_DECLS
+
+#endif /* __GDU_VIRTUAL_DISK_H__ */
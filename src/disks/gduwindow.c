@@ -25,6 +25,7 @@
 #include "gduvolumegrid.h"
 #include "gduatasmartdialog.h"
 #include "gdubenchmarkdialog.h"
+#include "gdubenchmarkmultipledialog.h"
 #include "gducrypttabdialog.h"
 #include "gdufstabdialog.h"
 #include "gdufilesystemdialog.h"
@@ -65,6 +66,8 @@ struct _GduWindow
   GtkWidget *overlay_toolbar;
   GtkWidget *overlay_toolbar_erase_button;
   GtkWidget *overlay_toolbar_create_raid_button;
+  GtkWidget *overlay_toolbar_restore_button;
+  GtkWidget *overlay_toolbar_benchmark_button;
 
   GtkWidget *main_hpane;
   GtkWidget *details_notebook;
@@ -178,6 +181,8 @@ static const struct {
   {G_STRUCT_OFFSET (GduWindow, overlay_toolbar), "overlay-toolbar"},
   {G_STRUCT_OFFSET (GduWindow, overlay_toolbar_erase_button), "overlay-toolbar-erase-button"},
   {G_STRUCT_OFFSET (GduWindow, overlay_toolbar_create_raid_button), "overlay-toolbar-create-raid-button"},
+  {G_STRUCT_OFFSET (GduWindow, overlay_toolbar_restore_button), "overlay-toolbar-restore-button"},
+  {G_STRUCT_OFFSET (GduWindow, overlay_toolbar_benchmark_button), "overlay-toolbar-benchmark-button"},
 
   {G_STRUCT_OFFSET (GduWindow, main_hpane), "main-hpane"},
   {G_STRUCT_OFFSET (GduWindow, device_tree_overlay), "device-tree-overlay"},
@@ -449,6 +454,12 @@ static void on_overlay_toolbar_erase_button_clicked (GtkButton *button,
 static void on_overlay_toolbar_create_raid_button_clicked (GtkButton *button,
                                                            gpointer   user_data);
 
+static void on_overlay_toolbar_restore_button_clicked (GtkButton *button,
+                                                       gpointer   user_data);
+
+static void on_overlay_toolbar_benchmark_button_clicked (GtkButton *button,
+                                                         gpointer   user_data);
+
 G_DEFINE_TYPE (GduWindow, gdu_window, GTK_TYPE_APPLICATION_WINDOW);
 
 static void
@@ -1641,6 +1652,18 @@ gdu_window_constructed (GObject *object)
                     G_CALLBACK (on_overlay_toolbar_create_raid_button_clicked),
                     window);
 
+  /* Restore Disk Image to all selected devices */
+  g_signal_connect (window->overlay_toolbar_restore_button,
+                    "clicked",
+                    G_CALLBACK (on_overlay_toolbar_restore_button_clicked),
+                    window);
+
+  /* Benchmark all selected devices */
+  g_signal_connect (window->overlay_toolbar_benchmark_button,
+                    "clicked",
+                    G_CALLBACK (on_overlay_toolbar_benchmark_button_clicked),
+                    window);
+
   ensure_something_selected (window);
   device_tree_selection_toolbar_select_done_toggle (window, FALSE);
   gtk_widget_grab_focus (window->device_tree_treeview);
@@ -5117,6 +5140,8 @@ update_for_multi_selection (GduWindow *window, ShowFlags *show_flags)
       gtk_widget_show (window->overlay_toolbar);
 
       gtk_widget_show (window->overlay_toolbar_erase_button);
+      gtk_widget_show (window->overlay_toolbar_restore_button);
+      gtk_widget_show (window->overlay_toolbar_benchmark_button);
 
       /* Createing a RAID array requires at all disks are the same size and that there are at least two of them */
       if (gdu_util_is_same_size (selected_blocks, &disk_size) && num_blocks >= 2)
@@ -5171,6 +5196,36 @@ on_overlay_toolbar_create_raid_button_clicked (GtkButton *button,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+on_overlay_toolbar_restore_button_clicked (GtkButton *button,
+                                           gpointer   user_data)
+{
+  GduWindow *window = GDU_WINDOW (user_data);
+  GList *selected_blocks;
+
+  selected_blocks = gdu_device_tree_model_get_selected_blocks (window->model);
+  gdu_restore_disk_image_dialog_show_for_blocks (window, selected_blocks, NULL);
+  device_tree_selection_toolbar_select_done_toggle (window, FALSE);
+  g_list_free_full (selected_blocks, g_object_unref);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+on_overlay_toolbar_benchmark_button_clicked (GtkButton *button,
+                                             gpointer   user_data)
+{
+  GduWindow *window = GDU_WINDOW (user_data);
+  GList *selected_blocks;
+
+  selected_blocks = gdu_device_tree_model_get_selected_blocks (window->model);
+  gdu_benchmark_multiple_dialog_show (window, selected_blocks);
+  device_tree_selection_toolbar_select_done_toggle (window, FALSE);
+  g_list_free_full (selected_blocks, g_object_unref);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 typedef struct {
   GSimpleAsyncResult *simple;
   GduWindow *window;
@@ -17,7 +17,6 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -170,69 +169,155 @@ gdu_xz_decompressor_iface_init (GConverterIface *iface)
   iface->reset = gdu_xz_decompressor_reset;
 }
 
-gsize
-gdu_xz_decompressor_get_uncompressed_size (GFile *compressed_file)
+static gboolean
+read_at (GInputStream *stream,
+         goffset       offset,
+         guint8       *buf,
+         gsize         size)
 {
-  gchar *path = NULL;
-  gsize ret = 0;
-  GMappedFile *mapped_file = NULL;
-  size_t bufpos = 0;
-  uint64_t memlimit = UINT64_MAX;
-  lzma_index *index_object = NULL;
-  lzma_ret res;
-  GError *error = NULL;
-  uint8_t *buf;
-  gsize len;
-  lzma_stream_flags stream_flags;
-  uint8_t *footer, *index;
-
-  path = g_file_get_path (compressed_file);
-  if (path == NULL)
+  gsize num_read;
+
+  if (!g_seekable_seek (G_SEEKABLE (stream), offset, G_SEEK_SET, NULL, NULL))
+    return FALSE;
+  if (!g_input_stream_read_all (stream, buf, size, &num_read, NULL, NULL))
+    return FALSE;
+  return num_read == size;
+}
+
+/* The index of a stream is only read if it isn't bigger than this -
+ * the size comes from the file, which isn't trusted
+ */
+#define MAX_INDEX_SIZE (64 * 1024 * 1024)
+
+/* How much stream padding is read at a time */
+#define PADDING_READ_SIZE 4096
+
+/* Returns the position of the stream padding ending at @pos, or -1 on error */
+static goffset
+skip_padding (GInputStream *stream,
+              goffset       pos)
+{
+  guint8 buf[PADDING_READ_SIZE];
+
+  while (pos >= 4)
     {
-      gchar *uri;
-      uri = g_file_get_uri (compressed_file);
-      g_warning ("No path for URI '%s'. Maybe you need to enable FUSE.", uri);
-      g_free (uri);
-      goto out;
+      gsize size = MIN (pos, PADDING_READ_SIZE) & ~((gsize) 3);
+      gsize n;
+
+      if (!read_at (stream, pos - size, buf, size))
+        return -1;
+      for (n = size; n > 0; n -= 4)
+        {
+          if (buf[n - 4] != 0 || buf[n - 3] != 0 || buf[n - 2] != 0 || buf[n - 1] != 0)
+            return pos;
+          pos -= 4;
+        }
     }
+  return pos;
+}
+
+/* Returns 0 if the size can't be determined.
+ *
+ * The index at the end of every .xz stream records the uncompressed
+ * size so only the stream footers and indexes are read - never the
+ * compressed data. Files with several concatenated streams (as
+ * produced by e.g. pxz or "cat a.xz b.xz") are handled by walking the
+ * streams backwards from the end of the file, skipping stream padding.
+ */
+guint64
+gdu_xz_decompressor_get_uncompressed_size (GFile *compressed_file)
+{
+  guint64 ret = 0;
+  GFileInputStream *stream = NULL;
+  GFileInfo *info = NULL;
+  goffset pos;
+  uint8_t *index = NULL;
+  lzma_index *index_object = NULL;
 
-  mapped_file = g_mapped_file_new (path, FALSE /* writable */, &error);
-  if (mapped_file == NULL)
+  stream = g_file_read (compressed_file, NULL, NULL);
+  if (stream == NULL)
+    goto fail;
+  info = g_file_input_stream_query_info (stream, G_FILE_ATTRIBUTE_STANDARD_SIZE, NULL, NULL);
+  if (info == NULL)
+    goto fail;
+  pos = g_file_info_get_size (info);
+  if (pos < 2 * LZMA_STREAM_HEADER_SIZE)
+    goto fail;
+
+  while (pos > 0)
     {
-      g_warning ("Error mapping file '%s': %s",
-                 path, error->message);
-      g_clear_error (&error);
-      goto out;
+      uint8_t buf[LZMA_STREAM_HEADER_SIZE];
+      lzma_stream_flags footer_flags;
+      lzma_stream_flags header_flags;
+      uint64_t memlimit = UINT64_MAX;
+      size_t bufpos = 0;
+      lzma_vli stream_size;
+
+      if (pos < 2 * LZMA_STREAM_HEADER_SIZE)
+        goto fail;
+      if (!read_at (G_INPUT_STREAM (stream), pos - LZMA_STREAM_HEADER_SIZE, buf, LZMA_STREAM_HEADER_SIZE))
+        goto fail;
+
+      /* stream padding - a multiple of four NUL bytes between or after streams */
+      if (buf[8] == 0 && buf[9] == 0 && buf[10] == 0 && buf[11] == 0)
+        {
+          pos = skip_padding (G_INPUT_STREAM (stream), pos);
+          if (pos < 2 * LZMA_STREAM_HEADER_SIZE)
+            goto fail;
+          continue;
+        }
+
+      if (lzma_stream_footer_decode (&footer_flags, buf) != LZMA_OK)
+        goto fail;
+      if (footer_flags.backward_size > (lzma_vli) (pos - 2 * LZMA_STREAM_HEADER_SIZE) ||
+          footer_flags.backward_size > MAX_INDEX_SIZE)
+        goto fail;
+
+      index = g_try_malloc (footer_flags.backward_size);
+      if (index == NULL)
+        goto fail;
+      if (!read_at (G_INPUT_STREAM (stream),
+                    pos - LZMA_STREAM_HEADER_SIZE - footer_flags.backward_size,
+                    index,
+                    footer_flags.backward_size))
+        goto fail;
+      if (lzma_index_buffer_decode (&index_object,
+                                    &memlimit,
+                                    NULL /* allocator */,
+                                    index,
+                                    &bufpos,
+                                    footer_flags.backward_size) != LZMA_OK)
+        goto fail;
+      g_free (index);
+      index = NULL;
+
+      /* header, blocks, index and footer of this stream */
+      stream_size = lzma_index_file_size (index_object);
+      if (stream_size > (lzma_vli) pos)
+        goto fail;
+      ret += lzma_index_uncompressed_size (index_object);
+      lzma_index_end (index_object, NULL);
+      index_object = NULL;
+      pos -= stream_size;
+
+      /* make sure we really arrived at the start of the stream */
+      if (!read_at (G_INPUT_STREAM (stream), pos, buf, LZMA_STREAM_HEADER_SIZE))
+        goto fail;
+      if (lzma_stream_header_decode (&header_flags, buf) != LZMA_OK)
+        goto fail;
+      if (lzma_stream_flags_compare (&header_flags, &footer_flags) != LZMA_OK)
+        goto fail;
     }
 
-  buf = (uint8_t*) g_mapped_file_get_contents (mapped_file);
-  len = g_mapped_file_get_length (mapped_file);
-
-  if (len < 12)
-    goto out;
-  footer = buf + len - 12;
-  if (lzma_stream_footer_decode (&stream_flags, footer) != LZMA_OK)
-    goto out;
-  if (stream_flags.backward_size > len - 12)
-    goto out;
-  index = footer - stream_flags.backward_size;
-
-  res = lzma_index_buffer_decode (&index_object,
-                                  &memlimit,
-                                  NULL /* allocator */,
-                                  index,
-                                  &bufpos,
-                                  footer - index);
-  if (res != LZMA_OK)
-    goto out;
-
-  ret = lzma_index_uncompressed_size (index_object);
-
  out:
   if (index_object != NULL)
     lzma_index_end (index_object, NULL);
-  if (mapped_file != NULL)
-    g_mapped_file_unref (mapped_file);
-  g_free (path);
+  g_free (index);
+  g_clear_object (&info);
+  g_clear_object (&stream);
   return ret;
+
+ fail:
+  ret = 0;
+  goto out;
 }
@@ -33,7 +33,7 @@ struct GduXzDecompressorClass
 GType              gdu_xz_decompressor_get_type      (void) G_GNUC_CONST;
 GduXzDecompressor *gdu_xz_decompressor_new           (void);
 
-gsize              gdu_xz_decompressor_get_uncompressed_size (GFile *compressed_file);
+guint64            gdu_xz_decompressor_get_uncompressed_size (GFile *compressed_file);
 
 G_END_DECLS
 
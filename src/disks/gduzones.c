@@ -0,0 +1,266 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+
+#ifdef HAVE_LINUX_BLKZONED_H
+#include <linux/blkzoned.h>
+#endif
+
+#include "gduzones.h"
+
+/* Zoned block devices - host-managed or host-aware SMR drives, ZNS
+ * SSDs and the like - are divided into zones. Conventional zones can
+ * be written anywhere but sequential zones only at their write
+ * pointer, which starts at the beginning of the zone and moves along
+ * as data is written. The only way to move it back is to reset the
+ * zone, which throws away everything in it.
+ *
+ * Host-managed devices fail writes that are not at the write pointer.
+ * Host-aware devices accept them but have to rewrite the zone behind
+ * the scenes, which is very slow, so both are treated the same.
+ */
+
+/* the number of zones to ask for with each BLKREPORTZONE */
+#define REPORT_NUM_ZONES 4096
+
+/**
+ * gdu_zones_get_model:
+ * @device_number: The device number of a block device.
+ *
+ * Checks if the block device @device_number is zoned, see the
+ * queue/zoned attribute in sysfs.
+ *
+ * Returns: The zoned model of the device, %GDU_ZONED_MODEL_NONE if it
+ * isn't zoned or if that can't be determined.
+ */
+GduZonedModel
+gdu_zones_get_model (dev_t device_number)
+{
+  GduZonedModel ret = GDU_ZONED_MODEL_NONE;
+  gchar *filename;
+  gchar *contents = NULL;
+
+  /* partitions don't have a queue/ directory but the kernel doesn't
+   * allow partitions on zoned devices anyway
+   */
+  filename = g_strdup_printf ("/sys/dev/block/%u:%u/queue/zoned", major (device_number), minor (device_number));
+  if (!g_file_get_contents (filename, &contents, NULL, NULL))
+    goto out;
+
+  g_strstrip (contents);
+  if (g_strcmp0 (contents, "host-managed") == 0)
+    ret = GDU_ZONED_MODEL_HOST_MANAGED;
+  else if (g_strcmp0 (contents, "host-aware") == 0)
+    ret = GDU_ZONED_MODEL_HOST_AWARE;
+
+ out:
+  g_free (contents);
+  g_free (filename);
+  return ret;
+}
+
+/**
+ * gdu_zones_report:
+ * @fd: A file descriptor for a zoned block device.
+ * @error: Return location for error or %NULL.
+ *
+ * Gets the zones of the block device @fd, in order.
+ *
+ * Returns: An array of #GduZone or %NULL if @error is set. Free with
+ * g_array_unref().
+ */
+GArray *
+gdu_zones_report (gint     fd,
+                  GError **error)
+{
+#ifdef HAVE_LINUX_BLKZONED_H
+  GArray *ret = NULL;
+  GArray *zones;
+  struct blk_zone_report *report;
+  guint64 num_sectors;
+  guint64 sector;
+  guint n;
+
+  g_return_val_if_fail (fd != -1, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  zones = g_array_new (FALSE, FALSE, sizeof (GduZone));
+  report = g_malloc0 (sizeof (struct blk_zone_report) + REPORT_NUM_ZONES * sizeof (struct blk_zone));
+
+  if (ioctl (fd, BLKGETSIZE64, &num_sectors) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error getting size of device: %s", g_strerror (errno));
+      goto out;
+    }
+  /* the zone ioctls always use 512-byte sectors */
+  num_sectors /= 512;
+
+  for (sector = 0; sector < num_sectors; )
+    {
+      memset (report, 0, sizeof (struct blk_zone_report));
+      report->sector = sector;
+      report->nr_zones = REPORT_NUM_ZONES;
+      if (ioctl (fd, BLKREPORTZONE, report) != 0)
+        {
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                       "Error getting zones from sector %" G_GUINT64_FORMAT ": %s",
+                       sector, g_strerror (errno));
+          goto out;
+        }
+      if (report->nr_zones == 0)
+        break;
+
+      for (n = 0; n < report->nr_zones; n++)
+        {
+          struct blk_zone *blk_zone = &report->zones[n];
+          GduZone zone = {0};
+
+          zone.offset = blk_zone->start * 512;
+          zone.size = blk_zone->len * 512;
+          zone.capacity = zone.size;
+#ifdef BLK_ZONE_REP_CAPACITY
+          if (report->flags & BLK_ZONE_REP_CAPACITY)
+            zone.capacity = blk_zone->capacity * 512;
+#endif
+          zone.write_pointer = blk_zone->wp * 512;
+          zone.sequential = (blk_zone->type != BLK_ZONE_TYPE_CONVENTIONAL);
+          zone.empty = zone.sequential && blk_zone->cond == BLK_ZONE_COND_EMPTY;
+          g_array_append_val (zones, zone);
+
+          sector = blk_zone->start + blk_zone->len;
+        }
+    }
+
+  ret = zones;
+  zones = NULL;
+
+ out:
+  if (zones != NULL)
+    g_array_unref (zones);
+  g_free (report);
+  return ret;
+#else
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+               "Zoned block devices are not supported");
+  return NULL;
+#endif
+}
+
+/**
+ * gdu_zones_lookup:
+ * @zones: An array of #GduZone from gdu_zones_report().
+ * @offset: An offset on the device.
+ *
+ * Finds the zone with @offset in it.
+ *
+ * Returns: The zone (owned by @zones) or %NULL if @offset is past the end of the device.
+ */
+const GduZone *
+gdu_zones_lookup (GArray  *zones,
+                  guint64  offset)
+{
+  guint low = 0;
+  guint high = zones->len;
+
+  while (low < high)
+    {
+      guint middle = low + (high - low) / 2;
+      const GduZone *zone = &g_array_index (zones, GduZone, middle);
+
+      if (offset < zone->offset)
+        high = middle;
+      else if (offset >= zone->offset + zone->size)
+        low = middle + 1;
+      else
+        return zone;
+    }
+  return NULL;
+}
+
+/**
+ * gdu_zones_find_empty:
+ * @zones: An array of #GduZone from gdu_zones_report().
+ * @offset: An offset on the device.
+ * @min_capacity: The number of bytes that must fit in the zone.
+ *
+ * Finds the first empty zone at or after @offset with room for at
+ * least @min_capacity bytes, starting over at the beginning of the
+ * device if there is none.
+ *
+ * Returns: The zone (owned by @zones) or %NULL if there is no such zone.
+ */
+const GduZone *
+gdu_zones_find_empty (GArray  *zones,
+                      guint64  offset,
+                      guint64  min_capacity)
+{
+  const GduZone *zone;
+  guint first = 0;
+  guint n;
+
+  zone = gdu_zones_lookup (zones, offset);
+  if (zone != NULL)
+    first = zone - &g_array_index (zones, GduZone, 0);
+
+  for (n = 0; n < zones->len; n++)
+    {
+      zone = &g_array_index (zones, GduZone, (first + n) % zones->len);
+      if (zone->empty && zone->capacity >= min_capacity)
+        return zone;
+    }
+  return NULL;
+}
+
+/**
+ * gdu_zones_reset:
+ * @fd: A file descriptor for a zoned block device, opened for writing.
+ * @zone: A sequential zone of the device.
+ * @error: Return location for error or %NULL.
+ *
+ * Resets @zone, discarding everything in it and moving its write
+ * pointer back to the start of the zone.
+ *
+ * Returns: %TRUE if the zone was reset, %FALSE if @error is set.
+ */
+gboolean
+gdu_zones_reset (gint            fd,
+                 const GduZone  *zone,
+                 GError        **error)
+{
+#ifdef HAVE_LINUX_BLKZONED_H
+  struct blk_zone_range range;
+
+  g_return_val_if_fail (fd != -1, FALSE);
+  g_return_val_if_fail (zone != NULL && zone->sequential, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  range.sector = zone->offset / 512;
+  range.nr_sectors = zone->size / 512;
+  if (ioctl (fd, BLKRESETZONE, &range) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error resetting zone at offset %" G_GUINT64_FORMAT ": %s",
+                   zone->offset, g_strerror (errno));
+      return FALSE;
+    }
+  return TRUE;
+#else
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+               "Zoned block devices are not supported");
+  return FALSE;
+#endif
+}
@@ -0,0 +1,48 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_ZONES_H__
+#define __GDU_ZONES_H__
+
+#include <gtk/gtk.h>
+#include <sys/types.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* A zone of a zoned block device, all offsets and sizes are in bytes */
+struct GduZone
+{
+  guint64   offset;
+  guint64   size;
+  guint64   capacity;        /* how much of the zone can be written, at most size */
+  guint64   write_pointer;   /* where the next write to a sequential zone must go */
+  gboolean  sequential;      /* FALSE for conventional zones, which can be written anywhere */
+  gboolean  empty;           /* TRUE if the zone is sequential and nothing has been written to it */
+};
+
+GduZonedModel   gdu_zones_get_model   (dev_t           device_number);
+
+GArray         *gdu_zones_report      (gint            fd,
+                                       GError        **error);
+
+const GduZone  *gdu_zones_lookup      (GArray         *zones,
+                                       guint64         offset);
+
+const GduZone  *gdu_zones_find_empty  (GArray         *zones,
+                                       guint64         offset,
+                                       guint64         min_capacity);
+
+gboolean        gdu_zones_reset       (gint            fd,
+                                       const GduZone  *zone,
+                                       GError        **error);
+
+G_END_DECLS
+
+#endif /* __GDU_ZONES_H__ */
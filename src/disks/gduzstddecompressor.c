@@ -0,0 +1,165 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include "gduzstddecompressor.h"
+
+#include <string.h>
+
+#include <zstd.h>
+#include <zstd_errors.h>
+
+/* Handles zstd files consisting of several frames, e.g. files created
+ * by concatenating zstd files or by multi-threaded compression.
+ */
+
+static void gdu_zstd_decompressor_iface_init          (GConverterIface *iface);
+
+struct GduZstdDecompressor
+{
+  GObject parent_instance;
+
+  ZSTD_DStream *dstream;
+
+  /* TRUE if the last frame has been completely decoded and flushed */
+  gboolean at_frame_boundary;
+};
+
+G_DEFINE_TYPE_WITH_CODE (GduZstdDecompressor, gdu_zstd_decompressor, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER,
+                                                gdu_zstd_decompressor_iface_init))
+
+static void
+gdu_zstd_decompressor_finalize (GObject *object)
+{
+  GduZstdDecompressor *decompressor = GDU_ZSTD_DECOMPRESSOR (object);
+
+  ZSTD_freeDStream (decompressor->dstream);
+
+  G_OBJECT_CLASS (gdu_zstd_decompressor_parent_class)->finalize (object);
+}
+
+static void
+init_zstd (GduZstdDecompressor *decompressor)
+{
+  size_t ret;
+  ret = ZSTD_initDStream (decompressor->dstream);
+  if (ZSTD_isError (ret))
+    g_critical ("Error initalizing zstd decoder: %s", ZSTD_getErrorName (ret));
+  decompressor->at_frame_boundary = TRUE;
+}
+
+static void
+gdu_zstd_decompressor_init (GduZstdDecompressor *decompressor)
+{
+  decompressor->dstream = ZSTD_createDStream ();
+  init_zstd (decompressor);
+}
+
+static void
+gdu_zstd_decompressor_class_init (GduZstdDecompressorClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gdu_zstd_decompressor_finalize;
+}
+
+GduZstdDecompressor *
+gdu_zstd_decompressor_new (void)
+{
+  GduZstdDecompressor *decompressor;
+
+  decompressor = g_object_new (GDU_TYPE_ZSTD_DECOMPRESSOR,
+                               NULL);
+
+  return decompressor;
+}
+
+static void
+gdu_zstd_decompressor_reset (GConverter *converter)
+{
+  GduZstdDecompressor *decompressor = GDU_ZSTD_DECOMPRESSOR (converter);
+  init_zstd (decompressor);
+}
+
+static GConverterResult
+gdu_zstd_decompressor_convert (GConverter *converter,
+                               const void *inbuf,
+                               gsize       inbuf_size,
+                               void       *outbuf,
+                               gsize       outbuf_size,
+                               GConverterFlags flags,
+                               gsize      *bytes_read,
+                               gsize      *bytes_written,
+                               GError    **error)
+{
+  GduZstdDecompressor *decompressor = GDU_ZSTD_DECOMPRESSOR (converter);
+  ZSTD_inBuffer input;
+  ZSTD_outBuffer output;
+  size_t res;
+
+  if (decompressor->at_frame_boundary && inbuf_size == 0 && (flags & G_CONVERTER_INPUT_AT_END))
+    {
+      *bytes_read = 0;
+      *bytes_written = 0;
+      return G_CONVERTER_FINISHED;
+    }
+
+  input.src = inbuf;
+  input.size = inbuf_size;
+  input.pos = 0;
+
+  output.dst = outbuf;
+  output.size = outbuf_size;
+  output.pos = 0;
+
+  /* consecutive frames are decoded without the need for a reset */
+  res = ZSTD_decompressStream (decompressor->dstream, &output, &input);
+  if (ZSTD_isError (res))
+    {
+      if (ZSTD_getErrorCode (res) == ZSTD_error_memory_allocation)
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             _("Not enough memory"));
+      else
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                             _("Invalid compressed data"));
+      return G_CONVERTER_ERROR;
+    }
+
+  *bytes_read = input.pos;
+  *bytes_written = output.pos;
+
+  /* res is 0 once a frame has been completely decoded and flushed */
+  decompressor->at_frame_boundary = (res == 0);
+
+  if (*bytes_read == 0 && *bytes_written == 0)
+    {
+      if (flags & G_CONVERTER_FLUSH)
+        return G_CONVERTER_FLUSHED;
+
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                           _("Need more input"));
+      return G_CONVERTER_ERROR;
+    }
+
+  if (decompressor->at_frame_boundary && *bytes_read == inbuf_size && (flags & G_CONVERTER_INPUT_AT_END))
+    return G_CONVERTER_FINISHED;
+
+  return G_CONVERTER_CONVERTED;
+}
+
+static void
+gdu_zstd_decompressor_iface_init (GConverterIface *iface)
+{
+  iface->convert = gdu_zstd_decompressor_convert;
+  iface->reset = gdu_zstd_decompressor_reset;
+}
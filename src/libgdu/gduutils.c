@@ -63,17 +63,13 @@ gdu_utils_has_configuration (UDisksBlock  *block,
   return ret;
 }
 
-void
-gdu_utils_configure_file_chooser_for_disk_images (GtkFileChooser *file_chooser,
-                                                  gboolean        set_file_types,
-                                                  gboolean        allow_compressed)
+/* returns the URI of the folder disk images were last used from, free with g_free() */
+gchar *
+gdu_utils_get_image_dir_uri (void)
 {
-  GtkFileFilter *filter;
   gchar *folder;
   GSettings *settings;
 
-  gtk_file_chooser_set_local_only (file_chooser, FALSE);
-
   /* Get folder from GSettings, and default to the "Documents" folder if not set */
   settings = g_settings_new ("org.gnome.Disks");
   folder = g_settings_get_string (settings, "image-dir-uri");
@@ -82,6 +78,21 @@ gdu_utils_configure_file_chooser_for_disk_images (GtkFileChooser *file_chooser,
       g_free (folder);
       folder = g_strdup_printf ("file://%s", g_get_user_special_dir (G_USER_DIRECTORY_DOCUMENTS));
     }
+  g_clear_object (&settings);
+  return folder;
+}
+
+void
+gdu_utils_configure_file_chooser_for_disk_images (GtkFileChooser *file_chooser,
+                                                  gboolean        set_file_types,
+                                                  gboolean        allow_compressed)
+{
+  GtkFileFilter *filter;
+  gchar *folder;
+
+  gtk_file_chooser_set_local_only (file_chooser, FALSE);
+
+  folder = gdu_utils_get_image_dir_uri ();
   g_object_set_data_full (G_OBJECT (file_chooser), "x-gdu-orig-folder", g_strdup (folder), g_free);
   gtk_file_chooser_set_current_folder_uri (file_chooser, folder);
 
@@ -94,7 +105,7 @@ gdu_utils_configure_file_chooser_for_disk_images (GtkFileChooser *file_chooser,
       gtk_file_chooser_add_filter (file_chooser, filter); /* adopts filter */
       filter = gtk_file_filter_new ();
       if (allow_compressed)
-        gtk_file_filter_set_name (filter, _("Disk Images (*.img, *.img.xz, *.iso)"));
+        gtk_file_filter_set_name (filter, _("Disk Images (*.img, *.img.xz, *.img.gz, *.img.bz2, *.img.zst, *.iso, *.qcow2, *.vhd, *.vhdx, *.vmdk)"));
       else
         gtk_file_filter_set_name (filter, _("Disk Images (*.img, *.iso)"));
       gtk_file_filter_add_pattern (filter, "*.raw-disk-image");
@@ -103,13 +114,22 @@ gdu_utils_configure_file_chooser_for_disk_images (GtkFileChooser *file_chooser,
         {
           gtk_file_filter_add_pattern (filter, "*.raw-disk-image.xz");
           gtk_file_filter_add_pattern (filter, "*.img.xz");
+          gtk_file_filter_add_pattern (filter, "*.raw-disk-image.gz");
+          gtk_file_filter_add_pattern (filter, "*.img.gz");
+          gtk_file_filter_add_pattern (filter, "*.raw-disk-image.bz2");
+          gtk_file_filter_add_pattern (filter, "*.img.bz2");
+          gtk_file_filter_add_pattern (filter, "*.raw-disk-image.zst");
+          gtk_file_filter_add_pattern (filter, "*.img.zst");
+          gtk_file_filter_add_pattern (filter, "*.qcow2");
+          gtk_file_filter_add_pattern (filter, "*.vhd");
+          gtk_file_filter_add_pattern (filter, "*.vhdx");
+          gtk_file_filter_add_pattern (filter, "*.vmdk");
         }
       gtk_file_filter_add_pattern (filter, "*.iso");
       gtk_file_chooser_add_filter (file_chooser, filter); /* adopts filter */
       gtk_file_chooser_set_filter (file_chooser, filter);
     }
 
-  g_clear_object (&settings);
   g_free (folder);
 }
 
@@ -18,6 +18,8 @@ gboolean gdu_utils_has_configuration (UDisksBlock  *block,
                                       const gchar  *type,
                                       gboolean     *out_has_passphrase);
 
+gchar *gdu_utils_get_image_dir_uri (void);
+
 void gdu_utils_configure_file_chooser_for_disk_images (GtkFileChooser *file_chooser,
                                                        gboolean        set_file_types,
                                                        gboolean        allow_compressed);